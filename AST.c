@@ -2,35 +2,92 @@
 #include <stdlib.h>
 #include <string.h>
 #include "AST.h"
+#include "trace.h"
 
-void ASTtoTAC(ASTNode *node)
+// Lowers a function declaration after the program body: the function
+// marker, one param per parameter into its local, then the body. A body
+// that can fall off its end returns 0.
+static void functionToTAC(ASTNode *node, TACList *list)
+{
+    list->function = node;
+    TAC marker = {TAC_FUNCTION, symbolOperand(list, node->funcDecl.funcName), {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+    appendTAC(list, &marker);
+
+    int index = 0;
+    for (ASTNode *param = node->funcDecl.paramList; param; param = param->varDeclList.varDeclList)
+    {
+        ASTNode *decl = param->varDeclList.varDecl;
+        if (!decl || decl->type != NodeType_VarDecl)
+            continue;
+        TAC receive = {TAC_PARAM, constOperand(index++), {OPERAND_NONE, 0},
+                       localOperand(list, node->funcDecl.funcName, decl->varDecl.varName), TAC_END};
+        appendTAC(list, &receive);
+    }
+
+    ASTtoTAC(node->funcDecl.funcBody, list);
+    if (list->code[list->tail].op != TAC_RETURN)
+    {
+        TAC fallOff = {TAC_RETURN, constOperand(0), {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+        appendTAC(list, &fallOff);
+    }
+    list->function = NULL;
+}
+
+// Lowers the functions among the declarations, in order.
+static void functionsToTAC(ASTNode *varDeclList, TACList *list)
+{
+    for (ASTNode *decls = varDeclList; decls; decls = decls->varDeclList.varDeclList)
+    {
+        if (decls->varDeclList.varDecl && decls->varDeclList.varDecl->type == NodeType_FunctionDecl)
+            functionToTAC(decls->varDeclList.varDecl, list);
+    }
+}
+
+// Lowers a while loop to a test at the top:
+//   head: t = condition; ifFalse t goto exit; body; goto head; exit:
+static void whileToTAC(ASTNode *node, TACList *list)
+{
+    Operand none = {OPERAND_NONE, 0};
+    Operand head = createLabel(list);
+    Operand exit = createLabel(list);
+
+    appendTAC(list, &(TAC){TAC_LABEL, head, none, none, TAC_END});
+    Operand condition = createOperand(list, node->whileStmt.condition);
+    appendTAC(list, &(TAC){TAC_IF_FALSE, condition, exit, none, TAC_END});
+    ASTtoTAC(node->whileStmt.body, list);
+    appendTAC(list, &(TAC){TAC_GOTO, head, none, none, TAC_END});
+    appendTAC(list, &(TAC){TAC_LABEL, exit, none, none, TAC_END});
+}
+
+void ASTtoTAC(ASTNode *node, TACList *list)
 {
     if (!node)
     {
-        printf("ASTtoTAC: Null node encountered.\n");
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: Null node encountered.\n");
         return;
     }
 
-    printf("ASTtoTAC: Processing node type %d.\n", node->type);
+    TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: Processing node type %d.\n", node->type);
 
     switch (node->type)
     {
     case NodeType_Program:
-        printf("ASTtoTAC: NodeType_Program\n");
-        ASTtoTAC(node->program.varDeclList);
-        ASTtoTAC(node->program.stmtList);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_Program\n");
+        ASTtoTAC(node->program.varDeclList, list);
+        ASTtoTAC(node->program.stmtList, list);
+        functionsToTAC(node->program.varDeclList, list);
         break;
 
     case NodeType_VarDeclList:
-        printf("ASTtoTAC: NodeType_VarDeclList\n");
-        ASTtoTAC(node->varDeclList.varDecl);
-        ASTtoTAC(node->varDeclList.varDeclList);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_VarDeclList\n");
+        ASTtoTAC(node->varDeclList.varDecl, list);
+        ASTtoTAC(node->varDeclList.varDeclList, list);
         break;
 
     case NodeType_StmtList:
-        printf("ASTtoTAC: NodeType_StmtList\n");
-        ASTtoTAC(node->stmtList.stmt);
-        ASTtoTAC(node->stmtList.stmtList);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_StmtList\n");
+        ASTtoTAC(node->stmtList.stmt, list);
+        ASTtoTAC(node->stmtList.stmtList, list);
         break;
 
     case NodeType_Expr:
@@ -40,46 +97,52 @@ void ASTtoTAC(ASTNode *node)
     case NodeType_AssignStmt:
     case NodeType_FunctionCall:
     case NodeType_ArrayAccess:
+    case NodeType_ArrayAssignStmt:
     case NodeType_WriteStmt:
-        printf("ASTtoTAC: NodeType involving expression or statement\n");
-        generateTACForExpr(node);
+    case NodeType_ReturnStmt:
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType involving expression or statement\n");
+        generateTACForExpr(list, node);
+        break;
+
+    case NodeType_WhileStmt:
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_WhileStmt\n");
+        whileToTAC(node, list);
         break;
 
     case NodeType_VarDecl:
-        printf("ASTtoTAC: NodeType_VarDecl\n");
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_VarDecl\n");
         // TODO VarDecl might not directly translate to TAC but may be involved in symbol table management
         break;
 
     case NodeType_FunctionDecl:
-        printf("ASTtoTAC: NodeType_FunctionDecl\n");
-        ASTtoTAC(node->funcDecl.paramList);
-        ASTtoTAC(node->funcDecl.funcBody);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_FunctionDecl\n");
+        // Lowered after the program body, see functionsToTAC
         break;
 
     case NodeType_ParamList:
-        printf("ASTtoTAC: NodeType_ParamList\n");
-        ASTtoTAC(node->paramList.param);
-        ASTtoTAC(node->paramList.paramList);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_ParamList\n");
+        ASTtoTAC(node->paramList.param, list);
+        ASTtoTAC(node->paramList.paramList, list);
         break;
 
     case NodeType_Param:
-        printf("ASTtoTAC: NodeType_Param\n");
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_Param\n");
         // TODO Parameters might not directly translate to TAC but are important for function calls
         break;
 
     case NodeType_ArgList:
-        printf("ASTtoTAC: NodeType_ArgList\n");
-        ASTtoTAC(node->argList.arg);
-        ASTtoTAC(node->argList.argList);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_ArgList\n");
+        ASTtoTAC(node->argList.arg, list);
+        ASTtoTAC(node->argList.argList, list);
         break;
 
     case NodeType_Arg:
-        printf("ASTtoTAC: NodeType_Arg\n");
-        ASTtoTAC(node->arg.arg);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_Arg\n");
+        ASTtoTAC(node->arg.arg, list);
         break;
 
     case NodeType_ArrayDecl:
-        printf("ASTtoTAC: NodeType_ArrayDecl\n");
+        TRACE(TRACE_TAC, TRACE_DEBUG, "ASTtoTAC: NodeType_ArrayDecl\n");
         // TODO Array declaration might influence symbol table but does not directly result in TAC
         break;
 
@@ -170,93 +233,25 @@ void traverseAST(ASTNode *node, int level)
         // printf("Array Index: %d\n", node->arrayAccess.indexExpr);
         // TODO Traverse the Array
         break;
+    case NodeType_ArrayAssignStmt:
+        printf("ArrayAssign: %s[] = (line %d)\n", node->arrayAssignStmt.arrayName, node->lineno);
+        traverseAST(node->arrayAssignStmt.indexExpr, level + 1);
+        traverseAST(node->arrayAssignStmt.expr, level + 1);
+        break;
     case NodeType_WriteStmt:
         printf("Write (line %d)\n", node->lineno);
         traverseAST(node->writeStmt.expr, level + 1);
         break;
-    }
-}
-
-void freeAST(ASTNode *node)
-{
-    if (!node)
-        return;
-
-    switch (node->type)
-    {
-    case NodeType_SimpleExpr:
-        // No dynamic memory to free for simple expressions
-        break;
-
-    case NodeType_SimpleID:
-        // No dynamic memory to free for simple identifiers
+    case NodeType_ReturnStmt:
+        printf("Return (line %d)\n", node->lineno);
+        traverseAST(node->returnStmt.expr, level + 1);
         break;
-    case NodeType_Program:
-        freeAST(node->program.varDeclList);
-        freeAST(node->program.stmtList);
-        break;
-    case NodeType_VarDeclList:
-        freeAST(node->varDeclList.varDecl);
-        freeAST(node->varDeclList.varDeclList);
-        break;
-    case NodeType_VarDecl:
-        free(node->varDecl.varType);
-        free(node->varDecl.varName);
-        break;
-    case NodeType_Expr:
-        freeAST(node->expr.left);
-        freeAST(node->expr.right);
-        break;
-    case NodeType_StmtList:
-        freeAST(node->stmtList.stmt);
-        freeAST(node->stmtList.stmtList);
-        break;
-    case NodeType_AssignStmt:
-        free(node->assignStmt.varName);
-        freeAST(node->assignStmt.expr);
-        break;
-    case NodeType_BinOp:
-        freeAST(node->binOp.left);
-        freeAST(node->binOp.right);
-        break;
-    case NodeType_FunctionDecl:
-        free(node->funcDecl.funcName);
-        free(node->funcDecl.returnType);
-        freeAST(node->funcDecl.paramList);
-        freeAST(node->funcDecl.funcBody);
-        break;
-    case NodeType_ParamList:
-        freeAST(node->paramList.param);
-        freeAST(node->paramList.paramList);
-        break;
-    case NodeType_Param:
-        free(node->param.paramType);
-        free(node->param.paramName);
-        break;
-    case NodeType_FunctionCall:
-        free(node->funcCall.funcName);
-        freeAST(node->funcCall.argList);
-        break;
-    case NodeType_ArgList:
-        freeAST(node->argList.arg);
-        freeAST(node->argList.argList);
-        break;
-    case NodeType_Arg:
-        freeAST(node->arg.arg);
-        break;
-    case NodeType_ArrayDecl:
-        free(node->arrayDecl.arrayName);
-        free(node->arrayDecl.arrayType);
-        break;
-    case NodeType_ArrayAccess:
-        free(node->arrayAccess.arrayName);
-        break;
-    case NodeType_WriteStmt:
-        freeAST(node->writeStmt.expr);
+    case NodeType_WhileStmt:
+        printf("While (line %d)\n", node->lineno);
+        traverseAST(node->whileStmt.condition, level + 1);
+        traverseAST(node->whileStmt.body, level + 1);
         break;
     }
-
-    free(node);
 }
 
 void printBranches(int level)
@@ -274,14 +269,9 @@ void printBranches(int level)
     }
 }
 
-ASTNode *createNode(NodeType type)
+ASTNode *createNode(Arena *arena, NodeType type)
 {
-    ASTNode *newNode = (ASTNode *)malloc(sizeof(ASTNode));
-    if (newNode == NULL)
-    {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
-    }
+    ASTNode *newNode = (ASTNode *)arenaAlloc(arena, sizeof(ASTNode));
 
     newNode->type = type;
     newNode->lineno = 0;
@@ -289,92 +279,112 @@ ASTNode *createNode(NodeType type)
     switch (type)
     {
     case NodeType_Program:
-        printf("Creating Program Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Program Node\n");
         newNode->program.varDeclList = NULL;
         newNode->program.stmtList = NULL;
         break;
     case NodeType_VarDeclList:
-        printf("Creating Variable Declaration List Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Variable Declaration List Node\n");
         newNode->varDeclList.varDecl = NULL;
         newNode->varDeclList.varDeclList = NULL;
         break;
     case NodeType_StmtList:
-        printf("Creating Statement List Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Statement List Node\n");
         newNode->stmtList.stmt = NULL;
         newNode->stmtList.stmtList = NULL;
         break;
     case NodeType_SimpleExpr:
-        printf("Creating Simple Expression Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Simple Expression Node\n");
+        newNode->simpleExpr.number = 0;
         break;
     case NodeType_Expr:
-        printf("Creating Expression Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Expression Node\n");
+        newNode->expr.operator = NULL;
         newNode->expr.left = NULL;
         newNode->expr.right = NULL;
         break;
     case NodeType_SimpleID:
-        printf("Creating Simple ID Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Simple ID Node\n");
+        newNode->simpleID.name = NULL;
         break;
     case NodeType_AssignStmt:
-        printf("Creating Assignment Statement Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Assignment Statement Node\n");
+        newNode->assignStmt.operator = NULL;
         newNode->assignStmt.varName = NULL;
         newNode->assignStmt.expr = NULL;
         break;
     case NodeType_BinOp:
-        printf("Creating Binary Operation Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Binary Operation Node\n");
+        newNode->binOp.operator = NULL;
         newNode->binOp.left = NULL;
         newNode->binOp.right = NULL;
         break;
     case NodeType_VarDecl:
-        printf("Creating Variable Declaration Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Variable Declaration Node\n");
         newNode->varDecl.varType = NULL;
         newNode->varDecl.varName = NULL;
         break;
     case NodeType_FunctionDecl:
-        printf("Creating Function Declaration Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Function Declaration Node\n");
         newNode->funcDecl.funcName = NULL;
         newNode->funcDecl.returnType = NULL;
         newNode->funcDecl.paramList = NULL;
         newNode->funcDecl.funcBody = NULL;
         break;
     case NodeType_ParamList:
-        printf("Creating Parameter List Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Parameter List Node\n");
         newNode->paramList.param = NULL;
         newNode->paramList.paramList = NULL;
         break;
     case NodeType_Param:
-        printf("Creating Parameter Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Parameter Node\n");
         newNode->param.paramType = NULL;
         newNode->param.paramName = NULL;
         break;
     case NodeType_FunctionCall:
-        printf("Creating Function Call Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Function Call Node\n");
         newNode->funcCall.funcName = NULL;
         newNode->funcCall.argList = NULL;
         break;
     case NodeType_ArgList:
-        printf("Creating Argument List Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Argument List Node\n");
         newNode->argList.arg = NULL;
         newNode->argList.argList = NULL;
         break;
     case NodeType_Arg:
-        printf("Creating Argument Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Argument Node\n");
         newNode->arg.arg = NULL;
         break;
     case NodeType_ArrayDecl:
-        printf("Creating Array Declaration Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Array Declaration Node\n");
         newNode->arrayDecl.arrayName = NULL;
         newNode->arrayDecl.arrayType = NULL;
         newNode->arrayDecl.sizeExpr = -1;
         break;
     case NodeType_ArrayAccess:
-        printf("Creating Array Access Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Array Access Node\n");
         newNode->arrayAccess.arrayName = NULL;
         newNode->arrayAccess.indexExpr = NULL;
         break;
+    case NodeType_ArrayAssignStmt:
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Array Assignment Statement Node\n");
+        newNode->arrayAssignStmt.arrayName = NULL;
+        newNode->arrayAssignStmt.indexExpr = NULL;
+        newNode->arrayAssignStmt.expr = NULL;
+        break;
     case NodeType_WriteStmt:
-        printf("Creating Write Statement Node\n");
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Write Statement Node\n");
         newNode->writeStmt.expr = NULL;
         break;
+    case NodeType_ReturnStmt:
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating Return Statement Node\n");
+        newNode->returnStmt.expr = NULL;
+        break;
+    case NodeType_WhileStmt:
+        TRACE(TRACE_PARSER, TRACE_VERBOSE, "Creating While Statement Node\n");
+        newNode->whileStmt.condition = NULL;
+        newNode->whileStmt.body = NULL;
+        break;
     default:
         printf("Unknown NodeType in createNode\n");
         break;
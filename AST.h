@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "tac.h"
+#include "arena.h"
 
 typedef enum
 {
@@ -25,7 +26,10 @@ typedef enum
     NodeType_ArgList,
     NodeType_Arg,
     NodeType_ArrayDecl,
-    NodeType_ArrayAccess
+    NodeType_ArrayAccess,
+    NodeType_ArrayAssignStmt,
+    NodeType_ReturnStmt,
+    NodeType_WhileStmt
 } NodeType;
 
 typedef struct ASTNode
@@ -139,17 +143,40 @@ typedef struct ASTNode
             char *arrayName;
         } arrayAccess;
 
+        struct
+        {
+            char *arrayName;
+            struct ASTNode *indexExpr;
+            struct ASTNode *expr;
+        } arrayAssignStmt;
+
         struct
         {
             struct ASTNode *expr;
         } writeStmt;
+
+        struct
+        {
+            struct ASTNode *expr;
+        } returnStmt;
+
+        struct
+        {
+            struct ASTNode *condition;
+            struct ASTNode *body; // A statement, or the statement list of a block
+        } whileStmt;
     };
 } ASTNode;
 
+struct TACList;
+
+// Every node in a tree comes from the arena of its compilation
+// (CompilerContext.astArena) and every name from its string pool
+// (CompilerContext.names), so the whole AST is released with the context.
+
 void traverseAST(ASTNode *node, int level);
-ASTNode *createNode(NodeType type);
+ASTNode *createNode(Arena *arena, NodeType type);
 void printBranches(int level);
-void ASTtoTAC(ASTNode *root);
-void freeAST(ASTNode *node);
+void ASTtoTAC(ASTNode *root, struct TACList *list);
 
 #endif // AST_H
\ No newline at end of file
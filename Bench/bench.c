@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "generator.h"
+#include "../compiler.h"
+
+// Compiler throughput benchmark. For each scaling axis, generates programs
+// at increasing sizes, compiles each one repeatedly and records the wall
+// time of every phase. Results go to a CSV file, one row per axis, size
+// and phase:
+//
+//   bench [-runs N] [-o results.csv] [-axis name]
+
+#define SOURCE_FILE "bench-tmp.cmm"
+#define OUTPUT_FILE "bench-tmp.s"
+#define MAX_RUNS 100
+#define MAX_SCALES 8
+
+typedef struct BenchAxis
+{
+    const char *name;
+    size_t field; // Offset of the option this axis scales
+    int scales[MAX_SCALES];
+} BenchAxis;
+
+static const BenchAxis axes[] = {
+    {"declarations", offsetof(GeneratorOptions, declarations), {500, 1000, 2000, 4000, 8000, 16000, 32000, 64000}},
+    {"statements", offsetof(GeneratorOptions, statements), {500, 1000, 2000, 4000, 8000, 16000, 32000, 64000}},
+    {"depth", offsetof(GeneratorOptions, depth), {4, 8, 16, 32, 64}},
+    {"arrays", offsetof(GeneratorOptions, arrays), {10, 20, 40, 80, 160, 320}},
+    {"functions", offsetof(GeneratorOptions, functions), {10, 20, 40, 80, 160, 320}},
+};
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Generates the program for one point and times runs compilations of it.
+// Returns false if the program failed to compile.
+static bool benchPoint(FILE *results, const BenchAxis *axis, int scale, int runs)
+{
+    GeneratorOptions options;
+    defaultGeneratorOptions(&options);
+    *(int *)((char *)&options + axis->field) = scale;
+
+    FILE *source = fopen(SOURCE_FILE, "w");
+    if (!source)
+    {
+        perror(SOURCE_FILE);
+        return false;
+    }
+    generateProgram(source, &options);
+    long bytes = ftell(source);
+    fclose(source);
+
+    double samples[PHASE_COUNT][MAX_RUNS];
+    int tokens = 0;
+    int instructions = 0; // Optimized TAC, as code generation received it
+
+    for (int run = 0; run < runs; run++)
+    {
+        CompilerContext ctx;
+
+        initCompilerContext(&ctx, SOURCE_FILE, OUTPUT_FILE);
+        tokens = scanFile(&ctx);
+        samples[PHASE_LEX][run] = ctx.stats.phases[PHASE_LEX].seconds;
+        freeCompilerContext(&ctx);
+
+        initCompilerContext(&ctx, SOURCE_FILE, OUTPUT_FILE);
+        bool ok = compileFile(&ctx);
+        for (int p = PHASE_PARSE; p < PHASE_COUNT; p++)
+            samples[p][run] = ctx.stats.phases[p].seconds;
+        instructions = tacLength(&ctx.tac); // count also holds the slots the optimizer unlinked
+        freeCompilerContext(&ctx);
+
+        if (!ok)
+        {
+            fprintf(stderr, "bench: %s=%d failed to compile\n", axis->name, scale);
+            return false;
+        }
+    }
+
+    printf("%-13s %6d %9ld bytes", axis->name, scale, bytes);
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        double total = 0;
+        for (int run = 0; run < runs; run++)
+            total += samples[p][run];
+        qsort(samples[p], runs, sizeof(double), compareDouble);
+
+        double median = runs % 2 ? samples[p][runs / 2] : (samples[p][runs / 2 - 1] + samples[p][runs / 2]) / 2;
+        fprintf(results, "%s,%d,%d,%d,%d,%d,%d,%ld,%d,%d,%s,%d,%.6f,%.6f,%.6f\n",
+                axis->name, scale, options.declarations, options.statements, options.depth,
+                options.arrays, options.functions, bytes, tokens, instructions,
+                compilerPhaseNames[p], runs, samples[p][0] * 1e3, median * 1e3, total / runs * 1e3);
+        printf(" %s %.3f", compilerPhaseNames[p], median * 1e3);
+    }
+    printf(" (median ms)\n");
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 5;
+    const char *resultsFilename = "bench-results.csv";
+    const char *onlyAxis = NULL;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-runs") == 0)
+            runs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-o") == 0)
+            resultsFilename = argv[i + 1];
+        else if (strcmp(argv[i], "-axis") == 0)
+            onlyAxis = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "Usage: %s [-runs N] [-o results.csv] [-axis name]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (runs < 1)
+        runs = 1;
+    if (runs > MAX_RUNS)
+        runs = MAX_RUNS;
+
+    FILE *results = fopen(resultsFilename, "w");
+    if (!results)
+    {
+        perror(resultsFilename);
+        return EXIT_FAILURE;
+    }
+    fprintf(results, "axis,scale,declarations,statements,depth,arrays,functions,bytes,tokens,"
+                     "tac_instructions,phase,runs,min_ms,median_ms,mean_ms\n");
+
+    int failures = 0;
+    for (size_t a = 0; a < sizeof(axes) / sizeof(axes[0]); a++)
+    {
+        if (onlyAxis && strcmp(onlyAxis, axes[a].name) != 0)
+            continue;
+        for (int s = 0; s < MAX_SCALES && axes[a].scales[s] > 0; s++)
+        {
+            if (!benchPoint(results, &axes[a], axes[a].scales[s], runs))
+                failures++;
+        }
+    }
+
+    fclose(results);
+    remove(SOURCE_FILE);
+    remove(OUTPUT_FILE);
+    printf("Results written to %s\n", resultsFilename);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
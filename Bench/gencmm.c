@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "generator.h"
+
+// Writes one synthetic program to stdout:
+//   gencmm [-decls N] [-stmts N] [-depth N] [-arrays N] [-funcs N] [-seed N]
+int main(int argc, char **argv)
+{
+    GeneratorOptions options;
+    defaultGeneratorOptions(&options);
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        int value = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-decls") == 0)
+            options.declarations = value;
+        else if (strcmp(argv[i], "-stmts") == 0)
+            options.statements = value;
+        else if (strcmp(argv[i], "-depth") == 0)
+            options.depth = value;
+        else if (strcmp(argv[i], "-arrays") == 0)
+            options.arrays = value;
+        else if (strcmp(argv[i], "-funcs") == 0)
+            options.functions = value;
+        else if (strcmp(argv[i], "-seed") == 0)
+            options.seed = (unsigned)value;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-decls N] [-stmts N] [-depth N] [-arrays N] [-funcs N] [-seed N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    generateProgram(stdout, &options);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "generator.h"
+
+#define ARRAY_SIZE 16
+
+void defaultGeneratorOptions(GeneratorOptions *options)
+{
+    options->declarations = 20;
+    options->statements = 100;
+    options->depth = 2;
+    options->arrays = 0;
+    options->functions = 0;
+    options->seed = 1;
+}
+
+// Small linear congruential generator so output does not depend on libc's rand
+static unsigned nextRandom(unsigned *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7fff;
+}
+
+// Writes an operand: a variable, a constant, an array element or a call.
+static void generateLeaf(FILE *out, const GeneratorOptions *options, unsigned *state)
+{
+    unsigned pick = nextRandom(state) % 8;
+
+    if (pick == 0 && options->arrays > 0)
+        fprintf(out, "a%u[%u]", nextRandom(state) % options->arrays, nextRandom(state) % ARRAY_SIZE);
+    else if (pick == 1 && options->functions > 0)
+    {
+        unsigned function = nextRandom(state) % options->functions;
+        fprintf(out, "f%u(v%u)", function, nextRandom(state) % options->declarations);
+    }
+    else if (pick < 4)
+        fprintf(out, "%u", nextRandom(state) % 100);
+    else
+        fprintf(out, "v%u", nextRandom(state) % options->declarations);
+}
+
+// Writes an expression whose parentheses nest depth levels deep.
+static void generateExpression(FILE *out, const GeneratorOptions *options, unsigned *state, int depth)
+{
+    if (depth <= 1)
+    {
+        generateLeaf(out, options, state);
+        return;
+    }
+
+    fprintf(out, "(");
+    generateExpression(out, options, state, depth - 1);
+    fprintf(out, " + ");
+    generateLeaf(out, options, state);
+    fprintf(out, ")");
+}
+
+void generateProgram(FILE *out, const GeneratorOptions *options)
+{
+    GeneratorOptions fixed = *options;
+    unsigned state = options->seed;
+
+    if (fixed.declarations < 1)
+        fixed.declarations = 1; // Statements need something to assign to
+
+    fprintf(out, "/* generated: %d declarations, %d statements, depth %d, %d arrays, %d functions */\n",
+            fixed.declarations, fixed.statements, fixed.depth, fixed.arrays, fixed.functions);
+
+    for (int i = 0; i < fixed.declarations; i++)
+        fprintf(out, "int v%d;\n", i);
+    for (int i = 0; i < fixed.arrays; i++)
+        fprintf(out, "int a%d[%d];\n", i, ARRAY_SIZE);
+    for (int i = 0; i < fixed.functions; i++)
+        fprintf(out, "int f%d(int p;) p = p + %d; write p; return p; ;\n", i, i);
+
+    for (int i = 0; i < fixed.statements; i++)
+    {
+        if (nextRandom(&state) % 4 == 0)
+        {
+            fprintf(out, "write ");
+        }
+        else if (fixed.arrays > 0 && nextRandom(&state) % 4 == 0)
+        {
+            unsigned array = nextRandom(&state) % fixed.arrays;
+            fprintf(out, "a%u[%u] = ", array, nextRandom(&state) % ARRAY_SIZE);
+        }
+        else
+        {
+            fprintf(out, "v%u = ", nextRandom(&state) % fixed.declarations);
+        }
+        generateExpression(out, &fixed, &state, fixed.depth);
+        fprintf(out, ";\n");
+    }
+}
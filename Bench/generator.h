@@ -0,0 +1,21 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdio.h>
+
+// Synthetic .cmm programs for the benchmarks. Each option scales one
+// dimension of the program; the output is deterministic for a given seed.
+typedef struct GeneratorOptions
+{
+    int declarations; // Scalar variables
+    int statements;   // Assignments and writes in the main program
+    int depth;        // Nesting depth of each statement's expression
+    int arrays;       // Array declarations, read in expressions and stored to
+    int functions;    // Function declarations, called in expressions
+    unsigned seed;
+} GeneratorOptions;
+
+void defaultGeneratorOptions(GeneratorOptions *options);
+void generateProgram(FILE *out, const GeneratorOptions *options);
+
+#endif // GENERATOR_H
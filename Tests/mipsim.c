@@ -0,0 +1,762 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+// Runs the assembly the compiler writes, for the end-to-end tests:
+//   mipsim [-steps N] file.s
+// Prints what the program writes and exits with the program's exit status.
+// Only the directives and instructions the code generator uses are read.
+// The calling convention is checked as the program runs: a function must
+// return with $s0-$s7 and $sp as it found them, and the registers a callee
+// may change are overwritten at every call and return, so code relying on
+// them keeps no stale value by luck. Anything the simulator cannot run
+// stops it with a message and exit status 2.
+
+#define SIM_ERROR_STATUS 2
+#define DEFAULT_STEP_LIMIT 100000000L
+#define DATA_BASE 0x10010000u
+#define STACK_TOP 0x7ffffffcu
+#define STACK_BYTES (1u << 20)
+#define MAX_OPERANDS 3
+#define MAX_CALL_DEPTH 100000
+#define CLOBBER_VALUE 0x5ca1ab1e
+
+enum
+{
+    REG_ZERO = 0,
+    REG_V0 = 2,
+    REG_V1 = 3,
+    REG_A0 = 4,
+    REG_A3 = 7,
+    REG_T0 = 8,
+    REG_T7 = 15,
+    REG_S0 = 16,
+    REG_S7 = 23,
+    REG_T8 = 24,
+    REG_T9 = 25,
+    REG_SP = 29,
+    REG_RA = 31,
+    REG_COUNT = 32
+};
+
+static const char *registerNames[REG_COUNT] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+
+typedef enum
+{
+    FORMAT_NONE,        // syscall, nop
+    FORMAT_DST_IMM,     // li, lui
+    FORMAT_DST_MEM,     // la, lw
+    FORMAT_SRC_MEM,     // sw
+    FORMAT_DST_SRC,     // move
+    FORMAT_DST_SRC_SRC, // addu ...
+    FORMAT_DST_SRC_IMM, // addiu ...
+    FORMAT_SRC_SRC,     // div
+    FORMAT_DST,         // mflo
+    FORMAT_LABEL,       // j, jal
+    FORMAT_BRANCH,      // beq, bne
+    FORMAT_SRC          // jr
+} Format;
+
+typedef enum
+{
+    OP_NOP, OP_LI, OP_LUI, OP_LA, OP_LW, OP_SW, OP_MOVE,
+    OP_ADDU, OP_SUBU, OP_MUL, OP_SLLV, OP_SRAV, OP_SRLV, OP_SLT, OP_SLTU,
+    OP_ADDIU, OP_SLL, OP_SRA, OP_SRL, OP_ORI, OP_XORI, OP_SLTI, OP_SLTIU,
+    OP_DIV, OP_MFLO, OP_J, OP_BEQ, OP_BNE, OP_JAL, OP_JR, OP_SYSCALL,
+    OP_COUNT
+} Opcode;
+
+static const struct
+{
+    const char *name;
+    Format format;
+} opcodes[OP_COUNT] = {
+    [OP_NOP] = {"nop", FORMAT_NONE},
+    [OP_LI] = {"li", FORMAT_DST_IMM},
+    [OP_LUI] = {"lui", FORMAT_DST_IMM},
+    [OP_LA] = {"la", FORMAT_DST_MEM},
+    [OP_LW] = {"lw", FORMAT_DST_MEM},
+    [OP_SW] = {"sw", FORMAT_SRC_MEM},
+    [OP_MOVE] = {"move", FORMAT_DST_SRC},
+    [OP_ADDU] = {"addu", FORMAT_DST_SRC_SRC},
+    [OP_SUBU] = {"subu", FORMAT_DST_SRC_SRC},
+    [OP_MUL] = {"mul", FORMAT_DST_SRC_SRC},
+    [OP_SLLV] = {"sllv", FORMAT_DST_SRC_SRC},
+    [OP_SRAV] = {"srav", FORMAT_DST_SRC_SRC},
+    [OP_SRLV] = {"srlv", FORMAT_DST_SRC_SRC},
+    [OP_SLT] = {"slt", FORMAT_DST_SRC_SRC},
+    [OP_SLTU] = {"sltu", FORMAT_DST_SRC_SRC},
+    [OP_ADDIU] = {"addiu", FORMAT_DST_SRC_IMM},
+    [OP_SLL] = {"sll", FORMAT_DST_SRC_IMM},
+    [OP_SRA] = {"sra", FORMAT_DST_SRC_IMM},
+    [OP_SRL] = {"srl", FORMAT_DST_SRC_IMM},
+    [OP_ORI] = {"ori", FORMAT_DST_SRC_IMM},
+    [OP_XORI] = {"xori", FORMAT_DST_SRC_IMM},
+    [OP_SLTI] = {"slti", FORMAT_DST_SRC_IMM},
+    [OP_SLTIU] = {"sltiu", FORMAT_DST_SRC_IMM},
+    [OP_DIV] = {"div", FORMAT_SRC_SRC},
+    [OP_MFLO] = {"mflo", FORMAT_DST},
+    [OP_J] = {"j", FORMAT_LABEL},
+    [OP_BEQ] = {"beq", FORMAT_BRANCH},
+    [OP_BNE] = {"bne", FORMAT_BRANCH},
+    [OP_JAL] = {"jal", FORMAT_LABEL},
+    [OP_JR] = {"jr", FORMAT_SRC},
+    [OP_SYSCALL] = {"syscall", FORMAT_NONE},
+};
+
+// A decoded instruction. Memory operands are base + imm with the symbol
+// already added in; jump and branch targets are instruction indexes.
+typedef struct Instruction
+{
+    Opcode op;
+    int dst;
+    int src1;
+    int src2; // -1 if the second source is imm
+    int32_t imm;
+    int target;
+    int line;
+} Instruction;
+
+typedef struct Label
+{
+    char *name;
+    bool inText;
+    uint32_t value; // Address, or instruction index in the text section
+} Label;
+
+// An instruction line kept until every label is known
+typedef struct PendingLine
+{
+    char *text;
+    int line;
+} PendingLine;
+
+typedef struct Frame
+{
+    int32_t saved[REG_S7 - REG_S0 + 1];
+    int32_t sp;
+    int callee;
+} Frame;
+
+typedef struct Machine
+{
+    const char *filename;
+    Label *labels;
+    int labelCount;
+    int labelCapacity;
+    uint8_t *data;
+    uint32_t dataSize;
+    uint32_t dataCapacity;
+    PendingLine *pending;
+    int pendingCount;
+    int pendingCapacity;
+    Instruction *code;
+    int codeCount;
+    uint8_t *stack;
+    int32_t regs[REG_COUNT];
+    int32_t lo;
+    Frame *frames;
+    int frameCount;
+} Machine;
+
+static void *allocateOrDie(size_t size)
+{
+    void *memory = calloc(1, size ? size : 1);
+    if (!memory)
+    {
+        fprintf(stderr, "mipsim: Memory allocation failed\n");
+        exit(SIM_ERROR_STATUS);
+    }
+    return memory;
+}
+
+static void *growOrDie(void *memory, int *capacity, size_t elementSize)
+{
+    *capacity = *capacity ? *capacity * 2 : 64;
+    memory = realloc(memory, elementSize * (size_t)*capacity);
+    if (!memory)
+    {
+        fprintf(stderr, "mipsim: Memory allocation failed\n");
+        exit(SIM_ERROR_STATUS);
+    }
+    return memory;
+}
+
+static void fail(Machine *m, int line, const char *message, const char *detail)
+{
+    fflush(stdout);
+    if (line > 0)
+        fprintf(stderr, "%s:%d: %s%s%s\n", m->filename, line, message, detail ? ": " : "", detail ? detail : "");
+    else
+        fprintf(stderr, "%s: %s%s%s\n", m->filename, message, detail ? ": " : "", detail ? detail : "");
+    exit(SIM_ERROR_STATUS);
+}
+
+static char *trim(char *text)
+{
+    while (isspace((unsigned char)*text))
+        text++;
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return text;
+}
+
+static Label *findLabel(Machine *m, const char *name, size_t length)
+{
+    for (int i = 0; i < m->labelCount; i++)
+    {
+        if (strlen(m->labels[i].name) == length && strncmp(m->labels[i].name, name, length) == 0)
+            return &m->labels[i];
+    }
+    return NULL;
+}
+
+// Two definitions of one label are an error, as in any assembler
+static void defineLabel(Machine *m, const char *name, bool inText, uint32_t value, int line)
+{
+    if (findLabel(m, name, strlen(name)))
+        fail(m, line, "Label defined twice", name);
+    if (m->labelCount == m->labelCapacity)
+        m->labels = (Label *)growOrDie(m->labels, &m->labelCapacity, sizeof(Label));
+    m->labels[m->labelCount++] = (Label){strdup(name), inText, value};
+}
+
+static void appendData(Machine *m, const void *bytes, uint32_t size)
+{
+    while (m->dataSize + size > m->dataCapacity)
+    {
+        int capacity = (int)m->dataCapacity;
+        m->data = (uint8_t *)growOrDie(m->data, &capacity, 1);
+        memset(m->data + m->dataCapacity, 0, (size_t)capacity - m->dataCapacity);
+        m->dataCapacity = (uint32_t)capacity;
+    }
+    if (bytes)
+        memcpy(m->data + m->dataSize, bytes, size);
+    else
+        memset(m->data + m->dataSize, 0, size);
+    m->dataSize += size;
+}
+
+static void alignData(Machine *m)
+{
+    while (m->dataSize % 4 != 0)
+        appendData(m, NULL, 1);
+}
+
+static void readDirective(Machine *m, char *text, int line)
+{
+    if (strncmp(text, ".word", 5) == 0)
+    {
+        alignData(m);
+        for (char *item = strtok(text + 5, ","); item; item = strtok(NULL, ","))
+        {
+            int32_t value = (int32_t)strtol(trim(item), NULL, 10);
+            appendData(m, &value, 4);
+        }
+    }
+    else if (strncmp(text, ".space", 6) == 0)
+    {
+        appendData(m, NULL, (uint32_t)strtoul(text + 6, NULL, 10));
+    }
+    else if (strncmp(text, ".asciiz", 7) == 0)
+    {
+        char *p = strchr(text, '"');
+        if (!p)
+            fail(m, line, "Expected a string", text);
+        for (p++; *p && *p != '"'; p++)
+        {
+            char c = *p;
+            if (c == '\\' && p[1])
+            {
+                c = *++p;
+                c = c == 'n' ? '\n' : c == 't' ? '\t' : c == '0' ? '\0' : c;
+            }
+            appendData(m, &c, 1);
+        }
+        appendData(m, NULL, 1);
+    }
+    else
+    {
+        fail(m, line, "Unknown directive", text);
+    }
+}
+
+// First pass: lays out the data section and numbers the instructions
+static void readSource(Machine *m, FILE *file)
+{
+    char buffer[4096];
+    bool inText = true;
+    int line = 0;
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        line++;
+        char *hash = strchr(buffer, '#');
+        if (hash && !strchr(buffer, '"'))
+            *hash = '\0';
+        char *text = trim(buffer);
+
+        // Labels, possibly followed by a directive or an instruction
+        for (;;)
+        {
+            char *colon = strchr(text, ':');
+            char *quote = strchr(text, '"');
+            if (!colon || (quote && quote < colon))
+                break;
+            *colon = '\0';
+            char *name = trim(text);
+            if (inText)
+                defineLabel(m, name, true, (uint32_t)m->pendingCount, line);
+            else
+            {
+                alignData(m);
+                defineLabel(m, name, false, DATA_BASE + m->dataSize, line);
+            }
+            text = trim(colon + 1);
+        }
+        if (*text == '\0')
+            continue;
+
+        if (strcmp(text, ".data") == 0)
+            inText = false;
+        else if (strcmp(text, ".text") == 0)
+            inText = true;
+        else if (strncmp(text, ".globl", 6) == 0)
+            continue;
+        else if (!inText)
+            readDirective(m, text, line);
+        else
+        {
+            if (m->pendingCount == m->pendingCapacity)
+                m->pending = (PendingLine *)growOrDie(m->pending, &m->pendingCapacity, sizeof(PendingLine));
+            m->pending[m->pendingCount++] = (PendingLine){strdup(text), line};
+        }
+    }
+}
+
+static int parseRegister(Machine *m, const char *text, int line)
+{
+    if (text[0] != '$')
+        fail(m, line, "Expected a register", text);
+    if (isdigit((unsigned char)text[1]))
+    {
+        int number = atoi(text + 1);
+        if (number >= 0 && number < REG_COUNT)
+            return number;
+    }
+    for (int r = 0; r < REG_COUNT; r++)
+    {
+        if (strcmp(text + 1, registerNames[r]) == 0)
+            return r;
+    }
+    fail(m, line, "Unknown register", text);
+    return 0;
+}
+
+static int32_t parseImmediate(Machine *m, const char *text, int line)
+{
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0')
+        fail(m, line, "Expected a number", text);
+    return (int32_t)value;
+}
+
+// symbol, symbol+offset, offset(base) or symbol+offset(base)
+static void parseAddress(Machine *m, char *text, int line, int *base, int32_t *offset)
+{
+    *base = -1;
+    *offset = 0;
+    char *paren = strchr(text, '(');
+    if (paren)
+    {
+        char *close = strchr(paren, ')');
+        if (!close)
+            fail(m, line, "Bad address", text);
+        *close = '\0';
+        *base = parseRegister(m, trim(paren + 1), line);
+        *paren = '\0';
+    }
+    text = trim(text);
+    size_t nameLength = 0;
+    while (isalnum((unsigned char)text[nameLength]) || text[nameLength] == '_' ||
+           (nameLength > 0 && text[nameLength] == '.'))
+        nameLength++;
+    if (nameLength > 0 && !isdigit((unsigned char)text[0]))
+    {
+        Label *label = findLabel(m, text, nameLength);
+        if (!label || label->inText)
+            fail(m, line, "Unknown data label", text);
+        *offset = (int32_t)label->value;
+        text += nameLength;
+    }
+    if (*text)
+        *offset += parseImmediate(m, *text == '+' ? text + 1 : text, line);
+}
+
+static int parseTarget(Machine *m, const char *text, int line)
+{
+    Label *label = findLabel(m, text, strlen(text));
+    if (!label || !label->inText)
+        fail(m, line, "Unknown code label", text);
+    return (int)label->value;
+}
+
+// Second pass: decodes every instruction now that the labels are known
+static void decode(Machine *m)
+{
+    m->code = (Instruction *)allocateOrDie(sizeof(Instruction) * (size_t)(m->pendingCount + 1));
+    for (int i = 0; i < m->pendingCount; i++)
+    {
+        char *text = m->pending[i].text;
+        int line = m->pending[i].line;
+        char *operands = text + strcspn(text, " \t");
+        if (*operands)
+            *operands++ = '\0';
+
+        int op = 0;
+        while (op < OP_COUNT && strcmp(opcodes[op].name, text) != 0)
+            op++;
+        if (op == OP_COUNT)
+            fail(m, line, "Unknown instruction", text);
+
+        char *args[MAX_OPERANDS] = {NULL, NULL, NULL};
+        int argCount = 0;
+        for (char *arg = strtok(operands, ","); arg; arg = strtok(NULL, ","))
+        {
+            if (argCount == MAX_OPERANDS)
+                fail(m, line, "Too many operands", text);
+            args[argCount++] = trim(arg);
+        }
+
+        static const int expectedOperands[] = {
+            [FORMAT_NONE] = 0, [FORMAT_DST_IMM] = 2, [FORMAT_DST_MEM] = 2, [FORMAT_SRC_MEM] = 2,
+            [FORMAT_DST_SRC] = 2, [FORMAT_DST_SRC_SRC] = 3, [FORMAT_DST_SRC_IMM] = 3, [FORMAT_SRC_SRC] = 2,
+            [FORMAT_DST] = 1, [FORMAT_LABEL] = 1, [FORMAT_BRANCH] = 3, [FORMAT_SRC] = 1};
+        Format format = opcodes[op].format;
+        if (argCount != expectedOperands[format])
+            fail(m, line, "Wrong number of operands for", text);
+
+        Instruction *instr = &m->code[i];
+        *instr = (Instruction){(Opcode)op, -1, -1, -1, 0, -1, line};
+        switch (format)
+        {
+        case FORMAT_NONE:
+            break;
+        case FORMAT_DST_IMM:
+            instr->dst = parseRegister(m, args[0], line);
+            instr->imm = parseImmediate(m, args[1], line);
+            break;
+        case FORMAT_DST_MEM:
+            instr->dst = parseRegister(m, args[0], line);
+            parseAddress(m, args[1], line, &instr->src1, &instr->imm);
+            break;
+        case FORMAT_SRC_MEM:
+            instr->src2 = parseRegister(m, args[0], line);
+            parseAddress(m, args[1], line, &instr->src1, &instr->imm);
+            break;
+        case FORMAT_DST_SRC:
+            instr->dst = parseRegister(m, args[0], line);
+            instr->src1 = parseRegister(m, args[1], line);
+            break;
+        case FORMAT_DST_SRC_SRC:
+            instr->dst = parseRegister(m, args[0], line);
+            instr->src1 = parseRegister(m, args[1], line);
+            instr->src2 = parseRegister(m, args[2], line);
+            break;
+        case FORMAT_DST_SRC_IMM:
+            instr->dst = parseRegister(m, args[0], line);
+            instr->src1 = parseRegister(m, args[1], line);
+            instr->imm = parseImmediate(m, args[2], line);
+            break;
+        case FORMAT_SRC_SRC:
+            instr->src1 = parseRegister(m, args[0], line);
+            instr->src2 = parseRegister(m, args[1], line);
+            break;
+        case FORMAT_DST:
+            instr->dst = parseRegister(m, args[0], line);
+            break;
+        case FORMAT_LABEL:
+            instr->target = parseTarget(m, args[0], line);
+            break;
+        case FORMAT_BRANCH:
+            instr->src1 = parseRegister(m, args[0], line);
+            if (args[1][0] == '$')
+                instr->src2 = parseRegister(m, args[1], line);
+            else
+                instr->imm = parseImmediate(m, args[1], line);
+            instr->target = parseTarget(m, args[2], line);
+            break;
+        case FORMAT_SRC:
+            instr->src1 = parseRegister(m, args[0], line);
+            break;
+        }
+        free(text);
+    }
+    m->codeCount = m->pendingCount;
+}
+
+// The word at address, which must be aligned and in the data or the stack
+static uint8_t *wordAt(Machine *m, const Instruction *instr, uint32_t address)
+{
+    if (address % 4 != 0)
+        fail(m, instr->line, "Unaligned word access", NULL);
+    if (address >= DATA_BASE && address - DATA_BASE + 4 <= m->dataSize)
+        return m->data + (address - DATA_BASE);
+    if (address <= STACK_TOP && STACK_TOP - address < STACK_BYTES - 4)
+        return m->stack + (STACK_BYTES - 4 - (STACK_TOP - address));
+    fail(m, instr->line, "Access outside the data section and the stack", NULL);
+    return NULL;
+}
+
+static void setRegister(Machine *m, int reg, int32_t value)
+{
+    if (reg != REG_ZERO)
+        m->regs[reg] = value;
+}
+
+// Overwrites the registers a callee may change, except $v0 and those that
+// carry arguments or results
+static void clobber(Machine *m, bool arguments)
+{
+    for (int r = REG_T0; r <= REG_T7; r++)
+        m->regs[r] = CLOBBER_VALUE;
+    m->regs[REG_T8] = m->regs[REG_T9] = m->regs[REG_V1] = CLOBBER_VALUE;
+    for (int r = REG_A0; arguments && r <= REG_A3; r++)
+        m->regs[r] = CLOBBER_VALUE;
+}
+
+static void call(Machine *m, const Instruction *instr, int pc)
+{
+    if (m->frameCount == MAX_CALL_DEPTH)
+        fail(m, instr->line, "Calls nested too deeply", NULL);
+    Frame *frame = &m->frames[m->frameCount++];
+    memcpy(frame->saved, &m->regs[REG_S0], sizeof(frame->saved));
+    frame->sp = m->regs[REG_SP];
+    frame->callee = instr->target;
+    m->regs[REG_RA] = pc;
+    clobber(m, false);
+}
+
+static const char *codeLabelAt(Machine *m, int index)
+{
+    for (int i = 0; i < m->labelCount; i++)
+    {
+        if (m->labels[i].inText && (int)m->labels[i].value == index)
+            return m->labels[i].name;
+    }
+    return "?";
+}
+
+static void returnFromCall(Machine *m, const Instruction *instr)
+{
+    if (m->frameCount == 0)
+        fail(m, instr->line, "Return with no call active", NULL);
+    Frame *frame = &m->frames[--m->frameCount];
+    for (int r = REG_S0; r <= REG_SP; r++)
+    {
+        if (r > REG_S7 && r < REG_SP)
+            continue;
+        if (m->regs[r] != (r == REG_SP ? frame->sp : frame->saved[r - REG_S0]))
+        {
+            fflush(stdout);
+            fprintf(stderr, "%s:%d: %s returns with $%s changed\n", m->filename, instr->line,
+                    codeLabelAt(m, frame->callee), registerNames[r]);
+            exit(SIM_ERROR_STATUS);
+        }
+    }
+    clobber(m, true);
+}
+
+// Runs from main until an exit syscall. Returns the exit status.
+static int run(Machine *m, long stepLimit)
+{
+    Label *entry = findLabel(m, "main", 4);
+    if (!entry || !entry->inText)
+        fail(m, 0, "No main label", NULL);
+    m->stack = (uint8_t *)allocateOrDie(STACK_BYTES);
+    m->frames = (Frame *)allocateOrDie(sizeof(Frame) * MAX_CALL_DEPTH);
+    m->regs[REG_SP] = (int32_t)STACK_TOP;
+    m->regs[REG_RA] = -1;
+
+    int pc = (int)entry->value;
+    for (long steps = 0;; steps++)
+    {
+        if (steps == stepLimit)
+            fail(m, 0, "Step limit reached", NULL);
+        if (pc < 0 || pc >= m->codeCount)
+            fail(m, 0, "Ran off the end of the text section", NULL);
+        const Instruction *instr = &m->code[pc++];
+        uint32_t a = (uint32_t)(instr->src1 >= 0 ? m->regs[instr->src1] : 0);
+        uint32_t b = (uint32_t)(instr->src2 >= 0 ? m->regs[instr->src2] : instr->imm);
+        uint32_t imm = (uint32_t)instr->imm;
+
+        switch (instr->op)
+        {
+        case OP_NOP:
+            break;
+        case OP_LI:
+            setRegister(m, instr->dst, instr->imm);
+            break;
+        case OP_LUI:
+            setRegister(m, instr->dst, (int32_t)(imm << 16));
+            break;
+        case OP_LA:
+            setRegister(m, instr->dst, (int32_t)(a + imm));
+            break;
+        case OP_LW:
+        {
+            int32_t value;
+            memcpy(&value, wordAt(m, instr, a + imm), 4);
+            setRegister(m, instr->dst, value);
+            break;
+        }
+        case OP_SW:
+        {
+            int32_t value = m->regs[instr->src2];
+            memcpy(wordAt(m, instr, a + imm), &value, 4);
+            break;
+        }
+        case OP_MOVE:
+            setRegister(m, instr->dst, (int32_t)a);
+            break;
+        case OP_ADDU:
+        case OP_ADDIU:
+            setRegister(m, instr->dst, (int32_t)(a + b));
+            break;
+        case OP_SUBU:
+            setRegister(m, instr->dst, (int32_t)(a - b));
+            break;
+        case OP_MUL:
+            setRegister(m, instr->dst, (int32_t)(a * b));
+            break;
+        case OP_SLLV:
+        case OP_SLL:
+            setRegister(m, instr->dst, (int32_t)(a << (b & 31)));
+            break;
+        case OP_SRAV:
+        case OP_SRA:
+            setRegister(m, instr->dst, (int32_t)a < 0 ? (int32_t)~(~a >> (b & 31)) : (int32_t)(a >> (b & 31)));
+            break;
+        case OP_SRLV:
+        case OP_SRL:
+            setRegister(m, instr->dst, (int32_t)(a >> (b & 31)));
+            break;
+        case OP_SLT:
+        case OP_SLTI:
+            setRegister(m, instr->dst, (int32_t)a < (int32_t)b);
+            break;
+        case OP_SLTU:
+        case OP_SLTIU:
+            setRegister(m, instr->dst, a < b);
+            break;
+        case OP_ORI:
+            setRegister(m, instr->dst, (int32_t)(a | (imm & 0xffff)));
+            break;
+        case OP_XORI:
+            setRegister(m, instr->dst, (int32_t)(a ^ (imm & 0xffff)));
+            break;
+        case OP_DIV:
+            if (b == 0)
+                fail(m, instr->line, "Division by zero", NULL);
+            m->lo = (int32_t)a == INT32_MIN && (int32_t)b == -1 ? INT32_MIN : (int32_t)a / (int32_t)b;
+            break;
+        case OP_MFLO:
+            setRegister(m, instr->dst, m->lo);
+            break;
+        case OP_J:
+            pc = instr->target;
+            break;
+        case OP_BEQ:
+            if (a == b)
+                pc = instr->target;
+            break;
+        case OP_BNE:
+            if (a != b)
+                pc = instr->target;
+            break;
+        case OP_JAL:
+            call(m, instr, pc);
+            pc = instr->target;
+            break;
+        case OP_JR:
+            if (instr->src1 != REG_RA)
+                fail(m, instr->line, "jr is only used to return", NULL);
+            returnFromCall(m, instr);
+            pc = (int)a;
+            break;
+        case OP_SYSCALL:
+            switch (m->regs[REG_V0])
+            {
+            case 1: // print_int
+                printf("%d", m->regs[REG_A0]);
+                break;
+            case 4: // print_string
+                for (uint32_t p = (uint32_t)m->regs[REG_A0];; p++)
+                {
+                    if (p < DATA_BASE || p - DATA_BASE >= m->dataSize)
+                        fail(m, instr->line, "String outside the data section", NULL);
+                    if (m->data[p - DATA_BASE] == '\0')
+                        break;
+                    putchar(m->data[p - DATA_BASE]);
+                }
+                break;
+            case 10: // exit
+                return 0;
+            case 11: // print_char
+                putchar(m->regs[REG_A0]);
+                break;
+            case 17: // exit2
+                return m->regs[REG_A0];
+            default:
+                fail(m, instr->line, "Unsupported syscall", NULL);
+            }
+            break;
+        case OP_COUNT:
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long stepLimit = DEFAULT_STEP_LIMIT;
+    const char *filename = NULL;
+    bool usage = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc)
+            stepLimit = atol(argv[++i]);
+        else if (!filename)
+            filename = argv[i];
+        else
+            usage = true;
+    }
+    if (!filename || usage)
+    {
+        fprintf(stderr, "Usage: %s [-steps N] file.s\n", argv[0]);
+        return SIM_ERROR_STATUS;
+    }
+
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        perror(filename);
+        return SIM_ERROR_STATUS;
+    }
+    Machine machine;
+    memset(&machine, 0, sizeof(machine));
+    machine.filename = filename;
+    readSource(&machine, file);
+    fclose(file);
+    decode(&machine);
+
+    int status = run(&machine, stepLimit);
+    fflush(stdout);
+    return status;
+}
@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# Compiles a program into an empty cache, then again with one function
+# edited, and checks that the second compile reuses the function the edit
+# does not reach and still runs like a compile without the cache. Run from
+# Tests/ after building the parser and mipsim.
+cd "$(dirname "$0")"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+program()
+{
+    cat <<END
+int total;
+int square(int n;) return n * n; ;
+int sumSquares(int n; int s;)
+    s = 0;
+    while (n > 0) { s = s + square(n); n = n - 1; }
+    return s + $1;
+;
+int twice(int n;) total = total + n; return n + n; ;
+write sumSquares(30, 0);
+write twice(21);
+write total;
+END
+}
+
+program 0 > "$dir/first.cmm"
+program 7 > "$dir/edited.cmm"
+../parser -cache "$dir/cache" "$dir/first.cmm" > /dev/null 2>&1
+../parser -cache "$dir/cache" -stats "$dir/edited.cmm" > /dev/null 2> "$dir/stats"
+./mipsim "$dir/edited.s" > "$dir/cached.out"
+../parser "$dir/edited.cmm" > /dev/null 2>&1
+./mipsim "$dir/edited.s" > "$dir/fresh.out"
+
+# square and twice are unchanged; sumSquares and the body are optimized again
+if ! grep -q "cache: miss, functions: 2 hits, 2 misses" "$dir/stats"; then
+    echo "test-cache: the edited program did not reuse the unchanged functions"
+    grep "cache:" "$dir/stats"
+    failures=$((failures + 1))
+fi
+if ! diff -u "$dir/fresh.out" "$dir/cached.out"; then
+    echo "test-cache: the cached compile wrote the wrong output"
+    failures=$((failures + 1))
+fi
+
+if [ "$failures" -ne 0 ]; then
+    echo "test-cache: $failures FAILED"
+    exit 1
+fi
+echo "test-cache: passed"
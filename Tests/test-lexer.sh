@@ -1,10 +1,97 @@
 #!/bin/bash
 
+# Scans a program with token tracing on and compares the tokens the lexer
+# reports with the expected list. Run from Tests/ after building the parser.
+cd "$(dirname "$0")"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
 # Lexer test input
-cat <<EOF | ../lexer
-int x = 10;
-write x;
+cat > "$dir/lexer.cmm" <<EOF
+int x;
+int a[4];
+/* a comment * with ** stars **/
+x = 10;
+while (x >= 1) { a[x / 4] = x - 1; x = x - 3; }
+write (x == 1) + (x != 2) * (x <= 3) - (x < 4) + (x > 5);
+EOF
+
+cat > "$dir/expected" <<EOF
+int : TYPE
+x : IDENTIFIER
+; : SEMICOLON
+int : TYPE
+a : IDENTIFIER
+[ : LBRACKET
+4 : NUMBER
+] : RBRACKET
+; : SEMICOLON
+x : IDENTIFIER
+= : EQ
+10 : NUMBER
+; : SEMICOLON
+while : KEYWORD
+( : LPAREN
+x : IDENTIFIER
+>= : GE
+1 : NUMBER
+) : RPAREN
+{ : LBRACE
+a : IDENTIFIER
+[ : LBRACKET
+x : IDENTIFIER
+/ : DIVIDE
+4 : NUMBER
+] : RBRACKET
+= : EQ
+x : IDENTIFIER
+- : MINUS
+1 : NUMBER
+; : SEMICOLON
+x : IDENTIFIER
+= : EQ
+x : IDENTIFIER
+- : MINUS
+3 : NUMBER
+; : SEMICOLON
+} : RBRACE
+write : KEYWORD
+( : LPAREN
+x : IDENTIFIER
+== : EQEQ
+1 : NUMBER
+) : RPAREN
++ : PLUS
+( : LPAREN
+x : IDENTIFIER
+!= : NE
+2 : NUMBER
+) : RPAREN
+* : TIMES
+( : LPAREN
+x : IDENTIFIER
+<= : LE
+3 : NUMBER
+) : RPAREN
+- : MINUS
+( : LPAREN
+x : IDENTIFIER
+< : LT
+4 : NUMBER
+) : RPAREN
++ : PLUS
+( : LPAREN
+x : IDENTIFIER
+> : GT
+5 : NUMBER
+) : RPAREN
+; : SEMICOLON
 EOF
 
-# Check the output for expected tokens
-# Add your validation logic here, e.g., grep for expected tokens
+# The tokens are traced at the debug level, among the other phases' output
+CMM_TRACE=lexer=2 ../parser "$dir/lexer.cmm" 2>&1 | grep -E '^[^ ]+ : [A-Z]+$' > "$dir/tokens"
+if ! diff -u "$dir/expected" "$dir/tokens"; then
+    echo "test-lexer: FAILED"
+    exit 1
+fi
+echo "test-lexer: passed"
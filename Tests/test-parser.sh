@@ -1,9 +1,160 @@
 #!/bin/bash
 
-# Parser test input
-cat <<EOF | ../parser
-int x = 10;
+# Compiles programs that must parse and programs that must be rejected, and
+# checks the parser's exit status for each. Run from Tests/ after building
+# the parser.
+cd "$(dirname "$0")"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+# accept name: the program on stdin compiles to name.s
+accept()
+{
+    cat > "$dir/$1.cmm"
+    if ! ../parser "$dir/$1.cmm" > "$dir/$1.log" 2>&1 || [ ! -s "$dir/$1.s" ]; then
+        echo "test-parser: $1 was rejected"
+        cat "$dir/$1.log"
+        failures=$((failures + 1))
+    fi
+}
+
+# reject name: the program on stdin fails to compile
+reject()
+{
+    cat > "$dir/$1.cmm"
+    if ../parser "$dir/$1.cmm" > "$dir/$1.log" 2>&1; then
+        echo "test-parser: $1 was accepted"
+        failures=$((failures + 1))
+    fi
+}
+
+accept declarations <<EOF
+int x;
+int a[10];
+x = 10;
+write x;
+EOF
+
+accept expressions <<EOF
+int x;
+int y;
+x = 1 + 2 * 3 - 8 / 4;
+y = (x + 1) * (x - 1);
+write x == y;
+write x != y;
+write (x < y) + (x <= y) + (x > y) + (x >= y);
+EOF
+
+accept functions <<EOF
+int total;
+int add(int a; int b;) return a + b; ;
+int bump() total = total + 1; return total; ;
+total = add(1, 2);
+write bump();
+EOF
+
+accept loops <<EOF
+int i;
+int a[5];
+i = 0;
+while (i < 5) { a[i] = i * i; i = i + 1; }
+while (i > 0) i = i - 1;
+write a[4];
+EOF
+
+accept comments <<EOF
+int x; /* a comment
+spanning lines */
+x = 1; /* ** stars ***/
+write x;
+EOF
+
+reject missingExpression <<EOF
+int x;
+x = ;
+EOF
+
+reject missingSemicolon <<EOF
+int x;
+x = 1
+write x;
+EOF
+
+reject unbalancedParentheses <<EOF
+int x;
+x = (1 + 2;
+EOF
+
+reject unclosedBlock <<EOF
+int i;
+while (i < 3) { i = i + 1;
+EOF
+
+# Semantic errors stop the compile as well
+reject tooFewArguments <<EOF
+int x;
+int add(int a; int b;) return a + b; ;
+x = add(1);
+EOF
+
+reject tooManyArguments <<EOF
+int x;
+int one() return 1; ;
+x = one(2);
+EOF
+
+reject nestedCallMismatch <<EOF
+int x;
+int add(int a; int b;) return a + b; ;
+write add(add(1), 2);
+EOF
+
+reject returnOutsideFunction <<EOF
+int x;
+return x;
+EOF
+
+reject undeclaredVariable <<EOF
+int x;
+x = y + 1;
+EOF
+
+reject functionAsVariable <<EOF
+int f(int p;) return p; ;
+int h(int p;) while (p > 0) { return h(p - 1); } return f; ;
+write h(3);
+EOF
+
+reject assignToFunction <<EOF
+int f(int p;) return p; ;
+f = 3;
+write f(1);
+EOF
+
+# Arrays live in the data section and can't be passed
+reject arrayParameter <<EOF
+int x;
+int one(int a[3];) return 1; ;
+x = 1;
 write x;
 EOF
 
-# Add checks for expected output or absence of syntax errors
+reject arrayAsVariable <<EOF
+int a[3];
+int add(int p;) return a + p; ;
+a[0] = 7;
+write add(1);
+EOF
+
+reject assignToArray <<EOF
+int a[3];
+a = 5;
+write a[0];
+EOF
+
+if [ "$failures" -ne 0 ]; then
+    echo "test-parser: $failures FAILED"
+    exit 1
+fi
+echo "test-parser: passed"
@@ -0,0 +1,51 @@
+#!/bin/bash
+
+# Compiles each program in Tests/programs, runs it under mipsim and compares
+# what it writes with the .expected file beside it. A program is compiled
+# both plainly and with -bounds, and must end with exit status 0, unless its
+# first line names the one flag to use or the status to expect:
+#   /* flags: -bounds status: 1 */
+# Run from Tests/ after building the parser and mipsim.
+cd "$(dirname "$0")"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+for program in programs/*.cmm; do
+    name=$(basename "$program" .cmm)
+    first=$(head -n 1 "$program")
+    variants=("" "-bounds")
+    status=0
+    if [[ $first =~ flags:\ *(-[a-z]+) ]]; then
+        variants=("${BASH_REMATCH[1]}")
+    fi
+    if [[ $first =~ status:\ *([0-9]+) ]]; then
+        status=${BASH_REMATCH[1]}
+    fi
+
+    cp "$program" "$dir/$name.cmm"
+    for flags in "${variants[@]}"; do
+        label="$name${flags:+ $flags}"
+        if ! ../parser $flags "$dir/$name.cmm" > "$dir/$name.log" 2>&1; then
+            echo "test-programs: $label failed to compile"
+            cat "$dir/$name.log"
+            failures=$((failures + 1))
+            continue
+        fi
+        ./mipsim "$dir/$name.s" > "$dir/$name.out"
+        result=$?
+        if [ "$result" -ne "$status" ]; then
+            echo "test-programs: $label exited with $result, expected $status"
+            failures=$((failures + 1))
+        elif ! diff -u "programs/$name.expected" "$dir/$name.out"; then
+            echo "test-programs: $label wrote the wrong output"
+            failures=$((failures + 1))
+        fi
+    done
+done
+
+if [ "$failures" -ne 0 ]; then
+    echo "test-programs: $failures FAILED"
+    exit 1
+fi
+echo "test-programs: passed"
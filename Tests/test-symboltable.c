@@ -3,14 +3,21 @@
 
 int main()
 {
-    SymbolTable *table = createSymbolTable(100); // Adjust size as needed
+    SymbolTable *table = createSymbolTable(4); // Small on purpose so the table has to grow
 
     addSymbol(table, "x", "int");
     addSymbol(table, "y", "float");
 
+    char name[16];
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), "v%d", i);
+        addSymbol(table, name, "int");
+    }
+
     printSymbolTable(table);
 
-    Symbol *x = findSymbol(table, "x");
+    Symbol *x = lookupSymbol(table, "x");
     if (x != NULL)
     {
         printf("Found symbol: %s of type %s\n", x->name, x->type);
@@ -20,6 +27,30 @@ int main()
         printf("Symbol x not found\n");
     }
 
+    if (lookupSymbol(table, "v999") == NULL || lookupSymbol(table, "missing") != NULL)
+    {
+        printf("Lookup after resize failed\n");
+        return 1;
+    }
+
+    // A local shadows the global until its scope is exited
+    enterScope(table);
+    addSymbol(table, "x", "float");
+    addSymbol(table, "local", "int");
+    if (strcmp(lookupSymbol(table, "x")->type, "float") != 0 || lookupSymbol(table, "local") == NULL)
+    {
+        printf("Scoped lookup failed\n");
+        return 1;
+    }
+    exitScope(table);
+    if (strcmp(lookupSymbol(table, "x")->type, "int") != 0 || lookupSymbol(table, "local") != NULL)
+    {
+        printf("Scope exit did not restore the outer binding\n");
+        return 1;
+    }
+
+    printSymbolTableStats(table);
+
     freeSymbolTable(table);
     return 0;
 }
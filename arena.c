@@ -0,0 +1,85 @@
+#include "arena.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT sizeof(void *)
+
+void initArena(Arena *arena, size_t chunkSize)
+{
+    arena->chunks = NULL;
+    arena->chunkSize = chunkSize ? chunkSize : ARENA_DEFAULT_CHUNK_SIZE;
+    arena->allocations = 0;
+    arena->chunkCount = 0;
+    arena->bytesRequested = 0;
+    arena->bytesReserved = 0;
+}
+
+static ArenaChunk *newChunk(Arena *arena, size_t minSize)
+{
+    size_t capacity = arena->chunkSize;
+    if (capacity < minSize)
+        capacity = minSize; // Oversized requests get a chunk of their own
+
+    ArenaChunk *chunk = (ArenaChunk *)trackedMalloc(sizeof(ArenaChunk) + capacity);
+    if (!chunk)
+    {
+        fprintf(stderr, "Arena: Memory allocation failed\n");
+        exit(1);
+    }
+
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    arena->chunkCount++;
+    arena->bytesReserved += sizeof(ArenaChunk) + capacity;
+    return chunk;
+}
+
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    ArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->capacity - chunk->used < size)
+        chunk = newChunk(arena, size);
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+
+    arena->allocations++;
+    arena->bytesRequested += size;
+    return ptr;
+}
+
+char *arenaStrdup(Arena *arena, const char *str)
+{
+    if (!str)
+        return NULL;
+
+    size_t len = strlen(str) + 1;
+    char *copy = (char *)arenaAlloc(arena, len);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+void freeArena(Arena *arena)
+{
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk)
+    {
+        ArenaChunk *next = chunk->next;
+        trackedFree(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+}
+
+void printArenaStats(const char *name, Arena *arena)
+{
+    printf("%s: %zu allocations, %zu bytes in %zu chunks (%zu bytes reserved)\n",
+           name, arena->allocations, arena->bytesRequested, arena->chunkCount, arena->bytesReserved);
+}
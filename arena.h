@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Chunked bump allocator. Everything allocated from an arena is released
+// together by freeArena; individual allocations are never freed.
+
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaChunk;
+
+typedef struct Arena
+{
+    ArenaChunk *chunks; // Most recently allocated chunk first
+    size_t chunkSize;   // Default capacity of a new chunk
+
+    // Counters
+    size_t allocations;    // Requests served by arenaAlloc
+    size_t chunkCount;     // Chunks obtained from malloc
+    size_t bytesRequested; // Bytes handed out, including alignment padding
+    size_t bytesReserved;  // Bytes obtained from malloc
+} Arena;
+
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+void initArena(Arena *arena, size_t chunkSize);
+void *arenaAlloc(Arena *arena, size_t size);
+char *arenaStrdup(Arena *arena, const char *str);
+void freeArena(Arena *arena);
+void printArenaStats(const char *name, Arena *arena);
+
+#endif // ARENA_H
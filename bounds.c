@@ -0,0 +1,349 @@
+#include "bounds.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "memtrack.h"
+#include "trace.h"
+
+// How often a value's range may grow before it is taken to be anything.
+// Ranges only grow around loops, so this bounds the rounds a loop costs.
+#define RANGE_WIDENING_LIMIT 3
+
+// Inserts a check before every array load and store, against the size the
+// symbol table gives the array. Returns the number of checks inserted.
+int insertBoundsChecks(TACList *list, SymbolTable *symTab)
+{
+    Operand none = {OPERAND_NONE, 0};
+    int inserted = 0;
+    int prev = TAC_END;
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        if (tac->op == TAC_ARRAY_LOAD || tac->op == TAC_ARRAY_STORE)
+        {
+            Operand array = tac->op == TAC_ARRAY_LOAD ? tac->arg1 : tac->result;
+            Symbol *symbol = lookupSymbol(symTab, (char *)internedString(&list->names, array.value));
+            if (symbol && symbol->isArray)
+            {
+                TAC check = {TAC_BOUNDS_CHECK, tac->arg2, constOperand(symbol->arraySize), none, TAC_END};
+                insertTAC(list, prev, &check);
+                inserted++;
+            }
+        }
+        prev = i;
+    }
+    return inserted;
+}
+
+// Range analysis //
+
+// Values a 32-bit value may take; empty (low > high) until a definition
+// has been seen. Bounds are 64-bit so arithmetic on them cannot overflow.
+typedef struct Range
+{
+    long long low;
+    long long high;
+} Range;
+
+static const Range fullRange = {INT_MIN, INT_MAX};
+static const Range emptyRange = {1, 0};
+
+static bool isEmptyRange(Range r)
+{
+    return r.low > r.high;
+}
+
+static bool isConstantRange(Range r)
+{
+    return r.low == r.high;
+}
+
+// The range of exact results, or every value if the generated code would
+// wrap around
+static Range fitRange(long long low, long long high)
+{
+    if (low < INT_MIN || high > INT_MAX)
+        return fullRange;
+    return (Range){low, high};
+}
+
+static Range unionRange(Range a, Range b)
+{
+    if (isEmptyRange(a))
+        return b;
+    if (isEmptyRange(b))
+        return a;
+    return (Range){a.low < b.low ? a.low : b.low, a.high > b.high ? a.high : b.high};
+}
+
+static Range operandRange(TACList *code, const Range *ranges, Operand operand)
+{
+    if (operand.kind == OPERAND_CONST)
+        return (Range){operand.value, operand.value};
+    if (operand.kind == OPERAND_TEMP)
+        return ranges[tacValueIndex(code, operand)];
+    return fullRange; // A variable's value in memory
+}
+
+// The range of a op b. Shifts and division are only followed for a
+// constant right operand; shift amounts are taken mod 32 as the code does.
+static Range arithmeticRange(TACOpcode op, Range a, Range b)
+{
+    if (isEmptyRange(a) || isEmptyRange(b))
+        return emptyRange;
+
+    switch (op)
+    {
+    case TAC_ADD:
+        return fitRange(a.low + b.low, a.high + b.high);
+    case TAC_SUB:
+        return fitRange(a.low - b.high, a.high - b.low);
+    case TAC_MUL:
+    {
+        long long products[4] = {a.low * b.low, a.low * b.high, a.high * b.low, a.high * b.high};
+        Range r = {products[0], products[0]};
+        for (int k = 1; k < 4; k++)
+            r = unionRange(r, (Range){products[k], products[k]});
+        return fitRange(r.low, r.high);
+    }
+    case TAC_DIV:
+        if (!isConstantRange(b) || b.low == 0)
+            return fullRange;
+        if (b.low > 0)
+            return fitRange(a.low / b.low, a.high / b.low);
+        return fitRange(a.high / b.low, a.low / b.low);
+    case TAC_SLL:
+        if (!isConstantRange(b))
+            return fullRange;
+        return fitRange(a.low * (1LL << (b.low & 31)), a.high * (1LL << (b.low & 31)));
+    case TAC_SRA:
+        if (!isConstantRange(b))
+            return fullRange;
+        return (Range){a.low >> (b.low & 31), a.high >> (b.low & 31)};
+    case TAC_SRL:
+        if (!isConstantRange(b))
+            return fullRange;
+        if ((b.low & 31) == 0 || a.low >= 0)
+            return (Range){a.low >> (b.low & 31), a.high >> (b.low & 31)};
+        return (Range){0, 0xffffffffLL >> (b.low & 31)};
+    default:
+        if (isComparisonOp(op))
+            return (Range){0, 1};
+        return fullRange;
+    }
+}
+
+// The range of the value instruction tac defines
+static Range definitionRange(TACList *code, const Range *ranges, TAC *tac)
+{
+    if (tac->op == TAC_ASSIGN || tac->op == TAC_LI)
+        return operandRange(code, ranges, tac->arg1);
+    if (isArithmeticOp(tac->op))
+        return arithmeticRange(tac->op, operandRange(code, ranges, tac->arg1), operandRange(code, ranges, tac->arg2));
+    return fullRange; // Calls, parameters and array loads
+}
+
+// Grows the range of temporary result to include r. Returns true if it grew.
+static bool widenRange(TACList *code, Range *ranges, int *growth, Operand result, Range r)
+{
+    int v = tacValueIndex(code, result);
+    Range grown = unionRange(ranges[v], r);
+    if (grown.low == ranges[v].low && grown.high == ranges[v].high)
+        return false;
+    if (++growth[v] > RANGE_WIDENING_LIMIT)
+        grown = fullRange;
+    ranges[v] = grown;
+    return true;
+}
+
+// Finds the range of every temporary: definitions are evaluated in reverse
+// postorder, phis take the union of their incoming values, and the whole
+// function is swept again until no range grows.
+static void computeRanges(SSAForm *ssa, Range *ranges, int *growth)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int k = 0; k < cfg->blockCount; k++)
+        {
+            int b = cfg->order[k];
+            if (!ssa->blockReachable[b])
+                continue;
+            BasicBlock *block = &cfg->blocks[b];
+            for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+            {
+                Phi *phi = &ssa->phis[p];
+                Range r = emptyRange;
+                for (int j = 0; j < block->predCount; j++)
+                {
+                    if (!ssa->blockReachable[block->preds[j]])
+                        continue;
+                    r = unionRange(r, phi->args[j].kind == OPERAND_NONE ? fullRange : operandRange(code, ranges, phi->args[j]));
+                }
+                changed |= widenRange(code, ranges, growth, phi->result, r);
+            }
+            for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+            {
+                TAC *tac = &code->code[i];
+                if (tac->result.kind == OPERAND_TEMP && tacDefinition(tac))
+                    changed |= widenRange(code, ranges, growth, tac->result, definitionRange(code, ranges, tac));
+            }
+        }
+    }
+}
+
+// Marks the checks of block b that must pass. checked[v] is the smallest
+// size a dominating check has held temporary v below, 0 if none; checks
+// in b add to it, logging the old value for the walk to restore.
+static int markBlock(SSAForm *ssa, const Range *ranges, int *checked, int *log, int *logCount, bool *redundant, int b)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    BasicBlock *block = &cfg->blocks[b];
+    int marked = 0;
+
+    for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+    {
+        TAC *tac = &code->code[i];
+        if (tac->op != TAC_BOUNDS_CHECK)
+            continue;
+
+        int size = tac->arg2.value;
+        int v = tac->arg1.kind == OPERAND_TEMP ? tacValueIndex(code, tac->arg1) : -1;
+        Range r = operandRange(code, ranges, tac->arg1);
+        if (isEmptyRange(r))
+            r = fullRange;
+        if (v >= 0 && checked[v] > 0)
+        {
+            r.low = r.low > 0 ? r.low : 0;
+            r.high = r.high < checked[v] - 1 ? r.high : checked[v] - 1;
+        }
+
+        if (r.low >= 0 && r.high < size)
+        {
+            redundant[i] = true;
+            marked++;
+            continue;
+        }
+        if (r.low >= size || r.high < 0)
+            TRACE(TRACE_OPTIMIZER, TRACE_INFO, "Bounds: index always outside an array of %d\n", size);
+        if (v >= 0 && (checked[v] == 0 || size < checked[v]))
+        {
+            log[(*logCount)++] = v;
+            log[(*logCount)++] = checked[v];
+            checked[v] = size;
+        }
+    }
+    return marked;
+}
+
+static void *allocateOrDie(size_t size)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "eliminateBoundsChecks: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Removes the bounds checks the range analysis proves redundant, walking
+// the dominator tree so a check's facts hold in the blocks it dominates.
+// Only temporaries carry facts from one check to the next: a variable's
+// symbol stands for memory, which a call may change. Returns the number of
+// checks removed.
+int eliminateBoundsChecks(SSAForm *ssa)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+
+    int checks = 0;
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+        checks += code->code[i].op == TAC_BOUNDS_CHECK;
+    if (checks == 0)
+        return 0;
+
+    int valueCount = tacValueCount(code);
+    Range *ranges = (Range *)allocateOrDie(sizeof(Range) * valueCount);
+    int *growth = (int *)allocateOrDie(sizeof(int) * valueCount);
+    int *checked = (int *)allocateOrDie(sizeof(int) * valueCount);
+    for (int v = 0; v < valueCount; v++)
+    {
+        ranges[v] = emptyRange;
+        growth[v] = 0;
+        checked[v] = 0;
+    }
+    computeRanges(ssa, ranges, growth);
+
+    bool *redundant = (bool *)allocateOrDie(sizeof(bool) * code->count);
+    for (int i = 0; i < code->count; i++)
+        redundant[i] = false;
+    int *log = (int *)allocateOrDie(sizeof(int) * 2 * checks);
+    int logCount = 0;
+    int *mark = (int *)allocateOrDie(sizeof(int) * n);
+    int *stack = (int *)allocateOrDie(sizeof(int) * 2 * n);
+    int top = 0;
+    if (n > 0)
+        stack[top++] = 0;
+    while (top > 0)
+    {
+        int entry = stack[--top];
+        if (entry < 0)
+        {
+            // Leaving the block: its checks no longer dominate
+            while (logCount > mark[~entry])
+            {
+                logCount -= 2;
+                checked[log[logCount]] = log[logCount + 1];
+            }
+            continue;
+        }
+        mark[entry] = logCount;
+        stack[top++] = ~entry;
+        if (ssa->blockReachable[entry])
+            markBlock(ssa, ranges, checked, log, &logCount, redundant, entry);
+        for (int c = ssa->dom.childStart[entry + 1] - 1; c >= ssa->dom.childStart[entry]; c--)
+            stack[top++] = ssa->dom.children[c];
+    }
+
+    // Unlink the marked checks, keeping the blocks' ends on live
+    // instructions. A block that is nothing but a check keeps it.
+    int removed = 0;
+    int prev = TAC_END;
+    for (int i = code->head; i != TAC_END;)
+    {
+        int next = code->code[i].next;
+        BasicBlock *block = redundant[i] ? &cfg->blocks[cfg->blockOf[i]] : NULL;
+        if (block && !(block->first == i && block->last == i))
+        {
+            if (block->first == i)
+                block->first = next;
+            if (block->last == i)
+                block->last = prev;
+            cfg->blockOf[i] = -1;
+            removeTAC(code, prev, i);
+            removed++;
+        }
+        else
+        {
+            prev = i;
+        }
+        i = next;
+    }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Bounds: %d of %d checks proven redundant\n", removed, checks);
+
+    trackedFree(stack);
+    trackedFree(mark);
+    trackedFree(log);
+    trackedFree(redundant);
+    trackedFree(checked);
+    trackedFree(growth);
+    trackedFree(ranges);
+    return removed;
+}
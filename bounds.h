@@ -0,0 +1,24 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "tac.h"
+#include "ssa.h"
+#include "symbolTable.h"
+
+// Runtime array bounds checks. With checking on, each array access is
+// preceded by a TAC_BOUNDS_CHECK of its index against the array's size, and
+// an index outside the array stops the program. A range analysis over the
+// SSA form drops the checks it proves always pass: those whose index can
+// only take values inside the array, and those dominated by a check of the
+// same value against the same or a smaller size.
+
+typedef struct BoundsStats
+{
+    int inserted; // Checks placed before array accesses
+    int removed;  // Checks proven to pass
+} BoundsStats;
+
+int insertBoundsChecks(TACList *list, SymbolTable *symTab);
+int eliminateBoundsChecks(SSAForm *ssa);
+
+#endif // BOUNDS_H
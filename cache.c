@@ -0,0 +1,727 @@
+#include "cache.h"
+#include "memtrack.h"
+#include "trace.h"
+#include "tacimage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define CACHE_COPY_CHUNK (64 * 1024)
+
+// Two independent 64-bit hashes of the settings and the input: FNV-1a, and
+// a multiply-xorshift mix. Together they make a 128-bit name.
+static void hashBytes(uint64_t hash[2], const char *bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        unsigned char c = (unsigned char)bytes[i];
+        hash[0] = (hash[0] ^ c) * 0x100000001b3ull;
+        hash[1] = (hash[1] + c) * 0x9e3779b97f4a7c15ull;
+        hash[1] ^= hash[1] >> 29;
+    }
+}
+
+// Hash of the running compiler's executable, so an entry one build wrote is
+// never served to another even if COMPILER_VERSION was not bumped. Left zero
+// when the executable can't be read; the version in the settings still
+// tells releases apart then.
+static uint64_t buildHash[2];
+static pthread_once_t buildHashOnce = PTHREAD_ONCE_INIT;
+
+static void hashBuild(void)
+{
+    FILE *file = fopen("/proc/self/exe", "rb");
+    if (!file)
+        return;
+    uint64_t hash[2] = {0xcbf29ce484222325ull, 0x2545f4914f6cdd1dull};
+    char *buffer = (char *)trackedMalloc(CACHE_COPY_CHUNK);
+    size_t n;
+    while (buffer && (n = fread(buffer, 1, CACHE_COPY_CHUNK, file)) > 0)
+        hashBytes(hash, buffer, n);
+    if (buffer && !ferror(file))
+    {
+        buildHash[0] = hash[0];
+        buildHash[1] = hash[1];
+    }
+    trackedFree(buffer);
+    fclose(file);
+}
+
+void computeCacheKey(CacheKey *key, const char *input, size_t size, const char *settings)
+{
+    pthread_once(&buildHashOnce, hashBuild);
+    uint64_t hash[2] = {0xcbf29ce484222325ull, 0x2545f4914f6cdd1dull};
+    hashBytes(hash, (const char *)buildHash, sizeof(buildHash));
+    hashBytes(hash, settings, strlen(settings) + 1); // The NUL keeps settings and input apart
+    hashBytes(hash, input, size);
+    snprintf(key->hex, sizeof(key->hex), "%016llx%016llx", (unsigned long long)hash[0],
+             (unsigned long long)hash[1]);
+}
+
+static void entryPath(char *path, const char *directory, const char *key, const char *extension)
+{
+    snprintf(path, PATH_MAX, "%s/%s%s", directory, key, extension);
+}
+
+static bool copyStream(FILE *from, FILE *to)
+{
+    char buffer[CACHE_COPY_CHUNK];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), from)) > 0)
+    {
+        if (fwrite(buffer, 1, n, to) != n)
+            return false;
+    }
+    return !ferror(from);
+}
+
+static bool copyFile(const char *fromFilename, const char *toFilename)
+{
+    FILE *from = fopen(fromFilename, "rb");
+    if (!from)
+        return false;
+    FILE *to = fopen(toFilename, "wb");
+    if (!to)
+    {
+        perror(toFilename);
+        fclose(from);
+        return false;
+    }
+    bool copied = copyStream(from, to);
+    fclose(from);
+    if (fclose(to) != 0)
+        copied = false;
+    return copied;
+}
+
+// Copies the entry to the outputs. The TAC dumps are only needed when a
+// filename is given for them. A hit marks the entry recently used.
+bool fetchCacheEntry(const char *directory, const CacheKey *key, const char *outputFilename,
+                     const char *tacFilename, const char *optimizedFilename)
+{
+    char assembly[PATH_MAX];
+    char tac[PATH_MAX];
+    char optimized[PATH_MAX];
+    entryPath(assembly, directory, key->hex, ".s");
+    entryPath(tac, directory, key->hex, ".ir");
+    entryPath(optimized, directory, key->hex, ".opt.ir");
+    if (access(assembly, R_OK) != 0 || (tacFilename && access(tac, R_OK) != 0) ||
+        (optimizedFilename && access(optimized, R_OK) != 0))
+        return false;
+
+    if (!copyFile(assembly, outputFilename) || (tacFilename && !copyFile(tac, tacFilename)) ||
+        (optimizedFilename && !copyFile(optimized, optimizedFilename)))
+        return false;
+    utimensat(AT_FDCWD, assembly, NULL, 0);
+    TRACE(TRACE_DRIVER, TRACE_INFO, "Cache hit %s for %s\n", key->hex, outputFilename);
+    return true;
+}
+
+// Opens a fresh temporary file next to the entry, to be renamed over it.
+static FILE *openTemporary(char *path, const char *directory, const char *key, const char *extension)
+{
+    snprintf(path, PATH_MAX, "%s/%s%s.XXXXXX", directory, key, extension);
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return NULL;
+    FILE *file = fdopen(fd, "wb");
+    if (!file)
+    {
+        close(fd);
+        unlink(path);
+    }
+    return file;
+}
+
+static bool commitTemporary(FILE *file, bool written, const char *temporary, const char *path)
+{
+    if (fclose(file) != 0)
+        written = false;
+    if (written && rename(temporary, path) == 0)
+        return true;
+    unlink(temporary);
+    return false;
+}
+
+// Copies filename into the entry under extension.
+static bool storeCopy(const char *directory, const CacheKey *key, const char *extension, const char *filename)
+{
+    char temporary[PATH_MAX];
+    char path[PATH_MAX];
+    FILE *from = fopen(filename, "rb");
+    if (!from)
+        return false;
+    FILE *file = openTemporary(temporary, directory, key->hex, extension);
+    if (!file)
+    {
+        fclose(from);
+        return false;
+    }
+    bool copied = copyStream(from, file);
+    fclose(from);
+    entryPath(path, directory, key->hex, extension);
+    return commitTemporary(file, copied, temporary, path);
+}
+
+static bool makeDirectory(const char *directory)
+{
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST)
+    {
+        perror(directory);
+        return false;
+    }
+    return true;
+}
+
+// Adds the assembly in outputFilename, the TAC dump in tacFilename if there
+// is one, and the optimized TAC to the cache. The assembly goes in last, so
+// a reader that finds it finds the rest.
+bool storeCacheEntry(const char *directory, const CacheKey *key, const char *outputFilename,
+                     const char *tacFilename, TACList *optimized)
+{
+    if (!makeDirectory(directory))
+        return false;
+
+    char temporary[PATH_MAX];
+    char path[PATH_MAX];
+    FILE *file = openTemporary(temporary, directory, key->hex, ".opt.ir");
+    if (!file)
+        return false;
+    entryPath(path, directory, key->hex, ".opt.ir");
+    if (!commitTemporary(file, writeTACList(file, optimized), temporary, path))
+        return false;
+    if (tacFilename && !storeCopy(directory, key, ".ir", tacFilename))
+        return false;
+    return storeCopy(directory, key, ".s", outputFilename);
+}
+
+// Function entries //
+
+#define FUNCTION_ENTRY_MAGIC "CMMFUNC\n"
+
+// A function entry is this header, then each name as its length and bytes,
+// then the instructions as image records. Symbol operands index the names,
+// and temporaries and labels are numbered from 0 within the function.
+typedef struct FunctionEntryHeader
+{
+    char magic[8];
+    uint32_t instructionCount;
+    uint32_t nameCount;
+    uint32_t tempCount;
+    uint32_t labelCount;
+    CachedFunctionStats stats;
+} FunctionEntryHeader;
+
+// Numbers the names, temporaries and labels of one function in order of
+// first appearance. A number is only valid where its stamp is the current
+// function, so the maps are allocated once and not cleared in between.
+typedef struct LocalNumbers
+{
+    int stamp;
+    int *names;
+    int *nameStamps;
+    int nameCount;
+    int *temps;
+    int *tempStamps;
+    int tempCount;
+    int *labels;
+    int *labelStamps;
+    int labelCount;
+} LocalNumbers;
+
+static int *allocateInts(int count)
+{
+    int *ints = (int *)trackedCalloc((size_t)count + 1, sizeof(int));
+    if (!ints)
+    {
+        fprintf(stderr, "cache: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ints;
+}
+
+static void initLocalNumbers(LocalNumbers *numbers, TACList *list)
+{
+    numbers->stamp = 0;
+    numbers->names = allocateInts(list->names.count);
+    numbers->nameStamps = allocateInts(list->names.count);
+    numbers->temps = allocateInts(list->tempCount);
+    numbers->tempStamps = allocateInts(list->tempCount);
+    numbers->labels = allocateInts(list->labelCount);
+    numbers->labelStamps = allocateInts(list->labelCount);
+}
+
+static void freeLocalNumbers(LocalNumbers *numbers)
+{
+    trackedFree(numbers->names);
+    trackedFree(numbers->nameStamps);
+    trackedFree(numbers->temps);
+    trackedFree(numbers->tempStamps);
+    trackedFree(numbers->labels);
+    trackedFree(numbers->labelStamps);
+}
+
+static void beginLocalNumbers(LocalNumbers *numbers)
+{
+    numbers->stamp++;
+    numbers->nameCount = 0;
+    numbers->tempCount = 0;
+    numbers->labelCount = 0;
+}
+
+static int localNumber(int *map, int *stamps, int stamp, int value, int *count)
+{
+    if (stamps[value] != stamp)
+    {
+        stamps[value] = stamp;
+        map[value] = (*count)++;
+    }
+    return map[value];
+}
+
+static int localValue(LocalNumbers *numbers, Operand operand)
+{
+    switch (operand.kind)
+    {
+    case OPERAND_SYMBOL:
+        return localNumber(numbers->names, numbers->nameStamps, numbers->stamp, operand.value, &numbers->nameCount);
+    case OPERAND_TEMP:
+        return localNumber(numbers->temps, numbers->tempStamps, numbers->stamp, operand.value, &numbers->tempCount);
+    case OPERAND_LABEL:
+        return localNumber(numbers->labels, numbers->labelStamps, numbers->stamp, operand.value, &numbers->labelCount);
+    default:
+        return operand.value;
+    }
+}
+
+// Hashes the function's instructions, symbols by name and everything else
+// by local number, and then its length.
+static void hashFunction(uint64_t hash[2], TACList *list, const TACFunction *function, LocalNumbers *numbers)
+{
+    beginLocalNumbers(numbers);
+    int32_t length = 0;
+    for (int i = function->head; i != TAC_END; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        Operand operands[3] = {tac->arg1, tac->arg2, tac->result};
+        int32_t op = tac->op;
+        hashBytes(hash, (const char *)&op, sizeof(op));
+        for (int j = 0; j < 3; j++)
+        {
+            int32_t fields[2] = {operands[j].kind, 0};
+            if (operands[j].kind == OPERAND_SYMBOL)
+            {
+                const char *name = internedString(&list->names, operands[j].value);
+                hashBytes(hash, (const char *)fields, sizeof(fields[0]));
+                hashBytes(hash, name, strlen(name) + 1);
+            }
+            else if (operands[j].kind != OPERAND_NONE)
+            {
+                fields[1] = localValue(numbers, operands[j]);
+                hashBytes(hash, (const char *)fields, sizeof(fields));
+            }
+            else
+            {
+                hashBytes(hash, (const char *)fields, sizeof(fields[0]));
+            }
+        }
+        length++;
+        if (i == function->tail)
+            break;
+    }
+    hashBytes(hash, (const char *)&length, sizeof(length));
+}
+
+// Names the entry for optimizing functions[f], which the list's current view
+// may hold: its code, then for each function it calls, in order of first
+// call, that function's code and how many calls the program makes to it.
+void computeFunctionKey(CacheKey *key, const char *settings, TACList *list, TACFunction *functions, int count, int f)
+{
+    pthread_once(&buildHashOnce, hashBuild);
+    uint64_t hash[2] = {0xcbf29ce484222325ull, 0x2545f4914f6cdd1dull};
+    hashBytes(hash, (const char *)buildHash, sizeof(buildHash));
+    hashBytes(hash, settings, strlen(settings) + 1);
+    hashBytes(hash, FUNCTION_ENTRY_MAGIC, sizeof(FUNCTION_ENTRY_MAGIC)); // Never the key of a whole file
+
+    // functionOf is the function's index, or 0 for a name that is none; the
+    // program body is never called
+    int *functionOf = allocateInts(list->names.count);
+    int *calls = allocateInts(count);
+    int *seen = allocateInts(count);
+    for (int g = 1; g < count; g++)
+        functionOf[functions[g].name] = g;
+    for (int g = 0; g < count; g++)
+    {
+        for (int i = functions[g].head; i != TAC_END; i = list->code[i].next)
+        {
+            if (list->code[i].op == TAC_CALL)
+                calls[functionOf[list->code[i].arg1.value]]++;
+            if (i == functions[g].tail)
+                break;
+        }
+    }
+
+    LocalNumbers numbers;
+    initLocalNumbers(&numbers, list);
+    hashFunction(hash, list, &functions[f], &numbers);
+    for (int i = functions[f].head; i != TAC_END; i = list->code[i].next)
+    {
+        int callee = list->code[i].op == TAC_CALL ? functionOf[list->code[i].arg1.value] : 0;
+        if (callee > 0 && callee != f && !seen[callee])
+        {
+            seen[callee] = 1;
+            int32_t calleeCalls = calls[callee];
+            hashFunction(hash, list, &functions[callee], &numbers);
+            hashBytes(hash, (const char *)&calleeCalls, sizeof(calleeCalls));
+        }
+        if (i == functions[f].tail)
+            break;
+    }
+    freeLocalNumbers(&numbers);
+    trackedFree(functionOf);
+    trackedFree(calls);
+    trackedFree(seen);
+
+    snprintf(key->hex, sizeof(key->hex), "%016llx%016llx", (unsigned long long)hash[0],
+             (unsigned long long)hash[1]);
+}
+
+static bool validRecord(const FunctionEntryHeader *header, const TACRecord *record)
+{
+    uint8_t kinds[3] = {record->arg1Kind, record->arg2Kind, record->resultKind};
+    int32_t values[3] = {record->arg1, record->arg2, record->result};
+    if (record->op >= TAC_OPCODE_COUNT)
+        return false;
+    for (int j = 0; j < 3; j++)
+    {
+        uint32_t limit;
+        switch (kinds[j])
+        {
+        case OPERAND_NONE:
+        case OPERAND_CONST:
+            continue;
+        case OPERAND_SYMBOL:
+            limit = header->nameCount;
+            break;
+        case OPERAND_TEMP:
+            limit = header->tempCount;
+            break;
+        case OPERAND_LABEL:
+            limit = header->labelCount;
+            break;
+        default:
+            return false;
+        }
+        if (values[j] < 0 || (uint32_t)values[j] >= limit)
+            return false;
+    }
+    return true;
+}
+
+// Replaces the list's current view, the function the key was computed for,
+// with the entry's code under fresh temporaries and labels. Leaves the list
+// alone if there is no entry or it does not check out.
+bool fetchFunctionEntry(const char *directory, const CacheKey *key, TACList *list, CachedFunctionStats *stats)
+{
+    char path[PATH_MAX];
+    entryPath(path, directory, key->hex, ".fn");
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    struct stat info;
+    char *data = NULL;
+    size_t size = 0;
+    if (fstat(fileno(file), &info) == 0 && (size_t)info.st_size >= sizeof(FunctionEntryHeader))
+    {
+        size = (size_t)info.st_size;
+        data = (char *)trackedMalloc(size);
+        if (data && fread(data, 1, size, file) != size)
+        {
+            trackedFree(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    if (!data)
+        return false;
+
+    // Check the whole entry before touching the list
+    FunctionEntryHeader header;
+    memcpy(&header, data, sizeof(header));
+    size_t offset = sizeof(header);
+    bool valid = memcmp(header.magic, FUNCTION_ENTRY_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.nameCount <= size && header.instructionCount <= size;
+    size_t *nameOffsets = valid ? (size_t *)trackedMalloc(sizeof(size_t) * (header.nameCount + 1)) : NULL;
+    valid = valid && nameOffsets;
+    for (uint32_t n = 0; valid && n < header.nameCount; n++)
+    {
+        uint32_t length;
+        valid = size - offset >= sizeof(length);
+        if (!valid)
+            break;
+        memcpy(&length, data + offset, sizeof(length));
+        nameOffsets[n] = offset;
+        offset += sizeof(length);
+        valid = size - offset >= length;
+        offset += length;
+    }
+    valid = valid && size - offset == (size_t)header.instructionCount * sizeof(TACRecord);
+    TACRecord *records = valid ? (TACRecord *)trackedMalloc(sizeof(TACRecord) * (header.instructionCount + 1)) : NULL;
+    valid = valid && records;
+    if (valid)
+        memcpy(records, data + offset, (size_t)header.instructionCount * sizeof(TACRecord));
+    for (uint32_t i = 0; valid && i < header.instructionCount; i++)
+        valid = validRecord(&header, &records[i]);
+    if (!valid)
+    {
+        TRACE(TRACE_DRIVER, TRACE_INFO, "Cache entry %s.fn is damaged, ignored\n", key->hex);
+        trackedFree(nameOffsets);
+        trackedFree(records);
+        trackedFree(data);
+        return false;
+    }
+
+    int *names = allocateInts(header.nameCount);
+    for (uint32_t n = 0; n < header.nameCount; n++)
+    {
+        uint32_t length;
+        memcpy(&length, data + nameOffsets[n], sizeof(length));
+        names[n] = internStringLength(&list->names, data + nameOffsets[n] + sizeof(length), length);
+    }
+    int firstTemp = list->tempCount;
+    int firstLabel = list->labelCount;
+    list->tempCount += (int)header.tempCount;
+    list->labelCount += (int)header.labelCount;
+
+    list->head = list->tail = TAC_END;
+    for (uint32_t i = 0; i < header.instructionCount; i++)
+    {
+        uint8_t kinds[3] = {records[i].arg1Kind, records[i].arg2Kind, records[i].resultKind};
+        int32_t values[3] = {records[i].arg1, records[i].arg2, records[i].result};
+        Operand operands[3];
+        for (int j = 0; j < 3; j++)
+        {
+            operands[j] = (Operand){(OperandKind)kinds[j], values[j]};
+            if (kinds[j] == OPERAND_SYMBOL)
+                operands[j].value = names[values[j]];
+            else if (kinds[j] == OPERAND_TEMP)
+                operands[j].value += firstTemp;
+            else if (kinds[j] == OPERAND_LABEL)
+                operands[j].value += firstLabel;
+        }
+        appendTAC(list, &(TAC){(TACOpcode)records[i].op, operands[0], operands[1], operands[2], TAC_END});
+    }
+    *stats = header.stats;
+
+    trackedFree(names);
+    trackedFree(nameOffsets);
+    trackedFree(records);
+    trackedFree(data);
+    utimensat(AT_FDCWD, path, NULL, 0);
+    TRACE(TRACE_DRIVER, TRACE_DEBUG, "Cache hit %s for a function\n", key->hex);
+    return true;
+}
+
+// Adds the list's current view, one optimized function, to the cache.
+bool storeFunctionEntry(const char *directory, const CacheKey *key, TACList *list, const CachedFunctionStats *stats)
+{
+    if (!makeDirectory(directory))
+        return false;
+
+    int length = tacLength(list);
+    TACRecord *records = (TACRecord *)trackedMalloc(sizeof(TACRecord) * (length + 1));
+    int *nameIds = allocateInts(length * 3); // Local number -> name id
+    if (!records)
+    {
+        fprintf(stderr, "cache: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    LocalNumbers numbers;
+    initLocalNumbers(&numbers, list);
+    beginLocalNumbers(&numbers);
+    int count = 0;
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        Operand operands[3] = {tac->arg1, tac->arg2, tac->result};
+        int32_t values[3];
+        for (int j = 0; j < 3; j++)
+        {
+            int names = numbers.nameCount;
+            values[j] = operands[j].kind == OPERAND_NONE ? 0 : localValue(&numbers, operands[j]);
+            if (numbers.nameCount > names)
+                nameIds[values[j]] = operands[j].value;
+        }
+        records[count++] = (TACRecord){(uint8_t)tac->op, (uint8_t)tac->arg1.kind, (uint8_t)tac->arg2.kind,
+                                       (uint8_t)tac->result.kind, values[0], values[1], values[2]};
+    }
+
+    FunctionEntryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FUNCTION_ENTRY_MAGIC, sizeof(header.magic));
+    header.instructionCount = (uint32_t)count;
+    header.nameCount = (uint32_t)numbers.nameCount;
+    header.tempCount = (uint32_t)numbers.tempCount;
+    header.labelCount = (uint32_t)numbers.labelCount;
+    header.stats = *stats;
+
+    char temporary[PATH_MAX];
+    char path[PATH_MAX];
+    bool stored = false;
+    FILE *file = openTemporary(temporary, directory, key->hex, ".fn");
+    if (file)
+    {
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (int n = 0; written && n < numbers.nameCount; n++)
+        {
+            const char *name = internedString(&list->names, nameIds[n]);
+            uint32_t nameLength = (uint32_t)strlen(name);
+            written = fwrite(&nameLength, sizeof(nameLength), 1, file) == 1 &&
+                      fwrite(name, 1, nameLength, file) == nameLength;
+        }
+        written = written && fwrite(records, sizeof(TACRecord), (size_t)count, file) == (size_t)count;
+        entryPath(path, directory, key->hex, ".fn");
+        stored = commitTemporary(file, written, temporary, path);
+    }
+
+    freeLocalNumbers(&numbers);
+    trackedFree(nameIds);
+    trackedFree(records);
+    return stored;
+}
+
+typedef struct CacheEntry
+{
+    char key[CACHE_KEY_LENGTH + 1];
+    const char *extension; // ".s" for a file's outputs, ".fn" for a function
+    size_t bytes;
+    struct timespec used;  // Modification time of the assembly or function
+} CacheEntry;
+
+// The extension of the file that stands for a whole entry, or NULL if name
+// is not one
+static const char *entryExtension(const char *name)
+{
+    static const char *extensions[] = {".s", ".fn"};
+    if (strlen(name) <= CACHE_KEY_LENGTH)
+        return NULL;
+    for (int i = 0; i < CACHE_KEY_LENGTH; i++)
+    {
+        if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f')))
+            return NULL;
+    }
+    for (size_t e = 0; e < sizeof(extensions) / sizeof(extensions[0]); e++)
+    {
+        if (strcmp(name + CACHE_KEY_LENGTH, extensions[e]) == 0)
+            return extensions[e];
+    }
+    return NULL;
+}
+
+static int compareUse(const void *a, const void *b)
+{
+    const struct timespec *x = &((const CacheEntry *)a)->used;
+    const struct timespec *y = &((const CacheEntry *)b)->used;
+    if (x->tv_sec != y->tv_sec)
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+// Evicts the least recently used entries, file and function entries alike,
+// until the directory holds at most limit bytes. Returns the number of
+// entries evicted.
+int trimCache(const char *directory, size_t limit)
+{
+    DIR *dir = opendir(directory);
+    if (!dir)
+        return 0;
+
+    CacheEntry *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    size_t total = 0;
+    char path[PATH_MAX];
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        const char *extension = entryExtension(dirent->d_name);
+        if (!extension)
+            continue;
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            entries = (CacheEntry *)trackedRealloc(entries, sizeof(CacheEntry) * capacity);
+            if (!entries)
+            {
+                fprintf(stderr, "trimCache: Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        CacheEntry *entry = &entries[count];
+        memcpy(entry->key, dirent->d_name, CACHE_KEY_LENGTH);
+        entry->key[CACHE_KEY_LENGTH] = '\0';
+        entry->extension = extension;
+        struct stat info;
+        entryPath(path, directory, entry->key, extension);
+        if (stat(path, &info) != 0)
+            continue;
+        entry->bytes = (size_t)info.st_size;
+        entry->used = info.st_mtim;
+        if (strcmp(extension, ".s") == 0)
+        {
+            entryPath(path, directory, entry->key, ".ir");
+            if (stat(path, &info) == 0)
+                entry->bytes += (size_t)info.st_size;
+            entryPath(path, directory, entry->key, ".opt.ir");
+            if (stat(path, &info) == 0)
+                entry->bytes += (size_t)info.st_size;
+        }
+        total += entry->bytes;
+        count++;
+    }
+    closedir(dir);
+
+    if (count > 1)
+        qsort(entries, count, sizeof(CacheEntry), compareUse);
+    int evicted = 0;
+    for (int i = 0; i < count && total > limit; i++)
+    {
+        entryPath(path, directory, entries[i].key, entries[i].extension);
+        unlink(path);
+        if (strcmp(entries[i].extension, ".s") == 0)
+        {
+            entryPath(path, directory, entries[i].key, ".ir");
+            unlink(path);
+            entryPath(path, directory, entries[i].key, ".opt.ir");
+            unlink(path);
+        }
+        total -= entries[i].bytes;
+        evicted++;
+    }
+    trackedFree(entries);
+    if (evicted)
+        TRACE(TRACE_DRIVER, TRACE_INFO, "Evicted %d cache entries from %s\n", evicted, directory);
+    return evicted;
+}
+
+const char *cacheResultName(CacheResult result)
+{
+    switch (result)
+    {
+    case CACHE_HIT:
+        return "hit";
+    case CACHE_MISS:
+        return "miss";
+    default:
+        return "off";
+    }
+}
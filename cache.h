@@ -0,0 +1,71 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "tac.h"
+#include "inline.h"
+#include "bounds.h"
+#include "loop.h"
+
+// On-disk compilation cache. An entry is named by a hash of the input bytes,
+// the compiler version and executable, and the optimization settings, and
+// holds the assembly (<key>.s), the optimized TAC (<key>.opt.ir) and, once an
+// -ir compilation has stored it, the unoptimized TAC (<key>.ir). Entries are
+// written to a temporary file and renamed into place, so any number of
+// compilations can share a directory.
+//
+// A compilation that misses still reuses what it can function by function.
+// A function entry (<key>.fn) holds one function's optimized TAC. Its key
+// covers everything optimizing the function reads: its own TAC, and the TAC
+// and call count of each function it calls, since those decide what the
+// inliner copies in. Temporaries and labels are numbered within the
+// function, so the entry fits wherever the function lands in the list.
+
+#define CACHE_KEY_LENGTH 32 // Hex digits
+#define CACHE_DEFAULT_LIMIT (64 * 1024 * 1024)
+
+typedef enum
+{
+    CACHE_OFF,
+    CACHE_HIT,
+    CACHE_MISS
+} CacheResult;
+
+typedef struct CacheKey
+{
+    char hex[CACHE_KEY_LENGTH + 1];
+} CacheKey;
+
+// Per-function caching for one compilation. The optimizer counts the
+// functions it takes from the cache and the ones it optimizes and stores.
+typedef struct FunctionCache
+{
+    const char *directory; // NULL to optimize every function
+    const char *settings;  // As passed to computeCacheKey
+    int hits;
+    int misses;
+} FunctionCache;
+
+// What optimizing one function adds to the compilation's counts. It is
+// kept in the entry, so a hit reports the same figures.
+typedef struct CachedFunctionStats
+{
+    InlineStats inlining;
+    BoundsStats bounds;
+    LoopStats loops;
+} CachedFunctionStats;
+
+void computeCacheKey(CacheKey *key, const char *input, size_t size, const char *settings);
+void computeFunctionKey(CacheKey *key, const char *settings, TACList *list, TACFunction *functions, int count,
+                        int f);
+bool fetchFunctionEntry(const char *directory, const CacheKey *key, TACList *list, CachedFunctionStats *stats);
+bool storeFunctionEntry(const char *directory, const CacheKey *key, TACList *list, const CachedFunctionStats *stats);
+bool fetchCacheEntry(const char *directory, const CacheKey *key, const char *outputFilename,
+                     const char *tacFilename, const char *optimizedFilename);
+bool storeCacheEntry(const char *directory, const CacheKey *key, const char *outputFilename,
+                     const char *tacFilename, TACList *optimized);
+int trimCache(const char *directory, size_t limit);
+const char *cacheResultName(CacheResult result);
+
+#endif // CACHE_H
@@ -0,0 +1,243 @@
+#include "cfg.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void *allocateOrDie(size_t size)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "buildCFG: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static bool endsBlock(TAC *tac)
+{
+    return tac->op == TAC_GOTO || tac->op == TAC_IF_FALSE || tac->op == TAC_RETURN;
+}
+
+// The label a block-ending instruction jumps to, or -1 for a return.
+static int jumpTarget(TAC *tac)
+{
+    if (tac->op == TAC_RETURN)
+        return -1;
+    return tac->op == TAC_GOTO ? tac->arg1.value : tac->arg2.value;
+}
+
+// Control never falls out of a block ending in a goto or a return, nor into
+// the start of a function.
+static bool fallsThrough(TACList *code, TAC *last, int next)
+{
+    if (last->op == TAC_GOTO || last->op == TAC_RETURN)
+        return false;
+    return code->code[next].op != TAC_FUNCTION;
+}
+
+// Fills cfg->order with a reverse postorder from the entry block, followed by
+// any blocks that cannot be reached.
+static void computeOrder(CFG *cfg)
+{
+    int n = cfg->blockCount;
+    int *stack = (int *)allocateOrDie(sizeof(int) * n);
+    int *nextSucc = (int *)allocateOrDie(sizeof(int) * n);
+    char *visited = (char *)trackedCalloc(n ? n : 1, 1);
+    int *postorder = (int *)allocateOrDie(sizeof(int) * n);
+    int postCount = 0;
+
+    if (n > 0)
+    {
+        int top = 0;
+        stack[top++] = 0;
+        visited[0] = 1;
+        nextSucc[0] = 0;
+
+        while (top > 0)
+        {
+            int b = stack[top - 1];
+            if (nextSucc[b] < cfg->blocks[b].succCount)
+            {
+                int s = cfg->blocks[b].succs[nextSucc[b]++];
+                if (!visited[s])
+                {
+                    visited[s] = 1;
+                    nextSucc[s] = 0;
+                    stack[top++] = s;
+                }
+            }
+            else
+            {
+                postorder[postCount++] = b;
+                top--;
+            }
+        }
+    }
+
+    int k = 0;
+    for (int i = postCount - 1; i >= 0; i--)
+        cfg->order[k++] = postorder[i];
+    for (int b = 0; b < n; b++)
+    {
+        if (!visited[b])
+            cfg->order[k++] = b;
+    }
+
+    trackedFree(stack);
+    trackedFree(nextSucc);
+    trackedFree(visited);
+    trackedFree(postorder);
+}
+
+void buildCFG(CFG *cfg, TACList *code)
+{
+    cfg->code = code;
+    cfg->blockCount = 0;
+    cfg->blockOf = (int *)allocateOrDie(sizeof(int) * code->count);
+    for (int i = 0; i < code->count; i++)
+        cfg->blockOf[i] = -1;
+
+    // Pass 1: find leaders, number the blocks and map labels to blocks
+    int maxLabel = -1;
+    int capacity = 16;
+    cfg->blocks = (BasicBlock *)allocateOrDie(sizeof(BasicBlock) * capacity);
+
+    bool startNew = true;
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+    {
+        TAC *tac = &code->code[i];
+        if (tac->op == TAC_FUNCTION)
+            startNew = true;
+        if (tac->op == TAC_LABEL)
+        {
+            startNew = true;
+            if (tac->arg1.value > maxLabel)
+                maxLabel = tac->arg1.value;
+        }
+
+        if (startNew)
+        {
+            if (cfg->blockCount == capacity)
+            {
+                capacity *= 2;
+                cfg->blocks = (BasicBlock *)trackedRealloc(cfg->blocks, sizeof(BasicBlock) * capacity);
+                if (!cfg->blocks)
+                {
+                    fprintf(stderr, "buildCFG: Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            BasicBlock *block = &cfg->blocks[cfg->blockCount++];
+            block->first = i;
+            block->succCount = 0;
+            block->predCount = 0;
+            block->preds = NULL;
+            startNew = false;
+        }
+
+        cfg->blocks[cfg->blockCount - 1].last = i;
+        cfg->blockOf[i] = cfg->blockCount - 1;
+        startNew = endsBlock(tac);
+    }
+
+    int *labelBlock = (int *)allocateOrDie(sizeof(int) * (maxLabel + 1));
+    for (int l = 0; l <= maxLabel; l++)
+        labelBlock[l] = -1;
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        TAC *first = &code->code[cfg->blocks[b].first];
+        if (first->op == TAC_LABEL)
+            labelBlock[first->arg1.value] = b;
+    }
+
+    // Pass 2: successor edges
+    int edgeCount = 0;
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        TAC *last = &code->code[block->last];
+
+        if (endsBlock(last))
+        {
+            int target = jumpTarget(last);
+            if (target >= 0 && target <= maxLabel && labelBlock[target] >= 0)
+                block->succs[block->succCount++] = labelBlock[target];
+        }
+        if (b + 1 < cfg->blockCount && fallsThrough(code, last, cfg->blocks[b + 1].first))
+        {
+            if (block->succCount == 0 || block->succs[0] != b + 1)
+                block->succs[block->succCount++] = b + 1;
+        }
+        edgeCount += block->succCount;
+    }
+
+    // Pass 3: predecessor lists, stored back to back
+    cfg->predStorage = (int *)allocateOrDie(sizeof(int) * edgeCount);
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        for (int s = 0; s < cfg->blocks[b].succCount; s++)
+            cfg->blocks[cfg->blocks[b].succs[s]].predCount++;
+    }
+    int offset = 0;
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        cfg->blocks[b].preds = cfg->predStorage + offset;
+        offset += cfg->blocks[b].predCount;
+        cfg->blocks[b].predCount = 0;
+    }
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        for (int s = 0; s < cfg->blocks[b].succCount; s++)
+        {
+            BasicBlock *succ = &cfg->blocks[cfg->blocks[b].succs[s]];
+            succ->preds[succ->predCount++] = b;
+        }
+    }
+
+    cfg->order = (int *)allocateOrDie(sizeof(int) * cfg->blockCount);
+    computeOrder(cfg);
+
+    trackedFree(labelBlock);
+}
+
+// True if edge k of block b is the one its final jump takes.
+bool isJumpEdge(CFG *cfg, int b, int k)
+{
+    BasicBlock *block = &cfg->blocks[b];
+    TAC *last = &cfg->code->code[block->last];
+    if (last->op == TAC_GOTO)
+        return true;
+    if (last->op != TAC_IF_FALSE)
+        return false;
+    TAC *first = &cfg->code->code[cfg->blocks[block->succs[k]].first];
+    return first->op == TAC_LABEL && first->arg1.value == last->arg2.value;
+}
+
+void freeCFG(CFG *cfg)
+{
+    trackedFree(cfg->blocks);
+    trackedFree(cfg->blockOf);
+    trackedFree(cfg->order);
+    trackedFree(cfg->predStorage);
+    cfg->blocks = NULL;
+    cfg->blockOf = NULL;
+    cfg->order = NULL;
+    cfg->predStorage = NULL;
+    cfg->blockCount = 0;
+}
+
+void printCFG(CFG *cfg)
+{
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        printf("B%d: instructions %d..%d, succs:", b, block->first, block->last);
+        for (int s = 0; s < block->succCount; s++)
+            printf(" B%d", block->succs[s]);
+        printf(", preds:");
+        for (int p = 0; p < block->predCount; p++)
+            printf(" B%d", block->preds[p]);
+        printf("\n");
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "tac.h"
+
+// Basic blocks and control-flow graph over a TACList. A block is a run of
+// instructions along the next links from first to last; it starts at the
+// head, at a label, at a function or after a jump or return, and ends before
+// the next leader.
+
+typedef struct BasicBlock
+{
+    int first; // Index of the first instruction
+    int last;  // Index of the last instruction
+    int succs[2];
+    int succCount;
+    int *preds; // Points into CFG.predStorage
+    int predCount;
+} BasicBlock;
+
+typedef struct CFG
+{
+    TACList *code;
+    BasicBlock *blocks; // blocks[0] is the entry block
+    int blockCount;
+    int *blockOf;     // Instruction index -> block, -1 for unlinked slots
+    int *order;       // Blocks in reverse postorder; unreachable blocks last
+    int *predStorage; // Predecessor lists of all blocks
+} CFG;
+
+// Steps to the instruction after i within block, or TAC_END after the last:
+// for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+static inline int blockNext(CFG *cfg, BasicBlock *block, int i)
+{
+    return i == block->last ? TAC_END : cfg->code->code[i].next;
+}
+
+void buildCFG(CFG *cfg, TACList *code);
+bool isJumpEdge(CFG *cfg, int b, int k);
+void freeCFG(CFG *cfg);
+void printCFG(CFG *cfg);
+
+#endif // CFG_H
@@ -1,146 +1,1244 @@
 
 #include "codeGenerator.h"
+#include "trace.h"
+#include "optimizer.h"
+#include "memtrack.h"
+#include "cfg.h"
+#include "dataflow.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
-static FILE *outputFile;
+static void *allocateOrDie(size_t size)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "generateMIPS: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Opens the output file and writes the data section. Returns false if the
+// file cannot be opened.
+bool initCodeGenerator(CodeGenerator *gen, const char *outputFilename, SymbolTable *symTab)
+{
+    gen->code = NULL;
+    gen->instructionCount = 0;
+    memset(&gen->peephole, 0, sizeof(gen->peephole));
+    gen->outputFile = fopen(outputFilename, "w");
+    if (gen->outputFile == NULL)
+    {
+        perror(outputFilename);
+        return false;
+    }
+    initEmitter(&gen->out, gen->outputFile, NULL, 0);
+    emitString(&gen->out, ".data\n");
+
+    for (int i = 0; i < symTab->count; i++)
+    {
+        if (symTab->symbols[i].isFunction)
+            continue; // A label in the text section
+        emitString(&gen->out, SOURCE_LABEL_PREFIX);
+        emitString(&gen->out, symTab->symbols[i].name); // Allocate space for each variable
+        if (symTab->symbols[i].isArray)
+        {
+            emitString(&gen->out, ": .space ");
+            emitInt(&gen->out, symTab->symbols[i].arraySize * 4);
+            emitChar(&gen->out, '\n');
+        }
+        else
+        {
+            emitString(&gen->out, ": .word 0\n");
+        }
+    }
+    emitString(&gen->out, "newline: .asciiz \"\\n\"\n"); // For newline in write operations
+    return true;
+}
+
+// Instruction builders. Each appends one instruction to the list; the
+// peephole pass and writeMipsList see to the rest.
+
+// op dst, imm
+static void emitImm(CodeGenerator *gen, MipsOpcode op, int dst, int imm)
+{
+    MipsInstruction *instr = appendMips(&gen->mips, op);
+    instr->dst = dst;
+    instr->imm = imm;
+}
+
+// lw/la reg, address or sw reg, address
+static void emitMemory(CodeGenerator *gen, MipsOpcode op, int reg, MipsAddress address)
+{
+    MipsInstruction *instr = appendMips(&gen->mips, op);
+    if (op == MIPS_SW)
+        instr->src1 = reg;
+    else
+        instr->dst = reg;
+    instr->address = address;
+}
+
+static MipsAddress symbolAddress(const char *symbol)
+{
+    return (MipsAddress){symbol, 0, MIPS_NO_REGISTER};
+}
+
+// The label of a global or function the TAC names by id
+static const char *symbolLabel(CodeGenerator *gen, int id)
+{
+    return internedString(&gen->labels, id);
+}
+
+static MipsAddress stackAddress(int offset)
+{
+    return (MipsAddress){NULL, offset, MIPS_SP};
+}
+
+// op dst, src1, src2; unused registers are MIPS_NO_REGISTER
+static void emitRegs(CodeGenerator *gen, MipsOpcode op, int dst, int src1, int src2)
+{
+    MipsInstruction *instr = appendMips(&gen->mips, op);
+    instr->dst = dst;
+    instr->src1 = src1;
+    instr->src2 = src2;
+}
+
+// op dst, src, imm
+static void emitRegImm(CodeGenerator *gen, MipsOpcode op, int dst, int src, int imm)
+{
+    MipsInstruction *instr = appendMips(&gen->mips, op);
+    instr->dst = dst;
+    instr->src1 = src;
+    instr->imm = imm;
+}
+
+// Loads or stores a spilled value at its memory home: its .data word for a
+// global, its stack slot for a temporary or a local. The slots sit above
+// the outgoing arguments.
+static void emitMemoryAccess(CodeGenerator *gen, MipsOpcode op, int reg, int value)
+{
+    if (value < gen->code->names.count && isGlobalSymbol(gen->code, value))
+        emitMemory(gen, op, reg, symbolAddress(symbolLabel(gen, value)));
+    else
+        emitMemory(gen, op, reg, stackAddress(gen->argumentBytes + gen->allocation.stackSlot[value] * 4));
+}
+
+static int locationOf(CodeGenerator *gen, Operand operand)
+{
+    return gen->allocation.location[tacValueIndex(gen->code, operand)];
+}
+
+// Returns the register an instruction should compute its result into.
+static int resultRegister(CodeGenerator *gen, Operand result)
+{
+    int location = locationOf(gen, result);
+    return location >= 0 ? registerNumber(location) : SCRATCH_REGISTER_1;
+}
+
+// Stores a computed result to memory if the result was spilled.
+static void storeResult(CodeGenerator *gen, Operand result, int reg)
+{
+    if (locationOf(gen, result) < 0)
+        emitMemoryAccess(gen, MIPS_SW, reg, tacValueIndex(gen->code, result));
+}
+
+// Instruction selection //
+//
+// Each TAC instruction that computes a value, and each array store, becomes
+// a small expression tree: the operation with its operands as leaves. A
+// temporary used only as an array index, and defined by adding a constant
+// shortly before, is folded in as a subtree so the load or store can absorb
+// the address arithmetic.
+// Trees are labeled bottom-up with the cheapest rule of selectionRules for
+// every nonterminal, as in BURS, and the winning cover is emitted top-down.
+// Costs count instructions.
+
+typedef enum
+{
+    NT_REG,      // Value in a register
+    NT_IMM16,    // Constant that fits a signed 16-bit immediate
+    NT_NEGIMM16, // Constant whose negation does
+    NT_SHAMT,    // Constant shift amount
+    NT_POW2,     // Constant power of two
+    NT_CONST,    // Any constant
+    NT_INDEX,    // Register plus constant, as an array index
+    NT_STMT,     // No value; done for its effect
+    NT_COUNT
+} Nonterminal;
+
+#define PATTERN_VALUE -1 // Leaf: variable or temporary
+#define PATTERN_CONST -2 // Leaf: constant
+#define PATTERN_CHAIN -3 // Another nonterminal of the same node
+
+#define COST_INFINITE (INT_MAX / 4)
+#define TREE_MAX_NODES 8
+
+typedef struct TreeNode
+{
+    int op;          // TAC opcode or PATTERN_VALUE/PATTERN_CONST
+    Operand operand; // Leaves, and the value a store stores
+    Operand array;   // Array loads and stores, pointer accesses and TAC_ADDRESS
+    int kidCount;
+    struct TreeNode *kids[2];
+    int cost[NT_COUNT];
+    int rule[NT_COUNT]; // Index into selectionRules, -1 if none matches
+} TreeNode;
+
+typedef struct Tree
+{
+    TreeNode nodes[TREE_MAX_NODES];
+    int count;
+} Tree;
+
+// What a rule produced: a register, a constant, or both for NT_INDEX
+typedef struct Selected
+{
+    int reg;
+    int value;
+} Selected;
+
+typedef struct SelectionRule
+{
+    Nonterminal lhs;
+    int pattern;         // TAC opcode or PATTERN_*
+    Nonterminal kids[2]; // For PATTERN_CHAIN, kids[0] is the nonterminal the node is converted from
+    int cost;
+    bool (*accepts)(CodeGenerator *gen, const TreeNode *node); // NULL accepts every match
+    Selected (*emit)(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction);
+    MipsOpcode instruction;
+} SelectionRule;
+
+static bool inRegister(CodeGenerator *gen, const TreeNode *node)
+{
+    return locationOf(gen, node->operand) >= 0;
+}
+
+static bool inMemory(CodeGenerator *gen, const TreeNode *node)
+{
+    return locationOf(gen, node->operand) < 0;
+}
+
+static bool isZero(CodeGenerator *gen, const TreeNode *node)
+{
+    return node->operand.value == 0;
+}
+
+static bool fitsImmediate(CodeGenerator *gen, const TreeNode *node)
+{
+    return node->operand.value >= -32768 && node->operand.value <= 32767;
+}
+
+static bool negationFitsImmediate(CodeGenerator *gen, const TreeNode *node)
+{
+    return node->operand.value >= -32767 && node->operand.value <= 32768;
+}
+
+static bool fitsUnsignedImmediate(CodeGenerator *gen, const TreeNode *node)
+{
+    return node->operand.value >= 0 && node->operand.value <= 65535;
+}
+
+static bool lowHalfZero(CodeGenerator *gen, const TreeNode *node)
+{
+    return (node->operand.value & 0xffff) == 0;
+}
+
+static bool isPowerOfTwo(CodeGenerator *gen, const TreeNode *node)
+{
+    int value = node->operand.value;
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+static bool rightIsZero(CodeGenerator *gen, const TreeNode *node)
+{
+    return node->kids[1]->op == PATTERN_CONST && node->kids[1]->operand.value == 0;
+}
+
+// x <= c can be x < c + 1
+static bool rightSuccessorFitsImmediate(CodeGenerator *gen, const TreeNode *node)
+{
+    return node->kids[1]->op == PATTERN_CONST && node->kids[1]->operand.value >= -32769 &&
+           node->kids[1]->operand.value <= 32766;
+}
+
+static Selected inReg(int reg)
+{
+    return (Selected){reg, 0};
+}
+
+static MipsAddress elementAddress(CodeGenerator *gen, const TreeNode *node, int index, int base)
+{
+    const char *array = symbolLabel(gen, node->array.value);
+    return (MipsAddress){array, (int)((unsigned)index * 4u), base};
+}
+
+// Rule actions. target is the register the rule should compute into when
+// it needs one; it may return another register that already holds the value.
+
+static Selected selectRegister(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    return inReg(registerNumber(locationOf(gen, node->operand)));
+}
+
+static Selected selectLoad(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitMemoryAccess(gen, MIPS_LW, target, tacValueIndex(gen->code, node->operand));
+    return inReg(target);
+}
+
+static Selected selectZero(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    return inReg(MIPS_ZERO);
+}
+
+// li, ori or lui, whichever the rule's condition allowed
+static Selected selectImmediate(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    int value = node->operand.value;
+    if (instruction == MIPS_ORI)
+        emitRegImm(gen, MIPS_ORI, target, MIPS_ZERO, value);
+    else if (instruction == MIPS_LUI)
+        emitImm(gen, MIPS_LUI, target, (int)((unsigned)value >> 16));
+    else
+        emitImm(gen, MIPS_LI, target, value);
+    return inReg(target);
+}
+
+static Selected selectWideConstant(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    unsigned value = (unsigned)node->operand.value;
+    emitImm(gen, MIPS_LUI, target, (int)(value >> 16));
+    emitRegImm(gen, MIPS_ORI, target, target, (int)(value & 0xffff));
+    return inReg(target);
+}
+
+static Selected selectConstant(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    return (Selected){MIPS_NO_REGISTER, node->operand.value};
+}
+
+static Selected selectRegReg(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegs(gen, instruction, target, kids[0].reg, kids[1].reg);
+    return inReg(target);
+}
+
+// Shift amounts are taken mod 32, as the variable forms do
+static Selected selectRegImm(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    int imm = kids[1].value;
+    if (instruction == MIPS_SLL || instruction == MIPS_SRA || instruction == MIPS_SRL)
+        imm &= 31;
+    emitRegImm(gen, instruction, target, kids[0].reg, imm);
+    return inReg(target);
+}
+
+static Selected selectImmReg(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegImm(gen, instruction, target, kids[1].reg, kids[0].value);
+    return inReg(target);
+}
+
+// x - c as x + -c
+static Selected selectRegNegatedImm(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegImm(gen, instruction, target, kids[0].reg, -kids[1].value);
+    return inReg(target);
+}
+
+// x * 2^k as x << k
+static Selected selectRegLog2(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegImm(gen, instruction, target, kids[0].reg, __builtin_ctz(kids[1].value));
+    return inReg(target);
+}
+
+static Selected selectLog2Reg(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegImm(gen, instruction, target, kids[1].reg, __builtin_ctz(kids[0].value));
+    return inReg(target);
+}
+
+static Selected selectDivide(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegs(gen, MIPS_DIV, MIPS_NO_REGISTER, kids[0].reg, kids[1].reg); // Quotient in lo
+    emitRegs(gen, MIPS_MFLO, target, MIPS_NO_REGISTER, MIPS_NO_REGISTER);
+    return inReg(target);
+}
+
+// x > y as y < x
+static Selected selectSwappedRegReg(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegs(gen, instruction, target, kids[1].reg, kids[0].reg);
+    return inReg(target);
+}
+
+// x >= y as not x < y, and x <= y as not y < x
+static Selected selectNotLess(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    if (node->op == TAC_LE)
+        emitRegs(gen, MIPS_SLT, target, kids[1].reg, kids[0].reg);
+    else if (instruction == MIPS_SLTI)
+        emitRegImm(gen, MIPS_SLTI, target, kids[0].reg, kids[1].value);
+    else
+        emitRegs(gen, MIPS_SLT, target, kids[0].reg, kids[1].reg);
+    emitRegImm(gen, MIPS_XORI, target, target, 1);
+    return inReg(target);
+}
+
+// x <= c as x < c + 1
+static Selected selectLessThanSuccessor(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegImm(gen, MIPS_SLTI, target, kids[0].reg, node->kids[1]->operand.value + 1);
+    return inReg(target);
+}
+
+// x == y as x - y < 1 unsigned, x != y as 0 < x - y unsigned. Against zero
+// the subtraction goes.
+static Selected selectEquality(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    int difference = kids[0].reg;
+    if (instruction == MIPS_ADDIU)
+        emitRegImm(gen, MIPS_ADDIU, target, kids[0].reg, -kids[1].value);
+    else if (instruction == MIPS_SUBU)
+        emitRegs(gen, MIPS_SUBU, target, kids[0].reg, kids[1].reg);
+    if (instruction != MIPS_NOP)
+        difference = target;
+    if (node->op == TAC_EQ)
+        emitRegImm(gen, MIPS_SLTIU, target, difference, 1);
+    else
+        emitRegs(gen, MIPS_SLTU, target, MIPS_ZERO, difference);
+    return inReg(target);
+}
+
+static Selected selectIndex(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    return kids[0];
+}
+
+static Selected selectIndexPlus(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    return (Selected){kids[0].reg, kids[1].value};
+}
+
+static Selected selectIndexPlusSwapped(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    return (Selected){kids[1].reg, kids[0].value};
+}
+
+static Selected selectIndexMinus(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    return (Selected){kids[0].reg, (int)(0u - (unsigned)kids[1].value)};
+}
+
+// arr[c]: the element's address is a constant
+static Selected selectElementAt(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitMemory(gen, MIPS_LW, target, elementAddress(gen, node, kids[0].value, MIPS_NO_REGISTER));
+    return inReg(target);
+}
+
+// arr[i + c]: scale i, and let the load add the array and the constant
+static Selected selectElement(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegImm(gen, MIPS_SLL, target, kids[0].reg, 2);
+    emitMemory(gen, MIPS_LW, target, elementAddress(gen, node, kids[0].value, target));
+    return inReg(target);
+}
+
+// &arr
+static Selected selectAddress(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitMemory(gen, MIPS_LA, target, symbolAddress(symbolLabel(gen, node->array.value)));
+    return inReg(target);
+}
+
+// *(p + c): the pointer already holds the element's address
+static Selected selectPointerLoad(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitMemory(gen, MIPS_LW, target, (MipsAddress){NULL, kids[0].value, kids[0].reg});
+    return inReg(target);
+}
+
+static int selectOperand(CodeGenerator *gen, Operand operand, int target);
+
+// arr[c] = x
+static Selected selectStoreAt(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    int value = selectOperand(gen, node->operand, SCRATCH_REGISTER_1);
+    emitMemory(gen, MIPS_SW, value, elementAddress(gen, node, kids[0].value, MIPS_NO_REGISTER));
+    return inReg(MIPS_NO_REGISTER);
+}
+
+// arr[i + c] = x: the scaled index is in the first scratch register, so the
+// value goes through the second
+static Selected selectStore(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    emitRegImm(gen, MIPS_SLL, SCRATCH_REGISTER_1, kids[0].reg, 2);
+    int value = selectOperand(gen, node->operand, SCRATCH_REGISTER_2);
+    emitMemory(gen, MIPS_SW, value, elementAddress(gen, node, kids[0].value, SCRATCH_REGISTER_1));
+    return inReg(MIPS_NO_REGISTER);
+}
+
+// *(p + c) = x
+static Selected selectPointerStore(CodeGenerator *gen, const TreeNode *node, const Selected *kids, int target, MipsOpcode instruction)
+{
+    int value = selectOperand(gen, node->operand, SCRATCH_REGISTER_2);
+    emitMemory(gen, MIPS_SW, value, (MipsAddress){NULL, kids[0].value, kids[0].reg});
+    return inReg(MIPS_NO_REGISTER);
+}
+
+// Addition and subtraction use the non-trapping forms so overflow wraps, as
+// the optimizer assumes. Constants that fit no immediate field cost a lui
+// and an ori first.
+static const SelectionRule selectionRules[] = {
+    {NT_REG, PATTERN_VALUE, {0}, 0, inRegister, selectRegister},
+    {NT_REG, PATTERN_VALUE, {0}, 1, inMemory, selectLoad},
+    {NT_REG, PATTERN_CONST, {0}, 0, isZero, selectZero},
+    {NT_REG, PATTERN_CONST, {0}, 1, fitsImmediate, selectImmediate, MIPS_LI},
+    {NT_REG, PATTERN_CONST, {0}, 1, fitsUnsignedImmediate, selectImmediate, MIPS_ORI},
+    {NT_REG, PATTERN_CONST, {0}, 1, lowHalfZero, selectImmediate, MIPS_LUI},
+    {NT_REG, PATTERN_CONST, {0}, 2, NULL, selectWideConstant},
+    {NT_IMM16, PATTERN_CONST, {0}, 0, fitsImmediate, selectConstant},
+    {NT_NEGIMM16, PATTERN_CONST, {0}, 0, negationFitsImmediate, selectConstant},
+    {NT_SHAMT, PATTERN_CONST, {0}, 0, NULL, selectConstant},
+    {NT_POW2, PATTERN_CONST, {0}, 0, isPowerOfTwo, selectConstant},
+    {NT_CONST, PATTERN_CONST, {0}, 0, NULL, selectConstant},
+
+    {NT_REG, TAC_ADD, {NT_REG, NT_REG}, 1, NULL, selectRegReg, MIPS_ADDU},
+    {NT_REG, TAC_ADD, {NT_REG, NT_IMM16}, 1, NULL, selectRegImm, MIPS_ADDIU},
+    {NT_REG, TAC_ADD, {NT_IMM16, NT_REG}, 1, NULL, selectImmReg, MIPS_ADDIU},
+    {NT_REG, TAC_SUB, {NT_REG, NT_REG}, 1, NULL, selectRegReg, MIPS_SUBU},
+    {NT_REG, TAC_SUB, {NT_REG, NT_NEGIMM16}, 1, NULL, selectRegNegatedImm, MIPS_ADDIU},
+    {NT_REG, TAC_MUL, {NT_REG, NT_REG}, 1, NULL, selectRegReg, MIPS_MUL},
+    {NT_REG, TAC_MUL, {NT_REG, NT_POW2}, 1, NULL, selectRegLog2, MIPS_SLL},
+    {NT_REG, TAC_MUL, {NT_POW2, NT_REG}, 1, NULL, selectLog2Reg, MIPS_SLL},
+    {NT_REG, TAC_DIV, {NT_REG, NT_REG}, 2, NULL, selectDivide},
+    {NT_REG, TAC_SLL, {NT_REG, NT_REG}, 1, NULL, selectRegReg, MIPS_SLLV},
+    {NT_REG, TAC_SLL, {NT_REG, NT_SHAMT}, 1, NULL, selectRegImm, MIPS_SLL},
+    {NT_REG, TAC_SRA, {NT_REG, NT_REG}, 1, NULL, selectRegReg, MIPS_SRAV},
+    {NT_REG, TAC_SRA, {NT_REG, NT_SHAMT}, 1, NULL, selectRegImm, MIPS_SRA},
+    {NT_REG, TAC_SRL, {NT_REG, NT_REG}, 1, NULL, selectRegReg, MIPS_SRLV},
+    {NT_REG, TAC_SRL, {NT_REG, NT_SHAMT}, 1, NULL, selectRegImm, MIPS_SRL},
+    {NT_REG, TAC_LT, {NT_REG, NT_REG}, 1, NULL, selectRegReg, MIPS_SLT},
+    {NT_REG, TAC_LT, {NT_REG, NT_IMM16}, 1, NULL, selectRegImm, MIPS_SLTI},
+    {NT_REG, TAC_GT, {NT_REG, NT_REG}, 1, NULL, selectSwappedRegReg, MIPS_SLT},
+    {NT_REG, TAC_GE, {NT_REG, NT_REG}, 2, NULL, selectNotLess, MIPS_SLT},
+    {NT_REG, TAC_GE, {NT_REG, NT_IMM16}, 2, NULL, selectNotLess, MIPS_SLTI},
+    {NT_REG, TAC_LE, {NT_REG, NT_REG}, 2, NULL, selectNotLess, MIPS_SLT},
+    {NT_REG, TAC_LE, {NT_REG, NT_CONST}, 1, rightSuccessorFitsImmediate, selectLessThanSuccessor},
+    {NT_REG, TAC_EQ, {NT_REG, NT_REG}, 2, NULL, selectEquality, MIPS_SUBU},
+    {NT_REG, TAC_EQ, {NT_REG, NT_NEGIMM16}, 2, NULL, selectEquality, MIPS_ADDIU},
+    {NT_REG, TAC_EQ, {NT_REG, NT_CONST}, 1, rightIsZero, selectEquality, MIPS_NOP},
+    {NT_REG, TAC_NE, {NT_REG, NT_REG}, 2, NULL, selectEquality, MIPS_SUBU},
+    {NT_REG, TAC_NE, {NT_REG, NT_NEGIMM16}, 2, NULL, selectEquality, MIPS_ADDIU},
+    {NT_REG, TAC_NE, {NT_REG, NT_CONST}, 1, rightIsZero, selectEquality, MIPS_NOP},
 
-typedef struct
+    {NT_INDEX, PATTERN_CHAIN, {NT_REG}, 0, NULL, selectIndex},
+    {NT_INDEX, TAC_ADD, {NT_REG, NT_CONST}, 0, NULL, selectIndexPlus},
+    {NT_INDEX, TAC_ADD, {NT_CONST, NT_REG}, 0, NULL, selectIndexPlusSwapped},
+    {NT_INDEX, TAC_SUB, {NT_REG, NT_CONST}, 0, NULL, selectIndexMinus},
+    {NT_REG, TAC_ARRAY_LOAD, {NT_CONST}, 1, NULL, selectElementAt},
+    {NT_REG, TAC_ARRAY_LOAD, {NT_INDEX}, 2, NULL, selectElement},
+    {NT_STMT, TAC_ARRAY_STORE, {NT_CONST}, 1, NULL, selectStoreAt},
+    {NT_STMT, TAC_ARRAY_STORE, {NT_INDEX}, 2, NULL, selectStore},
+    {NT_REG, TAC_ADDRESS, {0}, 1, NULL, selectAddress},
+    {NT_REG, TAC_POINTER_LOAD, {NT_INDEX}, 1, NULL, selectPointerLoad},
+    {NT_STMT, TAC_POINTER_STORE, {NT_INDEX}, 1, NULL, selectPointerStore},
+};
+
+#define SELECTION_RULE_COUNT ((int)(sizeof(selectionRules) / sizeof(selectionRules[0])))
+
+static TreeNode *newTreeNode(Tree *tree, int op)
+{
+    TreeNode *node = &tree->nodes[tree->count++];
+    node->op = op;
+    node->kidCount = 0;
+    node->kids[0] = node->kids[1] = NULL;
+    return node;
+}
+
+static TreeNode *leafNode(Tree *tree, Operand operand)
+{
+    TreeNode *node = newTreeNode(tree, operand.kind == OPERAND_CONST ? PATTERN_CONST : PATTERN_VALUE);
+    node->operand = operand;
+    return node;
+}
+
+static bool isStore(TACOpcode op)
+{
+    return op == TAC_ARRAY_STORE || op == TAC_POINTER_STORE;
+}
+
+static bool isMemoryAccess(TACOpcode op)
+{
+    return op == TAC_ARRAY_LOAD || op == TAC_POINTER_LOAD || isStore(op);
+}
+
+// The tree of the value TAC instruction index computes, or of the store
+static TreeNode *buildTree(CodeGenerator *gen, Tree *tree, int index)
 {
-    char *name;
-    bool inUse;
-} MIPSRegister;
+    TAC *tac = &gen->code->code[index];
+    if (tac->op == TAC_ASSIGN || tac->op == TAC_LI)
+        return leafNode(tree, tac->arg1);
 
-MIPSRegister tempRegisters[NUM_TEMP_REGISTERS] = {
-    {"$t0", false}, {"$t1", false}, {"$t2", false}, {"$t3", false}, {"$t4", false}, {"$t5", false}, {"$t6", false}, {"$t7", false}, {"$t8", false}, {"$t9", false}};
+    TreeNode *node = newTreeNode(tree, tac->op);
+    if (tac->op == TAC_ADDRESS)
+    {
+        node->array = tac->arg1;
+    }
+    else if (isMemoryAccess(tac->op))
+    {
+        node->array = isStore(tac->op) ? tac->result : tac->arg1;
+        node->operand = tac->arg1;
+        node->kidCount = 1;
+        int folded = gen->foldedIndex[index];
+        node->kids[0] = folded >= 0 ? buildTree(gen, tree, folded) : leafNode(tree, tac->arg2);
+    }
+    else
+    {
+        node->kidCount = 2;
+        node->kids[0] = leafNode(tree, tac->arg1);
+        node->kids[1] = leafNode(tree, tac->arg2);
+    }
+    return node;
+}
 
-void initCodeGenerator(const char *outputFilename, SymbolTable *symTab)
+// Finds the cheapest rule for each nonterminal of node, kids first
+static void labelTree(CodeGenerator *gen, TreeNode *node)
 {
-    outputFile = fopen(outputFilename, "w");
-    if (outputFile == NULL)
+    for (int k = 0; k < node->kidCount; k++)
+        labelTree(gen, node->kids[k]);
+
+    for (int nt = 0; nt < NT_COUNT; nt++)
     {
-        perror("Failed to open output file");
-        exit(EXIT_FAILURE);
+        node->cost[nt] = COST_INFINITE;
+        node->rule[nt] = -1;
     }
-    fprintf(outputFile, ".data\n");
 
-    for (int i = 0; i < symTab->size; i++)
+    for (int r = 0; r < SELECTION_RULE_COUNT; r++)
     {
-        for (Symbol *sym = symTab->table[i]; sym != NULL; sym = sym->next)
+        const SelectionRule *rule = &selectionRules[r];
+        if (rule->pattern != node->op || (rule->accepts && !rule->accepts(gen, node)))
+            continue;
+        int cost = rule->cost;
+        for (int k = 0; k < node->kidCount; k++)
+            cost += node->kids[k]->cost[rule->kids[k]];
+        if (cost < node->cost[rule->lhs])
         {
-            fprintf(outputFile, "%s: .word 0\n", sym->name); // Allocate space for each variable
+            node->cost[rule->lhs] = cost;
+            node->rule[rule->lhs] = r;
         }
     }
-    fprintf(outputFile, "newline: .asciiz \"\\n\"\n"); // For newline in write operations
+
+    for (int r = 0; r < SELECTION_RULE_COUNT; r++)
+    {
+        const SelectionRule *rule = &selectionRules[r];
+        if (rule->pattern != PATTERN_CHAIN)
+            continue;
+        int cost = rule->cost + node->cost[rule->kids[0]];
+        if (cost < node->cost[rule->lhs])
+        {
+            node->cost[rule->lhs] = cost;
+            node->rule[rule->lhs] = r;
+        }
+    }
+}
+
+// Emits the cover chosen for node as nt. Kids compute into the scratch
+// register of their position, as they would without a tree.
+static Selected emitTree(CodeGenerator *gen, const TreeNode *node, Nonterminal nt, int target)
+{
+    const SelectionRule *rule = &selectionRules[node->rule[nt]];
+    Selected kids[2];
+    if (rule->pattern == PATTERN_CHAIN)
+    {
+        kids[0] = emitTree(gen, node, rule->kids[0], target);
+    }
+    else
+    {
+        for (int k = 0; k < node->kidCount; k++)
+            kids[k] = emitTree(gen, node->kids[k], rule->kids[k], k == 0 ? SCRATCH_REGISTER_1 : SCRATCH_REGISTER_2);
+    }
+    return rule->emit(gen, node, kids, target, rule->instruction);
+}
+
+// Returns the register holding the operand, loading it into target if it
+// is a constant or spilled
+static int selectOperand(CodeGenerator *gen, Operand operand, int target)
+{
+    Tree tree = {.count = 0};
+    TreeNode *leaf = leafNode(&tree, operand);
+    labelTree(gen, leaf);
+    return emitTree(gen, leaf, NT_REG, target).reg;
+}
+
+// Computes the value of TAC instruction index into its result's home
+static void generateValue(CodeGenerator *gen, int index)
+{
+    TAC *current = &gen->code->code[index];
+    Tree tree = {.count = 0};
+    TreeNode *root = buildTree(gen, &tree, index);
+    labelTree(gen, root);
+
+    int dest = resultRegister(gen, current->result);
+    int reg = emitTree(gen, root, NT_REG, dest).reg;
+    if (locationOf(gen, current->result) < 0)
+        storeResult(gen, current->result, reg);
+    else if (reg != dest)
+        emitRegs(gen, MIPS_MOVE, dest, reg, MIPS_NO_REGISTER);
+}
+
+static void generateStore(CodeGenerator *gen, int index)
+{
+    Tree tree = {.count = 0};
+    TreeNode *root = buildTree(gen, &tree, index);
+    labelTree(gen, root);
+    emitTree(gen, root, NT_STMT, MIPS_NO_REGISTER);
+}
+
+// Stops the program unless 0 <= arg1 < arg2. Compared unsigned, a negative
+// index is larger than any size, so one test covers both ends.
+static void generateBoundsCheck(CodeGenerator *gen, TAC *current)
+{
+    int index = selectOperand(gen, current->arg1, SCRATCH_REGISTER_1);
+    int size = current->arg2.value;
+    if (size <= 32767)
+    {
+        emitRegImm(gen, MIPS_SLTIU, SCRATCH_REGISTER_1, index, size);
+    }
+    else
+    {
+        int limit = selectOperand(gen, current->arg2, SCRATCH_REGISTER_2);
+        emitRegs(gen, MIPS_SLTU, SCRATCH_REGISTER_1, index, limit);
+    }
+    MipsInstruction *branch = appendMips(&gen->mips, MIPS_BEQ);
+    branch->src1 = SCRATCH_REGISTER_1;
+    branch->src2 = MIPS_ZERO;
+    branch->imm = gen->boundsLabel;
+    gen->boundsUsed = true;
+}
+
+static void emitBranch(CodeGenerator *gen, MipsOpcode op, int src1, int src2, int label)
+{
+    MipsInstruction *branch = appendMips(&gen->mips, op);
+    branch->src1 = src1;
+    branch->src2 = src2;
+    branch->imm = label;
 }
 
-void generateMIPS(TAC *tacInstructions)
+// Branches to arg2 if arg1 is false. A comparison folded into the branch
+// is tested directly: x == y and x != y by bne and beq, the orderings by
+// one slt or slti and a branch on its result.
+static void generateBranch(CodeGenerator *gen, int index)
 {
-    TAC *current = tacInstructions;
+    TAC *current = &gen->code->code[index];
+    int label = current->arg2.value;
+    if (gen->foldedIndex[index] < 0)
+    {
+        int condition = selectOperand(gen, current->arg1, SCRATCH_REGISTER_1);
+        emitBranch(gen, MIPS_BEQ, condition, MIPS_ZERO, label);
+        return;
+    }
 
-    fprintf(outputFile, ".text\n.globl main\nmain:\n");
+    TAC *compare = &gen->code->code[gen->foldedIndex[index]];
+    int a = selectOperand(gen, compare->arg1, SCRATCH_REGISTER_1);
+    if (compare->op == TAC_EQ || compare->op == TAC_NE)
+    {
+        int b = selectOperand(gen, compare->arg2, SCRATCH_REGISTER_2);
+        emitBranch(gen, compare->op == TAC_EQ ? MIPS_BNE : MIPS_BEQ, a, b, label);
+        return;
+    }
 
-    while (current != NULL)
+    // a < b holds for LT and fails for GE; b < a holds for GT and fails for LE
+    bool swapped = compare->op == TAC_GT || compare->op == TAC_LE;
+    bool branchIfLess = compare->op == TAC_GE || compare->op == TAC_LE;
+    int c = compare->arg2.value;
+    if (isConstant(compare->arg2) && !swapped && c >= -32768 && c <= 32767)
     {
-        if (strcmp(current->op, "assign") == 0)
+        emitRegImm(gen, MIPS_SLTI, SCRATCH_REGISTER_1, a, c);
+    }
+    else if (isConstant(compare->arg2) && swapped && c >= -32769 && c <= 32766)
+    {
+        // b < a is not a < b + 1
+        emitRegImm(gen, MIPS_SLTI, SCRATCH_REGISTER_1, a, c + 1);
+        branchIfLess = !branchIfLess;
+    }
+    else
+    {
+        int b = selectOperand(gen, compare->arg2, SCRATCH_REGISTER_2);
+        emitRegs(gen, MIPS_SLT, SCRATCH_REGISTER_1, swapped ? b : a, swapped ? a : b);
+    }
+    emitBranch(gen, branchIfLess ? MIPS_BNE : MIPS_BEQ, SCRATCH_REGISTER_1, MIPS_ZERO, label);
+}
+
+// x + c or x - c with x a variable or temporary, which an array access can
+// take as its index whole
+static bool isFoldableIndex(TAC *tac)
+{
+    if (tac->op == TAC_ADD)
+        return isConstant(tac->arg1) != isConstant(tac->arg2);
+    return tac->op == TAC_SUB && !isConstant(tac->arg1) && isConstant(tac->arg2);
+}
+
+#define FOLD_WINDOW 8 // Instructions a folded definition may move past
+
+// Returns the position in instructions[0..at) of the definition of the
+// array index read at position at, if it can be folded into the load: it
+// is the only definition reaching the load, the load is the only use, and
+// nothing in between writes the variable it reads or the register holding
+// that variable. Returns -1 otherwise.
+static int foldableDefinition(CodeGenerator *gen, const int *instructions, int at, const BitSet *liveAfter)
+{
+    TACList *list = gen->code;
+    Operand index = list->code[instructions[at]].arg2;
+    if (index.kind != OPERAND_TEMP || bitsetTest(liveAfter, tacValueIndex(list, index)))
+        return -1;
+
+    int def = -1;
+    for (int k = at - 1; k >= 0 && k >= at - FOLD_WINDOW; k--)
+    {
+        TAC *tac = &list->code[instructions[k]];
+        Operand *uses[2];
+        int useCount = tacUses(tac, uses);
+        for (int u = 0; u < useCount; u++)
+        {
+            if (sameOperand(*uses[u], index))
+                return -1;
+        }
+        Operand *result = tacDefinition(tac);
+        if (result && sameOperand(*result, index))
         {
-            int resReg = allocateRegister(); // Register for the result / right-hand side value
+            def = k;
+            break;
+        }
+    }
+    if (def < 0 || !isFoldableIndex(&list->code[instructions[def]]))
+        return -1;
 
-            if (resReg == -1)
-            {
-                fprintf(stderr, "Run out of registers for assignment\n");
-                exit(EXIT_FAILURE); // Real compiler should handle more gracefully
-            }
+    TAC *definition = &list->code[instructions[def]];
+    Operand source = isConstant(definition->arg1) ? definition->arg2 : definition->arg1;
+    int value = tacValueIndex(list, source);
+    int location = gen->allocation.location[value];
+    for (int k = def + 1; k < at; k++)
+    {
+        TAC *tac = &list->code[instructions[k]];
+        if (tac->op == TAC_CALL)
+            return -1;
+        Operand *result = tacDefinition(tac);
+        if (!result)
+            continue;
+        int written = tacValueIndex(list, *result);
+        if (written == value || (location >= 0 && gen->allocation.location[written] == location))
+            return -1;
+    }
+    return def;
+}
 
-            if (isdigit(current->arg1[0]) || (current->arg1[0] == '-' && isdigit(current->arg1[1])))
+// Whether the comparison at index decides the branch that follows it and
+// nothing else: then the branch can test its operands itself.
+static bool foldableComparison(CodeGenerator *gen, int index, TAC *branch, const BitSet *liveAfter)
+{
+    TAC *compare = &gen->code->code[index];
+    return isComparisonOp(compare->op) && compare->result.kind == OPERAND_TEMP &&
+           sameOperand(compare->result, branch->arg1) && !bitsetTest(liveAfter, tacValueIndex(gen->code, compare->result));
+}
+
+// Marks the index computations that array loads and stores will absorb,
+// and the comparisons branches will
+static void findFoldedIndexes(CodeGenerator *gen)
+{
+    TACList *list = gen->code;
+    gen->foldedIndex = allocateOrDie(sizeof(int) * list->count);
+    gen->folded = allocateOrDie(sizeof(bool) * list->count);
+    for (int i = 0; i < list->count; i++)
+    {
+        gen->foldedIndex[i] = -1;
+        gen->folded[i] = false;
+    }
+
+    CFG cfg;
+    Liveness live;
+    buildCFG(&cfg, list);
+    computeLiveness(&live, &cfg, NULL);
+    BitSet *liveNow = allocateBitSets(1, live.valueCount);
+    int *instructions = allocateOrDie(sizeof(int) * (list->count + 1));
+
+    // Backward over each block, so liveNow holds what is live after the
+    // instruction being looked at
+    for (int b = 0; b < cfg.blockCount; b++)
+    {
+        BasicBlock *block = &cfg.blocks[b];
+        int count = 0;
+        for (int i = block->first; i != TAC_END; i = blockNext(&cfg, block, i))
+            instructions[count++] = i;
+
+        bitsetCopy(liveNow, &live.problem.out[b]);
+        for (int k = count - 1; k >= 0; k--)
+        {
+            TAC *current = &list->code[instructions[k]];
+            bool indexed = isMemoryAccess(current->op) && !(isStore(current->op) && sameOperand(current->arg1, current->arg2));
+            if (current->op == TAC_IF_FALSE && k > 0 && foldableComparison(gen, instructions[k - 1], current, liveNow))
             {
-                fprintf(outputFile, "\tli %s, %s\n", tempRegisters[resReg].name, current->arg1); // Load immediate value
+                gen->foldedIndex[instructions[k]] = instructions[k - 1];
+                gen->folded[instructions[k - 1]] = true;
             }
-            else
+            else if (indexed)
             {
-                fprintf(outputFile, "\tlw %s, %s\n", tempRegisters[resReg].name, current->arg1); // Load value from variable
+                int def = foldableDefinition(gen, instructions, k, liveNow);
+                if (def >= 0)
+                {
+                    gen->foldedIndex[instructions[k]] = instructions[def];
+                    gen->folded[instructions[def]] = true;
+                }
             }
-            fprintf(outputFile, "\tsw %s, %s\n", tempRegisters[resReg].name, current->result); // Store it in the result variable
 
-            deallocateRegister(resReg); // Free up the register after use
+            Operand *def = tacDefinition(current);
+            if (def)
+                bitsetClear(liveNow, tacValueIndex(list, *def));
+            Operand *uses[2];
+            int useCount = tacUses(current, uses);
+            for (int u = 0; u < useCount; u++)
+                bitsetSet(liveNow, tacValueIndex(list, *uses[u]));
+            if (readsGlobals(current))
+                markSymbolsLive(list, liveNow);
         }
-        else if (strcmp(current->op, "+") == 0)
-        {
-            int reg1 = allocateRegister();
-            int reg2 = allocateRegister();
-            int resReg = allocateRegister(); // Result register
+    }
 
-            if (reg1 == -1 || reg2 == -1 || resReg == -1)
-            {
-                fprintf(stderr, "Run out of registers for addition\n");
-                exit(EXIT_FAILURE); // TODO Fix this
-            }
+    trackedFree(instructions);
+    freeBitSets(liveNow);
+    freeLiveness(&live);
+    freeCFG(&cfg);
+}
+
+// Prints the value and a newline. The service numbers and the newline's
+// address are loaded every time; the peephole pass drops the reloads.
+static void generateWrite(CodeGenerator *gen, TAC *current)
+{
+    int value = selectOperand(gen, current->arg1, MIPS_A0); // Load the value straight into $a0 when it is not in a register
+    if (value != MIPS_A0)
+        emitRegs(gen, MIPS_MOVE, MIPS_A0, value, MIPS_NO_REGISTER);
+    emitImm(gen, MIPS_LI, MIPS_V0, 1);                    // print_int
+    appendMips(&gen->mips, MIPS_SYSCALL);
+    emitImm(gen, MIPS_LI, MIPS_V0, 4);                    // print_string
+    emitMemory(gen, MIPS_LA, MIPS_A0, symbolAddress("newline"));
+    appendMips(&gen->mips, MIPS_SYSCALL);
+}
 
-            fprintf(outputFile, "\tlw %s, %s\n", tempRegisters[reg1].name, current->arg1);                                             // Load first operand
-            fprintf(outputFile, "\tlw %s, %s\n", tempRegisters[reg2].name, current->arg2);                                             // Load second operand
-            fprintf(outputFile, "\tadd %s, %s, %s\n", tempRegisters[resReg].name, tempRegisters[reg1].name, tempRegisters[reg2].name); // Add them
-            fprintf(outputFile, "\tsw %s, %s\n", tempRegisters[resReg].name, current->result);                                         // Store result
+// Frame layout, from $sp up: arguments past the fourth for the calls this
+// function makes, the stack slots of spilled values, the $s registers it
+// uses and, unless it is a leaf, $ra. Each part is only there if it is
+// needed; a leaf using no stack has no frame at all. A function that calls
+// keeps $sp 8-byte aligned. Arguments past the fourth arrive just above
+// the frame, where the caller stored them.
+static void layoutFrame(CodeGenerator *gen, bool isMain)
+{
+    int stackArguments = 0;
+    gen->isLeaf = true;
+    for (int i = gen->code->head; i != TAC_END; i = gen->code->code[i].next)
+    {
+        TAC *tac = &gen->code->code[i];
+        if (tac->op != TAC_CALL)
+            continue;
+        gen->isLeaf = false;
+        if (tac->arg2.value - MIPS_ARGUMENT_REGISTERS > stackArguments)
+            stackArguments = tac->arg2.value - MIPS_ARGUMENT_REGISTERS;
+    }
 
-            deallocateRegister(reg1); // Freeing up the registers after use
-            deallocateRegister(reg2);
-            deallocateRegister(resReg);
-        }
-        else if (strcmp(current->op, "write") == 0)
+    gen->savesReturnAddress = !isMain && !gen->isLeaf; // main leaves through the exit syscall
+    gen->argumentBytes = stackArguments * 4;
+    gen->savedOffset = gen->argumentBytes + gen->allocation.stackSlotCount * 4;
+    int savedCount = __builtin_popcount(gen->allocation.savedUsed) + (gen->savesReturnAddress ? 1 : 0);
+    gen->frameSize = gen->savedOffset + savedCount * 4;
+    if (!gen->isLeaf)
+        gen->frameSize = (gen->frameSize + 7) & ~7;
+}
+
+// Saves or restores the $s registers the allocator handed out, and $ra
+static void transferSavedRegisters(CodeGenerator *gen, MipsOpcode op)
+{
+    int offset = gen->savedOffset;
+    for (int r = FIRST_SAVED_REGISTER; r < NUM_ALLOCATABLE_REGISTERS; r++)
+    {
+        if (gen->allocation.savedUsed & (1u << r))
         {
-            int argReg = allocateRegister(); // Register for the argument
+            emitMemory(gen, op, registerNumber(r), stackAddress(offset));
+            offset += 4;
+        }
+    }
+    if (gen->savesReturnAddress)
+        emitMemory(gen, op, MIPS_RA, stackAddress(offset));
+}
 
-            if (argReg == -1)
-            {
-                fprintf(stderr, "Run out of registers for write operation\n");
-                exit(EXIT_FAILURE);
-            }
+// Reserves the stack frame, saves the registers the function must preserve
+// and loads globals whose values are live on entry into their registers.
+static void generatePrologue(CodeGenerator *gen)
+{
+    if (gen->frameSize > 0)
+        emitRegImm(gen, MIPS_ADDIU, MIPS_SP, MIPS_SP, -gen->frameSize);
+    transferSavedRegisters(gen, MIPS_SW);
 
-            fprintf(outputFile, "\tlw %s, %s\n", tempRegisters[argReg].name, current->arg1); // Load the variable's value into register
-            fprintf(outputFile, "\tmove $a0, %s\n", tempRegisters[argReg].name);             // Move the value to $a0 for printing
-            fprintf(outputFile, "\tli $v0, 1\n");                                            // Set $v0 to 1 for print_int syscall
-            fprintf(outputFile, "\tsyscall\n");                                              // Make the syscall
-            fprintf(outputFile, "\tli $v0, 4\n");                                            // Set $v0 to 4 for print_string syscall
-            fprintf(outputFile, "\tla $a0, newline\n");                                      // Load address of newline character
-            fprintf(outputFile, "\tsyscall\n");                                              // Print newline
+    for (int v = 0; v < gen->code->names.count; v++)
+    {
+        if (gen->allocation.location[v] >= 0 && gen->allocation.liveOnEntry[v])
+            emitMemoryAccess(gen, MIPS_LW, registerNumber(gen->allocation.location[v]), v);
+    }
+}
 
-            deallocateRegister(argReg); // Free up the register after use
-        }
-        // TODO Add subtraction, multiplication, division, handle arrays.
+static void generateEpilogue(CodeGenerator *gen)
+{
+    transferSavedRegisters(gen, MIPS_LW);
+    if (gen->frameSize > 0)
+        emitRegImm(gen, MIPS_ADDIU, MIPS_SP, MIPS_SP, gen->frameSize);
+}
 
-        current = current->next;
+// Moves argument arg2 of the coming call into its register, or stores it
+// where the callee will find it on the stack. The TAC keeps a call's
+// arguments right before it, so the argument registers stay untouched
+// until the jal.
+static void generateArgument(CodeGenerator *gen, TAC *current)
+{
+    int k = current->arg2.value;
+    if (k < MIPS_ARGUMENT_REGISTERS)
+    {
+        int reg = selectOperand(gen, current->arg1, MIPS_A0 + k);
+        if (reg != MIPS_A0 + k)
+            emitRegs(gen, MIPS_MOVE, MIPS_A0 + k, reg, MIPS_NO_REGISTER);
+    }
+    else
+    {
+        int reg = selectOperand(gen, current->arg1, SCRATCH_REGISTER_1);
+        emitMemory(gen, MIPS_SW, reg, stackAddress((k - MIPS_ARGUMENT_REGISTERS) * 4));
     }
-    fprintf(outputFile, "\tli $v0, 10\n"); // Exit syscall
-    fprintf(outputFile, "\tsyscall\n");
 }
 
-void finalizeCodeGenerator(const char *outputFilename)
+static void generateCall(CodeGenerator *gen, TAC *current)
+{
+    MipsInstruction *call = appendMips(&gen->mips, MIPS_JAL);
+    call->address = symbolAddress(symbolLabel(gen, current->arg1.value));
+
+    int location = locationOf(gen, current->result);
+    if (location >= 0)
+        emitRegs(gen, MIPS_MOVE, registerNumber(location), MIPS_V0, MIPS_NO_REGISTER);
+    else
+        storeResult(gen, current->result, MIPS_V0);
+}
+
+// Takes parameter arg1 from its argument register, or from above the frame
+static void generateParameter(CodeGenerator *gen, TAC *current)
 {
-    if (outputFile)
+    int k = current->arg1.value;
+    int reg = MIPS_A0 + k;
+    if (k >= MIPS_ARGUMENT_REGISTERS)
+    {
+        reg = resultRegister(gen, current->result);
+        emitMemory(gen, MIPS_LW, reg, stackAddress(gen->frameSize + (k - MIPS_ARGUMENT_REGISTERS) * 4));
+    }
+
+    int location = locationOf(gen, current->result);
+    if (location < 0)
+        storeResult(gen, current->result, reg);
+    else if (registerNumber(location) != reg)
+        emitRegs(gen, MIPS_MOVE, registerNumber(location), reg, MIPS_NO_REGISTER);
+}
+
+// Leaves the value in $v0 and heads for the epilogue, which a return at the
+// end of the function falls into
+static void generateReturn(CodeGenerator *gen, TAC *current, bool last)
+{
+    int value = selectOperand(gen, current->arg1, MIPS_V0);
+    if (value != MIPS_V0)
+        emitRegs(gen, MIPS_MOVE, MIPS_V0, value, MIPS_NO_REGISTER);
+    if (!last)
+    {
+        emitImm(gen, MIPS_J, MIPS_NO_REGISTER, gen->exitLabel);
+        gen->exitUsed = true;
+    }
+}
+
+// Selects instructions for the function in the list's current view, runs
+// the peephole pass over them and writes them after the function's label.
+// The program body is main, which ends in the exit syscall.
+static void generateFunction(CodeGenerator *gen, TACList *list, const char *name, bool isMain, int exitLabel)
+{
+    gen->code = list;
+    allocateRegisters(&gen->allocation, list);
+    findFoldedIndexes(gen);
+    initMipsList(&gen->mips);
+
+    layoutFrame(gen, isMain);
+    gen->exitLabel = exitLabel;
+    gen->exitUsed = false;
+
+    generatePrologue(gen);
+
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
     {
-        fclose(outputFile);
-        printf("MIPS code generated and saved to file %s\n", outputFilename);
-        outputFile = NULL;
+        TAC *current = &list->code[i];
+
+        if (gen->folded[i])
+        {
+            continue; // Computed by the array access that uses it
+        }
+        else if (current->op == TAC_ASSIGN || current->op == TAC_LI || isArithmeticOp(current->op) ||
+                 current->op == TAC_ARRAY_LOAD || current->op == TAC_POINTER_LOAD || current->op == TAC_ADDRESS)
+        {
+            generateValue(gen, i);
+        }
+        else if (isStore(current->op))
+        {
+            generateStore(gen, i);
+        }
+        else if (current->op == TAC_BOUNDS_CHECK)
+        {
+            generateBoundsCheck(gen, current);
+        }
+        else if (current->op == TAC_WRITE)
+        {
+            generateWrite(gen, current);
+        }
+        else if (current->op == TAC_LABEL)
+        {
+            emitImm(gen, MIPS_LABEL, MIPS_NO_REGISTER, current->arg1.value);
+        }
+        else if (current->op == TAC_GOTO)
+        {
+            emitImm(gen, MIPS_J, MIPS_NO_REGISTER, current->arg1.value);
+        }
+        else if (current->op == TAC_IF_FALSE)
+        {
+            generateBranch(gen, i);
+        }
+        else if (current->op == TAC_ARG)
+        {
+            generateArgument(gen, current);
+        }
+        else if (current->op == TAC_CALL)
+        {
+            generateCall(gen, current);
+        }
+        else if (current->op == TAC_PARAM)
+        {
+            generateParameter(gen, current);
+        }
+        else if (current->op == TAC_RETURN)
+        {
+            generateReturn(gen, current, current->next == TAC_END);
+        }
+    }
+
+    if (gen->exitUsed)
+        emitImm(gen, MIPS_LABEL, MIPS_NO_REGISTER, gen->exitLabel);
+    generateEpilogue(gen);
+    if (isMain)
+    {
+        emitImm(gen, MIPS_LI, MIPS_V0, 10); // Exit syscall
+        appendMips(&gen->mips, MIPS_SYSCALL);
     }
+    else
+    {
+        emitRegs(gen, MIPS_JR, MIPS_NO_REGISTER, MIPS_RA, MIPS_NO_REGISTER);
+    }
+
+    PeepholeStats stats;
+    peepholeOptimize(&gen->mips, &stats);
+    for (int r = 0; r < PEEPHOLE_RULE_COUNT; r++)
+        gen->peephole.fired[r] += stats.fired[r];
+    gen->peephole.removed += stats.removed;
+    gen->instructionCount += mipsInstructionCount(&gen->mips);
+
+    emitString(&gen->out, name);
+    emitString(&gen->out, ":\n");
+    writeMipsList(&gen->out, &gen->mips);
+
+    TRACE(TRACE_CODEGEN, TRACE_INFO, "Function %s: %d byte frame%s\n", name, gen->frameSize, gen->isLeaf ? ", leaf" : "");
+
+    freeMipsList(&gen->mips);
+    trackedFree(gen->foldedIndex);
+    trackedFree(gen->folded);
+    freeRegisterAllocation(&gen->allocation);
 }
 
-int allocateRegister()
+// Where failed bounds checks go: prints the message and exits with status 1
+static void generateBoundsHandler(CodeGenerator *gen)
 {
-    for (int i = 0; i < NUM_TEMP_REGISTERS; i++)
+    initMipsList(&gen->mips);
+    emitImm(gen, MIPS_LABEL, MIPS_NO_REGISTER, gen->boundsLabel);
+    emitImm(gen, MIPS_LI, MIPS_V0, 4); // print_string
+    emitMemory(gen, MIPS_LA, MIPS_A0, symbolAddress("outOfBounds"));
+    appendMips(&gen->mips, MIPS_SYSCALL);
+    emitImm(gen, MIPS_LI, MIPS_A0, 1);
+    emitImm(gen, MIPS_LI, MIPS_V0, 17); // exit2
+    appendMips(&gen->mips, MIPS_SYSCALL);
+    gen->instructionCount += mipsInstructionCount(&gen->mips);
+    writeMipsList(&gen->out, &gen->mips);
+    freeMipsList(&gen->mips);
+
+    emitString(&gen->out, ".data\noutOfBounds: .asciiz \"Array index out of bounds\\n\"\n");
+}
+
+// Interns the label of every TAC name, SOURCE_LABEL_PREFIX and the name, so
+// that each has the id of the name it labels
+static void nameLabels(CodeGenerator *gen, TACList *list)
+{
+    initStringPool(&gen->labels);
+    size_t capacity = 64;
+    char *label = (char *)allocateOrDie(capacity);
+    for (int id = 0; id < list->names.count; id++)
     {
-        if (!tempRegisters[i].inUse)
+        const char *name = internedString(&list->names, id);
+        size_t length = sizeof(SOURCE_LABEL_PREFIX) + strlen(name);
+        if (length > capacity)
         {
-            tempRegisters[i].inUse = true;
-            return i;
+            trackedFree(label);
+            capacity = length;
+            label = (char *)allocateOrDie(capacity);
         }
+        strcpy(label, SOURCE_LABEL_PREFIX);
+        strcat(label, name);
+        internString(&gen->labels, label);
     }
-    return -1;
+    trackedFree(label);
+}
+
+// Generates the program body as main, then each function, into the text
+// section. Labels the epilogues and the bounds handler need are numbered
+// after the TAC's own.
+void generateMIPS(CodeGenerator *gen, TACList *tacInstructions)
+{
+    nameLabels(gen, tacInstructions);
+    TACFunction *functions;
+    int functionCount = splitTACFunctions(tacInstructions, &functions);
+    gen->boundsLabel = tacInstructions->labelCount + functionCount;
+    gen->boundsUsed = false;
+
+    emitString(&gen->out, ".text\n.globl main\n");
+    for (int f = 0; f < functionCount; f++)
+    {
+        const char *name = f == 0 ? "main" : symbolLabel(gen, functions[f].name);
+        beginTACFunction(tacInstructions, &functions[f]);
+        generateFunction(gen, tacInstructions, name, f == 0, tacInstructions->labelCount + f);
+        endTACFunction(tacInstructions, &functions[f]);
+    }
+    if (gen->boundsUsed)
+        generateBoundsHandler(gen);
+
+    joinTACFunctions(tacInstructions, functions, functionCount);
+    trackedFree(functions);
+    freeStringPool(&gen->labels);
 }
 
-void deallocateRegister(int regIndex)
+void finalizeCodeGenerator(CodeGenerator *gen, const char *outputFilename)
 {
-    if (regIndex >= 0 && regIndex < NUM_TEMP_REGISTERS)
+    if (gen->outputFile)
     {
-        tempRegisters[regIndex].inUse = false;
+        if (!closeEmitter(&gen->out))
+            fprintf(stderr, "%s: Failed to write assembly\n", outputFilename);
+        fclose(gen->outputFile);
+        TRACE(TRACE_CODEGEN, TRACE_INFO, "MIPS code generated and saved to file %s\n", outputFilename);
+        gen->outputFile = NULL;
     }
 }
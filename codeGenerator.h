@@ -6,14 +6,43 @@
 #include "AST.h"
 #include "semantic.h"
 #include "tac.h"
+#include "regalloc.h"
+#include "emitter.h"
+#include "mips.h"
+#include "peephole.h"
 #include <stdbool.h>
 
-#define NUM_TEMP_REGISTERS 10
+// Source names are written with this prefix, so a variable or function can
+// never share a label with main, the generated L<n> labels, the runtime's
+// newline and outOfBounds, or an instruction mnemonic.
+#define SOURCE_LABEL_PREFIX "_"
 
-void initCodeGenerator(const char *outputFilename, SymbolTable *symTab);
-void finalizeCodeGenerator(const char *outputFilename);
-void generateMIPS(TAC *tacInstructions);
-void deallocateRegister(int regIndex);
-int allocateRegister();
+// State of one translation to MIPS; each compilation owns its own.
+typedef struct CodeGenerator
+{
+    FILE *outputFile;
+    Emitter out;                  // Buffers everything written to outputFile
+    TACList *code;                // Instructions being translated
+    StringPool labels;            // TAC name id -> its label in the assembly
+    RegisterAllocation allocation; // Where each value lives
+    int *foldedIndex;              // TAC index -> index computation or comparison folded into it, or -1
+    bool *folded;                  // TAC index -> computed as part of a later instruction
+    MipsList mips;                 // Instructions of the current function, written out at its end
+    PeepholeStats peephole;        // What the peephole pass did, over all functions
+    int instructionCount;          // Instructions written
+    int argumentBytes;             // Outgoing stack arguments at the bottom of the frame
+    int savedOffset;               // Where the saved registers start in the frame
+    int frameSize;                 // Bytes the prologue reserves, 0 for no frame
+    bool isLeaf;                   // Makes no calls
+    bool savesReturnAddress;
+    int exitLabel;                 // Label of the epilogue
+    bool exitUsed;                 // Some return jumps to it
+    int boundsLabel;               // Label of the handler failed bounds checks jump to
+    bool boundsUsed;               // Some bounds check jumps to it
+} CodeGenerator;
+
+bool initCodeGenerator(CodeGenerator *gen, const char *outputFilename, SymbolTable *symTab);
+void finalizeCodeGenerator(CodeGenerator *gen, const char *outputFilename);
+void generateMIPS(CodeGenerator *gen, TACList *tacInstructions);
 
 #endif // CODE_GENERATOR_H
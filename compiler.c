@@ -0,0 +1,385 @@
+#include "compiler.h"
+#include "parser.tab.h"
+#include "semantic.h"
+#include "optimizer.h"
+#include "codeGenerator.h"
+#include "tacimage.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TABLE_SIZE 100
+
+// Everything besides the input that decides the output, hashed into the
+// cache key. The passes always run, so only bounds checking varies.
+static const char *cacheSettings = COMPILER_VERSION " inline sccp gvn fold constprop copyprop dce burs peephole";
+static const char *boundsCacheSettings = COMPILER_VERSION " inline sccp gvn bounds fold constprop copyprop dce burs peephole";
+
+static const char *cacheSettingsOf(const CompilerContext *ctx)
+{
+    return ctx->boundsChecks ? boundsCacheSettings : cacheSettings;
+}
+
+// Reentrant scanner interface generated by flex from lexer.l
+int yylex_init_extra(CompilerContext *ctx, yyscan_t *scanner);
+struct yy_buffer_state *yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_lineno(int lineNumber, yyscan_t scanner);
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+
+const char *compilerPhaseNames[PHASE_COUNT] = {
+    [PHASE_LEX] = "lex",
+    [PHASE_PARSE] = "parse",
+    [PHASE_SEMANTIC] = "semantic",
+    [PHASE_TAC] = "tac",
+    [PHASE_OPTIMIZE] = "optimize",
+    [PHASE_CODEGEN] = "codegen",
+};
+
+// Monotonic wall clock in seconds, for phase timing.
+double compilerClock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void initCompilerContext(CompilerContext *ctx, const char *inputFilename, const char *outputFilename)
+{
+    ctx->inputFilename = inputFilename;
+    ctx->outputFilename = outputFilename;
+    ctx->tacFilename = NULL;
+    ctx->optimizedFilename = NULL;
+    ctx->imageFilename = NULL;
+    ctx->cacheDirectory = NULL;
+    ctx->source.data = NULL;
+    ctx->source.size = 0;
+    ctx->source.mappedSize = 0;
+    initArena(&ctx->astArena, 0);
+    initStringPool(&ctx->names);
+    ctx->root = NULL;
+    ctx->symTab = createSymbolTable(TABLE_SIZE);
+    initTACList(&ctx->tac);
+    ctx->parseErrors = 0;
+    ctx->semanticErrors = 0;
+    ctx->boundsChecks = false;
+    ctx->collectStats = false;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    memset(&ctx->memory, 0, sizeof(ctx->memory));
+    ctx->phaseStartTotal = 0;
+    ctx->phaseStart = 0;
+}
+
+// Phase bracketing. With stats enabled, the compilation's counters are
+// installed on this thread for the phase and the peak is reset so each phase
+// reports its own high-water mark.
+static void beginPhase(CompilerContext *ctx)
+{
+    if (ctx->collectStats)
+    {
+        setMemoryCounters(&ctx->memory);
+        ctx->memory.peak = ctx->memory.current;
+        ctx->phaseStartTotal = ctx->memory.total;
+    }
+    ctx->phaseStart = compilerClock();
+}
+
+static void endPhase(CompilerContext *ctx, CompilerPhase phase)
+{
+    PhaseStats *stats = &ctx->stats.phases[phase];
+    stats->seconds = compilerClock() - ctx->phaseStart;
+    if (ctx->collectStats)
+    {
+        stats->allocatedBytes = ctx->memory.total - ctx->phaseStartTotal;
+        stats->peakBytes = ctx->memory.peak;
+    }
+}
+
+// Loads the source on first use and creates a scanner reading it in place.
+static bool openScanner(CompilerContext *ctx, yyscan_t *scanner)
+{
+    if (ctx->source.data == NULL && !loadSource(&ctx->source, ctx->inputFilename))
+        return false;
+
+    if (yylex_init_extra(ctx, scanner) != 0)
+    {
+        fprintf(stderr, "%s: Failed to create scanner\n", ctx->inputFilename);
+        return false;
+    }
+    if (!yy_scan_buffer(ctx->source.data, ctx->source.size + 2, *scanner))
+    {
+        fprintf(stderr, "%s: Failed to create scanner\n", ctx->inputFilename);
+        yylex_destroy(*scanner);
+        return false;
+    }
+    // yy_scan_buffer leaves the new buffer's line number unset
+    yyset_lineno(1, *scanner);
+    return true;
+}
+
+// The text of a TYPE, ID or WRITE token, interned in ctx->names. Each
+// distinct name is copied out of the source once.
+char *tokenText(CompilerContext *ctx, TokenSlice slice)
+{
+    int id = internStringLength(&ctx->names, ctx->source.data + slice.offset, slice.length);
+    return (char *)internedString(&ctx->names, id);
+}
+
+// Runs the scanner alone over the input, discarding the tokens, and records
+// PHASE_LEX. Returns the number of tokens, or -1 on failure.
+int scanFile(CompilerContext *ctx)
+{
+    beginPhase(ctx);
+    yyscan_t scanner;
+    int tokens = -1;
+    if (openScanner(ctx, &scanner))
+    {
+        YYSTYPE value;
+        tokens = 0;
+        while (yylex(&value, scanner) != 0)
+            tokens++;
+        yylex_destroy(scanner);
+    }
+    endPhase(ctx, PHASE_LEX);
+    setMemoryCounters(NULL);
+    return tokens;
+}
+
+// Parses and checks the source and generates its TAC.
+static bool runFrontEnd(CompilerContext *ctx)
+{
+    beginPhase(ctx);
+    yyscan_t scanner;
+    if (!openScanner(ctx, &scanner))
+        return false;
+    int parseResult = yyparse(ctx, scanner);
+    yylex_destroy(scanner);
+    endPhase(ctx, PHASE_PARSE);
+
+    if (parseResult != 0 || ctx->parseErrors > 0)
+    {
+        fprintf(stderr, "%s: Parsing failed\n", ctx->inputFilename);
+        return false;
+    }
+
+    TRACE(TRACE_DRIVER, TRACE_INFO, "Parsing completed successfully.\n");
+    if (TRACE_ENABLED(TRACE_DRIVER, TRACE_INFO))
+        printArenaStats("AST arena", &ctx->astArena);
+
+    // Traverse AST for debugging
+    if (TRACE_ENABLED(TRACE_AST, TRACE_INFO))
+    {
+        printf("\n+++ AST Traversal +++\n");
+        traverseAST(ctx->root, 0); // This prints the AST for debugging
+        printf("\n+++++++++++++++++++++\n");
+    }
+
+    // Semantic Analysis
+    TRACE(TRACE_DRIVER, TRACE_INFO, "\n--- Semantic Analysis ---\n");
+    beginPhase(ctx);
+    ctx->semanticErrors = semanticAnalysis(ctx->root, ctx->symTab);
+    endPhase(ctx, PHASE_SEMANTIC);
+    TRACE(TRACE_DRIVER, TRACE_INFO, "\n------------------------\n");
+
+    if (ctx->semanticErrors != 0)
+    {
+        fprintf(stderr, "%s: Compilation stopped due to semantic errors.\n", ctx->inputFilename);
+        return false;
+    }
+
+    // Print symbol table for debugging
+    if (TRACE_ENABLED(TRACE_SYMTAB, TRACE_INFO))
+    {
+        printf("\n*** Symbol Table ***\n");
+        printSymbolTable(ctx->symTab);
+        printSymbolTableStats(ctx->symTab);
+        printf("\n********************\n");
+    }
+
+    // TAC Generation
+    TRACE(TRACE_DRIVER, TRACE_INFO, "\n$$$ TAC Generation $$$\n");
+    beginPhase(ctx);
+    ASTtoTAC(ctx->root, &ctx->tac);
+    endPhase(ctx, PHASE_TAC);
+    if (ctx->imageFilename && !writeTACImage(ctx->imageFilename, &ctx->tac, ctx->symTab))
+        return false;
+    return true;
+}
+
+// Takes the TAC and symbols from a binary image in place of the front end.
+// Loading is timed as PHASE_TAC.
+static bool loadImage(CompilerContext *ctx)
+{
+    beginPhase(ctx);
+    TACImage image;
+    bool loaded = mapTACImage(&image, ctx->inputFilename);
+    if (loaded)
+    {
+        loaded = loadTACImage(&image, &ctx->tac, ctx->symTab);
+        if (!loaded)
+            fprintf(stderr, "%s: Corrupt TAC image\n", ctx->inputFilename);
+        unmapTACImage(&image);
+    }
+    endPhase(ctx, PHASE_TAC);
+    return loaded;
+}
+
+// Optimizes the TAC and generates the assembly. Bounds checks go in first,
+// so the optimizer sees them and the TAC dump shows them.
+static bool runBackEnd(CompilerContext *ctx)
+{
+    if (ctx->boundsChecks)
+        ctx->stats.bounds.inserted = insertBoundsChecks(&ctx->tac, ctx->symTab);
+    if (ctx->tacFilename)
+        printTACToFile(ctx->tacFilename, &ctx->tac);
+
+    // Code Optimization
+    if (ctx->collectStats)
+        ctx->stats.tacBeforeOptimization = tacLength(&ctx->tac);
+    beginPhase(ctx);
+    // Functions are only cached alongside the whole-file entry they belong to
+    FunctionCache functionCache = {ctx->stats.cache == CACHE_MISS ? ctx->cacheDirectory : NULL,
+                                   cacheSettingsOf(ctx), 0, 0};
+    optimizeTAC(&ctx->tac, &functionCache, &ctx->stats.inlining, &ctx->stats.bounds, &ctx->stats.loops);
+    ctx->stats.functionHits = functionCache.hits;
+    ctx->stats.functionMisses = functionCache.misses;
+    endPhase(ctx, PHASE_OPTIMIZE);
+    if (ctx->collectStats)
+        ctx->stats.tacAfterOptimization = tacLength(&ctx->tac);
+    if (ctx->optimizedFilename)
+        printOptimizedTAC(ctx->optimizedFilename, &ctx->tac);
+
+    // MIPS Code Generation
+    TRACE(TRACE_DRIVER, TRACE_INFO, "\n=== MIPS Code Generation ===\n");
+    beginPhase(ctx);
+    CodeGenerator gen;
+    if (!initCodeGenerator(&gen, ctx->outputFilename, ctx->symTab))
+        return false;
+    generateMIPS(&gen, &ctx->tac);
+    finalizeCodeGenerator(&gen, ctx->outputFilename);
+    endPhase(ctx, PHASE_CODEGEN);
+    ctx->stats.mipsInstructions = gen.instructionCount;
+    ctx->stats.peephole = gen.peephole;
+    return true;
+}
+
+static bool runPipeline(CompilerContext *ctx)
+{
+    bool loaded = isTACImageFilename(ctx->inputFilename) ? loadImage(ctx) : runFrontEnd(ctx);
+    return loaded && runBackEnd(ctx);
+}
+
+// Runs the whole pipeline on one file. Returns true if assembly was written.
+// With collectStats set, the file is also scanned once on its own so the
+// report can separate lexing from parsing. A .tac file is a TAC image and
+// starts at the optimizer. With a cache directory, a hit copies the stored
+// assembly and TAC dumps to the outputs and a miss stores them. Binary
+// images are not cached, so asking for one always compiles.
+bool compileFile(CompilerContext *ctx)
+{
+    CacheKey key;
+    if (ctx->cacheDirectory && !ctx->imageFilename)
+    {
+        if (!loadSource(&ctx->source, ctx->inputFilename))
+            return false;
+        computeCacheKey(&key, ctx->source.data, ctx->source.size, cacheSettingsOf(ctx));
+        if (fetchCacheEntry(ctx->cacheDirectory, &key, ctx->outputFilename, ctx->tacFilename,
+                            ctx->optimizedFilename))
+        {
+            ctx->stats.cache = CACHE_HIT;
+            return true;
+        }
+        ctx->stats.cache = CACHE_MISS;
+    }
+
+    if (ctx->collectStats && !isTACImageFilename(ctx->inputFilename))
+        ctx->stats.tokens = scanFile(ctx);
+
+    bool ok = runPipeline(ctx);
+    setMemoryCounters(NULL);
+    if (ok && ctx->stats.cache == CACHE_MISS)
+        storeCacheEntry(ctx->cacheDirectory, &key, ctx->outputFilename, ctx->tacFilename, &ctx->tac);
+
+    getSymbolTableStats(ctx->symTab, &ctx->stats.symbols);
+    return ok;
+}
+
+void freeCompilerContext(CompilerContext *ctx)
+{
+    freeArena(&ctx->astArena); // Releases every node at once
+    freeStringPool(&ctx->names);
+    releaseSource(&ctx->source);
+    freeSymbolTable(ctx->symTab);
+    freeTACList(&ctx->tac); // Releases every instruction and operand at once
+    ctx->root = NULL;
+    ctx->symTab = NULL;
+}
+
+// Prints the -stats report in the manner of -ftime-report.
+void printCompilerStats(FILE *out, const char *filename, const CompilerStats *stats)
+{
+    double totalSeconds = 0;
+    for (int p = 0; p < PHASE_COUNT; p++)
+        totalSeconds += stats->phases[p].seconds;
+
+    fprintf(out, "Compilation statistics for %s\n", filename);
+    fprintf(out, "  %-10s %10s %7s %14s %14s\n", "phase", "wall ms", "%", "allocated", "peak bytes");
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        const PhaseStats *phase = &stats->phases[p];
+        fprintf(out, "  %-10s %10.3f %6.1f%% %14zu %14zu\n", compilerPhaseNames[p], phase->seconds * 1e3,
+                totalSeconds > 0 ? 100.0 * phase->seconds / totalSeconds : 0.0,
+                phase->allocatedBytes, phase->peakBytes);
+    }
+    fprintf(out, "  %-10s %10.3f\n", "total", totalSeconds * 1e3);
+    fprintf(out, "  tokens: %d, AST nodes: %d\n", stats->tokens, stats->astNodes);
+    fprintf(out, "  symbol lookups: %lu, average probe length: %.2f, longest probe: %d\n",
+            stats->symbols.lookups, stats->symbols.averageProbe, stats->symbols.maxProbe);
+    fprintf(out, "  TAC instructions: %d before optimization, %d after\n",
+            stats->tacBeforeOptimization, stats->tacAfterOptimization);
+    fprintf(out, "  calls: %d inlined, %d kept\n", stats->inlining.inlined, stats->inlining.kept);
+    fprintf(out, "  bounds checks: %d inserted, %d removed\n", stats->bounds.inserted, stats->bounds.removed);
+    fprintf(out, "  loops: %d, %d invariants hoisted, %d accesses through pointers\n",
+            stats->loops.loops, stats->loops.hoisted, stats->loops.reduced);
+    fprintf(out, "  MIPS instructions: %d, %d removed by peephole rules:\n",
+            stats->mipsInstructions, stats->peephole.removed);
+    for (int r = 0; r < PEEPHOLE_RULE_COUNT; r++)
+        fprintf(out, "    %-26s %8d\n", peepholeRuleName(r), stats->peephole.fired[r]);
+    fprintf(out, "  cache: %s, functions: %d hits, %d misses\n", cacheResultName(stats->cache),
+            stats->functionHits, stats->functionMisses);
+}
+
+// Prints the same figures as one JSON object, without a trailing newline so
+// callers can join several into an array.
+void printCompilerStatsJSON(FILE *out, const char *filename, const CompilerStats *stats)
+{
+    fputs("{\"file\": \"", out);
+    for (const char *c = filename; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        fputc(*c, out);
+    }
+    fputs("\", \"phases\": {", out);
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        const PhaseStats *phase = &stats->phases[p];
+        fprintf(out, "%s\"%s\": {\"ms\": %.3f, \"allocated_bytes\": %zu, \"peak_bytes\": %zu}",
+                p ? ", " : "", compilerPhaseNames[p], phase->seconds * 1e3, phase->allocatedBytes, phase->peakBytes);
+    }
+    fprintf(out, "}, \"tokens\": %d, \"ast_nodes\": %d", stats->tokens, stats->astNodes);
+    fprintf(out, ", \"symbol_lookups\": %lu, \"average_probe\": %.3f, \"max_probe\": %d",
+            stats->symbols.lookups, stats->symbols.averageProbe, stats->symbols.maxProbe);
+    fprintf(out, ", \"tac_before\": %d, \"tac_after\": %d, \"mips_instructions\": %d",
+            stats->tacBeforeOptimization, stats->tacAfterOptimization, stats->mipsInstructions);
+    fprintf(out, ", \"inlined\": %d, \"calls_kept\": %d", stats->inlining.inlined, stats->inlining.kept);
+    fprintf(out, ", \"bounds_checks\": %d, \"bounds_checks_removed\": %d", stats->bounds.inserted, stats->bounds.removed);
+    fprintf(out, ", \"loops\": %d, \"invariants_hoisted\": %d, \"pointer_accesses\": %d",
+            stats->loops.loops, stats->loops.hoisted, stats->loops.reduced);
+    fprintf(out, ", \"peephole\": {\"removed\": %d", stats->peephole.removed);
+    for (int r = 0; r < PEEPHOLE_RULE_COUNT; r++)
+        fprintf(out, ", \"%s\": %d", peepholeRuleName(r), stats->peephole.fired[r]);
+    fprintf(out, "}, \"cache\": \"%s\", \"function_cache_hits\": %d, \"function_cache_misses\": %d}",
+            cacheResultName(stats->cache), stats->functionHits, stats->functionMisses);
+}
@@ -0,0 +1,101 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "arena.h"
+#include "AST.h"
+#include "symbolTable.h"
+#include "tac.h"
+#include "memtrack.h"
+#include "source.h"
+#include "intern.h"
+#include "peephole.h"
+#include "inline.h"
+#include "bounds.h"
+#include "loop.h"
+#include "cache.h"
+
+// Part of every cache key. Bump it whenever the generated code changes.
+#define COMPILER_VERSION "cmm 1.5"
+
+typedef enum
+{
+    PHASE_LEX,      // Scan-only pass, see scanFile
+    PHASE_PARSE,    // Includes the scanning the parser drives
+    PHASE_SEMANTIC,
+    PHASE_TAC,
+    PHASE_OPTIMIZE,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+} CompilerPhase;
+
+extern const char *compilerPhaseNames[PHASE_COUNT];
+
+typedef struct PhaseStats
+{
+    double seconds;        // Wall time
+    size_t allocatedBytes; // Bytes allocated during the phase
+    size_t peakBytes;      // Highest live heap of the compilation during the phase
+} PhaseStats;
+
+// Figures for the -stats report. Phase times are always recorded; memory
+// and the counters are only gathered when the context asks for them.
+typedef struct CompilerStats
+{
+    PhaseStats phases[PHASE_COUNT];
+    int tokens;
+    int astNodes;
+    SymbolTableStats symbols;
+    int tacBeforeOptimization;
+    int tacAfterOptimization;
+    InlineStats inlining;
+    BoundsStats bounds;
+    LoopStats loops;
+    int mipsInstructions;  // After the peephole pass
+    PeepholeStats peephole;
+    CacheResult cache;
+    int functionHits;      // Functions taken from the cache on a miss
+    int functionMisses;    // Functions optimized and stored on a miss
+} CompilerStats;
+
+// Everything one compilation owns, from the scanner's input to the TAC.
+// Nothing in the pipeline keeps global state, so any number of contexts can
+// compile side by side on different threads.
+typedef struct CompilerContext
+{
+    const char *inputFilename;
+    const char *outputFilename;    // MIPS assembly
+    const char *tacFilename;       // TAC dump before optimization, NULL to skip
+    const char *optimizedFilename; // TAC dump after optimization, NULL to skip
+    const char *imageFilename;     // Binary TAC image after generation, NULL to skip
+    const char *cacheDirectory;    // Compilation cache, NULL to always compile
+    bool boundsChecks;             // Check array indexes at run time
+
+    SourceBuffer source; // Input being scanned; tokens are slices of it
+    Arena astArena;      // Nodes of the tree
+    StringPool names;    // Identifiers of the source, interned once as the parser meets them
+    ASTNode *root;
+    SymbolTable *symTab;
+    TACList tac;
+
+    int parseErrors;
+    int semanticErrors;
+
+    bool collectStats; // Gather memory and counters, and time a separate lex pass
+    CompilerStats stats;
+    MemoryCounters memory;
+    size_t phaseStartTotal;
+    double phaseStart;
+} CompilerContext;
+
+void initCompilerContext(CompilerContext *ctx, const char *inputFilename, const char *outputFilename);
+bool compileFile(CompilerContext *ctx);
+int scanFile(CompilerContext *ctx);
+char *tokenText(CompilerContext *ctx, TokenSlice slice);
+double compilerClock();
+void freeCompilerContext(CompilerContext *ctx);
+void printCompilerStats(FILE *out, const char *filename, const CompilerStats *stats);
+void printCompilerStatsJSON(FILE *out, const char *filename, const CompilerStats *stats);
+
+#endif // COMPILER_H
@@ -0,0 +1,654 @@
+#include "dataflow.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *allocateOrDie(size_t size)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "Dataflow: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Bit sets //
+
+// Allocates count sets of size bits each, all cleared, in a single block.
+BitSet *allocateBitSets(int count, int size)
+{
+    int words = (size + 63) / 64;
+    BitSet *sets = (BitSet *)allocateOrDie(sizeof(BitSet) * count + sizeof(uint64_t) * words * count);
+    uint64_t *storage = (uint64_t *)(sets + count);
+    memset(storage, 0, sizeof(uint64_t) * words * count);
+
+    for (int i = 0; i < count; i++)
+    {
+        sets[i].words = storage + (size_t)i * words;
+        sets[i].size = size;
+    }
+    return sets;
+}
+
+void freeBitSets(BitSet *sets)
+{
+    trackedFree(sets);
+}
+
+static int wordCount(const BitSet *set)
+{
+    return (set->size + 63) / 64;
+}
+
+void bitsetFill(BitSet *set, bool value)
+{
+    memset(set->words, value ? 0xff : 0, sizeof(uint64_t) * wordCount(set));
+    if (value && (set->size & 63))
+        set->words[wordCount(set) - 1] = ((uint64_t)1 << (set->size & 63)) - 1;
+}
+
+void bitsetCopy(BitSet *dst, const BitSet *src)
+{
+    memcpy(dst->words, src->words, sizeof(uint64_t) * wordCount(src));
+}
+
+void bitsetUnion(BitSet *dst, const BitSet *src)
+{
+    for (int w = 0; w < wordCount(dst); w++)
+        dst->words[w] |= src->words[w];
+}
+
+void bitsetIntersect(BitSet *dst, const BitSet *src)
+{
+    for (int w = 0; w < wordCount(dst); w++)
+        dst->words[w] &= src->words[w];
+}
+
+// Returns the first set bit at or after from, or -1.
+int bitsetNext(const BitSet *set, int from)
+{
+    if (from >= set->size)
+        return -1;
+
+    int w = from >> 6;
+    uint64_t word = set->words[w] & (~(uint64_t)0 << (from & 63));
+    while (!word)
+    {
+        if (++w >= wordCount(set))
+            return -1;
+        word = set->words[w];
+    }
+    return (w << 6) + __builtin_ctzll(word);
+}
+
+int bitsetCount(const BitSet *set)
+{
+    int count = 0;
+    for (int w = 0; w < wordCount(set); w++)
+        count += __builtin_popcountll(set->words[w]);
+    return count;
+}
+
+// dst = gen | (src & ~kill); returns true if dst changed.
+static bool applyTransfer(BitSet *dst, const BitSet *gen, const BitSet *src, const BitSet *kill)
+{
+    bool changed = false;
+    for (int w = 0; w < wordCount(dst); w++)
+    {
+        uint64_t value = gen->words[w] | (src->words[w] & ~kill->words[w]);
+        if (value != dst->words[w])
+        {
+            dst->words[w] = value;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Worklist solver //
+
+void initDataflowProblem(DataflowProblem *problem, CFG *cfg, DataflowDirection direction,
+                         DataflowMeet meet, int universe)
+{
+    int n = cfg->blockCount;
+    problem->direction = direction;
+    problem->meet = meet;
+    problem->universe = universe;
+    problem->blockCount = n;
+    problem->sets = allocateBitSets(4 * n, universe);
+    problem->gen = problem->sets;
+    problem->kill = problem->sets + n;
+    problem->in = problem->sets + 2 * n;
+    problem->out = problem->sets + 3 * n;
+    problem->boundary = NULL;
+    problem->iterations = 0;
+}
+
+void freeDataflowProblem(DataflowProblem *problem)
+{
+    freeBitSets(problem->sets);
+    problem->sets = NULL;
+}
+
+// Combines the values flowing into a block from its neighbours (predecessors
+// for forward problems, successors for backward ones) into result.
+static void meetInto(DataflowProblem *problem, BitSet *result, BitSet *from,
+                     int *neighbours, int count, bool isBoundary)
+{
+    bool first = true;
+
+    if (isBoundary)
+    {
+        if (problem->boundary)
+            bitsetCopy(result, problem->boundary);
+        else
+            bitsetFill(result, false);
+        first = false;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (first)
+        {
+            bitsetCopy(result, &from[neighbours[i]]);
+            first = false;
+        }
+        else if (problem->meet == DATAFLOW_UNION)
+        {
+            bitsetUnion(result, &from[neighbours[i]]);
+        }
+        else
+        {
+            bitsetIntersect(result, &from[neighbours[i]]);
+        }
+    }
+
+    if (first)
+        bitsetFill(result, false); // No neighbours and not a boundary: unreachable
+}
+
+void solveDataflow(DataflowProblem *problem, CFG *cfg)
+{
+    int n = cfg->blockCount;
+    bool forward = problem->direction == DATAFLOW_FORWARD;
+    BitSet *before = forward ? problem->in : problem->out; // Meet result
+    BitSet *after = forward ? problem->out : problem->in;  // Transfer result
+
+    // Must problems start from the full set so the meet can only shrink it
+    for (int b = 0; b < n; b++)
+    {
+        bitsetFill(&before[b], problem->meet == DATAFLOW_INTERSECTION);
+        bitsetFill(&after[b], problem->meet == DATAFLOW_INTERSECTION);
+    }
+
+    // Circular worklist seeded in reverse postorder (forward) or postorder (backward)
+    int *queue = (int *)allocateOrDie(sizeof(int) * (n + 1));
+    char *queued = (char *)allocateOrDie(n);
+    int head = 0, tail = 0;
+    for (int k = 0; k < n; k++)
+    {
+        queue[tail++] = forward ? cfg->order[k] : cfg->order[n - 1 - k];
+        queued[queue[tail - 1]] = 1;
+    }
+    tail %= n + 1;
+
+    problem->iterations = 0;
+    while (head != tail)
+    {
+        int b = queue[head];
+        head = (head + 1) % (n + 1);
+        queued[b] = 0;
+        problem->iterations++;
+
+        BasicBlock *block = &cfg->blocks[b];
+        if (forward)
+            meetInto(problem, &before[b], after, block->preds, block->predCount, b == 0);
+        else
+            meetInto(problem, &before[b], after, block->succs, block->succCount, block->succCount == 0);
+
+        if (!applyTransfer(&after[b], &problem->gen[b], &before[b], &problem->kill[b]))
+            continue;
+
+        int *next = forward ? block->succs : block->preds;
+        int nextCount = forward ? block->succCount : block->predCount;
+        for (int i = 0; i < nextCount; i++)
+        {
+            if (!queued[next[i]])
+            {
+                queued[next[i]] = 1;
+                queue[tail] = next[i];
+                tail = (tail + 1) % (n + 1);
+            }
+        }
+    }
+
+    trackedFree(queue);
+    trackedFree(queued);
+}
+
+// Reaching definitions //
+
+// Makes def the last definition of its value in block b so far.
+static void generateDefinition(ReachingDefinitions *rd, BitSet *gen, BitSet *kill, int *lastGen, int *stamp,
+                               int b, int def)
+{
+    int v = rd->defValue[def];
+    if (stamp[v] == b)
+    {
+        bitsetClear(gen, lastGen[v]);
+    }
+    else
+    {
+        for (int k = rd->valueDefStart[v]; k < rd->valueDefStart[v + 1]; k++)
+            bitsetSet(kill, rd->valueDefs[k]);
+    }
+    bitsetSet(gen, def);
+    lastGen[v] = def;
+    stamp[v] = b;
+}
+
+// Steps a set of reaching definitions past instruction i.
+void stepReachingDefinitions(ReachingDefinitions *rd, TACList *code, BitSet *reaching, int i)
+{
+    if (writesGlobals(&code->code[i]))
+    {
+        for (int v = 0; v < code->names.count; v++)
+        {
+            if (!isGlobalSymbol(code, v))
+                continue;
+            for (int k = rd->valueDefStart[v]; k < rd->valueDefStart[v + 1]; k++)
+                bitsetClear(reaching, rd->valueDefs[k]);
+            bitsetSet(reaching, v);
+        }
+    }
+
+    int d = rd->defOf[i];
+    if (d >= 0)
+    {
+        int v = rd->defValue[d];
+        for (int k = rd->valueDefStart[v]; k < rd->valueDefStart[v + 1]; k++)
+            bitsetClear(reaching, rd->valueDefs[k]);
+        bitsetSet(reaching, d);
+    }
+}
+
+void computeReachingDefinitions(ReachingDefinitions *rd, CFG *cfg)
+{
+    TACList *code = cfg->code;
+    int valueCount = tacValueCount(code);
+
+    int realDefs = 0;
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+    {
+        if (tacDefinition(&code->code[i]))
+            realDefs++;
+    }
+
+    rd->valueCount = valueCount;
+    rd->defCount = valueCount + realDefs;
+    rd->defInstruction = (int *)allocateOrDie(sizeof(int) * rd->defCount);
+    rd->defValue = (int *)allocateOrDie(sizeof(int) * rd->defCount);
+    rd->defOf = (int *)allocateOrDie(sizeof(int) * code->count);
+    rd->valueDefStart = (int *)trackedCalloc(valueCount + 1, sizeof(int));
+    rd->valueDefs = (int *)allocateOrDie(sizeof(int) * rd->defCount);
+    if (!rd->valueDefStart)
+    {
+        fprintf(stderr, "Dataflow: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Number the definitions
+    for (int v = 0; v < valueCount; v++)
+    {
+        rd->defInstruction[v] = -1;
+        rd->defValue[v] = v;
+        rd->valueDefStart[v + 1]++;
+    }
+    for (int i = 0; i < code->count; i++)
+        rd->defOf[i] = -1;
+
+    int d = valueCount;
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+    {
+        Operand *def = tacDefinition(&code->code[i]);
+        if (!def)
+            continue;
+        int v = tacValueIndex(code, *def);
+        rd->defInstruction[d] = i;
+        rd->defValue[d] = v;
+        rd->defOf[i] = d;
+        rd->valueDefStart[v + 1]++;
+        d++;
+    }
+
+    // Group definitions by value
+    for (int v = 0; v < valueCount; v++)
+        rd->valueDefStart[v + 1] += rd->valueDefStart[v];
+    int *fill = (int *)allocateOrDie(sizeof(int) * (valueCount + 1));
+    memcpy(fill, rd->valueDefStart, sizeof(int) * (valueCount + 1));
+    for (d = 0; d < rd->defCount; d++)
+        rd->valueDefs[fill[rd->defValue[d]]++] = d;
+    trackedFree(fill);
+
+    initDataflowProblem(&rd->problem, cfg, DATAFLOW_FORWARD, DATAFLOW_UNION, rd->defCount);
+
+    // gen is the last definition of each value in the block; kill is every
+    // definition of each value the block assigns
+    int *lastGen = (int *)allocateOrDie(sizeof(int) * (valueCount ? valueCount : 1));
+    int *stamp = (int *)allocateOrDie(sizeof(int) * (valueCount ? valueCount : 1));
+    for (int v = 0; v < valueCount; v++)
+        stamp[v] = -1;
+
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        BitSet *gen = &rd->problem.gen[b];
+        BitSet *kill = &rd->problem.kill[b];
+
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            // A call leaves each global with a value from elsewhere, like
+            // the one it has on entry
+            if (writesGlobals(&code->code[i]))
+            {
+                for (int v = 0; v < code->names.count; v++)
+                {
+                    if (isGlobalSymbol(code, v))
+                        generateDefinition(rd, gen, kill, lastGen, stamp, b, v);
+                }
+            }
+
+            int def = rd->defOf[i];
+            if (def >= 0)
+                generateDefinition(rd, gen, kill, lastGen, stamp, b, def);
+        }
+    }
+    trackedFree(lastGen);
+    trackedFree(stamp);
+
+    // Every value starts out with its entry definition
+    BitSet *boundary = allocateBitSets(1, rd->defCount);
+    for (int v = 0; v < valueCount; v++)
+        bitsetSet(boundary, v);
+    rd->problem.boundary = boundary;
+
+    solveDataflow(&rd->problem, cfg);
+}
+
+void freeReachingDefinitions(ReachingDefinitions *rd)
+{
+    freeBitSets(rd->problem.boundary);
+    freeDataflowProblem(&rd->problem);
+    trackedFree(rd->defInstruction);
+    trackedFree(rd->defValue);
+    trackedFree(rd->defOf);
+    trackedFree(rd->valueDefStart);
+    trackedFree(rd->valueDefs);
+}
+
+// Available expressions and copies //
+
+typedef struct AvailabilityKey
+{
+    TACOpcode op;
+    Operand arg1;
+    Operand arg2;
+    Operand result;
+} AvailabilityKey;
+
+static bool makeKey(TAC *tac, bool copies, AvailabilityKey *key)
+{
+    memset(key, 0, sizeof(*key));
+
+    if (copies)
+    {
+        if (tac->op != TAC_ASSIGN || !tacDefinition(tac) ||
+            (tac->arg1.kind != OPERAND_SYMBOL && tac->arg1.kind != OPERAND_TEMP) ||
+            sameOperand(tac->arg1, tac->result))
+            return false;
+        key->op = TAC_ASSIGN;
+        key->arg1 = tac->arg1;
+        key->result = tac->result;
+        return true;
+    }
+
+    if (!isArithmeticOp(tac->op))
+        return false;
+    key->op = tac->op;
+    key->arg1 = tac->arg1;
+    key->arg2 = tac->arg2;
+    return true;
+}
+
+static unsigned hashKey(const AvailabilityKey *key)
+{
+    unsigned h = (unsigned)key->op * 16777619u;
+    const Operand *operands[3] = {&key->arg1, &key->arg2, &key->result};
+    for (int i = 0; i < 3; i++)
+    {
+        h = (h ^ (unsigned)operands[i]->kind) * 16777619u;
+        h = (h ^ (unsigned)operands[i]->value) * 16777619u;
+    }
+    return h;
+}
+
+static bool sameKey(const AvailabilityKey *a, const AvailabilityKey *b)
+{
+    return a->op == b->op && sameOperand(a->arg1, b->arg1) &&
+           sameOperand(a->arg2, b->arg2) && sameOperand(a->result, b->result);
+}
+
+// Finds the distinct values an item mentions: its operands, or for a copy
+// its source and destination. Returns how many (0-2).
+static int itemValues(TACList *code, TAC *tac, bool copies, int values[2])
+{
+    int count = 0;
+    int v1 = tacValueIndex(code, tac->arg1);
+    int v2 = tacValueIndex(code, copies ? tac->result : tac->arg2);
+    if (v1 >= 0)
+        values[count++] = v1;
+    if (v2 >= 0 && v2 != v1)
+        values[count++] = v2;
+    return count;
+}
+
+// Removes the items mentioning value v from gen and adds them to kill.
+static void killItems(Availability *avail, BitSet *gen, BitSet *kill, int v)
+{
+    for (int k = avail->valueItemStart[v]; k < avail->valueItemStart[v + 1]; k++)
+    {
+        bitsetClear(gen, avail->valueItems[k]);
+        bitsetSet(kill, avail->valueItems[k]);
+    }
+}
+
+static void computeAvailability(Availability *avail, CFG *cfg, bool copies)
+{
+    TACList *code = cfg->code;
+    avail->copies = copies;
+    avail->valueCount = tacValueCount(code);
+    avail->itemCount = 0;
+    avail->itemOf = (int *)allocateOrDie(sizeof(int) * code->count);
+    avail->itemInstruction = (int *)allocateOrDie(sizeof(int) * (code->count ? code->count : 1));
+
+    // Number the distinct items with an open-addressing table of item ids
+    int slotCount = 16;
+    while (slotCount < code->count * 2)
+        slotCount *= 2;
+    int *slots = (int *)allocateOrDie(sizeof(int) * slotCount);
+    for (int s = 0; s < slotCount; s++)
+        slots[s] = -1;
+
+    for (int i = 0; i < code->count; i++)
+        avail->itemOf[i] = -1;
+
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+    {
+        AvailabilityKey key;
+        if (!makeKey(&code->code[i], copies, &key))
+            continue;
+
+        int s = hashKey(&key) & (slotCount - 1);
+        while (slots[s] != -1)
+        {
+            AvailabilityKey other;
+            makeKey(&code->code[avail->itemInstruction[slots[s]]], copies, &other);
+            if (sameKey(&key, &other))
+                break;
+            s = (s + 1) & (slotCount - 1);
+        }
+        if (slots[s] == -1)
+        {
+            slots[s] = avail->itemCount;
+            avail->itemInstruction[avail->itemCount++] = i;
+        }
+        avail->itemOf[i] = slots[s];
+    }
+    trackedFree(slots);
+
+    // Index the items by the values they mention
+    int valueCount = avail->valueCount;
+    avail->valueItemStart = (int *)trackedCalloc(valueCount + 1, sizeof(int));
+    if (!avail->valueItemStart)
+    {
+        fprintf(stderr, "Dataflow: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    int values[2];
+    for (int x = 0; x < avail->itemCount; x++)
+    {
+        int count = itemValues(code, &code->code[avail->itemInstruction[x]], copies, values);
+        for (int k = 0; k < count; k++)
+            avail->valueItemStart[values[k] + 1]++;
+    }
+    for (int v = 0; v < valueCount; v++)
+        avail->valueItemStart[v + 1] += avail->valueItemStart[v];
+    avail->valueItems = (int *)allocateOrDie(sizeof(int) * (avail->valueItemStart[valueCount] + 1));
+    int *fill = (int *)allocateOrDie(sizeof(int) * (valueCount + 1));
+    memcpy(fill, avail->valueItemStart, sizeof(int) * (valueCount + 1));
+    for (int x = 0; x < avail->itemCount; x++)
+    {
+        int count = itemValues(code, &code->code[avail->itemInstruction[x]], copies, values);
+        for (int k = 0; k < count; k++)
+            avail->valueItems[fill[values[k]]++] = x;
+    }
+    trackedFree(fill);
+
+    initDataflowProblem(&avail->problem, cfg, DATAFLOW_FORWARD, DATAFLOW_INTERSECTION, avail->itemCount);
+
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        BitSet *gen = &avail->problem.gen[b];
+        BitSet *kill = &avail->problem.kill[b];
+
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            int item = avail->itemOf[i];
+
+            // An expression is evaluated before its result is assigned, so
+            // t = t + 1 kills itself; a copy is available after it executes.
+            if (item >= 0 && !copies)
+                bitsetSet(gen, item);
+
+            Operand *def = tacDefinition(&code->code[i]);
+            if (def)
+                killItems(avail, gen, kill, tacValueIndex(code, *def));
+            if (writesGlobals(&code->code[i]))
+            {
+                for (int v = 0; v < code->names.count; v++)
+                {
+                    if (isGlobalSymbol(code, v))
+                        killItems(avail, gen, kill, v);
+                }
+            }
+
+            if (item >= 0 && copies)
+                bitsetSet(gen, item);
+        }
+    }
+
+    solveDataflow(&avail->problem, cfg);
+}
+
+void computeAvailableExpressions(Availability *avail, CFG *cfg)
+{
+    computeAvailability(avail, cfg, false);
+}
+
+void computeAvailableCopies(Availability *avail, CFG *cfg)
+{
+    computeAvailability(avail, cfg, true);
+}
+
+void freeAvailability(Availability *avail)
+{
+    freeDataflowProblem(&avail->problem);
+    trackedFree(avail->itemOf);
+    trackedFree(avail->itemInstruction);
+    trackedFree(avail->valueItemStart);
+    trackedFree(avail->valueItems);
+}
+
+// Liveness //
+
+// A call or return may read any global, so all of them are live before it.
+void markSymbolsLive(TACList *list, BitSet *set)
+{
+    for (int v = 0; v < list->names.count; v++)
+    {
+        if (isGlobalSymbol(list, v))
+            bitsetSet(set, v);
+    }
+}
+
+void computeLiveness(Liveness *live, CFG *cfg, BitSet *liveAtExit)
+{
+    TACList *code = cfg->code;
+    live->valueCount = tacValueCount(code);
+    initDataflowProblem(&live->problem, cfg, DATAFLOW_BACKWARD, DATAFLOW_UNION, live->valueCount);
+    live->problem.boundary = liveAtExit;
+
+    // gen holds values read before any write in the block, kill the values written
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        BitSet *gen = &live->problem.gen[b];
+        BitSet *kill = &live->problem.kill[b];
+
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            TAC *tac = &code->code[i];
+            Operand *uses[2];
+            int useCount = tacUses(tac, uses);
+            for (int u = 0; u < useCount; u++)
+            {
+                int v = tacValueIndex(code, *uses[u]);
+                if (!bitsetTest(kill, v))
+                    bitsetSet(gen, v);
+            }
+            if (readsGlobals(tac))
+            {
+                for (int v = 0; v < code->names.count; v++)
+                {
+                    if (!bitsetTest(kill, v) && isGlobalSymbol(code, v))
+                        bitsetSet(gen, v);
+                }
+            }
+
+            Operand *def = tacDefinition(tac);
+            if (def)
+                bitsetSet(kill, tacValueIndex(code, *def));
+        }
+    }
+
+    solveDataflow(&live->problem, cfg);
+}
+
+void freeLiveness(Liveness *live)
+{
+    freeDataflowProblem(&live->problem);
+}
@@ -0,0 +1,128 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cfg.h"
+
+// Bit-vector sets and an iterative worklist solver for gen/kill dataflow
+// problems over a CFG, plus the classic analyses built on it.
+
+typedef struct BitSet
+{
+    uint64_t *words;
+    int size; // Number of bits
+} BitSet;
+
+static inline void bitsetSet(BitSet *set, int bit)
+{
+    set->words[bit >> 6] |= (uint64_t)1 << (bit & 63);
+}
+
+static inline void bitsetClear(BitSet *set, int bit)
+{
+    set->words[bit >> 6] &= ~((uint64_t)1 << (bit & 63));
+}
+
+static inline bool bitsetTest(const BitSet *set, int bit)
+{
+    return (set->words[bit >> 6] >> (bit & 63)) & 1;
+}
+
+BitSet *allocateBitSets(int count, int size);
+void freeBitSets(BitSet *sets);
+void bitsetFill(BitSet *set, bool value);
+void bitsetCopy(BitSet *dst, const BitSet *src);
+void bitsetUnion(BitSet *dst, const BitSet *src);
+void bitsetIntersect(BitSet *dst, const BitSet *src);
+int bitsetNext(const BitSet *set, int from);
+int bitsetCount(const BitSet *set);
+
+typedef enum
+{
+    DATAFLOW_FORWARD,
+    DATAFLOW_BACKWARD
+} DataflowDirection;
+
+typedef enum
+{
+    DATAFLOW_UNION,       // May problems
+    DATAFLOW_INTERSECTION // Must problems
+} DataflowMeet;
+
+// Each block's transfer function is out = gen | (in & ~kill) for forward
+// problems and in = gen | (out & ~kill) for backward ones. The caller fills
+// gen and kill; solveDataflow fills in and out.
+typedef struct DataflowProblem
+{
+    DataflowDirection direction;
+    DataflowMeet meet;
+    int universe;
+    int blockCount;
+    BitSet *sets;     // Backing allocation for the four arrays below
+    BitSet *gen;
+    BitSet *kill;
+    BitSet *in;
+    BitSet *out;
+    BitSet *boundary; // Value at the entry (forward) or exits (backward); NULL means empty
+    int iterations;   // Blocks processed by the last solve
+} DataflowProblem;
+
+void initDataflowProblem(DataflowProblem *problem, CFG *cfg, DataflowDirection direction,
+                         DataflowMeet meet, int universe);
+void solveDataflow(DataflowProblem *problem, CFG *cfg);
+void freeDataflowProblem(DataflowProblem *problem);
+
+// Reaching definitions. Definition ids 0..valueCount-1 stand for the value
+// each variable has on entry; real definitions follow, one per instruction
+// that assigns a value. A call gives each global a value from elsewhere, so
+// its entry definition reaches again after the call.
+typedef struct ReachingDefinitions
+{
+    DataflowProblem problem;
+    int valueCount;
+    int defCount;
+    int *defInstruction; // Definition id -> instruction index, -1 for entry values
+    int *defValue;       // Definition id -> value index
+    int *defOf;          // Instruction index -> definition id, -1 if none
+    int *valueDefStart;  // Definitions of value v are valueDefs[valueDefStart[v]..valueDefStart[v+1])
+    int *valueDefs;
+} ReachingDefinitions;
+
+void computeReachingDefinitions(ReachingDefinitions *rd, CFG *cfg);
+void stepReachingDefinitions(ReachingDefinitions *rd, TACList *code, BitSet *reaching, int i);
+void freeReachingDefinitions(ReachingDefinitions *rd);
+
+// Available expressions and available copies. An item is a distinct
+// arithmetic expression (op, arg1, arg2), or a distinct copy (result, arg1).
+// An item is killed by any assignment to one of its operands, and by a call
+// if it mentions a global.
+typedef struct Availability
+{
+    DataflowProblem problem;
+    bool copies;         // true for available copies
+    int itemCount;
+    int *itemOf;         // Instruction index -> item, -1 if none
+    int *itemInstruction; // Item -> first instruction computing it
+    int *valueItemStart; // Items mentioning value v are valueItems[valueItemStart[v]..valueItemStart[v+1])
+    int *valueItems;
+    int valueCount;
+} Availability;
+
+void computeAvailableExpressions(Availability *avail, CFG *cfg);
+void computeAvailableCopies(Availability *avail, CFG *cfg);
+void freeAvailability(Availability *avail);
+
+// Live variables. Bits are value indices (see tacValueIndex). Calls and
+// returns count as uses of every global.
+typedef struct Liveness
+{
+    DataflowProblem problem;
+    int valueCount;
+} Liveness;
+
+void computeLiveness(Liveness *live, CFG *cfg, BitSet *liveAtExit);
+void freeLiveness(Liveness *live);
+void markSymbolsLive(TACList *list, BitSet *set);
+
+#endif // DATAFLOW_H
@@ -0,0 +1,72 @@
+#include "emitter.h"
+#include "memtrack.h"
+#include <stdlib.h>
+
+void initEmitter(Emitter *out, FILE *file, char *buffer, size_t capacity)
+{
+    out->file = file;
+    out->length = 0;
+    out->failed = false;
+    out->ownsBuffer = buffer == NULL;
+    if (buffer == NULL)
+    {
+        capacity = capacity ? capacity : EMITTER_BUFFER_SIZE;
+        buffer = (char *)trackedMalloc(capacity);
+        if (!buffer)
+        {
+            fprintf(stderr, "initEmitter: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    out->buffer = buffer;
+    out->capacity = capacity;
+}
+
+void flushEmitter(Emitter *out)
+{
+    if (out->length > 0 && fwrite(out->buffer, 1, out->length, out->file) != out->length)
+        out->failed = true;
+    out->length = 0;
+}
+
+bool closeEmitter(Emitter *out)
+{
+    flushEmitter(out);
+    if (out->ownsBuffer)
+        trackedFree(out->buffer);
+    out->buffer = NULL;
+    out->capacity = 0;
+    return !out->failed;
+}
+
+// Slow path of emitBytes: the bytes do not fit in what is left of the buffer.
+// Runs longer than the whole buffer bypass it.
+void emitBytesSlow(Emitter *out, const char *bytes, size_t length)
+{
+    flushEmitter(out);
+    if (length >= out->capacity)
+    {
+        if (fwrite(bytes, 1, length, out->file) != length)
+            out->failed = true;
+        return;
+    }
+    memcpy(out->buffer, bytes, length);
+    out->length = length;
+}
+
+void emitInt(Emitter *out, int value)
+{
+    char digits[12];
+    int n = sizeof(digits);
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+
+    do
+    {
+        digits[--n] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0)
+        digits[--n] = '-';
+
+    emitBytes(out, digits + n, sizeof(digits) - n);
+}
@@ -0,0 +1,56 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Buffered text output for the assembly and IR writers. Lines are built
+// with plain copies and a hand-rolled integer formatter into a large buffer,
+// which goes to the file in one fwrite whenever it fills up.
+
+typedef struct Emitter
+{
+    FILE *file;
+    char *buffer;
+    size_t length;   // Bytes waiting in buffer
+    size_t capacity;
+    bool ownsBuffer; // buffer was allocated by initEmitter
+    bool failed;     // A write to file came up short
+} Emitter;
+
+#define EMITTER_BUFFER_SIZE (256 * 1024)
+
+// Passing a NULL buffer allocates one of capacity bytes (EMITTER_BUFFER_SIZE
+// when capacity is 0).
+void initEmitter(Emitter *out, FILE *file, char *buffer, size_t capacity);
+void flushEmitter(Emitter *out);
+bool closeEmitter(Emitter *out); // Flushes and releases the buffer; the file stays open
+void emitBytesSlow(Emitter *out, const char *bytes, size_t length);
+void emitInt(Emitter *out, int value);
+
+static inline void emitChar(Emitter *out, char c)
+{
+    if (out->length == out->capacity)
+        flushEmitter(out);
+    out->buffer[out->length++] = c;
+}
+
+static inline void emitBytes(Emitter *out, const char *bytes, size_t length)
+{
+    if (out->capacity - out->length < length)
+    {
+        emitBytesSlow(out, bytes, length);
+        return;
+    }
+    memcpy(out->buffer + out->length, bytes, length);
+    out->length += length;
+}
+
+static inline void emitString(Emitter *out, const char *str)
+{
+    emitBytes(out, str, strlen(str));
+}
+
+#endif // EMITTER_H
@@ -0,0 +1,346 @@
+#include "inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "memtrack.h"
+#include "trace.h"
+
+// Renaming of one callee copy. A map entry is only valid where its stamp is
+// the current site, so the maps are allocated once per caller rather than
+// cleared for every call site.
+typedef struct Inliner
+{
+    TACList *list;
+    int site;
+    int *tempMap; // Callee temporary -> caller temporary
+    int *tempStamp;
+    int *labelMap; // Callee label -> caller label
+    int *labelStamp;
+    int *localMap; // Callee local -> caller temporary
+    int *localStamp;
+} Inliner;
+
+static int *allocateInts(int count, int value)
+{
+    int *ints = (int *)trackedMalloc(sizeof(int) * (count + 1));
+    if (!ints)
+    {
+        fprintf(stderr, "inlineCalls: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++)
+        ints[i] = value;
+    return ints;
+}
+
+static int mapValue(Inliner *inliner, int *map, int *stamp, int value, Operand (*create)(TACList *))
+{
+    if (stamp[value] != inliner->site)
+    {
+        stamp[value] = inliner->site;
+        map[value] = create(inliner->list).value;
+    }
+    return map[value];
+}
+
+// The caller's name for a callee operand. Globals and constants stay as
+// they are; everything private to the callee gets a fresh name.
+static Operand mapOperand(Inliner *inliner, Operand operand)
+{
+    switch (operand.kind)
+    {
+    case OPERAND_TEMP:
+        operand.value = mapValue(inliner, inliner->tempMap, inliner->tempStamp, operand.value, createTempVar);
+        return operand;
+    case OPERAND_LABEL:
+        operand.value = mapValue(inliner, inliner->labelMap, inliner->labelStamp, operand.value, createLabel);
+        return operand;
+    case OPERAND_SYMBOL:
+        if (isGlobalSymbol(inliner->list, operand.value))
+            return operand;
+        return (Operand){OPERAND_TEMP, mapValue(inliner, inliner->localMap, inliner->localStamp, operand.value, createTempVar)};
+    default:
+        return operand;
+    }
+}
+
+// Instructions a copy of the function adds, not counting its entry.
+static int functionSize(TACList *list, TACFunction *function)
+{
+    int size = 0;
+    for (int i = function->head; i != TAC_END; i = list->code[i].next)
+    {
+        if (list->code[i].op != TAC_FUNCTION && list->code[i].op != TAC_PARAM)
+            size++;
+        if (i == function->tail)
+            break;
+    }
+    return size;
+}
+
+static void countCalls(TACList *list, int head, int tail, const int *functionOf, int *calls)
+{
+    for (int i = head; i != TAC_END; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        if (tac->op == TAC_CALL && functionOf[tac->arg1.value] >= 0)
+            calls[functionOf[tac->arg1.value]]++;
+        if (i == tail)
+            break;
+    }
+}
+
+// Replaces the call at index, whose predecessor is prev, with a copy of the
+// callee. The argument at args[k] becomes the move into parameter k; a
+// parameter without an argument starts at 0. Returns the last instruction
+// of the copy, the new predecessor of whatever followed the call.
+static int inlineCall(Inliner *inliner, TACFunction *callee, int prev, int index, int *args, int argCount)
+{
+    TACList *list = inliner->list;
+    TAC call = list->code[index];
+    Operand none = {OPERAND_NONE, 0};
+    Operand exitLabel = none;
+    int after = prev;
+
+    inliner->site++;
+    for (int j = callee->head; j != TAC_END; j = list->code[j].next)
+    {
+        TAC source = list->code[j]; // insertTAC may move the code
+        bool last = j == callee->tail;
+        switch (source.op)
+        {
+        case TAC_FUNCTION:
+            break;
+
+        case TAC_PARAM:
+        {
+            Operand parameter = mapOperand(inliner, source.result);
+            int k = source.arg1.value;
+            if (k < argCount && args[k] != TAC_END)
+            {
+                TAC *arg = &list->code[args[k]];
+                *arg = (TAC){TAC_ASSIGN, arg->arg1, none, parameter, arg->next};
+                args[k] = TAC_END;
+            }
+            else
+            {
+                after = insertTAC(list, after, &(TAC){TAC_ASSIGN, constOperand(0), none, parameter, TAC_END});
+            }
+            break;
+        }
+
+        case TAC_RETURN:
+            after = insertTAC(list, after, &(TAC){TAC_ASSIGN, mapOperand(inliner, source.arg1), none, call.result, TAC_END});
+            if (!last)
+            {
+                if (exitLabel.kind == OPERAND_NONE)
+                    exitLabel = createLabel(list);
+                after = insertTAC(list, after, &(TAC){TAC_GOTO, exitLabel, none, none, TAC_END});
+            }
+            break;
+
+        default:
+            source.arg1 = mapOperand(inliner, source.arg1);
+            source.arg2 = mapOperand(inliner, source.arg2);
+            source.result = mapOperand(inliner, source.result);
+            after = insertTAC(list, after, &source);
+            break;
+        }
+        if (last)
+            break;
+    }
+    if (exitLabel.kind != OPERAND_NONE)
+        after = insertTAC(list, after, &(TAC){TAC_LABEL, exitLabel, none, none, TAC_END});
+
+    // Arguments beyond the callee's parameters are still evaluated
+    for (int k = 0; k < argCount; k++)
+    {
+        if (args[k] != TAC_END)
+        {
+            TAC *arg = &list->code[args[k]];
+            *arg = (TAC){TAC_ASSIGN, arg->arg1, none, createTempVar(list), arg->next};
+        }
+    }
+
+    removeTAC(list, after, index);
+    return after;
+}
+
+// Why the call should stay a call, or NULL to inline it.
+static const char *keepReason(int caller, int callee, int size, int cost, int growth)
+{
+    if (callee == caller)
+        return "recursive";
+    if (size > INLINE_SIZE_LIMIT)
+        return "callee too large";
+    if (cost > INLINE_COST_LIMIT)
+        return "too costly";
+    if (growth + (cost > 0 ? cost : 0) > INLINE_GROWTH_LIMIT)
+        return "caller growth limit";
+    return NULL;
+}
+
+// Inlines the calls of the function being optimized, functions[caller],
+// whose range is the list's current view. The other ranges are the callees
+// as they stand, so a callee optimized first is copied in its optimized
+// form. Calls inside a copy are left for the next caller up. Returns the
+// number of call sites inlined.
+int inlineCalls(TACList *list, TACFunction *functions, int count, int caller, InlineStats *stats)
+{
+    int *functionOf = allocateInts(list->names.count, -1);
+    int *sizes = allocateInts(count, 0);
+    int *calls = allocateInts(count, 0);
+    for (int f = 1; f < count; f++)
+        functionOf[functions[f].name] = f;
+    for (int f = 0; f < count; f++)
+    {
+        if (f == caller)
+            countCalls(list, list->head, list->tail, functionOf, calls);
+        else
+            countCalls(list, functions[f].head, functions[f].tail, functionOf, calls);
+        sizes[f] = f == caller ? 0 : functionSize(list, &functions[f]);
+    }
+
+    Inliner inliner = {list, 0};
+    inliner.tempMap = allocateInts(list->tempCount, 0);
+    inliner.tempStamp = allocateInts(list->tempCount, 0);
+    inliner.labelMap = allocateInts(list->labelCount, 0);
+    inliner.labelStamp = allocateInts(list->labelCount, 0);
+    inliner.localMap = allocateInts(list->names.count, 0);
+    inliner.localStamp = allocateInts(list->names.count, 0);
+
+    int argCapacity = 8;
+    int *args = allocateInts(argCapacity, TAC_END);
+    int argCount = 0;
+    int site = 0;
+    int growth = 0;
+    int inlined = 0;
+
+    int prev = TAC_END;
+    for (int i = list->head; i != TAC_END;)
+    {
+        TAC *tac = &list->code[i];
+        int next = tac->next;
+        if (tac->op == TAC_ARG)
+        {
+            int k = tac->arg2.value;
+            if (k >= argCapacity)
+            {
+                args = (int *)trackedRealloc(args, sizeof(int) * (k * 2 + 1));
+                if (!args)
+                {
+                    fprintf(stderr, "inlineCalls: Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+                argCapacity = k * 2;
+            }
+            for (; argCount <= k; argCount++)
+                args[argCount] = TAC_END;
+            args[k] = i;
+        }
+        else if (tac->op == TAC_CALL && functionOf[tac->arg1.value] >= 0)
+        {
+            int callee = functionOf[tac->arg1.value];
+            int constants = 0;
+            for (int k = 0; k < argCount; k++)
+            {
+                if (args[k] != TAC_END && list->code[args[k]].arg1.kind == OPERAND_CONST)
+                    constants++;
+            }
+            int cost = sizes[callee] - INLINE_CALL_SAVING - argCount - INLINE_CONSTANT_SAVING * constants;
+            if (calls[callee] == 1)
+                cost -= sizes[callee]; // The callee goes away with its only call
+            const char *reason = keepReason(caller, callee, sizes[callee], cost, growth);
+            site++;
+
+            if (reason)
+            {
+                TRACE(TRACE_OPTIMIZER, TRACE_INFO, "Inliner: %s call %d to %s kept, %s\n",
+                      caller == 0 ? "main" : internedString(&list->names, functions[caller].name),
+                      site, internedString(&list->names, functions[callee].name), reason);
+                stats->kept++;
+            }
+            else
+            {
+                TRACE(TRACE_OPTIMIZER, TRACE_INFO, "Inliner: %s call %d to %s inlined, %d instructions\n",
+                      caller == 0 ? "main" : internedString(&list->names, functions[caller].name),
+                      site, internedString(&list->names, functions[callee].name), sizes[callee]);
+                i = inlineCall(&inliner, &functions[callee], prev, i, args, argCount);
+                growth += cost > 0 ? cost : 0;
+                calls[callee]--;
+                stats->inlined++;
+                inlined++;
+            }
+            argCount = 0;
+        }
+        else if (tac->op == TAC_CALL)
+        {
+            argCount = 0;
+        }
+        prev = i;
+        i = next;
+    }
+
+    trackedFree(functionOf);
+    trackedFree(sizes);
+    trackedFree(calls);
+    trackedFree(args);
+    trackedFree(inliner.tempMap);
+    trackedFree(inliner.tempStamp);
+    trackedFree(inliner.labelMap);
+    trackedFree(inliner.labelStamp);
+    trackedFree(inliner.localMap);
+    trackedFree(inliner.localStamp);
+    return inlined;
+}
+
+// Drops the functions no call can reach from the program body any more.
+// Returns how many were dropped.
+int removeUncalledFunctions(TACList *list, TACFunction *functions, int count)
+{
+    int *functionOf = allocateInts(list->names.count, -1);
+    int *work = allocateInts(count, 0);
+    bool *called = (bool *)trackedCalloc(count, sizeof(bool));
+    if (!called)
+    {
+        fprintf(stderr, "removeUncalledFunctions: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int f = 1; f < count; f++)
+        functionOf[functions[f].name] = f;
+
+    int workCount = 0;
+    work[workCount++] = 0;
+    called[0] = true;
+    while (workCount > 0)
+    {
+        TACFunction *function = &functions[work[--workCount]];
+        for (int i = function->head; i != TAC_END; i = list->code[i].next)
+        {
+            TAC *tac = &list->code[i];
+            int callee = tac->op == TAC_CALL ? functionOf[tac->arg1.value] : -1;
+            if (callee >= 0 && !called[callee])
+            {
+                called[callee] = true;
+                work[workCount++] = callee;
+            }
+            if (i == function->tail)
+                break;
+        }
+    }
+
+    int removed = 0;
+    for (int f = 1; f < count; f++)
+    {
+        if (!called[f] && functions[f].head != TAC_END)
+        {
+            TRACE(TRACE_OPTIMIZER, TRACE_INFO, "Inliner: %s no longer called, removed\n", internedString(&list->names, functions[f].name));
+            functions[f].head = functions[f].tail = TAC_END;
+            removed++;
+        }
+    }
+
+    trackedFree(functionOf);
+    trackedFree(work);
+    trackedFree(called);
+    return removed;
+}
@@ -0,0 +1,27 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "tac.h"
+
+// Inlining of calls on the TAC. A call is replaced by a copy of the callee's
+// body when the copy is small enough for what it saves: the argument and
+// return moves, the call itself, and whatever constant arguments fold away
+// inside the copy. The callee's locals and temporaries become fresh
+// temporaries of the caller, so the copy joins the caller's SSA passes.
+
+#define INLINE_SIZE_LIMIT 64     // Largest callee body copied, in instructions
+#define INLINE_COST_LIMIT 24     // Most net instructions one call site may add
+#define INLINE_GROWTH_LIMIT 512  // Most net instructions inlining may add to one caller
+#define INLINE_CALL_SAVING 4     // Call, parameter and return moves saved at a site
+#define INLINE_CONSTANT_SAVING 3 // Further saving per constant argument
+
+typedef struct InlineStats
+{
+    int inlined; // Call sites replaced by a copy of the callee
+    int kept;    // Call sites left as calls
+} InlineStats;
+
+int inlineCalls(TACList *list, TACFunction *functions, int count, int caller, InlineStats *stats);
+int removeUncalledFunctions(TACList *list, TACFunction *functions, int count);
+
+#endif // INLINE_H
@@ -0,0 +1,160 @@
+#include "intern.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SLOT_COUNT 64
+
+void initStringPool(StringPool *pool)
+{
+    initArena(&pool->storage, 0);
+    pool->names = NULL;
+    pool->hashes = NULL;
+    pool->count = 0;
+    pool->capacity = 0;
+    pool->slotCount = INITIAL_SLOT_COUNT;
+    pool->slots = (int *)trackedMalloc(sizeof(int) * pool->slotCount);
+    if (!pool->slots)
+    {
+        fprintf(stderr, "initStringPool: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(pool->slots, -1, sizeof(int) * pool->slotCount);
+}
+
+void freeStringPool(StringPool *pool)
+{
+    freeArena(&pool->storage);
+    trackedFree(pool->names);
+    trackedFree(pool->hashes);
+    trackedFree(pool->slots);
+    pool->names = NULL;
+    pool->hashes = NULL;
+    pool->slots = NULL;
+    pool->count = pool->capacity = pool->slotCount = 0;
+}
+
+// FNV-1a
+unsigned hashString(const char *str)
+{
+    unsigned hashval = 2166136261u;
+    for (; *str != '\0'; str++)
+    {
+        hashval ^= (unsigned char)*str;
+        hashval *= 16777619u;
+    }
+    return hashval;
+}
+
+// FNV-1a over the first length bytes of str; matches hashString.
+static unsigned hashBytes(const char *str, size_t length)
+{
+    unsigned hashval = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hashval ^= (unsigned char)str[i];
+        hashval *= 16777619u;
+    }
+    return hashval;
+}
+
+// Returns the slot holding the length bytes at str, or the empty slot where
+// they would go.
+static int findSlot(StringPool *pool, const char *str, size_t length, unsigned hashval)
+{
+    int mask = pool->slotCount - 1;
+    int slot = hashval & mask;
+
+    while (pool->slots[slot] != -1)
+    {
+        int id = pool->slots[slot];
+        if (pool->hashes[id] == hashval && strncmp(pool->names[id], str, length) == 0 &&
+            pool->names[id][length] == '\0')
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void growSlots(StringPool *pool)
+{
+    int newCount = pool->slotCount * 2;
+    int *slots = (int *)trackedMalloc(sizeof(int) * newCount);
+    if (!slots)
+    {
+        fprintf(stderr, "internString: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(slots, -1, sizeof(int) * newCount);
+
+    for (int id = 0; id < pool->count; id++)
+    {
+        int slot = pool->hashes[id] & (newCount - 1);
+        while (slots[slot] != -1)
+            slot = (slot + 1) & (newCount - 1);
+        slots[slot] = id;
+    }
+
+    trackedFree(pool->slots);
+    pool->slots = slots;
+    pool->slotCount = newCount;
+}
+
+int internString(StringPool *pool, const char *str)
+{
+    return internStringLength(pool, str, strlen(str));
+}
+
+// Interns the length bytes at str, which need not be NUL-terminated. This
+// is how names are taken straight out of the source buffer.
+int internStringLength(StringPool *pool, const char *str, size_t length)
+{
+    unsigned hashval = hashBytes(str, length);
+    int slot = findSlot(pool, str, length, hashval);
+    if (pool->slots[slot] != -1)
+        return pool->slots[slot];
+
+    if (pool->count == pool->capacity)
+    {
+        int newCapacity = pool->capacity ? pool->capacity * 2 : 64;
+        const char **names = (const char **)trackedRealloc(pool->names, sizeof(char *) * newCapacity);
+        unsigned *hashes = (unsigned *)trackedRealloc(pool->hashes, sizeof(unsigned) * newCapacity);
+        if (!names || !hashes)
+        {
+            fprintf(stderr, "internString: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        pool->names = names;
+        pool->hashes = hashes;
+        pool->capacity = newCapacity;
+    }
+
+    int id = pool->count++;
+    char *copy = (char *)arenaAlloc(&pool->storage, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    pool->names[id] = copy;
+    pool->hashes[id] = hashval;
+    pool->slots[slot] = id;
+
+    // Keep the load factor at or below one half
+    if (pool->count * 2 > pool->slotCount)
+        growSlots(pool);
+
+    return id;
+}
+
+// Returns the id of str, or -1 if it has never been interned.
+int findInternedString(StringPool *pool, const char *str)
+{
+    size_t length = strlen(str);
+    return pool->slots[findSlot(pool, str, length, hashBytes(str, length))];
+}
+
+const char *internedString(StringPool *pool, int id)
+{
+    if (id < 0 || id >= pool->count)
+        return NULL;
+    return pool->names[id];
+}
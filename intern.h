@@ -0,0 +1,28 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "arena.h"
+
+// Interns names so that each distinct string is stored once and identified
+// by a small dense integer. Comparing two interned names is an int compare.
+
+typedef struct StringPool
+{
+    Arena storage;      // Backing store for the interned characters
+    const char **names; // Id -> interned string
+    unsigned *hashes;   // Id -> cached hash of the string
+    int count;
+    int capacity;
+    int *slots;         // Open-addressing table of ids, -1 when empty
+    int slotCount;      // Always a power of two
+} StringPool;
+
+void initStringPool(StringPool *pool);
+void freeStringPool(StringPool *pool);
+int internString(StringPool *pool, const char *str);
+int internStringLength(StringPool *pool, const char *str, size_t length);
+int findInternedString(StringPool *pool, const char *str);
+const char *internedString(StringPool *pool, int id);
+unsigned hashString(const char *str);
+
+#endif // INTERN_H
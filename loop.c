@@ -0,0 +1,885 @@
+#include "loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "memtrack.h"
+#include "optimizer.h"
+#include "trace.h"
+
+static void *allocateOrDie(size_t size)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "Loops: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void *growOrDie(void *ptr, size_t size)
+{
+    ptr = trackedRealloc(ptr, size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "Loops: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Loop detection //
+
+static bool dominates(DominatorTree *dom, int a, int b)
+{
+    while (b >= 0 && b != a)
+        b = dom->idom[b];
+    return b == a;
+}
+
+static int compareLoopSize(const void *a, const void *b)
+{
+    const Loop *x = (const Loop *)a;
+    const Loop *y = (const Loop *)b;
+    if (x->blockCount != y->blockCount)
+        return x->blockCount < y->blockCount ? -1 : 1;
+    return x->header < y->header ? -1 : x->header > y->header;
+}
+
+// Finds the natural loop of every block that is the target of a back edge,
+// all back edges into one header making one loop. Loops with different
+// headers are either disjoint or nested, and a nested loop is the smaller,
+// so sorting by size puts every loop after the loops inside it.
+void findLoops(LoopForest *forest, CFG *cfg, DominatorTree *dom, const bool *reachable)
+{
+    TACList *code = cfg->code;
+    int n = cfg->blockCount;
+    int *mark = (int *)allocateOrDie(sizeof(int) * n);
+    int *stack = (int *)allocateOrDie(sizeof(int) * n);
+    int *rpoIndex = (int *)allocateOrDie(sizeof(int) * n);
+    int *offsets = NULL;
+    int storageCount = 0;
+    int storageCapacity = 0;
+    forest->loops = NULL;
+    forest->loopCount = 0;
+    forest->blockStorage = NULL;
+    forest->loopOf = (int *)allocateOrDie(sizeof(int) * n);
+    for (int b = 0; b < n; b++)
+    {
+        mark[b] = -1;
+        forest->loopOf[b] = -1;
+    }
+    for (int k = 0; k < n; k++)
+        rpoIndex[cfg->order[k]] = k;
+
+    int capacity = 0;
+    for (int k = 0; k < n; k++)
+    {
+        int h = cfg->order[k];
+        if (!reachable[h])
+            continue;
+
+        // Walk back from each back edge's source, stopping at the header.
+        // Only an edge against reverse postorder can be a back edge.
+        BasicBlock *header = &cfg->blocks[h];
+        int top = 0;
+        mark[h] = k;
+        for (int j = 0; j < header->predCount; j++)
+        {
+            int p = header->preds[j];
+            if (reachable[p] && mark[p] != k && rpoIndex[p] >= k && dominates(dom, h, p))
+            {
+                mark[p] = k;
+                stack[top++] = p;
+            }
+        }
+        if (top == 0)
+            continue;
+        while (top > 0)
+        {
+            BasicBlock *block = &cfg->blocks[stack[--top]];
+            for (int j = 0; j < block->predCount; j++)
+            {
+                int p = block->preds[j];
+                if (reachable[p] && mark[p] != k)
+                {
+                    mark[p] = k;
+                    stack[top++] = p;
+                }
+            }
+        }
+
+        if (forest->loopCount == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 8;
+            forest->loops = (Loop *)growOrDie(forest->loops, sizeof(Loop) * capacity);
+            offsets = (int *)growOrDie(offsets, sizeof(int) * capacity);
+        }
+        Loop *loop = &forest->loops[forest->loopCount];
+        offsets[forest->loopCount++] = storageCount;
+        loop->header = h;
+        loop->blockCount = 0;
+        for (int r = 0; r < n; r++)
+        {
+            if (mark[cfg->order[r]] != k)
+                continue;
+            if (storageCount == storageCapacity)
+            {
+                storageCapacity = storageCapacity ? storageCapacity * 2 : 64;
+                forest->blockStorage = (int *)growOrDie(forest->blockStorage, sizeof(int) * storageCapacity);
+            }
+            forest->blockStorage[storageCount++] = cfg->order[r];
+            loop->blockCount++;
+        }
+    }
+
+    for (int l = 0; l < forest->loopCount; l++)
+        forest->loops[l].blocks = forest->blockStorage + offsets[l];
+    if (forest->loopCount > 1)
+        qsort(forest->loops, forest->loopCount, sizeof(Loop), compareLoopSize);
+
+    // Outermost loops first, so each block ends up with its innermost loop
+    for (int l = forest->loopCount - 1; l >= 0; l--)
+    {
+        Loop *loop = &forest->loops[l];
+        loop->parent = forest->loopOf[loop->header];
+        loop->depth = loop->parent < 0 ? 1 : forest->loops[loop->parent].depth + 1;
+        for (int k = 0; k < loop->blockCount; k++)
+            forest->loopOf[loop->blocks[k]] = l;
+    }
+
+    for (int l = 0; l < forest->loopCount; l++)
+    {
+        Loop *loop = &forest->loops[l];
+        BasicBlock *header = &cfg->blocks[loop->header];
+        int outside = 0;
+        loop->preheader = -1;
+        for (int j = 0; j < header->predCount; j++)
+        {
+            int p = header->preds[j];
+            if (reachable[p] && !loopContains(forest, l, p))
+            {
+                outside++;
+                loop->preheader = p;
+            }
+        }
+        if (outside != 1 || cfg->blocks[loop->preheader].succCount != 1 ||
+            code->code[cfg->blocks[loop->preheader].last].op == TAC_IF_FALSE)
+            loop->preheader = -1;
+    }
+
+    trackedFree(offsets);
+    trackedFree(rpoIndex);
+    trackedFree(stack);
+    trackedFree(mark);
+}
+
+bool loopContains(LoopForest *forest, int loop, int b)
+{
+    for (int l = forest->loopOf[b]; l >= 0; l = forest->loops[l].parent)
+    {
+        if (l == loop)
+            return true;
+    }
+    return false;
+}
+
+void freeLoops(LoopForest *forest)
+{
+    trackedFree(forest->loops);
+    trackedFree(forest->loopOf);
+    trackedFree(forest->blockStorage);
+    forest->loops = NULL;
+    forest->loopOf = NULL;
+    forest->blockStorage = NULL;
+    forest->loopCount = 0;
+}
+
+// True if some jump goes to a label before it, as every loop needs one
+static bool hasBackwardJump(TACList *list)
+{
+    bool *seen = (bool *)allocateOrDie(sizeof(bool) * (list->labelCount + 1));
+    for (int l = 0; l <= list->labelCount; l++)
+        seen[l] = false;
+    bool found = false;
+    for (int i = list->head; i != TAC_END && !found; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        if (tac->op == TAC_LABEL && tac->arg1.value < list->labelCount)
+            seen[tac->arg1.value] = true;
+        else if (tac->op == TAC_GOTO)
+            found = seen[tac->arg1.value];
+        else if (tac->op == TAC_IF_FALSE)
+            found = seen[tac->arg2.value];
+    }
+    trackedFree(seen);
+    return found;
+}
+
+// Gives every loop header that lacks one a preheader: a new label placed
+// just before the header, which the jumps from outside the loop are
+// retargeted to. A header that a block of its own loop falls into, or that
+// has no label to jump to, is left alone. Returns the number inserted.
+int insertPreheaders(TACList *list)
+{
+    if (!hasBackwardJump(list))
+        return 0;
+
+    CFG cfg;
+    DominatorTree dom;
+    buildCFG(&cfg, list);
+    computeDominators(&dom, &cfg);
+    int n = cfg.blockCount;
+    bool *reachable = (bool *)allocateOrDie(sizeof(bool) * n);
+    for (int b = 0; b < n; b++)
+        reachable[b] = b == 0 || dom.idom[b] >= 0;
+
+    LoopForest forest;
+    findLoops(&forest, &cfg, &dom, reachable);
+    int inserted = 0;
+    for (int l = 0; l < forest.loopCount; l++)
+    {
+        Loop *loop = &forest.loops[l];
+        int h = loop->header;
+        BasicBlock *header = &cfg.blocks[h];
+        if (loop->preheader >= 0 || list->code[header->first].op != TAC_LABEL)
+            continue;
+
+        bool fallsIn = false;
+        for (int j = 0; j < header->predCount; j++)
+        {
+            int p = header->preds[j];
+            int k = cfg.blocks[p].succs[0] == h ? 0 : 1;
+            if (loopContains(&forest, l, p) && !isJumpEdge(&cfg, p, k))
+                fallsIn = true;
+        }
+        if (fallsIn)
+            continue;
+
+        int target = list->code[header->first].arg1.value;
+        Operand label = createLabel(list);
+        TAC preheader = {TAC_LABEL, label, {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+        insertTAC(list, h > 0 ? cfg.blocks[h - 1].last : TAC_END, &preheader);
+        for (int j = 0; j < header->predCount; j++)
+        {
+            int p = header->preds[j];
+            TAC *last = &list->code[cfg.blocks[p].last];
+            if (loopContains(&forest, l, p))
+                continue;
+            if (last->op == TAC_GOTO && last->arg1.value == target)
+                last->arg1 = label;
+            else if (last->op == TAC_IF_FALSE && last->arg2.value == target)
+                last->arg2 = label;
+        }
+        inserted++;
+    }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Loops: %d loops, %d preheaders inserted\n", forest.loopCount, inserted);
+
+    freeLoops(&forest);
+    trackedFree(reachable);
+    freeDominatorTree(&dom);
+    freeCFG(&cfg);
+    return inserted;
+}
+
+// Rewriting //
+
+typedef struct LoopOptimizer
+{
+    SSAForm *ssa;
+    LoopForest forest;
+    int *defBlock;       // Value -> block of its definition, -1 if none
+    int *defInstruction; // Value -> defining instruction, -1 for a phi
+    int valueCapacity;
+    int *prev; // Instruction index -> previous linked instruction
+    int prevCapacity;
+} LoopOptimizer;
+
+static void noteDefinition(LoopOptimizer *lo, Operand value, int b, int i)
+{
+    int v = tacValueIndex(lo->ssa->code, value);
+    if (v >= lo->valueCapacity)
+    {
+        int capacity = tacValueCount(lo->ssa->code) * 2;
+        lo->defBlock = (int *)growOrDie(lo->defBlock, sizeof(int) * capacity);
+        lo->defInstruction = (int *)growOrDie(lo->defInstruction, sizeof(int) * capacity);
+        for (int w = lo->valueCapacity; w < capacity; w++)
+        {
+            lo->defBlock[w] = -1;
+            lo->defInstruction[w] = -1;
+        }
+        lo->valueCapacity = capacity;
+    }
+    lo->defBlock[v] = b;
+    lo->defInstruction[v] = i;
+}
+
+static int definingBlock(LoopOptimizer *lo, Operand value)
+{
+    int v = tacValueIndex(lo->ssa->code, value);
+    return v < lo->valueCapacity ? lo->defBlock[v] : -1;
+}
+
+static int definingInstruction(LoopOptimizer *lo, Operand value)
+{
+    int v = tacValueIndex(lo->ssa->code, value);
+    return v < lo->valueCapacity ? lo->defInstruction[v] : -1;
+}
+
+static int linkAfter(LoopOptimizer *lo, int b, int after, const TAC *tac)
+{
+    TACList *code = lo->ssa->code;
+    int index = insertTAC(code, after, tac);
+    if (code->count > lo->prevCapacity)
+    {
+        lo->prevCapacity = code->count * 2;
+        lo->prev = (int *)growOrDie(lo->prev, sizeof(int) * lo->prevCapacity);
+    }
+    lo->prev[index] = after;
+    if (code->code[index].next != TAC_END)
+        lo->prev[code->code[index].next] = index;
+    Operand *def = tacDefinition(&code->code[index]);
+    if (def && def->kind == OPERAND_TEMP)
+        noteDefinition(lo, *def, b, index);
+    return index;
+}
+
+// Inserts tac after instruction after of block b
+static int insertAfter(LoopOptimizer *lo, int b, int after, const TAC *tac)
+{
+    BasicBlock *block = &lo->ssa->cfg.blocks[b];
+    int index = linkAfter(lo, b, after, tac);
+    if (block->last == after)
+        block->last = index;
+    return index;
+}
+
+// Inserts tac before instruction before of block b
+static int insertBefore(LoopOptimizer *lo, int b, int before, const TAC *tac)
+{
+    BasicBlock *block = &lo->ssa->cfg.blocks[b];
+    int index = linkAfter(lo, b, lo->prev[before], tac);
+    if (block->first == before)
+        block->first = index;
+    return index;
+}
+
+// Adds tac to the end of preheader p, ahead of its jump into the loop
+static int appendToPreheader(LoopOptimizer *lo, int p, const TAC *tac)
+{
+    BasicBlock *block = &lo->ssa->cfg.blocks[p];
+    if (lo->ssa->code->code[block->last].op == TAC_GOTO)
+        return insertBefore(lo, p, block->last, tac);
+    return insertAfter(lo, p, block->last, tac);
+}
+
+static void unlinkFromBlock(LoopOptimizer *lo, int b, int i)
+{
+    TACList *code = lo->ssa->code;
+    BasicBlock *block = &lo->ssa->cfg.blocks[b];
+    int next = code->code[i].next;
+    if (block->first == i)
+        block->first = next;
+    if (block->last == i)
+        block->last = lo->prev[i];
+    removeTAC(code, lo->prev[i], i);
+    if (next != TAC_END)
+        lo->prev[next] = lo->prev[i];
+}
+
+// Invariant code motion //
+
+// True if a call in the loop, or a store of a variable, may change what a
+// variable holds in memory
+static bool loopWritesMemory(LoopOptimizer *lo, Loop *loop)
+{
+    CFG *cfg = &lo->ssa->cfg;
+    for (int k = 0; k < loop->blockCount; k++)
+    {
+        BasicBlock *block = &cfg->blocks[loop->blocks[k]];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            TAC *tac = &lo->ssa->code->code[i];
+            Operand *def = tacDefinition(tac);
+            if (tac->op == TAC_CALL || (def && def->kind == OPERAND_SYMBOL))
+                return true;
+        }
+    }
+    return false;
+}
+
+// True if operand has the same value on every iteration of loop l
+static bool isInvariant(LoopOptimizer *lo, int l, bool writesMemory, Operand operand)
+{
+    switch (operand.kind)
+    {
+    case OPERAND_NONE:
+    case OPERAND_CONST:
+        return true;
+    case OPERAND_SYMBOL:
+        return !writesMemory;
+    case OPERAND_TEMP:
+    {
+        int b = definingBlock(lo, operand);
+        return b >= 0 && !loopContains(&lo->forest, l, b);
+    }
+    default:
+        return false;
+    }
+}
+
+// Pure computations that cannot trap, so they may run when the loop does not
+static bool isHoistable(TAC *tac)
+{
+    if (tac->result.kind != OPERAND_TEMP)
+        return false;
+    if (tac->op == TAC_ADDRESS)
+        return true;
+    if (tac->op == TAC_DIV)
+        return tac->arg2.kind == OPERAND_CONST && tac->arg2.value != 0;
+    return isArithmeticOp(tac->op);
+}
+
+// Moves the invariant computations of loop l into its preheader. Blocks
+// are visited in reverse postorder, so an instruction whose operands were
+// hoisted before it is hoisted too. Copies and constants stay, as leaving
+// SSA form removes most of them anyway.
+static int hoistInvariants(LoopOptimizer *lo, int l)
+{
+    Loop *loop = &lo->forest.loops[l];
+    CFG *cfg = &lo->ssa->cfg;
+    TACList *code = lo->ssa->code;
+    bool writesMemory = loopWritesMemory(lo, loop);
+    int hoisted = 0;
+
+    for (int k = 0; k < loop->blockCount; k++)
+    {
+        int b = loop->blocks[k];
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END;)
+        {
+            int next = blockNext(cfg, block, i);
+            TAC tac = code->code[i];
+            if (isHoistable(&tac) && !(block->first == i && block->last == i) &&
+                isInvariant(lo, l, writesMemory, tac.arg1) && isInvariant(lo, l, writesMemory, tac.arg2))
+            {
+                unlinkFromBlock(lo, b, i);
+                appendToPreheader(lo, loop->preheader, &tac);
+                hoisted++;
+            }
+            i = next;
+        }
+    }
+    return hoisted;
+}
+
+// Strength reduction //
+
+// A basic induction variable: a header phi whose value on every back edge
+// is its own value plus a constant step
+typedef struct InductionVariable
+{
+    Operand value;
+    Operand next;    // value + step, computed by instruction increment
+    Operand initial; // The value on entry, from the preheader
+    int increment;
+    int incrementBlock;
+    unsigned step;
+} InductionVariable;
+
+// An index as scale * variable + invariant + offset, in 32-bit wraparound
+// arithmetic. A stepped index uses the variable's next value.
+typedef struct LinearIndex
+{
+    int variable; // Induction variable, -1 if the index does not step
+    bool stepped;
+    unsigned scale;
+    unsigned offset;
+    Operand invariant; // OPERAND_NONE if there is none
+} LinearIndex;
+
+// A pointer that steps with an induction variable: on each iteration value
+// is the address of array[scale * variable + invariant], and next is that
+// address for the variable's next value.
+typedef struct PointerVariable
+{
+    Operand array;
+    int variable;
+    unsigned scale;
+    Operand invariant;
+    Operand address; // &array, computed in the preheader
+    Operand value;
+    Operand next;
+} PointerVariable;
+
+typedef struct LoopContext
+{
+    LoopOptimizer *lo;
+    int loop;
+    bool writesMemory;
+    InductionVariable *variables;
+    int variableCount;
+} LoopContext;
+
+static int findInductionVariables(LoopContext *ctx)
+{
+    LoopOptimizer *lo = ctx->lo;
+    Loop *loop = &lo->forest.loops[ctx->loop];
+    SSAForm *ssa = lo->ssa;
+    TACList *code = ssa->code;
+    BasicBlock *header = &ssa->cfg.blocks[loop->header];
+    int phiCount = ssa->phiStart[loop->header + 1] - ssa->phiStart[loop->header];
+    ctx->variables = (InductionVariable *)allocateOrDie(sizeof(InductionVariable) * phiCount);
+    ctx->variableCount = 0;
+
+    for (int p = ssa->phiStart[loop->header]; p < ssa->phiStart[loop->header + 1]; p++)
+    {
+        Phi *phi = &ssa->phis[p];
+        InductionVariable iv = {phi->result, {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, -1, -1, 0};
+        bool same = phi->result.kind == OPERAND_TEMP;
+        for (int j = 0; j < header->predCount && same; j++)
+        {
+            int pred = header->preds[j];
+            if (pred == loop->preheader)
+                iv.initial = phi->args[j];
+            else if (loopContains(&lo->forest, ctx->loop, pred))
+            {
+                if (iv.next.kind == OPERAND_NONE)
+                    iv.next = phi->args[j];
+                else
+                    same = sameOperand(iv.next, phi->args[j]);
+            }
+        }
+        if (!same || iv.initial.kind == OPERAND_NONE || iv.next.kind != OPERAND_TEMP)
+            continue;
+
+        // Follow copies back to the increment
+        Operand v = iv.next;
+        for (int chased = 0; chased < LOOP_CHASE_LIMIT; chased++)
+        {
+            int d = definingInstruction(lo, v);
+            if (d < 0 || !loopContains(&lo->forest, ctx->loop, definingBlock(lo, v)))
+                break;
+            TAC *tac = &code->code[d];
+            if (tac->op == TAC_ASSIGN && tac->arg1.kind == OPERAND_TEMP)
+            {
+                v = tac->arg1;
+                continue;
+            }
+            if (tac->op == TAC_ADD && sameOperand(tac->arg1, iv.value) && tac->arg2.kind == OPERAND_CONST)
+                iv.step = (unsigned)tac->arg2.value;
+            else if (tac->op == TAC_ADD && sameOperand(tac->arg2, iv.value) && tac->arg1.kind == OPERAND_CONST)
+                iv.step = (unsigned)tac->arg1.value;
+            else if (tac->op == TAC_SUB && sameOperand(tac->arg1, iv.value) && tac->arg2.kind == OPERAND_CONST)
+                iv.step = 0u - (unsigned)tac->arg2.value;
+            else
+                break;
+            iv.next = tac->result;
+            iv.increment = d;
+            iv.incrementBlock = definingBlock(lo, v);
+            break;
+        }
+        if (iv.increment >= 0)
+            ctx->variables[ctx->variableCount++] = iv;
+    }
+    return ctx->variableCount;
+}
+
+static void scaleIndex(LinearIndex *index, unsigned factor)
+{
+    index->scale *= factor;
+    index->offset *= factor;
+}
+
+// a + b, if both step with the same variable or at most one steps
+static bool addIndexes(LinearIndex *a, const LinearIndex *b)
+{
+    if (b->variable >= 0)
+    {
+        if (a->variable >= 0 && (a->variable != b->variable || a->stepped != b->stepped))
+            return false;
+        a->variable = b->variable;
+        a->stepped = b->stepped;
+    }
+    if (b->invariant.kind != OPERAND_NONE)
+    {
+        if (a->invariant.kind != OPERAND_NONE)
+            return false;
+        a->invariant = b->invariant;
+    }
+    a->scale += b->scale;
+    a->offset += b->offset;
+    return true;
+}
+
+// True for an index that is only a constant
+static bool isConstantIndex(const LinearIndex *index)
+{
+    return index->variable < 0 && index->invariant.kind == OPERAND_NONE;
+}
+
+// Expresses operand as a linear function of one induction variable,
+// following its definitions inside the loop
+static bool expressIndex(LoopContext *ctx, Operand operand, int depth, LinearIndex *index)
+{
+    *index = (LinearIndex){-1, false, 0, 0, {OPERAND_NONE, 0}};
+    if (operand.kind == OPERAND_CONST)
+    {
+        index->offset = (unsigned)operand.value;
+        return true;
+    }
+    for (int k = 0; k < ctx->variableCount; k++)
+    {
+        if (sameOperand(operand, ctx->variables[k].value) || sameOperand(operand, ctx->variables[k].next))
+        {
+            index->variable = k;
+            index->stepped = sameOperand(operand, ctx->variables[k].next);
+            index->scale = 1;
+            return true;
+        }
+    }
+    if (isInvariant(ctx->lo, ctx->loop, ctx->writesMemory, operand))
+    {
+        index->invariant = operand;
+        return true;
+    }
+    if (operand.kind != OPERAND_TEMP || depth >= LOOP_CHASE_LIMIT)
+        return false;
+    int d = definingInstruction(ctx->lo, operand);
+    if (d < 0)
+        return false;
+
+    TAC tac = ctx->lo->ssa->code->code[d];
+    LinearIndex right;
+    switch (tac.op)
+    {
+    case TAC_ASSIGN:
+        return expressIndex(ctx, tac.arg1, depth + 1, index);
+    case TAC_ADD:
+        return expressIndex(ctx, tac.arg1, depth + 1, index) && expressIndex(ctx, tac.arg2, depth + 1, &right) &&
+               addIndexes(index, &right);
+    case TAC_SUB:
+        if (!expressIndex(ctx, tac.arg1, depth + 1, index) || !expressIndex(ctx, tac.arg2, depth + 1, &right) ||
+            right.invariant.kind != OPERAND_NONE)
+            return false;
+        scaleIndex(&right, 0u - 1u);
+        return addIndexes(index, &right);
+    case TAC_MUL:
+        if (!expressIndex(ctx, tac.arg1, depth + 1, index) || !expressIndex(ctx, tac.arg2, depth + 1, &right))
+            return false;
+        if (isConstantIndex(index))
+        {
+            LinearIndex constant = *index;
+            *index = right;
+            right = constant;
+        }
+        if (!isConstantIndex(&right) || index->invariant.kind != OPERAND_NONE)
+            return false;
+        scaleIndex(index, right.offset);
+        return true;
+    case TAC_SLL:
+        if (tac.arg2.kind != OPERAND_CONST || tac.arg2.value < 0 || tac.arg2.value > 31 ||
+            !expressIndex(ctx, tac.arg1, depth + 1, index) || index->invariant.kind != OPERAND_NONE)
+            return false;
+        scaleIndex(index, 1u << tac.arg2.value);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Emits result = a op b into the preheader, or folds it if both are constant
+static Operand emitInPreheader(LoopContext *ctx, TACOpcode op, Operand a, Operand b)
+{
+    int folded;
+    if (a.kind == OPERAND_CONST && b.kind == OPERAND_CONST && evaluateArithmetic(op, a.value, b.value, &folded))
+        return constOperand(folded);
+    Operand result = createTempVar(ctx->lo->ssa->code);
+    TAC tac = {op, a, b, result, TAC_END};
+    appendToPreheader(ctx->lo, ctx->lo->forest.loops[ctx->loop].preheader, &tac);
+    return result;
+}
+
+// Sets up pointer: its start address in the preheader, a phi at the header
+// and its step right after the induction variable's
+static void createPointer(LoopContext *ctx, PointerVariable *pointer, const PointerVariable *others, int otherCount)
+{
+    LoopOptimizer *lo = ctx->lo;
+    SSAForm *ssa = lo->ssa;
+    Loop *loop = &lo->forest.loops[ctx->loop];
+    InductionVariable *iv = &ctx->variables[pointer->variable];
+    Operand none = {OPERAND_NONE, 0};
+
+    pointer->address = none;
+    for (int k = 0; k < otherCount; k++)
+    {
+        if (sameOperand(others[k].array, pointer->array))
+            pointer->address = others[k].address;
+    }
+    if (pointer->address.kind == OPERAND_NONE)
+        pointer->address = emitInPreheader(ctx, TAC_ADDRESS, pointer->array, none);
+
+    Operand element = iv->initial;
+    if (pointer->scale != 1)
+        element = emitInPreheader(ctx, TAC_MUL, element, constOperand((int)pointer->scale));
+    if (pointer->invariant.kind != OPERAND_NONE)
+        element = emitInPreheader(ctx, TAC_ADD, element, pointer->invariant);
+    Operand start = emitInPreheader(ctx, TAC_ADD, pointer->address, emitInPreheader(ctx, TAC_SLL, element, constOperand(2)));
+
+    pointer->value = createTempVar(ssa->code);
+    pointer->next = createTempVar(ssa->code);
+    Phi *phi = addPhi(ssa, loop->header, pointer->value);
+    BasicBlock *header = &ssa->cfg.blocks[loop->header];
+    for (int j = 0; j < header->predCount; j++)
+    {
+        if (header->preds[j] == loop->preheader)
+            phi->args[j] = start;
+        else if (loopContains(&lo->forest, ctx->loop, header->preds[j]))
+            phi->args[j] = pointer->next;
+    }
+    noteDefinition(lo, pointer->value, loop->header, -1);
+
+    TAC step = {TAC_ADD, pointer->value, constOperand((int)(4u * pointer->scale * iv->step)), pointer->next, TAC_END};
+    insertAfter(lo, iv->incrementBlock, iv->increment, &step);
+}
+
+// Turns the array accesses of loop l whose index steps with an induction
+// variable into accesses through a pointer that steps with it, one pointer
+// per array, variable, scale and invariant part. The constant part of the
+// index becomes the access's offset from the pointer.
+static int reduceAccesses(LoopOptimizer *lo, int l)
+{
+    Loop *loop = &lo->forest.loops[l];
+    CFG *cfg = &lo->ssa->cfg;
+    TACList *code = lo->ssa->code;
+    LoopContext ctx = {lo, l, loopWritesMemory(lo, loop), NULL, 0};
+    PointerVariable pointers[LOOP_POINTER_LIMIT];
+    int pointerCount = 0;
+    int reduced = 0;
+
+    if (findInductionVariables(&ctx) == 0)
+    {
+        trackedFree(ctx.variables);
+        return 0;
+    }
+
+    for (int k = 0; k < loop->blockCount; k++)
+    {
+        int b = loop->blocks[k];
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            TAC *tac = &code->code[i];
+            if (tac->op != TAC_ARRAY_LOAD && tac->op != TAC_ARRAY_STORE)
+                continue;
+            LinearIndex index;
+            if (!expressIndex(&ctx, tac->arg2, 0, &index) || index.variable < 0 || index.scale == 0)
+                continue;
+            int offset = (int)(4u * index.offset);
+            if (offset < -32768 || offset > 32767)
+                continue;
+
+            Operand array = tac->op == TAC_ARRAY_LOAD ? tac->arg1 : tac->result;
+            PointerVariable *pointer = NULL;
+            for (int p = 0; p < pointerCount && !pointer; p++)
+            {
+                if (sameOperand(pointers[p].array, array) && pointers[p].variable == index.variable &&
+                    pointers[p].scale == index.scale && sameOperand(pointers[p].invariant, index.invariant))
+                    pointer = &pointers[p];
+            }
+            if (!pointer)
+            {
+                if (pointerCount == LOOP_POINTER_LIMIT)
+                    continue;
+                pointer = &pointers[pointerCount];
+                pointer->array = array;
+                pointer->variable = index.variable;
+                pointer->scale = index.scale;
+                pointer->invariant = index.invariant;
+                createPointer(&ctx, pointer, pointers, pointerCount++);
+            }
+
+            Operand address = index.stepped ? pointer->next : pointer->value;
+            if (offset != 0)
+            {
+                Operand base = address;
+                address = createTempVar(code);
+                TAC add = {TAC_ADD, base, constOperand(offset), address, TAC_END};
+                insertBefore(lo, b, i, &add);
+            }
+            tac = &code->code[i];
+            if (tac->op == TAC_ARRAY_LOAD)
+                *tac = (TAC){TAC_POINTER_LOAD, array, address, tac->result, tac->next};
+            else
+                *tac = (TAC){TAC_POINTER_STORE, tac->arg1, address, array, tac->next};
+            reduced++;
+        }
+    }
+
+    trackedFree(ctx.variables);
+    return reduced;
+}
+
+// Runs invariant code motion and then strength reduction on every loop with
+// a preheader, inner loops first: what an inner loop hoists or sets up in
+// its preheader is then in the body of the loop around it, to be hoisted
+// again from there.
+void optimizeLoops(SSAForm *ssa, LoopStats *stats)
+{
+    LoopOptimizer lo = {ssa};
+    findLoops(&lo.forest, &ssa->cfg, &ssa->dom, ssa->blockReachable);
+    stats->loops += lo.forest.loopCount;
+    if (lo.forest.loopCount == 0)
+    {
+        freeLoops(&lo.forest);
+        return;
+    }
+
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    lo.prevCapacity = code->count * 2 + 16;
+    lo.prev = (int *)allocateOrDie(sizeof(int) * lo.prevCapacity);
+    int last = TAC_END;
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+    {
+        lo.prev[i] = last;
+        last = i;
+    }
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        if (!ssa->blockReachable[b])
+            continue;
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+        {
+            if (ssa->phis[p].result.kind == OPERAND_TEMP)
+                noteDefinition(&lo, ssa->phis[p].result, b, -1);
+        }
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            Operand *def = tacDefinition(&code->code[i]);
+            if (def && def->kind == OPERAND_TEMP)
+                noteDefinition(&lo, *def, b, i);
+        }
+    }
+
+    int hoisted = 0;
+    int reduced = 0;
+    for (int l = 0; l < lo.forest.loopCount; l++)
+    {
+        if (lo.forest.loops[l].preheader < 0)
+            continue;
+        hoisted += hoistInvariants(&lo, l);
+        reduced += reduceAccesses(&lo, l);
+    }
+    stats->hoisted += hoisted;
+    stats->reduced += reduced;
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Loops: %d loops, %d invariants hoisted, %d accesses through pointers\n",
+          lo.forest.loopCount, hoisted, reduced);
+
+    trackedFree(lo.prev);
+    trackedFree(lo.defBlock);
+    trackedFree(lo.defInstruction);
+    freeLoops(&lo.forest);
+}
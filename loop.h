@@ -0,0 +1,52 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "tac.h"
+#include "ssa.h"
+
+// Natural loops and the loop passes over the SSA form. A loop is found from
+// each back edge, an edge into a block that dominates its source, and holds
+// the header and every block that reaches the back edge without passing the
+// header. Before SSA construction each loop header is given a preheader: a
+// block of its own that is the only way into the loop from outside, so
+// code moved out of the loop has one place to go. Loop-invariant code
+// motion then hoists pure computations whose operands do not change in the
+// loop into the preheader, and strength reduction turns array accesses
+// indexed by an induction variable into loads and stores through a pointer
+// that is stepped along with the variable.
+
+#define LOOP_POINTER_LIMIT 4 // Pointer induction variables one loop may add
+#define LOOP_CHASE_LIMIT 8   // Definitions followed to express an index
+
+typedef struct Loop
+{
+    int header;
+    int preheader; // The header's only predecessor from outside, -1 if none
+    int parent;    // Innermost enclosing loop, -1 if outermost
+    int depth;     // 1 for an outermost loop
+    int *blocks;   // Blocks of the loop in reverse postorder
+    int blockCount;
+} Loop;
+
+typedef struct LoopForest
+{
+    Loop *loops; // Inner loops before the loops enclosing them
+    int loopCount;
+    int *loopOf; // Block -> innermost loop containing it, -1 if none
+    int *blockStorage;
+} LoopForest;
+
+typedef struct LoopStats
+{
+    int loops;   // Natural loops found
+    int hoisted; // Instructions moved into a preheader
+    int reduced; // Array accesses turned into pointer accesses
+} LoopStats;
+
+void findLoops(LoopForest *forest, CFG *cfg, DominatorTree *dom, const bool *reachable);
+bool loopContains(LoopForest *forest, int loop, int b);
+void freeLoops(LoopForest *forest);
+int insertPreheaders(TACList *list);
+void optimizeLoops(SSAForm *ssa, LoopStats *stats);
+
+#endif // LOOP_H
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "compiler.h"
+#include "tacimage.h"
+#include "trace.h"
+
+// Batch driver: compiles every file named on the command line, each with
+// its own CompilerContext, on a pool of worker threads.
+//
+//   parser [-j jobs] [-ir] [-tac] [-bounds] [-cache dir] [-cache-size bytes]
+//          [-stats] [-stats-json out.json] file.cmm ...
+//
+// foo.cmm is compiled to foo.s; -ir also writes foo.ir and foo.opt.ir, and
+// -tac writes the unoptimized TAC as the binary image foo.tac. Giving
+// foo.tac as an input skips the front end and compiles the image to foo.s.
+// -bounds checks every array index at run time, except where the optimizer
+// proves it in range; a program indexing outside an array stops with an
+// error and exit status 1.
+// -cache keeps the assembly and optimized TAC of each input in dir, keyed by
+// its contents, and the optimized TAC of each function, so an input with one
+// function edited reoptimizes only what that edit reaches. dir is trimmed
+// to -cache-size bytes (64 MB by default) once all files are done.
+// -stats prints per-phase time, memory and counters for each file to
+// stderr; -stats-json writes the same figures as a JSON array.
+// With no files, testProg.cmm is compiled.
+
+#define DEFAULT_INPUT "testProg.cmm"
+
+typedef struct CompileJob
+{
+    const char *inputFilename;
+    char *outputFilename;
+    char *tacFilename;
+    char *optimizedFilename;
+    char *imageFilename;
+    const char *cacheDirectory;
+    bool boundsChecks;
+    bool collectStats;
+    bool succeeded;
+    CompilerStats stats;
+} CompileJob;
+
+typedef struct JobQueue
+{
+    CompileJob *jobs;
+    int count;
+    int next; // Next job to hand out
+    pthread_mutex_t lock;
+} JobQueue;
+
+// Returns inputFilename with its extension replaced by extension.
+static char *replaceExtension(const char *inputFilename, const char *extension)
+{
+    const char *dot = strrchr(inputFilename, '.');
+    const char *slash = strrchr(inputFilename, '/');
+    size_t stem = (dot && (!slash || dot > slash)) ? (size_t)(dot - inputFilename) : strlen(inputFilename);
+
+    char *name = (char *)malloc(stem + strlen(extension) + 1);
+    if (!name)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(name, inputFilename, stem);
+    strcpy(name + stem, extension);
+    return name;
+}
+
+static void runJob(CompileJob *job)
+{
+    CompilerContext ctx;
+    initCompilerContext(&ctx, job->inputFilename, job->outputFilename);
+    ctx.tacFilename = job->tacFilename;
+    ctx.optimizedFilename = job->optimizedFilename;
+    ctx.imageFilename = job->imageFilename;
+    ctx.cacheDirectory = job->cacheDirectory;
+    ctx.boundsChecks = job->boundsChecks;
+    ctx.collectStats = job->collectStats;
+    job->succeeded = compileFile(&ctx);
+    job->stats = ctx.stats;
+    freeCompilerContext(&ctx);
+}
+
+static void *worker(void *arg)
+{
+    JobQueue *queue = (JobQueue *)arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        int index = queue->next < queue->count ? queue->next++ : -1;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index < 0)
+            return NULL;
+        runJob(&queue->jobs[index]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int jobs = 1;
+    bool dumpIR = false;
+    bool writeImage = false;
+    bool boundsChecks = false;
+    const char *cacheDirectory = NULL;
+    size_t cacheLimit = CACHE_DEFAULT_LIMIT;
+    bool printStats = false;
+    const char *statsJSONFilename = NULL;
+    const char **inputs = (const char **)malloc(sizeof(char *) * (argc + 1));
+    int inputCount = 0;
+
+    // Select trace categories and levels, e.g. CMM_TRACE="parser=2,symtab=3"
+    initTrace(getenv("CMM_TRACE"));
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-ir") == 0)
+        {
+            dumpIR = true;
+        }
+        else if (strcmp(argv[i], "-tac") == 0)
+        {
+            writeImage = true;
+        }
+        else if (strcmp(argv[i], "-bounds") == 0)
+        {
+            boundsChecks = true;
+        }
+        else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+        {
+            cacheDirectory = argv[++i];
+        }
+        else if (strcmp(argv[i], "-cache-size") == 0 && i + 1 < argc)
+        {
+            cacheLimit = (size_t)strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-stats") == 0)
+        {
+            printStats = true;
+        }
+        else if (strcmp(argv[i], "-stats-json") == 0 && i + 1 < argc)
+        {
+            statsJSONFilename = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Usage: %s [-j jobs] [-ir] [-tac] [-bounds] [-cache dir] [-cache-size bytes] [-stats] [-stats-json file] file.cmm ...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            inputs[inputCount++] = argv[i];
+        }
+    }
+    if (inputCount == 0)
+        inputs[inputCount++] = DEFAULT_INPUT;
+    if (jobs < 1)
+        jobs = 1;
+    if (jobs > inputCount)
+        jobs = inputCount;
+
+    JobQueue queue;
+    queue.jobs = (CompileJob *)calloc(inputCount, sizeof(CompileJob));
+    queue.count = inputCount;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    for (int i = 0; i < inputCount; i++)
+    {
+        CompileJob *job = &queue.jobs[i];
+        job->inputFilename = inputs[i];
+        job->outputFilename = replaceExtension(inputs[i], ".s");
+        job->tacFilename = dumpIR ? replaceExtension(inputs[i], ".ir") : NULL;
+        job->optimizedFilename = dumpIR ? replaceExtension(inputs[i], ".opt.ir") : NULL;
+        job->imageFilename = writeImage && !isTACImageFilename(inputs[i]) ? replaceExtension(inputs[i], ".tac") : NULL;
+        job->cacheDirectory = cacheDirectory;
+        job->boundsChecks = boundsChecks;
+        job->collectStats = printStats || statsJSONFilename;
+    }
+
+    // The main thread is one of the workers
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * jobs);
+    for (int t = 1; t < jobs; t++)
+    {
+        if (pthread_create(&threads[t], NULL, worker, &queue) != 0)
+        {
+            fprintf(stderr, "Failed to start worker thread\n");
+            jobs = t;
+            break;
+        }
+    }
+    worker(&queue);
+    for (int t = 1; t < jobs; t++)
+        pthread_join(threads[t], NULL);
+
+    int evicted = cacheDirectory ? trimCache(cacheDirectory, cacheLimit) : 0;
+
+    if (printStats)
+    {
+        for (int i = 0; i < inputCount; i++)
+            printCompilerStats(stderr, queue.jobs[i].inputFilename, &queue.jobs[i].stats);
+    }
+    if (cacheDirectory && (printStats || statsJSONFilename))
+    {
+        int hits = 0;
+        int misses = 0;
+        int functionHits = 0;
+        int functionMisses = 0;
+        for (int i = 0; i < inputCount; i++)
+        {
+            hits += queue.jobs[i].stats.cache == CACHE_HIT;
+            misses += queue.jobs[i].stats.cache == CACHE_MISS;
+            functionHits += queue.jobs[i].stats.functionHits;
+            functionMisses += queue.jobs[i].stats.functionMisses;
+        }
+        fprintf(stderr, "Cache %s: %d hits, %d misses, %d evicted; functions: %d hits, %d misses\n", cacheDirectory,
+                hits, misses, evicted, functionHits, functionMisses);
+    }
+    if (statsJSONFilename)
+    {
+        FILE *out = fopen(statsJSONFilename, "w");
+        if (out)
+        {
+            fputs("[\n", out);
+            for (int i = 0; i < inputCount; i++)
+            {
+                fputs("  ", out);
+                printCompilerStatsJSON(out, queue.jobs[i].inputFilename, &queue.jobs[i].stats);
+                fputs(i + 1 < inputCount ? ",\n" : "\n", out);
+            }
+            fputs("]\n", out);
+            fclose(out);
+        }
+        else
+        {
+            perror(statsJSONFilename);
+        }
+    }
+
+    int failures = 0;
+    for (int i = 0; i < inputCount; i++)
+    {
+        CompileJob *job = &queue.jobs[i];
+        if (!job->succeeded)
+            failures++;
+        free(job->outputFilename);
+        free(job->tacFilename);
+        free(job->optimizedFilename);
+        free(job->imageFilename);
+    }
+    if (inputCount > 1)
+        TRACE(TRACE_DRIVER, TRACE_INFO, "Compiled %d files, %d failed\n", inputCount, failures);
+
+    pthread_mutex_destroy(&queue.lock);
+    free(queue.jobs);
+    free(threads);
+    free(inputs);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#include "memtrack.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Every block carries a header with its size, so frees can be subtracted,
+// and whether it was counted, so blocks allocated while counting was off
+// never drive the counters negative.
+typedef union BlockHeader
+{
+    struct
+    {
+        size_t size;
+        bool counted;
+    };
+    max_align_t align; // Keeps the payload suitably aligned
+} BlockHeader;
+
+static _Thread_local MemoryCounters *activeCounters;
+
+void setMemoryCounters(MemoryCounters *counters)
+{
+    activeCounters = counters;
+}
+
+MemoryCounters *getMemoryCounters()
+{
+    return activeCounters;
+}
+
+static void countAllocation(BlockHeader *header, size_t size)
+{
+    header->size = size;
+    header->counted = activeCounters != NULL;
+    if (!header->counted)
+        return;
+
+    activeCounters->current += size;
+    activeCounters->total += size;
+    activeCounters->allocations++;
+    if (activeCounters->current > activeCounters->peak)
+        activeCounters->peak = activeCounters->current;
+}
+
+static void countFree(BlockHeader *header)
+{
+    if (header->counted && activeCounters && activeCounters->current >= header->size)
+        activeCounters->current -= header->size;
+}
+
+void *trackedMalloc(size_t size)
+{
+    BlockHeader *header = (BlockHeader *)malloc(sizeof(BlockHeader) + size);
+    if (!header)
+        return NULL;
+    countAllocation(header, size);
+    return header + 1;
+}
+
+void *trackedCalloc(size_t count, size_t size)
+{
+    if (size && count > ((size_t)-1 - sizeof(BlockHeader)) / size)
+        return NULL;
+    void *ptr = trackedMalloc(count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *trackedRealloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return trackedMalloc(size);
+
+    BlockHeader *header = (BlockHeader *)ptr - 1;
+    BlockHeader old = *header;
+    BlockHeader *resized = (BlockHeader *)realloc(header, sizeof(BlockHeader) + size);
+    if (!resized)
+        return NULL;
+
+    countFree(&old);
+    countAllocation(resized, size);
+    return resized + 1;
+}
+
+void trackedFree(void *ptr)
+{
+    if (!ptr)
+        return;
+    BlockHeader *header = (BlockHeader *)ptr - 1;
+    countFree(header);
+    free(header);
+}
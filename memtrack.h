@@ -0,0 +1,27 @@
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <stddef.h>
+
+// Allocation accounting for the statistics report. The compiler allocates
+// through these wrappers; they behave like malloc and friends (returning
+// NULL on failure) and, while a thread has counters installed, add each
+// allocation to them. With no counters installed the cost is one branch.
+
+typedef struct MemoryCounters
+{
+    size_t current; // Bytes allocated and not yet freed
+    size_t peak;    // High-water mark of current
+    size_t total;   // Bytes allocated overall
+    unsigned long allocations;
+} MemoryCounters;
+
+void setMemoryCounters(MemoryCounters *counters);
+MemoryCounters *getMemoryCounters();
+
+void *trackedMalloc(size_t size);
+void *trackedCalloc(size_t count, size_t size);
+void *trackedRealloc(void *ptr, size_t size);
+void trackedFree(void *ptr);
+
+#endif // MEMTRACK_H
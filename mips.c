@@ -0,0 +1,345 @@
+#include "mips.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *registerNames[MIPS_REGISTER_COUNT] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"};
+
+// Operand layout of each opcode, which decides both how it is written and
+// which registers it reads and writes
+typedef enum
+{
+    FORMAT_NONE,    // op
+    FORMAT_LABEL,   // L<imm>:
+    FORMAT_DST_IMM, // op dst, imm
+    FORMAT_DST_MEM, // op dst, address
+    FORMAT_SRC_MEM, // op src1, address
+    FORMAT_DST_SRC, // op dst, src1
+    FORMAT_DST_SRC_SRC, // op dst, src1, src2
+    FORMAT_DST_SRC_IMM, // op dst, src1, imm
+    FORMAT_SRC_SRC, // op src1, src2
+    FORMAT_DST,     // op dst
+    FORMAT_JUMP,    // op L<imm>
+    FORMAT_BRANCH,  // op src1, src2, L<imm>
+    FORMAT_CALL,    // op symbol
+    FORMAT_SRC      // op src1
+} MipsFormat;
+
+static const struct
+{
+    const char *name;
+    MipsFormat format;
+} opcodeInfo[MIPS_OPCODE_COUNT] = {
+    [MIPS_NOP] = {"nop", FORMAT_NONE},
+    [MIPS_LABEL] = {"", FORMAT_LABEL},
+    [MIPS_LI] = {"li", FORMAT_DST_IMM},
+    [MIPS_LUI] = {"lui", FORMAT_DST_IMM},
+    [MIPS_LA] = {"la", FORMAT_DST_MEM},
+    [MIPS_LW] = {"lw", FORMAT_DST_MEM},
+    [MIPS_SW] = {"sw", FORMAT_SRC_MEM},
+    [MIPS_MOVE] = {"move", FORMAT_DST_SRC},
+    [MIPS_ADDU] = {"addu", FORMAT_DST_SRC_SRC},
+    [MIPS_SUBU] = {"subu", FORMAT_DST_SRC_SRC},
+    [MIPS_MUL] = {"mul", FORMAT_DST_SRC_SRC},
+    [MIPS_SLLV] = {"sllv", FORMAT_DST_SRC_SRC},
+    [MIPS_SRAV] = {"srav", FORMAT_DST_SRC_SRC},
+    [MIPS_SRLV] = {"srlv", FORMAT_DST_SRC_SRC},
+    [MIPS_SLT] = {"slt", FORMAT_DST_SRC_SRC},
+    [MIPS_SLTU] = {"sltu", FORMAT_DST_SRC_SRC},
+    [MIPS_ADDIU] = {"addiu", FORMAT_DST_SRC_IMM},
+    [MIPS_SLL] = {"sll", FORMAT_DST_SRC_IMM},
+    [MIPS_SRA] = {"sra", FORMAT_DST_SRC_IMM},
+    [MIPS_SRL] = {"srl", FORMAT_DST_SRC_IMM},
+    [MIPS_ORI] = {"ori", FORMAT_DST_SRC_IMM},
+    [MIPS_XORI] = {"xori", FORMAT_DST_SRC_IMM},
+    [MIPS_SLTI] = {"slti", FORMAT_DST_SRC_IMM},
+    [MIPS_SLTIU] = {"sltiu", FORMAT_DST_SRC_IMM},
+    [MIPS_DIV] = {"div", FORMAT_SRC_SRC},
+    [MIPS_MFLO] = {"mflo", FORMAT_DST},
+    [MIPS_J] = {"j", FORMAT_JUMP},
+    [MIPS_BEQ] = {"beq", FORMAT_BRANCH},
+    [MIPS_BNE] = {"bne", FORMAT_BRANCH},
+    [MIPS_JAL] = {"jal", FORMAT_CALL},
+    [MIPS_JR] = {"jr", FORMAT_SRC},
+    [MIPS_SYSCALL] = {"syscall", FORMAT_NONE},
+};
+
+void initMipsList(MipsList *list)
+{
+    list->code = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void freeMipsList(MipsList *list)
+{
+    trackedFree(list->code);
+    list->code = NULL;
+    list->count = list->capacity = 0;
+}
+
+// Returns the new instruction with every operand cleared. The pointer is
+// only good until the next append.
+MipsInstruction *appendMips(MipsList *list, MipsOpcode op)
+{
+    if (list->count == list->capacity)
+    {
+        int newCapacity = list->capacity ? list->capacity * 2 : 256;
+        MipsInstruction *code = (MipsInstruction *)trackedRealloc(list->code, sizeof(MipsInstruction) * newCapacity);
+        if (!code)
+        {
+            fprintf(stderr, "appendMips: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        list->code = code;
+        list->capacity = newCapacity;
+    }
+
+    MipsInstruction *instr = &list->code[list->count++];
+    instr->op = op;
+    instr->dst = instr->src1 = instr->src2 = MIPS_NO_REGISTER;
+    instr->imm = 0;
+    instr->address = (MipsAddress){NULL, 0, MIPS_NO_REGISTER};
+    return instr;
+}
+
+void compactMipsList(MipsList *list)
+{
+    int kept = 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        if (list->code[i].op != MIPS_NOP)
+            list->code[kept++] = list->code[i];
+    }
+    list->count = kept;
+}
+
+int mipsInstructionCount(const MipsList *list)
+{
+    int count = 0;
+    for (int i = 0; i < list->count; i++)
+        count += list->code[i].op != MIPS_NOP && list->code[i].op != MIPS_LABEL;
+    return count;
+}
+
+int mipsWrittenRegister(const MipsInstruction *instr)
+{
+    switch (opcodeInfo[instr->op].format)
+    {
+    case FORMAT_DST_IMM:
+    case FORMAT_DST_MEM:
+    case FORMAT_DST_SRC:
+    case FORMAT_DST_SRC_SRC:
+    case FORMAT_DST_SRC_IMM:
+    case FORMAT_DST:
+        return instr->dst;
+    default:
+        return instr->op == MIPS_SYSCALL ? MIPS_V0 : MIPS_NO_REGISTER; // read_int answers in $v0
+    }
+}
+
+int mipsReadRegisters(const MipsInstruction *instr, int regs[4])
+{
+    int count = 0;
+    switch (opcodeInfo[instr->op].format)
+    {
+    case FORMAT_DST_SRC_SRC:
+    case FORMAT_SRC_SRC:
+    case FORMAT_BRANCH:
+        regs[count++] = instr->src1;
+        regs[count++] = instr->src2;
+        break;
+    case FORMAT_DST_SRC:
+    case FORMAT_DST_SRC_IMM:
+        regs[count++] = instr->src1;
+        break;
+    case FORMAT_SRC_MEM:
+        regs[count++] = instr->src1;
+        // fall through
+    case FORMAT_DST_MEM:
+        if (instr->address.base != MIPS_NO_REGISTER)
+            regs[count++] = instr->address.base;
+        break;
+    case FORMAT_SRC:
+        regs[count++] = instr->src1;
+        regs[count++] = MIPS_V0; // The return value
+        break;
+    case FORMAT_CALL:
+        for (int reg = MIPS_A0; reg <= MIPS_A3; reg++)
+            regs[count++] = reg;
+        break;
+    default:
+        if (instr->op == MIPS_SYSCALL)
+        {
+            regs[count++] = MIPS_V0;
+            regs[count++] = MIPS_A0;
+        }
+        break;
+    }
+    return count;
+}
+
+bool mipsReadsRegister(const MipsInstruction *instr, int reg)
+{
+    int regs[4];
+    int count = mipsReadRegisters(instr, regs);
+    for (int i = 0; i < count; i++)
+    {
+        if (regs[i] == reg)
+            return true;
+    }
+    return false;
+}
+
+bool sameMipsAddress(MipsAddress a, MipsAddress b)
+{
+    if (a.offset != b.offset || a.base != b.base)
+        return false;
+    if (a.symbol == b.symbol)
+        return true;
+    return a.symbol && b.symbol && strcmp(a.symbol, b.symbol) == 0;
+}
+
+const char *mipsRegisterName(int reg)
+{
+    return registerNames[reg];
+}
+
+const char *mipsOpcodeName(MipsOpcode op)
+{
+    return opcodeInfo[op].name;
+}
+
+static void writeRegister(Emitter *out, int reg)
+{
+    emitString(out, registerNames[reg]);
+}
+
+static void writeSeparator(Emitter *out)
+{
+    emitBytes(out, ", ", 2);
+}
+
+static void writeLabel(Emitter *out, int label)
+{
+    emitChar(out, 'L');
+    emitInt(out, label);
+}
+
+// symbol, symbol+offset, offset(base) or symbol+offset(base)
+static void writeAddress(Emitter *out, MipsAddress address)
+{
+    if (address.symbol)
+    {
+        emitString(out, address.symbol);
+        if (address.offset)
+        {
+            if (address.offset > 0)
+                emitChar(out, '+');
+            emitInt(out, address.offset);
+        }
+    }
+    else
+    {
+        emitInt(out, address.offset);
+    }
+    if (address.base != MIPS_NO_REGISTER)
+    {
+        emitChar(out, '(');
+        writeRegister(out, address.base);
+        emitChar(out, ')');
+    }
+}
+
+// Writes each instruction as one indented line, "\top a, b, c", and each
+// label flush left.
+void writeMipsList(Emitter *out, const MipsList *list)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        const MipsInstruction *instr = &list->code[i];
+        MipsFormat format = opcodeInfo[instr->op].format;
+        if (instr->op == MIPS_NOP)
+            continue;
+        if (format == FORMAT_LABEL)
+        {
+            writeLabel(out, instr->imm);
+            emitBytes(out, ":\n", 2);
+            continue;
+        }
+
+        emitChar(out, '\t');
+        emitString(out, opcodeInfo[instr->op].name);
+        if (format != FORMAT_NONE)
+            emitChar(out, ' ');
+        switch (format)
+        {
+        case FORMAT_DST_IMM:
+            writeRegister(out, instr->dst);
+            writeSeparator(out);
+            emitInt(out, instr->imm);
+            break;
+        case FORMAT_DST_MEM:
+            writeRegister(out, instr->dst);
+            writeSeparator(out);
+            writeAddress(out, instr->address);
+            break;
+        case FORMAT_SRC_MEM:
+            writeRegister(out, instr->src1);
+            writeSeparator(out);
+            writeAddress(out, instr->address);
+            break;
+        case FORMAT_DST_SRC:
+            writeRegister(out, instr->dst);
+            writeSeparator(out);
+            writeRegister(out, instr->src1);
+            break;
+        case FORMAT_DST_SRC_SRC:
+            writeRegister(out, instr->dst);
+            writeSeparator(out);
+            writeRegister(out, instr->src1);
+            writeSeparator(out);
+            writeRegister(out, instr->src2);
+            break;
+        case FORMAT_DST_SRC_IMM:
+            writeRegister(out, instr->dst);
+            writeSeparator(out);
+            writeRegister(out, instr->src1);
+            writeSeparator(out);
+            emitInt(out, instr->imm);
+            break;
+        case FORMAT_SRC_SRC:
+            writeRegister(out, instr->src1);
+            writeSeparator(out);
+            writeRegister(out, instr->src2);
+            break;
+        case FORMAT_DST:
+            writeRegister(out, instr->dst);
+            break;
+        case FORMAT_JUMP:
+            writeLabel(out, instr->imm);
+            break;
+        case FORMAT_BRANCH:
+            writeRegister(out, instr->src1);
+            writeSeparator(out);
+            writeRegister(out, instr->src2);
+            writeSeparator(out);
+            writeLabel(out, instr->imm);
+            break;
+        case FORMAT_CALL:
+            emitString(out, instr->address.symbol);
+            break;
+        case FORMAT_SRC:
+            writeRegister(out, instr->src1);
+            break;
+        default:
+            break;
+        }
+        emitChar(out, '\n');
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef MIPS_H
+#define MIPS_H
+
+#include <stdbool.h>
+#include "emitter.h"
+
+// MIPS instructions as data. The code generator appends to a MipsList, the
+// peephole pass rewrites it in place, and writeMipsList prints the text.
+
+// Register numbers, as the assembler knows them
+enum
+{
+    MIPS_ZERO = 0,
+    MIPS_V0 = 2,
+    MIPS_A0 = 4,  // $a0-$a3 are 4-7
+    MIPS_A3 = 7,
+    MIPS_T0 = 8,  // $t0-$t7 are 8-15
+    MIPS_S0 = 16, // $s0-$s7 are 16-23
+    MIPS_T8 = 24,
+    MIPS_T9 = 25,
+    MIPS_SP = 29,
+    MIPS_RA = 31,
+    MIPS_REGISTER_COUNT = 32
+};
+
+#define MIPS_NO_REGISTER -1
+#define MIPS_ARGUMENT_REGISTERS 4 // $a0-$a3; further arguments go on the stack
+
+typedef enum
+{
+    MIPS_NOP,   // Removed by the peephole pass; never written
+    MIPS_LABEL, // imm is the label number, written L<n>
+    MIPS_LI,    // dst = imm, a signed 16-bit value
+    MIPS_LUI,   // dst = imm << 16
+    MIPS_LA,    // dst = address
+    MIPS_LW,    // dst = word at address
+    MIPS_SW,    // word at address = src1
+    MIPS_MOVE,  // dst = src1
+    MIPS_ADDU,  // dst = src1 op src2
+    MIPS_SUBU,
+    MIPS_MUL,
+    MIPS_SLLV,
+    MIPS_SRAV,
+    MIPS_SRLV,
+    MIPS_SLT,   // Signed <
+    MIPS_SLTU,  // Unsigned <
+    MIPS_ADDIU, // dst = src1 op imm
+    MIPS_SLL,
+    MIPS_SRA,
+    MIPS_SRL,
+    MIPS_ORI,
+    MIPS_XORI,
+    MIPS_SLTI,  // Signed <
+    MIPS_SLTIU, // Unsigned <
+    MIPS_DIV,   // lo = src1 / src2
+    MIPS_MFLO,  // dst = lo
+    MIPS_J,     // Jump to label imm
+    MIPS_BEQ,   // Branch to label imm if src1 == src2
+    MIPS_BNE,   // Branch to label imm if src1 != src2
+    MIPS_JAL,   // Call the function named by address.symbol
+    MIPS_JR,    // Jump to the address in src1; only used to return
+    MIPS_SYSCALL,
+    MIPS_OPCODE_COUNT
+} MipsOpcode;
+
+// A memory operand: symbol+offset, offset(base) or symbol+offset(base).
+// Symbols are compared by pointer first, so pass the interned spelling.
+typedef struct MipsAddress
+{
+    const char *symbol; // NULL for a plain offset(base)
+    int offset;
+    int base;           // MIPS_NO_REGISTER for an absolute address
+} MipsAddress;
+
+typedef struct MipsInstruction
+{
+    MipsOpcode op;
+    int dst;
+    int src1;
+    int src2;
+    int imm;
+    MipsAddress address;
+} MipsInstruction;
+
+typedef struct MipsList
+{
+    MipsInstruction *code;
+    int count;
+    int capacity;
+} MipsList;
+
+void initMipsList(MipsList *list);
+void freeMipsList(MipsList *list);
+MipsInstruction *appendMips(MipsList *list, MipsOpcode op);
+void compactMipsList(MipsList *list); // Drops MIPS_NOP entries
+int mipsInstructionCount(const MipsList *list); // Labels and NOPs excluded
+
+// Register the instruction writes, or MIPS_NO_REGISTER
+int mipsWrittenRegister(const MipsInstruction *instr);
+// Fills regs with the registers the instruction reads and returns how many
+// (at most 4). A syscall reads $v0 and $a0, a call the argument registers
+// and a return $v0.
+int mipsReadRegisters(const MipsInstruction *instr, int regs[4]);
+bool mipsReadsRegister(const MipsInstruction *instr, int reg);
+bool sameMipsAddress(MipsAddress a, MipsAddress b);
+
+const char *mipsRegisterName(int reg);
+const char *mipsOpcodeName(MipsOpcode op);
+void writeMipsList(Emitter *out, const MipsList *list);
+
+#endif // MIPS_H
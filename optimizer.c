@@ -1,277 +1,1390 @@
 #include "optimizer.h"
+#include "memtrack.h"
+#include "trace.h"
+#include "cfg.h"
+#include "dataflow.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <limits.h>
 
-void optimizeTAC(TAC **head)
-{
-    constantFolding(head);
-    /*
-    constantPropagation(head);
-    copyPropagation(head);
-    deadCodeElimination(head);
-    */
-}
+#define MAX_OPTIMIZER_ROUNDS 16
 
-/**
- * Check if a string represents an integer constant.
- *
- * @param str The string to check.
- * @return true if the string is an integer constant, false otherwise.
- *
- *
- * Functionality:
-The function first checks if the input is 'NULL' or an empty string,
-returning 'false' in these cases as they don't represent a valid constant.
+// Runs the SSA passes once, then the local passes until none of them
+// changes anything. Each rewrite can expose more work for the others, e.g.
+// propagating a constant leaves the assignment that defined it dead; the
+// local passes also clean up the copies left by leaving SSA form.
+static void optimizeFunction(TACList *list, BoundsStats *bounds, LoopStats *loops)
+{
+    SSAForm ssa;
+    LoopStats found = {0, 0, 0};
+    insertPreheaders(list);
+    buildSSA(&ssa, list);
+    int constants = sparseConditionalConstantPropagation(&ssa);
+    int redundant = globalValueNumbering(&ssa);
+    int checks = eliminateBoundsChecks(&ssa);
+    bounds->removed += checks;
+    optimizeLoops(&ssa, &found);
+    loops->loops += found.loops;
+    loops->hoisted += found.hoisted;
+    loops->reduced += found.reduced;
+    leaveSSA(&ssa);
+    freeSSA(&ssa);
 
-If your language supports negative numbers as constants, the function optionally checks
-for a leading - character, skipping it for the subsequent numeric check.
+    int removed = 0;
+    int round = 0;
+    int changes;
 
-The main part of the function iterates over each character of the string using a while loop.
-For each character, it uses isdigit() to check if it's a numeric digit.
+    do
+    {
+        changes = constantFolding(list);
+        changes += constantPropagation(list);
+        changes += copyPropagation(list);
+        int dead = deadCodeElimination(list);
+        removed += dead;
+        changes += dead;
+        round++;
+    } while (changes > 0 && round < MAX_OPTIMIZER_ROUNDS);
 
-If any character is not a digit, the function immediately returns 'false'.
+    (void)constants; // Only traced
+    (void)redundant;
+    TRACE(TRACE_OPTIMIZER, TRACE_INFO, "Optimizer: %d SSA constants, %d redundant values, %d bounds checks, %d loops, %d invariants hoisted, %d pointer accesses, %d rounds, %d dead instructions removed\n",
+          constants, redundant, checks, found.loops, found.hoisted, found.reduced, round, removed);
+}
 
-If the end of the string is reached without encountering any non-digit characters,
-the function returns 'true', indicating the string is a numeric constant.
- */
-bool isConstant(const char *str)
+// Inlines into and optimizes functions[f], the list's current view, unless
+// the cache holds the result of doing so to the same code.
+static void optimizeOrReuse(TACList *list, TACFunction *functions, int count, int f, FunctionCache *cache,
+                            CachedFunctionStats *stats)
 {
-    if (str == NULL || *str == '\0')
+    CacheKey key;
+    if (cache->directory)
     {
-        return false; // Empty string is not a constant
+        computeFunctionKey(&key, cache->settings, list, functions, count, f);
+        if (fetchFunctionEntry(cache->directory, &key, list, stats))
+        {
+            cache->hits++;
+            return;
+        }
     }
 
-    // Optional: Handle negative numbers
-    if (*str == '-')
+    inlineCalls(list, functions, count, f, &stats->inlining);
+    optimizeFunction(list, &stats->bounds, &stats->loops);
+    if (cache->directory)
     {
-        ++str;
+        storeFunctionEntry(cache->directory, &key, list, stats);
+        cache->misses++;
     }
+}
 
-    // Check if string is numeric
-    while (*str)
+// Optimizes each function on its own, callees first: a function can only
+// call itself and the functions declared before it, and the program body
+// comes last. The calls of each function are inlined before it is
+// optimized, so the copies are folded into their new context. With a cache
+// directory, a function whose code and callees are unchanged since an
+// earlier compilation is taken from the cache instead.
+void optimizeTAC(TACList *list, FunctionCache *cache, InlineStats *inlining, BoundsStats *bounds, LoopStats *loops)
+{
+    TACFunction *functions;
+    int count = splitTACFunctions(list, &functions);
+    FunctionCache noCache = {NULL, NULL, 0, 0};
+    if (!cache)
+        cache = &noCache;
+
+    for (int n = 1; n <= count; n++)
     {
-        if (!isdigit((unsigned char)*str))
+        int f = n % count;
+        beginTACFunction(list, &functions[f]);
+        if (list->head != TAC_END)
         {
-            return false; // Found a non-digit character
+            CachedFunctionStats stats;
+            memset(&stats, 0, sizeof(stats));
+            optimizeOrReuse(list, functions, count, f, cache, &stats);
+            inlining->inlined += stats.inlining.inlined;
+            inlining->kept += stats.inlining.kept;
+            bounds->removed += stats.bounds.removed;
+            loops->loops += stats.loops.loops;
+            loops->hoisted += stats.loops.hoisted;
+            loops->reduced += stats.loops.reduced;
         }
-        ++str;
+        endTACFunction(list, &functions[f]);
     }
+    removeUncalledFunctions(list, functions, count);
+    joinTACFunctions(list, functions, count);
+    trackedFree(functions);
 
-    return true; // All characters were digits
+    // Compact the temporaries now that no pass will add or remove any
+    renumberTemporaries(list);
 }
 
-/**
- * Checks if a string represents a valid variable name according to a simple naming convention.
- *
- * @param str The string to check.
- * @return true if the string is a valid variable name, false otherwise.
+// Check if an operand is an integer constant.
+bool isConstant(Operand operand)
+{
+    return operand.kind == OPERAND_CONST;
+}
 
-Functionality:
--------------
-Initially, the function checks if the input is 'NULL' or an empty string,
-returning false in either case since these don't represent valid variable names.
+// Check if an operand names a value: a program variable or a temporary.
+bool isVariable(Operand operand)
+{
+    return operand.kind == OPERAND_SYMBOL || operand.kind == OPERAND_TEMP;
+}
 
-It then checks if the first character is either a letter or an underscore,
-as per the common naming convention that variable names must start with
-an alphabetic character or underscore.
+// Evaluates an arithmetic op on two constants with 32-bit two's complement
+// wraparound, as the generated code computes it. Returns false if the
+// result is undefined (division by zero).
+bool evaluateArithmetic(TACOpcode op, int a, int b, int *result)
+{
+    unsigned x = (unsigned)a;
+    unsigned y = (unsigned)b;
+    switch (op)
+    {
+    case TAC_ADD:
+        *result = (int)(x + y);
+        return true;
+    case TAC_SUB:
+        *result = (int)(x - y);
+        return true;
+    case TAC_MUL:
+        *result = (int)(x * y);
+        return true;
+    case TAC_DIV:
+        if (b == 0)
+            return false;
+        *result = (a == INT_MIN && b == -1) ? INT_MIN : a / b;
+        return true;
+    case TAC_SLL:
+        *result = (int)(x << (y & 31));
+        return true;
+    case TAC_SRA:
+        *result = a < 0 ? (int)~(~x >> (y & 31)) : (int)(x >> (y & 31));
+        return true;
+    case TAC_SRL:
+        *result = (int)(x >> (y & 31));
+        return true;
+    case TAC_LT:
+        *result = a < b;
+        return true;
+    case TAC_LE:
+        *result = a <= b;
+        return true;
+    case TAC_GT:
+        *result = a > b;
+        return true;
+    case TAC_GE:
+        *result = a >= b;
+        return true;
+    case TAC_EQ:
+        *result = a == b;
+        return true;
+    case TAC_NE:
+        *result = a != b;
+        return true;
+    default:
+        return false;
+    }
+}
 
-For the rest of the string, the function checks each character to ensure
-it is either a letter, a digit, or an underscore. This loop starts from the second character,
-as the first character's check was already performed.
+// The comparison that holds of (b, a) exactly when op holds of (a, b).
+static TACOpcode swappedComparison(TACOpcode op)
+{
+    switch (op)
+    {
+    case TAC_LT:
+        return TAC_GT;
+    case TAC_LE:
+        return TAC_GE;
+    case TAC_GT:
+        return TAC_LT;
+    case TAC_GE:
+        return TAC_LE;
+    default:
+        return op;
+    }
+}
+
+// Returns k if c is 2^k for some k from 1 to 30, or -1.
+static int exactLog2(int c)
+{
+    if (c < 2 || (c & (c - 1)) != 0)
+        return -1;
+    return __builtin_ctz((unsigned)c);
+}
 
-If any character does not meet these criteria, the function returns 'false'.
+static void rewriteAsCopy(TAC *tac, Operand source)
+{
+    tac->op = TAC_ASSIGN;
+    tac->arg1 = source;
+    tac->arg2 = (Operand){OPERAND_NONE, 0};
+}
 
-If the string passes all checks, it is considered a valid variable name, and the function returns 'true'.
- */
-bool isVariable(const char *str)
+static void rewriteAsNegation(TAC *tac, Operand source)
 {
-    if (str == NULL || *str == '\0')
+    tac->op = TAC_SUB;
+    tac->arg1 = constOperand(0);
+    tac->arg2 = source;
+}
+
+// Rewrites x / 2^k as a shift. The shift rounds toward minus infinity, so a
+// negative dividend is first biased by 2^k - 1: (x + ((x >> 31) >>> (32 - k))) >> k.
+static void reduceDivision(TACList *list, int prev, int index, int k)
+{
+    Operand x = list->code[index].arg1;
+    Operand bias = createTempVar(list);
+    Operand biased = createTempVar(list);
+    TAC step = {TAC_SRA, x, constOperand(31), bias, TAC_END};
+    if (k == 1)
+    {
+        step.op = TAC_SRL; // The sign bit alone is the bias
+    }
+    else
     {
-        return false; // Null or empty string is not a variable
+        prev = insertTAC(list, prev, &step);
+        step = (TAC){TAC_SRL, bias, constOperand(32 - k), createTempVar(list), TAC_END};
+        bias = step.result;
     }
+    prev = insertTAC(list, prev, &step);
+    step = (TAC){TAC_ADD, x, bias, biased, TAC_END};
+    insertTAC(list, prev, &step);
 
-    // Check if the first character is a letter or underscore
-    if (!isalpha((unsigned char)*str) && *str != '_')
+    TAC *tac = &list->code[index]; // insertTAC may have moved the code
+    tac->op = TAC_SRA;
+    tac->arg1 = biased;
+    tac->arg2 = constOperand(k);
+}
+
+// Applies one folding or simplification rule to the arithmetic instruction
+// at index. Returns true if the instruction changed.
+static bool simplifyArithmetic(TACList *list, int prev, int index)
+{
+    TAC *tac = &list->code[index];
+    Operand a = tac->arg1;
+    Operand b = tac->arg2;
+    int value;
+
+    if (isConstant(a) && isConstant(b))
     {
-        return false;
+        if (!evaluateArithmetic(tac->op, a.value, b.value, &value))
+            return false;
+        rewriteAsCopy(tac, constOperand(value));
+        return true;
+    }
+    if (isConstant(a) && (isCommutativeOp(tac->op) || isComparisonOp(tac->op)))
+    {
+        tac->op = swappedComparison(tac->op);
+        tac->arg1 = b; // Constants go on the right
+        tac->arg2 = a;
+        return true;
+    }
+    if (isComparisonOp(tac->op) && sameOperand(a, b))
+    {
+        value = tac->op == TAC_LE || tac->op == TAC_GE || tac->op == TAC_EQ;
+        rewriteAsCopy(tac, constOperand(value));
+        return true;
     }
 
-    // Check remaining characters for letters, digits, or underscores
-    ++str; // Move past the first character
-    while (*str)
+    switch (tac->op)
     {
-        if (!isalnum((unsigned char)*str) && *str != '_')
+    case TAC_ADD:
+        if (isConstant(b) && b.value == 0)
         {
-            return false; // Invalid character found
+            rewriteAsCopy(tac, a);
+            return true;
         }
-        ++str;
+        break;
+    case TAC_SUB:
+        if (sameOperand(a, b))
+        {
+            rewriteAsCopy(tac, constOperand(0));
+            return true;
+        }
+        if (isConstant(b) && b.value != INT_MIN)
+        {
+            tac->op = TAC_ADD; // x - c becomes x + -c, so it meets the ADD rules
+            tac->arg2 = constOperand(-b.value);
+            return true;
+        }
+        break;
+    case TAC_MUL:
+        if (!isConstant(b))
+            break;
+        if (b.value == 0 || b.value == 1)
+        {
+            rewriteAsCopy(tac, b.value == 0 ? b : a);
+            return true;
+        }
+        if (b.value == -1)
+        {
+            rewriteAsNegation(tac, a);
+            return true;
+        }
+        if (exactLog2(b.value) > 0)
+        {
+            tac->op = TAC_SLL;
+            tac->arg2 = constOperand(exactLog2(b.value));
+            return true;
+        }
+        break;
+    case TAC_DIV:
+        if (!isConstant(b))
+            break;
+        if (b.value == 1)
+        {
+            rewriteAsCopy(tac, a);
+            return true;
+        }
+        if (b.value == -1)
+        {
+            rewriteAsNegation(tac, a);
+            return true;
+        }
+        if (exactLog2(b.value) > 0)
+        {
+            reduceDivision(list, prev, index, exactLog2(b.value));
+            return true;
+        }
+        break;
+    case TAC_SLL:
+    case TAC_SRA:
+    case TAC_SRL:
+        if ((isConstant(b) && (b.value & 31) == 0) || (isConstant(a) && a.value == 0))
+        {
+            rewriteAsCopy(tac, a);
+            return true;
+        }
+        break;
+    default:
+        break;
+    }
+    return false;
+}
+
+// Constant folding and algebraic simplification. Within a block, a value
+// known to hold a constant (from li or a constant assignment) is substituted
+// into the instructions that follow, so chains fold in one sweep; then each
+// arithmetic instruction is simplified until no rule applies: constant
+// operands are evaluated, identities such as x+0, x*1, x*0, x-x and x<x
+// reduce to copies, and multiplication or division by a power of two
+// becomes a shift.
+// Returns the number of rewrites.
+int constantFolding(TACList *list)
+{
+    int valueCount = tacValueCount(list);
+    int *knownBlock = (int *)trackedMalloc(sizeof(int) * (valueCount + 1));
+    int *knownValue = (int *)trackedMalloc(sizeof(int) * (valueCount + 1));
+    if (!knownBlock || !knownValue)
+    {
+        fprintf(stderr, "constantFolding: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
     }
+    for (int v = 0; v < valueCount; v++)
+        knownBlock[v] = -1;
+
+    int folded = 0;
+    int block = 0;
+    int prev = TAC_END;
+    for (int i = list->head; i != TAC_END; prev = i, i = list->code[i].next)
+    {
+        TAC *current = &list->code[i];
+        if (current->op == TAC_LABEL || current->op == TAC_FUNCTION)
+            block++;
 
-    return true; // String meets the criteria for a variable name
+        Operand *uses[2];
+        int useCount = tacUses(current, uses);
+        for (int u = 0; u < useCount; u++)
+        {
+            int v = tacValueIndex(list, *uses[u]);
+            if (v < valueCount && knownBlock[v] == block)
+            {
+                *uses[u] = constOperand(knownValue[v]);
+                folded++;
+            }
+        }
+
+        if (isArithmeticOp(current->op))
+        {
+            while (isArithmeticOp(list->code[i].op) && simplifyArithmetic(list, prev, i))
+                folded++;
+            current = &list->code[i];
+        }
+
+        Operand *def = tacDefinition(current);
+        if (def && tacValueIndex(list, *def) < valueCount)
+        {
+            int v = tacValueIndex(list, *def);
+            bool constant = (current->op == TAC_ASSIGN || current->op == TAC_LI) && isConstant(current->arg1);
+            knownBlock[v] = constant ? block : -1;
+            knownValue[v] = current->arg1.value;
+        }
+        if (current->op == TAC_GOTO || current->op == TAC_IF_FALSE || current->op == TAC_RETURN ||
+            writesGlobals(current))
+            block++; // What is known about globals does not survive a call
+    }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Constant folding: %d rewrites\n", folded);
+
+    trackedFree(knownBlock);
+    trackedFree(knownValue);
+    return folded;
 }
 
-// A simplified constant folding example that only handles addition of integer constants.
-void constantFolding(TAC **head)
+// Returns true if every definition of value v in reaching assigns the same
+// constant, storing it in constant. The entry definition means the value may
+// be uninitialised or set elsewhere, so it blocks propagation.
+static bool reachingConstant(TACList *list, ReachingDefinitions *rd, BitSet *reaching, int v, int *constant)
 {
-    TAC *current = *head; // Current TAC instruction
+    bool found = false;
+    for (int k = rd->valueDefStart[v]; k < rd->valueDefStart[v + 1]; k++)
+    {
+        int d = rd->valueDefs[k];
+        if (!bitsetTest(reaching, d))
+            continue;
+        if (rd->defInstruction[d] < 0)
+            return false;
+
+        TAC *def = &list->code[rd->defInstruction[d]];
+        if (def->op != TAC_ASSIGN || !isConstant(def->arg1))
+            return false;
+        if (found && def->arg1.value != *constant)
+            return false;
+        *constant = def->arg1.value;
+        found = true;
+    }
+    return found;
+}
 
-    // Apply constant folding optimization
-    while (current != NULL)
+// Constant propagation over reaching definitions: a use is replaced by a
+// constant when every definition that reaches it assigns that constant.
+// Returns the number of uses replaced.
+int constantPropagation(TACList *list)
+{
+    CFG cfg;
+    ReachingDefinitions rd;
+    buildCFG(&cfg, list);
+    computeReachingDefinitions(&rd, &cfg);
+
+    BitSet *reaching = allocateBitSets(1, rd.defCount);
+    int replaced = 0;
+
+    for (int b = 0; b < cfg.blockCount; b++)
     {
-        if (current->op != NULL && strcmp(current->op, "+") == 0)
+        BasicBlock *block = &cfg.blocks[b];
+        bitsetCopy(reaching, &rd.problem.in[b]);
+
+        for (int i = block->first; i != TAC_END; i = blockNext(&cfg, block, i))
         {
-            // Check if both operands are constants
-            if (isConstant(current->arg1) && isConstant(current->arg2))
+            TAC *current = &list->code[i];
+            Operand *uses[2];
+            int useCount = tacUses(current, uses);
+            for (int u = 0; u < useCount; u++)
             {
-                int result = atoi(current->arg1) + atoi(current->arg2); // Perform the addition
-                char resultStr[20];
-                sprintf(resultStr, "%d", result); // Convert the result to a string
-                free(current->arg1);
-                free(current->arg2);
-                current->arg1 = strdup(resultStr);
-                current->op = strdup("assign");
-                current->arg2 = NULL;
+                int constant;
+                if (reachingConstant(list, &rd, reaching, tacValueIndex(list, *uses[u]), &constant))
+                {
+                    *uses[u] = constOperand(constant);
+                    replaced++;
+                }
             }
+
+            stepReachingDefinitions(&rd, list, reaching, i);
         }
-        current = current->next; // Move to the next TAC instruction
     }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Constant propagation: %d uses replaced, %d blocks, %d iterations\n",
+          replaced, cfg.blockCount, rd.problem.iterations);
+
+    freeBitSets(reaching);
+    freeReachingDefinitions(&rd);
+    freeCFG(&cfg);
+    return replaced;
 }
 
-// A simplified constant propagation example that only handles assignment of integer constants to variables.
-void constantPropagation(TAC **head)
+// Clears the copies into or out of value v from available.
+static void forgetCopies(Availability *copies, BitSet *available, int v)
 {
-    /*
-    This function performs constant propagation on the provided TAC list.
-    It iterates through the list and looks for assignments of integer constants to variables.
-    When such an assignment is found, it propagates the constant value to all uses of the variable.
-    */
-    TAC *current = *head;
-    while (current != NULL)
+    for (int k = copies->valueItemStart[v]; k < copies->valueItemStart[v + 1]; k++)
+        bitsetClear(available, copies->valueItems[k]);
+}
+
+// Copy propagation over available copies: after "x = y", a use of x is
+// replaced by y wherever the copy reaches along every path with neither x
+// nor y reassigned. Returns the number of uses replaced.
+int copyPropagation(TACList *list)
+{
+    CFG cfg;
+    Availability copies;
+    buildCFG(&cfg, list);
+    computeAvailableCopies(&copies, &cfg);
+
+    // Snapshot each copy before rewriting starts, since rewriting a use may
+    // change the source operand of the instruction that defined the copy
+    Operand *source = (Operand *)trackedMalloc(sizeof(Operand) * (copies.itemCount + 1));
+    int *target = (int *)trackedMalloc(sizeof(int) * (copies.itemCount + 1));
+    if (!source || !target)
+    {
+        fprintf(stderr, "copyPropagation: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int x = 0; x < copies.itemCount; x++)
     {
-        if (current->op != NULL && strcmp(current->op, "assign") == 0)
+        TAC *copy = &list->code[copies.itemInstruction[x]];
+        source[x] = copy->arg1;
+        target[x] = tacValueIndex(list, copy->result);
+    }
+
+    BitSet *available = allocateBitSets(1, copies.itemCount);
+    int replaced = 0;
+
+    for (int b = 0; b < cfg.blockCount; b++)
+    {
+        BasicBlock *block = &cfg.blocks[b];
+        bitsetCopy(available, &copies.problem.in[b]);
+
+        for (int i = block->first; i != TAC_END; i = blockNext(&cfg, block, i))
         {
-            // Check if the argument is a constant
-            if (isConstant(current->arg1))
+            TAC *current = &list->code[i];
+            Operand *uses[2];
+            int useCount = tacUses(current, uses);
+            for (int u = 0; u < useCount; u++)
             {
-                // Propagate the constant value to all uses of the variable
-                TAC *temp = current->next;
-                while (temp != NULL)
+                // At most one copy into a value can be available at a time
+                int v = tacValueIndex(list, *uses[u]);
+                for (int k = copies.valueItemStart[v]; k < copies.valueItemStart[v + 1]; k++)
                 {
-                    if (temp->arg1 != NULL && strcmp(temp->arg1, current->result) == 0)
+                    int x = copies.valueItems[k];
+                    if (target[x] == v && bitsetTest(available, x))
                     {
-                        free(temp->arg1);
-                        temp->arg1 = strdup(current->arg1);
+                        *uses[u] = source[x];
+                        replaced++;
+                        break;
                     }
-                    if (temp->arg2 != NULL && strcmp(temp->arg2, current->result) == 0)
-                    {
-                        free(temp->arg2);
-                        temp->arg2 = strdup(current->arg1);
-                    }
-                    temp = temp->next;
                 }
             }
+
+            Operand *def = tacDefinition(current);
+            if (def)
+                forgetCopies(&copies, available, tacValueIndex(list, *def));
+            if (writesGlobals(current))
+            {
+                for (int v = 0; v < list->names.count; v++)
+                {
+                    if (isGlobalSymbol(list, v))
+                        forgetCopies(&copies, available, v);
+                }
+            }
+            if (copies.itemOf[i] >= 0)
+                bitsetSet(available, copies.itemOf[i]);
         }
-        current = current->next;
     }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Copy propagation: %d uses replaced, %d blocks, %d iterations\n",
+          replaced, cfg.blockCount, copies.problem.iterations);
+
+    freeBitSets(available);
+    trackedFree(source);
+    trackedFree(target);
+    freeAvailability(&copies);
+    freeCFG(&cfg);
+    return replaced;
 }
 
-// A simplified copy propagation example that only handles assignment of variables to variables.
-// This function replaces all uses of a variable with the value of the variable being assigned.
-// For example, if the TAC contains "assign x, y", it will replace all uses of "y" with "x".
+// Instructions that only compute their result can go once the result is dead.
+static bool isRemovable(TAC *tac)
+{
+    switch (tac->op)
+    {
+    case TAC_ASSIGN:
+    case TAC_LI:
+    case TAC_ARRAY_LOAD:
+    case TAC_ADDRESS:
+    case TAC_POINTER_LOAD:
+        return tacDefinition(tac) != NULL;
+    default:
+        return isArithmeticOp(tac->op) && tacDefinition(tac) != NULL;
+    }
+}
 
-void copyPropagation(TAC **head)
+// Dead code elimination as one backward sweep per block over liveness:
+// starting from the block's live-out set, an instruction whose result is
+// not live (or that copies a value onto itself) is unlinked; otherwise its
+// definition is killed and its uses become live. Blocks are swept last to
+// first so the instruction before each block's head is still linked when
+// that head is removed. Returns the number of instructions removed.
+int deadCodeElimination(TACList *list)
 {
-    TAC *current = *head;
-    while (current != NULL)
+    CFG cfg;
+    Liveness live;
+    buildCFG(&cfg, list);
+    computeLiveness(&live, &cfg, NULL);
+
+    BitSet *liveNow = allocateBitSets(1, live.valueCount);
+    int *instructions = (int *)trackedMalloc(sizeof(int) * (list->count + 1));
+    if (!instructions)
+    {
+        fprintf(stderr, "deadCodeElimination: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    int removed = 0;
+
+    for (int b = cfg.blockCount - 1; b >= 0; b--)
     {
-        if (current->op != NULL && strcmp(current->op, "assign") == 0)
+        BasicBlock *block = &cfg.blocks[b];
+        int count = 0;
+        for (int i = block->first; i != TAC_END; i = blockNext(&cfg, block, i))
+            instructions[count++] = i;
+
+        bitsetCopy(liveNow, &live.problem.out[b]);
+        for (int k = count - 1; k >= 0; k--)
         {
-            // Check if the argument is a variable
-            if (isVariable(current->arg1))
+            TAC *current = &list->code[instructions[k]];
+            Operand *def = tacDefinition(current);
+
+            if (isRemovable(current))
             {
-                // Propagate the variable value to all uses of the variable
-                TAC *temp = current->next;
-                while (temp != NULL)
+                bool selfCopy = current->op == TAC_ASSIGN && sameOperand(current->arg1, current->result);
+                if (selfCopy || !bitsetTest(liveNow, tacValueIndex(list, *def)))
                 {
-                    if (temp->arg1 != NULL && strcmp(temp->arg1, current->result) == 0)
-                    {
-                        free(temp->arg1);
-                        temp->arg1 = strdup(current->arg1);
-                    }
-                    if (temp->arg2 != NULL && strcmp(temp->arg2, current->result) == 0)
-                    {
-                        free(temp->arg2);
-                        temp->arg2 = strdup(current->arg1);
-                    }
-                    temp = temp->next;
+                    int prev = k > 0 ? instructions[k - 1] : (b > 0 ? cfg.blocks[b - 1].last : TAC_END);
+                    removeTAC(list, prev, instructions[k]);
+                    removed++;
+                    continue;
                 }
             }
+
+            if (def)
+                bitsetClear(liveNow, tacValueIndex(list, *def));
+            Operand *uses[2];
+            int useCount = tacUses(current, uses);
+            for (int u = 0; u < useCount; u++)
+                bitsetSet(liveNow, tacValueIndex(list, *uses[u]));
+            if (readsGlobals(current))
+                markSymbolsLive(list, liveNow);
+        }
+    }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Dead code elimination: %d instructions removed\n", removed);
+
+    trackedFree(instructions);
+    freeBitSets(liveNow);
+    freeLiveness(&live);
+    freeCFG(&cfg);
+    return removed;
+}
+
+// SSA passes //
+
+typedef enum
+{
+    LATTICE_TOP,    // No definition seen executing yet
+    LATTICE_CONST,  // Always the same constant
+    LATTICE_BOTTOM  // Varies
+} LatticeLevel;
+
+typedef struct LatticeValue
+{
+    LatticeLevel level;
+    int constant;
+} LatticeValue;
+
+typedef struct SCCPState
+{
+    SSAForm *ssa;
+    LatticeValue *values; // Value index -> lattice value
+    int *useStart;        // Users of v are users[useStart[v]..useStart[v+1]):
+    int *users;           // an instruction index, or ~p for phi p
+    int *phiBlock;
+    bool *visited;        // Blocks whose instructions have been evaluated
+    int *blockWork;
+    int blockTop;
+    int *valueWork;
+    int valueTop;
+    bool *queued;
+} SCCPState;
+
+static void *allocateOrDie(size_t size, const char *pass)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "%s: Memory allocation failed\n", pass);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static LatticeValue operandLattice(SCCPState *st, Operand operand)
+{
+    if (operand.kind == OPERAND_CONST)
+        return (LatticeValue){LATTICE_CONST, operand.value};
+    if (operand.kind == OPERAND_NONE)
+        return (LatticeValue){LATTICE_TOP, 0};
+    return st->values[tacValueIndex(st->ssa->code, operand)];
+}
+
+static LatticeValue meet(LatticeValue a, LatticeValue b)
+{
+    if (a.level == LATTICE_TOP)
+        return b;
+    if (b.level == LATTICE_TOP)
+        return a;
+    if (a.level == LATTICE_CONST && b.level == LATTICE_CONST && a.constant == b.constant)
+        return a;
+    return (LatticeValue){LATTICE_BOTTOM, 0};
+}
+
+static void lowerValue(SCCPState *st, Operand result, LatticeValue value)
+{
+    int v = tacValueIndex(st->ssa->code, result);
+    LatticeValue lowered = meet(st->values[v], value);
+    if (lowered.level == st->values[v].level)
+        return; // A constant can only move down to bottom
+    st->values[v] = lowered;
+    if (!st->queued[v])
+    {
+        st->queued[v] = true;
+        st->valueWork[st->valueTop++] = v;
+    }
+}
+
+static void markEdge(SCCPState *st, int b, int k)
+{
+    SSAForm *ssa = st->ssa;
+    if (ssa->edgeExecutable[2 * b + k])
+        return;
+    ssa->edgeExecutable[2 * b + k] = true;
+    st->blockWork[st->blockTop++] = ssa->cfg.blocks[b].succs[k];
+}
+
+static void visitPhi(SCCPState *st, int p)
+{
+    SSAForm *ssa = st->ssa;
+    Phi *phi = &ssa->phis[p];
+    BasicBlock *block = &ssa->cfg.blocks[st->phiBlock[p]];
+    LatticeValue value = {LATTICE_TOP, 0};
+    for (int j = 0; j < block->predCount; j++)
+    {
+        int pred = block->preds[j];
+        int k = ssa->cfg.blocks[pred].succs[0] == st->phiBlock[p] ? 0 : 1;
+        if (ssa->edgeExecutable[2 * pred + k])
+            value = meet(value, operandLattice(st, phi->args[j]));
+    }
+    lowerValue(st, phi->result, value);
+}
+
+static void visitInstruction(SCCPState *st, int i)
+{
+    SSAForm *ssa = st->ssa;
+    TAC *tac = &ssa->code->code[i];
+    int b = ssa->cfg.blockOf[i];
+
+    if (tac->op == TAC_IF_FALSE && ssa->cfg.blocks[b].succCount == 2)
+    {
+        LatticeValue condition = operandLattice(st, tac->arg1);
+        for (int k = 0; k < 2; k++)
+        {
+            bool taken = isJumpEdge(&ssa->cfg, b, k);
+            if (condition.level == LATTICE_BOTTOM || (condition.level == LATTICE_CONST && taken == (condition.constant == 0)))
+                markEdge(st, b, k);
         }
-        current = current->next;
+        return;
+    }
+    if (i == ssa->cfg.blocks[b].last)
+    {
+        for (int k = 0; k < ssa->cfg.blocks[b].succCount; k++)
+            markEdge(st, b, k);
+    }
+
+    if (tac->result.kind != OPERAND_TEMP)
+        return; // Stores back to variables define nothing in SSA form
+
+    LatticeValue value = {LATTICE_BOTTOM, 0};
+    if (tac->op == TAC_ASSIGN)
+    {
+        value = operandLattice(st, tac->arg1);
+    }
+    else if (tac->op == TAC_LI)
+    {
+        value = (LatticeValue){LATTICE_CONST, tac->arg1.value};
+    }
+    else if (isArithmeticOp(tac->op))
+    {
+        LatticeValue left = operandLattice(st, tac->arg1);
+        LatticeValue right = operandLattice(st, tac->arg2);
+        int constant;
+        if (tac->op == TAC_MUL && ((left.level == LATTICE_CONST && left.constant == 0) ||
+                                   (right.level == LATTICE_CONST && right.constant == 0)))
+            value = (LatticeValue){LATTICE_CONST, 0};
+        else if (left.level == LATTICE_TOP || right.level == LATTICE_TOP)
+            value = (LatticeValue){LATTICE_TOP, 0};
+        else if (left.level == LATTICE_CONST && right.level == LATTICE_CONST &&
+                 evaluateArithmetic(tac->op, left.constant, right.constant, &constant))
+            value = (LatticeValue){LATTICE_CONST, constant};
     }
+    lowerValue(st, tac->result, value);
 }
 
-// A simplified dead code elimination example that only handles removal of unused assignments.
-// This function removes assignments that are not used in any subsequent TAC instructions.
-// For example, if the TAC contains "assign x, 5" and "assign y, x", and "x" is not used after that,
-// it will remove the "assign x, 5" instruction.
+static void visitBlock(SCCPState *st, int b)
+{
+    SSAForm *ssa = st->ssa;
+    for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+        visitPhi(st, p);
+    if (st->visited[b])
+        return;
+    st->visited[b] = true;
+
+    BasicBlock *block = &ssa->cfg.blocks[b];
+    for (int i = block->first; i != TAC_END; i = blockNext(&ssa->cfg, block, i))
+        visitInstruction(st, i);
+}
 
-void deadCodeElimination(TAC **head)
+// Collects, for every value, the instructions and phis that read it.
+static void buildUseLists(SCCPState *st, int valueCount)
 {
-    TAC *current = *head; // Current TAC instruction
-    TAC *prev = NULL;     // Previous TAC instruction
+    SSAForm *ssa = st->ssa;
+    TACList *code = ssa->code;
+    int *counts = (int *)allocateOrDie(sizeof(int) * (valueCount + 1), "SCCP");
+    for (int v = 0; v <= valueCount; v++)
+        counts[v] = 0;
 
-    while (current != NULL)
+    for (int pass = 0; pass < 2; pass++)
     {
-        if (current->op != NULL && strcmp(current->op, "assign") == 0)
+        for (int b = 0; b < ssa->cfg.blockCount; b++)
         {
-            // Check if the result of the assignment is used
-            int isUsed = 0;
-            TAC *temp = current->next;
-            while (temp != NULL)
+            BasicBlock *block = &ssa->cfg.blocks[b];
+            if (!ssa->blockReachable[b])
+                continue;
+            for (int i = block->first; i != TAC_END; i = blockNext(&ssa->cfg, block, i))
             {
-                if (temp->arg1 != NULL && strcmp(temp->arg1, current->result) == 0)
+                Operand *uses[2];
+                int useCount = tacUses(&code->code[i], uses);
+                for (int u = 0; u < useCount; u++)
                 {
-                    isUsed = 1;
-                    break;
+                    int v = tacValueIndex(code, *uses[u]);
+                    if (pass == 0)
+                        counts[v + 1]++;
+                    else
+                        st->users[counts[v]++] = i;
                 }
-                if (temp->arg2 != NULL && strcmp(temp->arg2, current->result) == 0)
+            }
+            for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+            {
+                for (int j = 0; j < block->predCount; j++)
                 {
-                    isUsed = 1;
-                    break;
+                    Operand arg = ssa->phis[p].args[j];
+                    if (!isVariable(arg))
+                        continue;
+                    int v = tacValueIndex(code, arg);
+                    if (pass == 0)
+                        counts[v + 1]++;
+                    else
+                        st->users[counts[v]++] = ~p;
                 }
-                temp = temp->next;
             }
-            if (!isUsed)
+        }
+
+        if (pass == 0)
+        {
+            for (int v = 0; v < valueCount; v++)
+                counts[v + 1] += counts[v];
+            st->useStart = (int *)allocateOrDie(sizeof(int) * (valueCount + 1), "SCCP");
+            for (int v = 0; v <= valueCount; v++)
+                st->useStart[v] = counts[v];
+            st->users = (int *)allocateOrDie(sizeof(int) * counts[valueCount], "SCCP");
+        }
+    }
+    trackedFree(counts);
+}
+
+// Sparse conditional constant propagation (Wegman and Zadeck): evaluates
+// the SSA values over a three-level lattice, following only the branch
+// edges that can execute given the constants found so far. Uses of
+// constant values are replaced, and the SSA form's reachability is narrowed
+// to the blocks and edges found executable, for leaveSSA to prune. Returns
+// the number of uses replaced.
+int sparseConditionalConstantPropagation(SSAForm *ssa)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+    int valueCount = tacValueCount(code);
+
+    SCCPState st = {0};
+    st.ssa = ssa;
+    st.values = (LatticeValue *)allocateOrDie(sizeof(LatticeValue) * valueCount, "SCCP");
+    st.queued = (bool *)allocateOrDie(sizeof(bool) * valueCount, "SCCP");
+    st.valueWork = (int *)allocateOrDie(sizeof(int) * valueCount, "SCCP");
+    st.visited = (bool *)allocateOrDie(sizeof(bool) * n, "SCCP");
+    st.blockWork = (int *)allocateOrDie(sizeof(int) * (2 * n + 1), "SCCP");
+    st.phiBlock = (int *)allocateOrDie(sizeof(int) * ssa->phiCount, "SCCP");
+    for (int v = 0; v < valueCount; v++)
+    {
+        // Variables read on entry may hold anything
+        st.values[v] = (LatticeValue){v < code->names.count ? LATTICE_BOTTOM : LATTICE_TOP, 0};
+        st.queued[v] = false;
+    }
+    for (int b = 0; b < n; b++)
+    {
+        st.visited[b] = false;
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+            st.phiBlock[p] = b;
+    }
+    buildUseLists(&st, valueCount);
+
+    for (int e = 0; e < 2 * n; e++)
+        ssa->edgeExecutable[e] = false;
+    if (n > 0)
+        st.blockWork[st.blockTop++] = 0;
+
+    while (st.blockTop > 0 || st.valueTop > 0)
+    {
+        if (st.blockTop > 0)
+        {
+            visitBlock(&st, st.blockWork[--st.blockTop]);
+            continue;
+        }
+
+        int v = st.valueWork[--st.valueTop];
+        st.queued[v] = false;
+        for (int u = st.useStart[v]; u < st.useStart[v + 1]; u++)
+        {
+            int user = st.users[u];
+            if (user < 0)
+            {
+                if (st.visited[st.phiBlock[~user]])
+                    visitPhi(&st, ~user);
+            }
+            else if (st.visited[cfg->blockOf[user]])
             {
-                // Remove the assignment
-                if (current == *head)
+                visitInstruction(&st, user);
+            }
+        }
+    }
+
+    // Rewrite: constant uses become immediates, constant definitions
+    // become loads of the constant
+    int replaced = 0;
+    for (int b = 0; b < n; b++)
+    {
+        ssa->blockReachable[b] = st.visited[b];
+        if (!st.visited[b])
+            continue;
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            TAC *tac = &code->code[i];
+            Operand *uses[2];
+            int useCount = tacUses(tac, uses);
+            for (int u = 0; u < useCount; u++)
+            {
+                LatticeValue value = st.values[tacValueIndex(code, *uses[u])];
+                if (value.level == LATTICE_CONST)
                 {
-                    *head = current->next;
+                    *uses[u] = constOperand(value.constant);
+                    replaced++;
                 }
-                else
+            }
+
+            if (tac->result.kind == OPERAND_TEMP && (tac->op == TAC_ASSIGN || isArithmeticOp(tac->op)))
+            {
+                LatticeValue value = st.values[tacValueIndex(code, tac->result)];
+                if (value.level == LATTICE_CONST)
                 {
-                    TAC *prev = *head;
-                    while (prev->next != current)
-                    {
-                        prev = prev->next;
-                    }
-                    prev->next = current->next;
+                    tac->op = TAC_ASSIGN;
+                    tac->arg1 = constOperand(value.constant);
+                    tac->arg2 = (Operand){OPERAND_NONE, 0};
                 }
-                free(current->op);
-                free(current->arg1);
-                free(current->arg2);
-                free(current->result);
-                free(current);
-                current = prev;
             }
         }
-        current = current->next;
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+        {
+            for (int j = 0; j < block->predCount; j++)
+            {
+                Operand *arg = &ssa->phis[p].args[j];
+                if (isVariable(*arg) && st.values[tacValueIndex(code, *arg)].level == LATTICE_CONST)
+                    *arg = constOperand(st.values[tacValueIndex(code, *arg)].constant);
+            }
+        }
+    }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "SCCP: %d uses replaced\n", replaced);
+
+    trackedFree(st.values);
+    trackedFree(st.queued);
+    trackedFree(st.valueWork);
+    trackedFree(st.visited);
+    trackedFree(st.blockWork);
+    trackedFree(st.phiBlock);
+    trackedFree(st.useStart);
+    trackedFree(st.users);
+    return replaced;
+}
+
+typedef struct ValueKey
+{
+    TACOpcode op;
+    Operand arg1;
+    Operand arg2;
+    Operand result; // OPERAND_NONE marks an empty slot
+} ValueKey;
+
+typedef struct ValueTable
+{
+    ValueKey *slots;
+    int mask;
+    int *log; // Slots filled, in order, so scopes can be unwound
+    int logCount;
+    bool hasCalls; // Then a symbol operand may hold different values at different points
+} ValueTable;
+
+static unsigned hashKey(TACOpcode op, Operand a, Operand b)
+{
+    unsigned h = (unsigned)op * 0x9E3779B1u;
+    h = (h ^ ((unsigned)a.kind << 28 ^ (unsigned)a.value)) * 0x85EBCA77u;
+    h = (h ^ ((unsigned)b.kind << 28 ^ (unsigned)b.value)) * 0xC2B2AE3Du;
+    return h ^ (h >> 15);
+}
+
+// Finds the slot holding (op, a, b), or the empty slot where it would go.
+static ValueKey *lookupValue(ValueTable *table, TACOpcode op, Operand a, Operand b)
+{
+    unsigned slot = hashKey(op, a, b) & table->mask;
+    for (;;)
+    {
+        ValueKey *key = &table->slots[slot];
+        if (key->result.kind == OPERAND_NONE ||
+            (key->op == op && sameOperand(key->arg1, a) && sameOperand(key->arg2, b)))
+            return key;
+        slot = (slot + 1) & table->mask;
     }
 }
 
+// The operand standing for the same value as operand in leader form.
+static Operand leaderOf(TACList *code, Operand *leader, Operand operand)
+{
+    if (operand.kind != OPERAND_TEMP)
+        return operand;
+    Operand found = leader[tacValueIndex(code, operand)];
+    return found.kind == OPERAND_NONE ? operand : found;
+}
+
+static bool operandBefore(Operand a, Operand b)
+{
+    return a.kind != b.kind ? a.kind < b.kind : a.value < b.value;
+}
+
+// Makes phi p a no-op copy of its own result, so leaveSSA emits nothing for it.
+static void dropPhi(SSAForm *ssa, int b, int p)
+{
+    for (int j = 0; j < ssa->cfg.blocks[b].predCount; j++)
+        ssa->phis[p].args[j] = ssa->phis[p].result;
+}
+
+static int numberPhis(SSAForm *ssa, Operand *leader, int b)
+{
+    TACList *code = ssa->code;
+    int predCount = ssa->cfg.blocks[b].predCount;
+    int redundant = 0;
+
+    for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+    {
+        Phi *phi = &ssa->phis[p];
+        Operand same = {OPERAND_NONE, 0};
+        bool allSame = true;
+        for (int j = 0; j < predCount && allSame; j++)
+        {
+            Operand arg = phi->args[j];
+            if (arg.kind == OPERAND_NONE || sameOperand(arg, phi->result))
+                continue;
+            if (same.kind == OPERAND_NONE)
+                same = arg;
+            else if (!sameOperand(same, arg))
+                allSame = false;
+        }
+        if (allSame && same.kind != OPERAND_NONE && same.kind != OPERAND_SYMBOL)
+        {
+            leader[tacValueIndex(code, phi->result)] = same;
+            dropPhi(ssa, b, p);
+            redundant++;
+            continue;
+        }
+
+        for (int q = ssa->phiStart[b]; q < p; q++)
+        {
+            Phi *other = &ssa->phis[q];
+            int j = 0;
+            while (j < predCount && sameOperand(other->args[j], phi->args[j]))
+                j++;
+            if (j == predCount && !sameOperand(other->args[0], other->result))
+            {
+                leader[tacValueIndex(code, phi->result)] = other->result;
+                dropPhi(ssa, b, p);
+                redundant++;
+                break;
+            }
+        }
+    }
+    return redundant;
+}
+
+static int numberBlock(SSAForm *ssa, ValueTable *table, Operand *leader, int b)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    BasicBlock *block = &cfg->blocks[b];
+    int redundant = numberPhis(ssa, leader, b);
+
+    for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+    {
+        TAC *tac = &code->code[i];
+        Operand *uses[2];
+        int useCount = tacUses(tac, uses);
+        for (int u = 0; u < useCount; u++)
+            *uses[u] = leaderOf(code, leader, *uses[u]);
+
+        if (tac->result.kind != OPERAND_TEMP)
+            continue;
+        int v = tacValueIndex(code, tac->result);
+
+        if ((tac->op == TAC_ASSIGN || tac->op == TAC_LI) && tac->arg1.kind != OPERAND_SYMBOL)
+        {
+            leader[v] = tac->op == TAC_LI ? constOperand(tac->arg1.value) : tac->arg1;
+        }
+        else if (isArithmeticOp(tac->op) &&
+                 !(table->hasCalls && (tac->arg1.kind == OPERAND_SYMBOL || tac->arg2.kind == OPERAND_SYMBOL)))
+        {
+            Operand a = tac->arg1;
+            Operand b2 = tac->arg2;
+            if (isCommutativeOp(tac->op) && operandBefore(b2, a))
+            {
+                a = tac->arg2;
+                b2 = tac->arg1;
+            }
+            ValueKey *key = lookupValue(table, tac->op, a, b2);
+            if (key->result.kind != OPERAND_NONE)
+            {
+                leader[v] = key->result;
+                redundant++;
+            }
+            else
+            {
+                *key = (ValueKey){tac->op, a, b2, tac->result};
+                table->log[table->logCount++] = (int)(key - table->slots);
+            }
+        }
+    }
+
+    for (int k = 0; k < block->succCount; k++)
+    {
+        int s = block->succs[k];
+        int j = 0;
+        while (cfg->blocks[s].preds[j] != b)
+            j++;
+        for (int p = ssa->phiStart[s]; p < ssa->phiStart[s + 1]; p++)
+        {
+            Phi *phi = &ssa->phis[p];
+            if (!sameOperand(phi->args[j], phi->result)) // Keep dropped phis dropped
+                phi->args[j] = leaderOf(code, leader, phi->args[j]);
+        }
+    }
+    return redundant;
+}
+
+// Dominator-based value numbering: walks the dominator tree with a scoped
+// hash table of the expressions computed on the way down, so an expression
+// already available from a dominating block is replaced by the temporary
+// that holds it. Copies and phis whose operands all agree are folded into
+// their source. Redundant definitions are left dead for dead code
+// elimination. Returns the number of redundant definitions found.
+int globalValueNumbering(SSAForm *ssa)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+    int valueCount = tacValueCount(code);
+
+    Operand *leader = (Operand *)allocateOrDie(sizeof(Operand) * valueCount, "GVN");
+    for (int v = 0; v < valueCount; v++)
+        leader[v] = (Operand){OPERAND_NONE, 0};
+
+    int size = 16;
+    while (size < 2 * code->count)
+        size *= 2;
+    ValueTable table;
+    table.slots = (ValueKey *)allocateOrDie(sizeof(ValueKey) * size, "GVN");
+    table.mask = size - 1;
+    table.log = (int *)allocateOrDie(sizeof(int) * code->count, "GVN");
+    table.logCount = 0;
+    table.hasCalls = false;
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+        table.hasCalls |= writesGlobals(&code->code[i]);
+    for (int s = 0; s < size; s++)
+        table.slots[s].result = (Operand){OPERAND_NONE, 0};
+
+    int *mark = (int *)allocateOrDie(sizeof(int) * n, "GVN");
+    int *stack = (int *)allocateOrDie(sizeof(int) * 2 * n, "GVN");
+    int top = 0;
+    int redundant = 0;
+    if (n > 0)
+        stack[top++] = 0;
+    while (top > 0)
+    {
+        int entry = stack[--top];
+        if (entry < 0)
+        {
+            // Leaving the block: forget what it computed, newest first
+            while (table.logCount > mark[~entry])
+                table.slots[table.log[--table.logCount]].result = (Operand){OPERAND_NONE, 0};
+            continue;
+        }
+        mark[entry] = table.logCount;
+        stack[top++] = ~entry;
+        if (ssa->blockReachable[entry])
+            redundant += numberBlock(ssa, &table, leader, entry);
+        for (int c = ssa->dom.childStart[entry + 1] - 1; c >= ssa->dom.childStart[entry]; c--)
+            stack[top++] = ssa->dom.children[c];
+    }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "GVN: %d redundant definitions\n", redundant);
+
+    trackedFree(stack);
+    trackedFree(mark);
+    trackedFree(table.log);
+    trackedFree(table.slots);
+    trackedFree(leader);
+    return redundant;
+}
+
+static void extendRange(int *start, int *end, int temp, int position)
+{
+    if (position < start[temp])
+        start[temp] = position;
+    if (position > end[temp])
+        end[temp] = position;
+}
+
+// Renumbers the temporaries densely, handing a number out again once the
+// temporary holding it is dead. A temporary occupies the hull, in list
+// order, of its references and of the blocks it is live into or out of, so
+// a number is never reused inside a loop that still needs it. Returns the
+// new number of temporaries.
+int renumberTemporaries(TACList *list)
+{
+    int tempCount = list->tempCount;
+    if (tempCount == 0)
+        return 0;
+
+    CFG cfg;
+    Liveness live;
+    buildCFG(&cfg, list);
+    computeLiveness(&live, &cfg, NULL);
+
+    int firstTemp = list->names.count;
+    int length = 0;
+    int *position = (int *)trackedMalloc(sizeof(int) * (list->count + 1));
+    int *start = (int *)trackedMalloc(sizeof(int) * tempCount);
+    int *end = (int *)trackedMalloc(sizeof(int) * tempCount);
+    int *number = (int *)trackedMalloc(sizeof(int) * tempCount);
+    int *nextStart = (int *)trackedMalloc(sizeof(int) * tempCount);
+    int *nextEnd = (int *)trackedMalloc(sizeof(int) * tempCount);
+    if (!position || !start || !end || !number || !nextStart || !nextEnd)
+    {
+        fprintf(stderr, "renumberTemporaries: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+        position[i] = length++;
+    for (int t = 0; t < tempCount; t++)
+    {
+        start[t] = length;
+        end[t] = -1;
+    }
+
+    for (int b = 0; b < cfg.blockCount; b++)
+    {
+        BasicBlock *block = &cfg.blocks[b];
+        for (int v = bitsetNext(&live.problem.in[b], firstTemp); v >= 0; v = bitsetNext(&live.problem.in[b], v + 1))
+            extendRange(start, end, v - firstTemp, position[block->first]);
+        for (int v = bitsetNext(&live.problem.out[b], firstTemp); v >= 0; v = bitsetNext(&live.problem.out[b], v + 1))
+            extendRange(start, end, v - firstTemp, position[block->last]);
+    }
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        Operand *operands[3] = {&tac->arg1, &tac->arg2, &tac->result};
+        for (int j = 0; j < 3; j++)
+        {
+            if (operands[j]->kind == OPERAND_TEMP)
+                extendRange(start, end, operands[j]->value, position[i]);
+        }
+    }
+
+    // Bucket the temporaries by the positions where they start and end
+    int *startsAt = (int *)trackedMalloc(sizeof(int) * (length + 1));
+    int *endsAt = (int *)trackedMalloc(sizeof(int) * (length + 1));
+    int *freeNumbers = (int *)trackedMalloc(sizeof(int) * tempCount);
+    if (!startsAt || !endsAt || !freeNumbers)
+    {
+        fprintf(stderr, "renumberTemporaries: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int p = 0; p < length; p++)
+        startsAt[p] = endsAt[p] = -1;
+    for (int t = tempCount - 1; t >= 0; t--)
+    {
+        number[t] = -1;
+        if (end[t] < 0)
+            continue; // Never referenced
+        nextStart[t] = startsAt[start[t]];
+        startsAt[start[t]] = t;
+        nextEnd[t] = endsAt[end[t]];
+        endsAt[end[t]] = t;
+    }
+
+    // Sweep the positions in order. Numbers freed at p are handed out again
+    // from p + 1 on, so one instruction never refers to the same number on
+    // behalf of two temporaries.
+    int freeCount = 0;
+    int numberCount = 0;
+    for (int p = 0; p < length; p++)
+    {
+        for (int t = startsAt[p]; t >= 0; t = nextStart[t])
+            number[t] = freeCount > 0 ? freeNumbers[--freeCount] : numberCount++;
+        for (int t = endsAt[p]; t >= 0; t = nextEnd[t])
+            freeNumbers[freeCount++] = number[t];
+    }
+
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        Operand *operands[3] = {&tac->arg1, &tac->arg2, &tac->result};
+        for (int j = 0; j < 3; j++)
+        {
+            if (operands[j]->kind == OPERAND_TEMP)
+                operands[j]->value = number[operands[j]->value];
+        }
+    }
+    list->tempCount = numberCount;
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "Renumbered %d temporaries to %d\n", tempCount, numberCount);
+
+    trackedFree(position);
+    trackedFree(start);
+    trackedFree(end);
+    trackedFree(number);
+    trackedFree(nextStart);
+    trackedFree(nextEnd);
+    trackedFree(startsAt);
+    trackedFree(endsAt);
+    trackedFree(freeNumbers);
+    freeLiveness(&live);
+    freeCFG(&cfg);
+    return numberCount;
+}
+
 // Print the optimized TAC list to a file
-void printOptimizedTAC(const char *filename, TAC *head)
+void printOptimizedTAC(const char *filename, TACList *list)
 {
     FILE *outputFile = fopen(filename, "w");
     if (outputFile == NULL)
@@ -280,12 +1393,8 @@ void printOptimizedTAC(const char *filename, TAC *head)
         exit(EXIT_FAILURE);
     }
 
-    TAC *current = head;
-    while (current != NULL)
-    {
-        fprintf(outputFile, "%s = %s %s %s\n", current->result, current->arg1, current->op, current->arg2);
-        current = current->next;
-    }
-    printf("Optimized TAC written to %s\n", filename);
+    if (!writeTACList(outputFile, list))
+        fprintf(stderr, "%s: Failed to write TAC\n", filename);
+    TRACE(TRACE_OPTIMIZER, TRACE_INFO, "Optimized TAC written to %s\n", filename);
     fclose(outputFile);
 }
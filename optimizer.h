@@ -20,16 +20,25 @@ Basic Optimizations:
 
 #include "semantic.h"
 #include "tac.h"
+#include "ssa.h"
+#include "inline.h"
+#include "bounds.h"
+#include "loop.h"
+#include "cache.h"
 #include <stdbool.h>
 #include <ctype.h>
 
-void optimizeTAC(TAC **head);
-bool isConstant(const char *str);
-bool isVariable(const char *str);
-void constantFolding(TAC **head);
-void constantPropagation(TAC **head);
-void copyPropagation(TAC **head);
-void deadCodeElimination(TAC **head);
-void printOptimizedTAC(const char *filename, TAC *head);
+void optimizeTAC(TACList *list, FunctionCache *cache, InlineStats *inlining, BoundsStats *bounds, LoopStats *loops);
+bool isConstant(Operand operand);
+bool isVariable(Operand operand);
+bool evaluateArithmetic(TACOpcode op, int a, int b, int *result);
+int constantFolding(TACList *list);
+int constantPropagation(TACList *list);
+int copyPropagation(TACList *list);
+int deadCodeElimination(TACList *list);
+int sparseConditionalConstantPropagation(SSAForm *ssa);
+int globalValueNumbering(SSAForm *ssa);
+int renumberTemporaries(TACList *list);
+void printOptimizedTAC(const char *filename, TACList *list);
 
 #endif // OPTIMIZER_H
\ No newline at end of file
@@ -3,95 +3,130 @@
 #include <stdlib.h>
 #include <string.h>
 #include "AST.h"
-#include "symbolTable.h"
-#include "semantic.h"
-#include "codeGenerator.h"
-#include "optimizer.h"
-#include "tac.h"
-
-#define TABLE_SIZE 100
+#include "compiler.h"
+#include "trace.h"
+%}
 
-extern int yylex();   // Declare yylex, the lexer function
-extern int yyparse(); // Declare yyparse, the parser function
-extern FILE* yyin;    // Declare yyin, the file pointer for the input file
-extern int yylineno;  // Declare yylineno, the line number counter
-extern TAC* tacHead;  // Declare the head of the linked list of TAC entries
+%code requires {
+typedef void *yyscan_t; // Reentrant scanner state, see lexer.l
+#include "source.h" // TokenSlice
+struct CompilerContext;
+}
 
-void yyerror(const char* s);
+%code {
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
+void yyerror(struct CompilerContext *ctx, yyscan_t scanner, const char *s);
+
+// All nodes go through createNode so they land in the compilation's AST arena
+static ASTNode* newNode(struct CompilerContext *ctx, yyscan_t scanner, NodeType type) {
+    ASTNode* node = createNode(&ctx->astArena, type);
+    node->lineno = yyget_lineno(scanner);
+    ctx->stats.astNodes++;
+    return node;
+}
 
-ASTNode* root = NULL; 
-SymbolTable* symTab = NULL;
-Symbol* symbol = NULL;
+// The operator tokens carry their spelling; precedence comes from the %left
+// declarations below
+static ASTNode* newBinaryExpr(struct CompilerContext *ctx, yyscan_t scanner, ASTNode *left, char *operator, ASTNode *right) {
+    TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized expression\n");
+    ASTNode* node = newNode(ctx, scanner, NodeType_Expr);
+    node->expr.left = left;
+    node->expr.right = right;
+    node->expr.operator = operator;
+    return node;
+}
+}
 
-%}
+%define api.pure full
+%parse-param {struct CompilerContext *ctx} {yyscan_t scanner}
+%lex-param {yyscan_t scanner}
 
 %union {
     int number;
     char character;
     char* string;
     char* operator;
+    TokenSlice slice;
     struct ASTNode* ast;
+    struct { struct ASTNode *head, *tail; } list; // Built left to right, see VarDecls
 }
 
-%token <string> TYPE
-%token <string> ID
-%token SEMICOLON
+%token <slice> TYPE
+%token <slice> ID
+%token SEMICOLON COMMA
 %token <operator> EQ
-%token <operator> PLUS
+%token <operator> PLUS MINUS TIMES DIVIDE
+%token <operator> EQEQ NE LT LE GT GE
 %token <number> NUMBER
-%token <string> WRITE
+%token <slice> WRITE
+%token RETURN WHILE
+%token LBRACE RBRACE
 %token <string> LBRACKET
 %token <string> RBRACKET
 %token <string> LPAREN
 %token <string> RPAREN
 
-%printer { fprintf(yyoutput, "%s", $$); } ID;
+%printer { fprintf(yyoutput, "%.*s", $$.length, ctx->source.data + $$.offset); } ID;
 
-%type <ast> Program VarDecl VarDeclList Stmt StmtList Expr BinOp FuncDecl FuncCall
+%type <ast> Program VarDecl VarDeclList Stmt StmtList Expr FuncDecl FuncCall ArgList
+%type <list> VarDecls Stmts
 %start Program
 
+%left EQEQ NE
+%left LT LE GT GE
+%left PLUS MINUS
+%left TIMES DIVIDE
+
 %%
 
 Program: VarDeclList StmtList {
-    printf("The PARSER has started\n");
-    root = malloc(sizeof(ASTNode));
-    root->type = NodeType_Program;
-    root->program.varDeclList = $1;
-    root->program.stmtList = $2;
+    TRACE(TRACE_PARSER, TRACE_DEBUG, "The PARSER has started\n");
+    ctx->root = newNode(ctx, scanner, NodeType_Program);
+    ctx->root->program.varDeclList = $1;
+    ctx->root->program.stmtList = $2;
 }
 
-VarDeclList:  { }
-    | VarDecl VarDeclList {
-        printf("PARSER: Recognized variable declaration list\n");
+VarDeclList: VarDecls { $$ = $1.head; }
+;
+
+// The lists are left-recursive so the parser stack stays flat however long
+// they get; the tail pointer appends each node in source order
+VarDecls:  { $$.head = $$.tail = NULL; }
+    | VarDecls VarDecl {
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized variable declaration list\n");
 
-        $$ = malloc(sizeof(ASTNode));
-        $$->type = NodeType_VarDeclList;
-        $$->varDeclList.varDecl = $1;
-        $$->varDeclList.varDeclList = $2;
+        ASTNode *node = newNode(ctx, scanner, NodeType_VarDeclList);
+        node->varDeclList.varDecl = $2;
+        $$ = $1;
+        if ($$.tail)
+            $$.tail->varDeclList.varDeclList = node;
+        else
+            $$.head = node;
+        $$.tail = node;
     }
 ;
 
 VarDecl: TYPE ID SEMICOLON { 
-            printf("PARSER: Recognized variable declaration: %s\n", $2);
+            $$ = newNode(ctx, scanner, NodeType_VarDecl);
+            $$->varDecl.varType = tokenText(ctx, $1);
+            $$->varDecl.varName = tokenText(ctx, $2);
 
-            $$ = malloc(sizeof(ASTNode));
-            $$->type = NodeType_VarDecl;
-            $$->varDecl.varType = strdup($1);
-            $$->varDecl.varName = strdup($2);
+            TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized variable declaration: %s\n", $$->varDecl.varName);
 
         }
         | TYPE ID LBRACKET NUMBER RBRACKET SEMICOLON { 
-            printf("PARSER: Recognized array declaration: %s[%d]\n", $2, $4);
-
-            $$ = malloc(sizeof(ASTNode));
-            $$->type = NodeType_ArrayDecl;
-            $$->arrayDecl.arrayType = strdup($1);
-            $$->arrayDecl.arrayName = strdup($2);
+            $$ = newNode(ctx, scanner, NodeType_ArrayDecl);
+            $$->arrayDecl.arrayType = tokenText(ctx, $1);
+            $$->arrayDecl.arrayName = tokenText(ctx, $2);
             $$->arrayDecl.sizeExpr = $4;  
 
+            TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized array declaration: %s[%d]\n", $$->arrayDecl.arrayName, $4);
+
             if ($4 <= 0) {
-                printf("Error: Array size must be a positive integer.\n");
-                exit(0);
+                fprintf(stderr, "%s:%d: Error: Array size must be a positive integer.\n", ctx->inputFilename, yyget_lineno(scanner));
+                ctx->parseErrors++;
+                YYABORT;
             } 
         }
         | FuncDecl SEMICOLON {  } 
@@ -99,82 +134,112 @@ VarDecl: TYPE ID SEMICOLON {
 
 
 FuncDecl: TYPE ID LPAREN VarDeclList RPAREN StmtList {
-    printf("PARSER: Recognized function declaration: %s\n", $2);
-    enterScope();
+    $$ = newNode(ctx, scanner, NodeType_FunctionDecl);
+    $$->funcDecl.returnType = tokenText(ctx, $1); 
+    $$->funcDecl.funcName = tokenText(ctx, $2);
+    TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized function declaration: %s\n", $$->funcDecl.funcName);
 
-    $$ = malloc(sizeof(ASTNode));
-    $$->type = NodeType_FunctionDecl;
-    $$->funcDecl.returnType = strdup($1); 
-    $$->funcDecl.funcName = strdup($2);
     $$->funcDecl.paramList = $4; 
     $$->funcDecl.funcBody = $6; 
-
-    exitScope();
 }
 
 FuncCall: ID LPAREN RPAREN {
-    printf("PARSER: Recognized function call: %s()\n", $1);
-
-    $$ = malloc(sizeof(ASTNode));
-    $$->type = NodeType_FunctionCall;
-    $$->funcCall.funcName = strdup($1);
+    $$ = newNode(ctx, scanner, NodeType_FunctionCall);
+    $$->funcCall.funcName = tokenText(ctx, $1);
+    TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized function call: %s()\n", $$->funcCall.funcName);
 
 }
-    | ID LPAREN Expr RPAREN {
-        printf("PARSER: Recognized function call with arguments: %s()\n", $1);
+    | ID LPAREN ArgList RPAREN {
+        $$ = newNode(ctx, scanner, NodeType_FunctionCall);
+        $$->funcCall.funcName = tokenText(ctx, $1);
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized function call with arguments: %s()\n", $$->funcCall.funcName);
 
-        $$ = malloc(sizeof(ASTNode));
-        $$->type = NodeType_FunctionCall;
-        $$->funcCall.funcName = strdup($1);
         $$->funcCall.argList = $3; 
     }
 ;
 
-StmtList:  {}
-    | Stmt StmtList {
-        printf("PARSER: Recognized statement list\n");
-        $$ = malloc(sizeof(ASTNode));
-        $$->type = NodeType_StmtList;
-        $$->stmtList.stmt = $1;
-        $$->stmtList.stmtList = $2;
+ArgList: Expr {
+    $$ = newNode(ctx, scanner, NodeType_ArgList);
+    $$->argList.arg = $1;
+}
+    | Expr COMMA ArgList {
+        $$ = newNode(ctx, scanner, NodeType_ArgList);
+        $$->argList.arg = $1;
+        $$->argList.argList = $3;
+    }
+;
+
+StmtList: Stmts { $$ = $1.head; }
+;
+
+Stmts:  { $$.head = $$.tail = NULL; }
+    | Stmts Stmt {
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized statement list\n");
+        ASTNode *node = newNode(ctx, scanner, NodeType_StmtList);
+        node->stmtList.stmt = $2;
+        $$ = $1;
+        if ($$.tail)
+            $$.tail->stmtList.stmtList = node;
+        else
+            $$.head = node;
+        $$.tail = node;
     }
 ;
 
 Stmt: ID EQ Expr SEMICOLON {
-    printf("PARSER: Recognized assignment statement\n");
-    $$ = malloc(sizeof(ASTNode));
-    $$->type = NodeType_AssignStmt;
-    $$->assignStmt.varName = strdup($1);
+    TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized assignment statement\n");
+    $$ = newNode(ctx, scanner, NodeType_AssignStmt);
+    $$->assignStmt.varName = tokenText(ctx, $1);
     $$->assignStmt.operator = $2;
     $$->assignStmt.expr = $3;
 }
+    | ID LBRACKET Expr RBRACKET EQ Expr SEMICOLON {
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized array assignment statement\n");
+        $$ = newNode(ctx, scanner, NodeType_ArrayAssignStmt);
+        $$->arrayAssignStmt.arrayName = tokenText(ctx, $1);
+        $$->arrayAssignStmt.indexExpr = $3;
+        $$->arrayAssignStmt.expr = $6;
+    }
     | WRITE Expr SEMICOLON {
-        printf("PARSER: Recognized write statement\n");
-        $$ = malloc(sizeof(ASTNode));
-        $$->type = NodeType_WriteStmt;
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized write statement\n");
+        $$ = newNode(ctx, scanner, NodeType_WriteStmt);
         $$->writeStmt.expr = $2;
     }
+    | RETURN Expr SEMICOLON {
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized return statement\n");
+        $$ = newNode(ctx, scanner, NodeType_ReturnStmt);
+        $$->returnStmt.expr = $2;
+    }
+    | WHILE LPAREN Expr RPAREN Stmt {
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized while statement\n");
+        $$ = newNode(ctx, scanner, NodeType_WhileStmt);
+        $$->whileStmt.condition = $3;
+        $$->whileStmt.body = $5;
+    }
+    | LBRACE StmtList RBRACE {
+        // A block is its statement list; an empty one is NULL like any other
+        $$ = $2;
+    }
 ;
 
-Expr: Expr BinOp Expr {
-    printf("PARSER: Recognized expression\n");
-    $$ = malloc(sizeof(ASTNode));
-    $$->type = NodeType_Expr;
-    $$->expr.left = $1;
-    $$->expr.right = $3;
-    $$->expr.operator = $2->binOp.operator;
-
-}
+Expr: Expr PLUS Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr MINUS Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr TIMES Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr DIVIDE Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr EQEQ Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr NE Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr LT Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr LE Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr GT Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
+    | Expr GE Expr { $$ = newBinaryExpr(ctx, scanner, $1, $2, $3); }
     | ID {
-        printf("ASSIGNMENT statement \n");
-        $$ = malloc(sizeof(ASTNode));
-        $$->type = NodeType_SimpleID;
-        $$->simpleID.name = $1;
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "ASSIGNMENT statement \n");
+        $$ = newNode(ctx, scanner, NodeType_SimpleID);
+        $$->simpleID.name = tokenText(ctx, $1);
     }
     | NUMBER {
-        printf("PARSER: Recognized number\n");
-        $$ = malloc(sizeof(ASTNode));
-        $$->type = NodeType_SimpleExpr;
+        TRACE(TRACE_PARSER, TRACE_DEBUG, "PARSER: Recognized number\n");
+        $$ = newNode(ctx, scanner, NodeType_SimpleExpr);
         $$->simpleExpr.number = $1;
     }
     | FuncCall {
@@ -182,94 +247,19 @@ Expr: Expr BinOp Expr {
     }
     | ID LBRACKET Expr RBRACKET {
         // Create AST node for Array access
-        $$ = malloc(sizeof(ASTNode));
-        $$->type = NodeType_ArrayAccess;
-        $$->arrayAccess.arrayName = strdup($1);
+        $$ = newNode(ctx, scanner, NodeType_ArrayAccess);
+        $$->arrayAccess.arrayName = tokenText(ctx, $1);
         $$->arrayAccess.indexExpr = $3;
     }
     | LPAREN Expr RPAREN {
         // TODO Add handle for parameters
+        $$ = $2;
     }
 ;
 
-BinOp: PLUS {
-    printf("PARSER: Recognized binary operator\n");
-    $$ = malloc(sizeof(ASTNode));
-    $$->type = NodeType_BinOp;
-    $$->binOp.operator = $1;
-}
-;
-
 %%
-int main() {
-    int semanticErrors = 0;
-    // Initialize file or input source
-    yyin = fopen("testProg.cmm", "r");
-
-    // Initialize symbol table
-    symTab = createSymbolTable(TABLE_SIZE);
-    if (symTab == NULL) {
-        fprintf(stderr, "Failed to create symbol table\n");
-        return EXIT_FAILURE;
-    }
-
-    // Initialize temporary variables for TAC generation
-    initializeTempVars();
-
-    // Start parsing
-    if (yyparse() == 0) {
-        printf("Parsing completed successfully.\n");
-
-        // Traverse AST for debugging
-        printf("\n+++ AST Traversal +++\n");
-        traverseAST(root, 0); // This prints the AST for debugging
-        printf("\n+++++++++++++++++++++\n");
-
-        // Semantic Analysis
-        printf("\n--- Semantic Analysis ---\n");
-        semanticErrors = semanticAnalysis(root, symTab); // Perform full semantic analysis
-        printf("\n------------------------\n");
-
-        // Check if semantic analysis was successful
-        if (semanticErrors == 0) {
-            // Print symbol table for debugging
-            printf("\n*** Symbol Table ***\n");
-            printSymbolTable(symTab);
-            printf("\n********************\n");
-
-            // TAC Generation
-            printf("\n$$$ TAC Generation $$$\n");
-            ASTtoTAC(root); // Changed from generateTACForExpr to ASTtoTAC
-            printTACToFile("TAC.ir", tacHead); // Print the generated TAC
-
-            // Code Optimization (If you have this phase implemented)
-            optimizeTAC(&tacHead); 
-            printOptimizedTAC("TACOptimized.ir", tacHead);
-
-            // MIPS Code Generation
-            printf("\n=== MIPS Code Generation ===\n");
-            initCodeGenerator("Output.s", symTab); // Initialize code generation
-            generateMIPS(tacHead); // Generate MIPS code from TAC
-            finalizeCodeGenerator("Output.s"); // Finalize code generation and write to file
-
-        } else {
-            fprintf(stderr, "Compilation stopped due to semantic errors.\n");
-        }
-
-        // Cleanup
-        freeAST(root);
-        freeSymbolTable(symTab);
-
-    } else {
-        fprintf(stderr, "Parsing failed\n");
-    }
-
-    fclose(yyin);
-    return 0;
-}
-
 
-void yyerror(const char* s) {
-	fprintf(stderr, "Parse error: %s\n", s);
-	exit(1);
+void yyerror(struct CompilerContext *ctx, yyscan_t scanner, const char* s) {
+	fprintf(stderr, "%s:%d: Parse error: %s\n", ctx->inputFilename, yyget_lineno(scanner), s);
+	ctx->parseErrors++;
 }
@@ -0,0 +1,424 @@
+#include "peephole.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+
+// How far ahead isDeadAfter looks for a read before giving up
+#define PEEPHOLE_WINDOW 64
+
+typedef struct RegisterFact
+{
+    bool hasConstant;
+    int constant;
+    const char *address; // Holds the address of this data label, or NULL
+    bool hasMemory;
+    MipsAddress memory;  // Holds the word stored here
+    int copyOf;          // Holds the same value as this register, or MIPS_NO_REGISTER
+} RegisterFact;
+
+typedef struct Peephole
+{
+    MipsList *list;
+    RegisterFact facts[MIPS_REGISTER_COUNT];
+} Peephole;
+
+// Scratch registers the code generator never carries from one TAC
+// instruction to the next, so they are dead wherever control can arrive
+// from elsewhere. $v0 is not one: it carries the return value to the
+// epilogue.
+static bool isScratchRegister(int reg)
+{
+    return reg == MIPS_A0 || reg == MIPS_T8 || reg == MIPS_T9;
+}
+
+// Registers a call leaves as they were
+static bool isCalleeSaved(int reg)
+{
+    return (reg >= MIPS_S0 && reg < MIPS_S0 + 8) || reg == MIPS_SP;
+}
+
+static void forgetRegister(Peephole *p, int reg)
+{
+    p->facts[reg] = (RegisterFact){false, 0, NULL, false, {NULL, 0, MIPS_NO_REGISTER}, MIPS_NO_REGISTER};
+    if (reg == MIPS_ZERO)
+        p->facts[reg].hasConstant = true;
+}
+
+static void forgetAll(Peephole *p)
+{
+    for (int r = 0; r < MIPS_REGISTER_COUNT; r++)
+        forgetRegister(p, r);
+}
+
+static int nextInstruction(Peephole *p, int at)
+{
+    for (int i = at + 1; i < p->list->count; i++)
+    {
+        if (p->list->code[i].op != MIPS_NOP)
+            return i;
+    }
+    return -1;
+}
+
+static void removeInstruction(Peephole *p, int at)
+{
+    p->list->code[at].op = MIPS_NOP;
+}
+
+// True if nothing reads the value reg holds after instruction at. Past a
+// label or a jump only scratch registers are known to be dead; a branch
+// target starts with a label, so for them the fall-through path decides.
+static bool isDeadAfter(Peephole *p, int at, int reg)
+{
+    if (reg == MIPS_ZERO || reg == MIPS_SP || reg == MIPS_RA || reg == MIPS_NO_REGISTER)
+        return false;
+
+    int seen = 0;
+    for (int i = at + 1; i < p->list->count; i++)
+    {
+        const MipsInstruction *instr = &p->list->code[i];
+        if (instr->op == MIPS_NOP)
+            continue;
+        if (++seen > PEEPHOLE_WINDOW)
+            return false;
+        if (instr->op == MIPS_LABEL)
+            return isScratchRegister(reg);
+        if (mipsReadsRegister(instr, reg))
+            return false;
+        bool branches = instr->op == MIPS_BEQ || instr->op == MIPS_BNE;
+        if (instr->op == MIPS_J || (branches && !isScratchRegister(reg)))
+            return isScratchRegister(reg);
+        if (instr->op == MIPS_JR)
+            return !isCalleeSaved(reg); // The caller only reads those and $v0
+        if (instr->op == MIPS_JAL)
+        {
+            if (!isCalleeSaved(reg))
+                return true; // The callee may overwrite it
+            continue;
+        }
+        if (mipsWrittenRegister(instr) == reg && instr->op != MIPS_SYSCALL)
+            return true;
+    }
+    return true; // The program has exited
+}
+
+// Whether a store to a may change the word at b. Stack slots and data
+// labels never overlap; an address through any other base could be anything.
+static bool mayAlias(MipsAddress a, MipsAddress b)
+{
+    bool aKnown = a.base == MIPS_NO_REGISTER || (a.base == MIPS_SP && a.symbol == NULL);
+    bool bKnown = b.base == MIPS_NO_REGISTER || (b.base == MIPS_SP && b.symbol == NULL);
+    if (!aKnown || !bKnown)
+        return true;
+    return sameMipsAddress(a, b);
+}
+
+static bool holdsMemory(const RegisterFact *fact, MipsAddress address)
+{
+    return fact->hasMemory && sameMipsAddress(fact->memory, address);
+}
+
+static bool holdSameValue(Peephole *p, int a, int b)
+{
+    const RegisterFact *x = &p->facts[a];
+    const RegisterFact *y = &p->facts[b];
+    if (a == b || x->copyOf == b || y->copyOf == a)
+        return true;
+    if (x->copyOf != MIPS_NO_REGISTER && x->copyOf == y->copyOf)
+        return true;
+    if (x->hasConstant && y->hasConstant && x->constant == y->constant)
+        return true;
+    if (x->address && x->address == y->address)
+        return true;
+    return x->hasMemory && holdsMemory(y, x->memory);
+}
+
+// Instructions whose only effect is to write their destination register
+static bool isPureWrite(const MipsInstruction *instr)
+{
+    return instr->op != MIPS_NOP && instr->op != MIPS_SYSCALL && instr->op != MIPS_DIV &&
+           mipsWrittenRegister(instr) != MIPS_NO_REGISTER;
+}
+
+// Rules. Each looks at the instruction at index at, with the facts that hold
+// just before it, and returns true if it rewrote or removed it.
+
+// lw r, M where r already holds the word at M
+static bool redundantLoad(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (instr->op != MIPS_LW || !holdsMemory(&p->facts[instr->dst], instr->address))
+        return false;
+    removeInstruction(p, at);
+    return true;
+}
+
+// lw r, M where another register holds the word at M: sw $t8, x then
+// lw $t9, x becomes a move
+static bool loadForwarding(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (instr->op != MIPS_LW)
+        return false;
+    for (int r = 1; r < MIPS_REGISTER_COUNT; r++)
+    {
+        if (r != instr->dst && holdsMemory(&p->facts[r], instr->address))
+        {
+            instr->op = MIPS_MOVE;
+            instr->src1 = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+// sw r, M where M already holds the value of r
+static bool redundantStore(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (instr->op != MIPS_SW || !holdsMemory(&p->facts[instr->src1], instr->address))
+        return false;
+    removeInstruction(p, at);
+    return true;
+}
+
+// li r, c where r already holds c, as $v0 does between syscalls
+static bool redundantConstant(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    const RegisterFact *fact = &p->facts[instr->dst];
+    if (instr->op != MIPS_LI || !fact->hasConstant || fact->constant != instr->imm)
+        return false;
+    removeInstruction(p, at);
+    return true;
+}
+
+// la r, label where r already holds that address
+static bool redundantAddress(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (instr->op != MIPS_LA || instr->address.base != MIPS_NO_REGISTER || instr->address.offset != 0)
+        return false;
+    const char *address = p->facts[instr->dst].address;
+    if (!address || strcmp(address, instr->address.symbol) != 0)
+        return false;
+    removeInstruction(p, at);
+    return true;
+}
+
+// move a, b where a already holds the value of b
+static bool redundantMove(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (instr->op != MIPS_MOVE || !holdSameValue(p, instr->dst, instr->src1))
+        return false;
+    removeInstruction(p, at);
+    return true;
+}
+
+// move a, b followed by an instruction that reads a for the last time:
+// that instruction reads b instead. Syscalls, calls and returns read their
+// registers implicitly, so they are left alone.
+static bool copyPropagation(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (instr->op != MIPS_MOVE)
+        return false;
+    int next = nextInstruction(p, at);
+    if (next < 0)
+        return false;
+
+    MipsInstruction *user = &p->list->code[next];
+    int copy = instr->dst;
+    if (user->op == MIPS_SYSCALL || user->op == MIPS_JAL || user->op == MIPS_JR || user->op == MIPS_LABEL ||
+        !mipsReadsRegister(user, copy))
+        return false;
+    if (mipsWrittenRegister(user) != copy && !isDeadAfter(p, next, copy))
+        return false;
+
+    if (user->src1 == copy)
+        user->src1 = instr->src1;
+    if (user->src2 == copy)
+        user->src2 = instr->src1;
+    if (user->address.base == copy)
+        user->address.base = instr->src1;
+    removeInstruction(p, at);
+    return true;
+}
+
+// An instruction computing into t, followed by move r, t with t dead
+// afterwards, computes into r directly
+static bool moveFusion(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (!isPureWrite(instr))
+        return false;
+    int next = nextInstruction(p, at);
+    if (next < 0)
+        return false;
+
+    MipsInstruction *move = &p->list->code[next];
+    int temp = mipsWrittenRegister(instr);
+    if (move->op != MIPS_MOVE || move->src1 != temp || move->dst == temp || !isDeadAfter(p, next, temp))
+        return false;
+
+    instr->dst = move->dst;
+    removeInstruction(p, next);
+    return true;
+}
+
+// A register written and then overwritten or abandoned before any read
+static bool deadWrite(Peephole *p, int at)
+{
+    MipsInstruction *instr = &p->list->code[at];
+    if (!isPureWrite(instr) || !isDeadAfter(p, at, mipsWrittenRegister(instr)))
+        return false;
+    removeInstruction(p, at);
+    return true;
+}
+
+static const struct
+{
+    const char *name;
+    bool (*apply)(Peephole *p, int at);
+} rules[PEEPHOLE_RULE_COUNT] = {
+    [PEEPHOLE_REDUNDANT_LOAD] = {"redundant load", redundantLoad},
+    [PEEPHOLE_LOAD_FORWARDING] = {"store-to-load forwarding", loadForwarding},
+    [PEEPHOLE_REDUNDANT_STORE] = {"redundant store", redundantStore},
+    [PEEPHOLE_REDUNDANT_CONSTANT] = {"redundant constant", redundantConstant},
+    [PEEPHOLE_REDUNDANT_ADDRESS] = {"redundant address", redundantAddress},
+    [PEEPHOLE_REDUNDANT_MOVE] = {"redundant move", redundantMove},
+    [PEEPHOLE_COPY_PROPAGATION] = {"copy propagation", copyPropagation},
+    [PEEPHOLE_MOVE_FUSION] = {"move fusion", moveFusion},
+    [PEEPHOLE_DEAD_WRITE] = {"dead write", deadWrite},
+};
+
+const char *peepholeRuleName(PeepholeRule rule)
+{
+    return rules[rule].name;
+}
+
+// Updates the facts for the effect of an instruction that stays
+static void recordInstruction(Peephole *p, const MipsInstruction *instr)
+{
+    if (instr->op == MIPS_LABEL || instr->op == MIPS_J || instr->op == MIPS_JR)
+    {
+        forgetAll(p); // Control may arrive from elsewhere
+        return;
+    }
+    if (instr->op == MIPS_JAL)
+    {
+        forgetAll(p); // The callee may change any register or word it likes
+        return;
+    }
+    if (instr->op == MIPS_SYSCALL)
+    {
+        const RegisterFact *service = &p->facts[MIPS_V0];
+        bool prints = service->hasConstant && (service->constant == 1 || service->constant == 4 ||
+                                               service->constant == 10 || service->constant == 11);
+        if (!prints)
+            forgetAll(p);
+        return;
+    }
+    if (instr->op == MIPS_SW)
+    {
+        for (int r = 0; r < MIPS_REGISTER_COUNT; r++)
+        {
+            if (p->facts[r].hasMemory && mayAlias(instr->address, p->facts[r].memory))
+                p->facts[r].hasMemory = false;
+        }
+        if (instr->src1 != MIPS_ZERO)
+        {
+            p->facts[instr->src1].hasMemory = true;
+            p->facts[instr->src1].memory = instr->address;
+        }
+        return;
+    }
+
+    int dst = mipsWrittenRegister(instr);
+    if (dst == MIPS_NO_REGISTER)
+        return;
+
+    RegisterFact source = p->facts[instr->src1 != MIPS_NO_REGISTER ? instr->src1 : dst];
+
+    forgetRegister(p, dst);
+    for (int r = 0; r < MIPS_REGISTER_COUNT; r++)
+    {
+        if (p->facts[r].copyOf == dst)
+            p->facts[r].copyOf = MIPS_NO_REGISTER;
+        if (p->facts[r].hasMemory && p->facts[r].memory.base == dst)
+            p->facts[r].hasMemory = false;
+    }
+
+    RegisterFact *target = &p->facts[dst];
+    switch (instr->op)
+    {
+    case MIPS_LI:
+        target->hasConstant = true;
+        target->constant = instr->imm;
+        break;
+    case MIPS_LUI:
+        target->hasConstant = true;
+        target->constant = (int)((unsigned)instr->imm << 16);
+        break;
+    case MIPS_ADDIU:
+    case MIPS_ORI:
+        if (source.hasConstant)
+        {
+            target->hasConstant = true;
+            target->constant = instr->op == MIPS_ADDIU ? (int)((unsigned)source.constant + (unsigned)instr->imm)
+                                                       : source.constant | instr->imm;
+        }
+        break;
+    case MIPS_LA:
+        if (instr->address.base == MIPS_NO_REGISTER && instr->address.offset == 0)
+            target->address = instr->address.symbol;
+        break;
+    case MIPS_LW:
+        if (instr->address.base != dst)
+        {
+            target->hasMemory = true;
+            target->memory = instr->address;
+        }
+        break;
+    case MIPS_MOVE:
+        *target = source;
+        if (source.hasMemory && source.memory.base == dst)
+            target->hasMemory = false;
+        target->copyOf = instr->src1;
+        break;
+    default:
+        break;
+    }
+}
+
+void peepholeOptimize(MipsList *list, PeepholeStats *stats)
+{
+    Peephole p;
+    p.list = list;
+    forgetAll(&p);
+    memset(stats, 0, sizeof(*stats));
+
+    int before = mipsInstructionCount(list);
+    for (int i = 0; i < list->count; i++)
+    {
+        // Rewriting an instruction may open it to an earlier rule, so the
+        // table is tried again from the top after every hit
+        for (int r = 0; r < PEEPHOLE_RULE_COUNT && list->code[i].op != MIPS_NOP; r++)
+        {
+            if (rules[r].apply(&p, i))
+            {
+                stats->fired[r]++;
+                r = -1;
+            }
+        }
+        if (list->code[i].op != MIPS_NOP)
+            recordInstruction(&p, &list->code[i]);
+    }
+    compactMipsList(list);
+    stats->removed = before - mipsInstructionCount(list);
+
+    for (int r = 0; r < PEEPHOLE_RULE_COUNT; r++)
+        TRACE(TRACE_CODEGEN, TRACE_DEBUG, "Peephole: %s fired %d times\n", rules[r].name, stats->fired[r]);
+    TRACE(TRACE_CODEGEN, TRACE_INFO, "Peephole: %d instructions removed\n", stats->removed);
+}
@@ -0,0 +1,36 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "mips.h"
+
+// Peephole optimization of the generated MIPS, run on the instruction list
+// before any text is written. One forward sweep tracks what each register
+// is known to hold (a constant, a data label's address, the word at some
+// address, another register) within a basic block, and tries the rules of
+// a table on every instruction against those facts.
+
+// One per row of the rule table in peephole.c
+typedef enum
+{
+    PEEPHOLE_REDUNDANT_LOAD,   // lw of a word the register already holds
+    PEEPHOLE_LOAD_FORWARDING,  // lw of a word another register holds becomes a move
+    PEEPHOLE_REDUNDANT_STORE,  // sw of the value memory already holds
+    PEEPHOLE_REDUNDANT_CONSTANT, // li of the constant the register already holds
+    PEEPHOLE_REDUNDANT_ADDRESS,  // la of the address the register already holds
+    PEEPHOLE_REDUNDANT_MOVE,   // move between registers holding the same value
+    PEEPHOLE_COPY_PROPAGATION, // move read once by the next instruction
+    PEEPHOLE_MOVE_FUSION,      // result computed into a register that is only moved on
+    PEEPHOLE_DEAD_WRITE,       // register written and never read
+    PEEPHOLE_RULE_COUNT
+} PeepholeRule;
+
+typedef struct PeepholeStats
+{
+    int fired[PEEPHOLE_RULE_COUNT];
+    int removed; // Instructions deleted in all
+} PeepholeStats;
+
+void peepholeOptimize(MipsList *list, PeepholeStats *stats);
+const char *peepholeRuleName(PeepholeRule rule);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,297 @@
+#include "regalloc.h"
+#include "memtrack.h"
+#include "cfg.h"
+#include "dataflow.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+// $t0-$t7 and $s0-$s7 are numbered consecutively
+int registerNumber(int reg)
+{
+    return MIPS_T0 + reg;
+}
+
+static void *allocateOrDie(size_t size)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "allocateRegisters: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void extend(LiveInterval *interval, int position)
+{
+    if (position < interval->start)
+        interval->start = position;
+    if (position > interval->end)
+        interval->end = position;
+}
+
+static int compareStart(const void *a, const void *b)
+{
+    const LiveInterval *x = (const LiveInterval *)a;
+    const LiveInterval *y = (const LiveInterval *)b;
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    return x->value - y->value;
+}
+
+// Spill weight: how often the value is touched per instruction it occupies
+// a register. The interval with the lowest weight is the cheapest to spill.
+static double spillWeight(const LiveInterval *interval)
+{
+    return (double)interval->uses / (interval->end - interval->start + 1);
+}
+
+// Builds one interval per value the code refers to: every use and
+// definition covers its own position, and a block the value is live into or
+// out of covers the block's first or last position.
+static LiveInterval *buildIntervals(RegisterAllocation *alloc, TACList *list, int valueCount)
+{
+    CFG cfg;
+    Liveness live;
+    buildCFG(&cfg, list);
+    computeLiveness(&live, &cfg, NULL);
+
+    for (int v = 0; v < valueCount; v++)
+        alloc->liveOnEntry[v] = cfg.blockCount > 0 && bitsetTest(&live.problem.in[0], v);
+
+    int *position = (int *)allocateOrDie(sizeof(int) * (list->count + 1));
+    int count = 0;
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+        position[i] = count++;
+
+    LiveInterval *intervals = (LiveInterval *)allocateOrDie(sizeof(LiveInterval) * (valueCount + 1));
+    for (int v = 0; v < valueCount; v++)
+    {
+        intervals[v].value = v;
+        intervals[v].start = INT_MAX;
+        intervals[v].end = -1;
+        intervals[v].uses = 0;
+        intervals[v].crossesCall = false;
+        intervals[v].inMemory = false;
+    }
+
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        TAC *tac = &list->code[i];
+        Operand *uses[2];
+        int useCount = tacUses(tac, uses);
+        for (int u = 0; u < useCount; u++)
+        {
+            LiveInterval *interval = &intervals[tacValueIndex(list, *uses[u])];
+            extend(interval, position[i]);
+            interval->uses++;
+        }
+        Operand *def = tacDefinition(tac);
+        if (def)
+        {
+            LiveInterval *interval = &intervals[tacValueIndex(list, *def)];
+            extend(interval, position[i]);
+            interval->uses++;
+        }
+    }
+
+    // Calls and returns make every global live; only those the code
+    // refers to need a home here
+    for (int b = 0; b < cfg.blockCount; b++)
+    {
+        BasicBlock *block = &cfg.blocks[b];
+        for (int v = bitsetNext(&live.problem.in[b], 0); v >= 0; v = bitsetNext(&live.problem.in[b], v + 1))
+        {
+            if (intervals[v].uses > 0)
+                extend(&intervals[v], position[block->first]);
+        }
+        for (int v = bitsetNext(&live.problem.out[b], 0); v >= 0; v = bitsetNext(&live.problem.out[b], v + 1))
+        {
+            if (intervals[v].uses > 0)
+                extend(&intervals[v], position[block->last]);
+        }
+    }
+
+    // A value live across a call needs a register the callee saves. A
+    // global live across a call must be in memory instead, since the callee
+    // may read or write it. So must a global the function assigns if it
+    // calls or returns at all: the TAC stores it back before the call or
+    // return, and that store has to reach memory.
+    bool *assigned = (bool *)allocateOrDie(sizeof(bool) * (valueCount + 1));
+    bool hasCallOrReturn = false;
+    for (int v = 0; v < valueCount; v++)
+        assigned[v] = false;
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        Operand *def = tacDefinition(&list->code[i]);
+        if (def)
+            assigned[tacValueIndex(list, *def)] = true;
+        hasCallOrReturn |= readsGlobals(&list->code[i]);
+    }
+    for (int v = 0; v < list->names.count; v++)
+    {
+        if (hasCallOrReturn && assigned[v] && isGlobalSymbol(list, v))
+            intervals[v].inMemory = true;
+    }
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        if (list->code[i].op != TAC_CALL)
+            continue;
+        // An interval that starts at the call, such as a global live into a
+        // block the call begins, is live across it too; only the call's own
+        // result is not
+        Operand *result = tacDefinition(&list->code[i]);
+        int resultValue = result ? tacValueIndex(list, *result) : -1;
+        for (int v = 0; v < valueCount; v++)
+        {
+            if (v == resultValue || intervals[v].start > position[i] || intervals[v].end < position[i])
+                continue;
+            if (v < list->names.count && isGlobalSymbol(list, v))
+                intervals[v].inMemory = true;
+            else if (intervals[v].end > position[i])
+                intervals[v].crossesCall = true;
+        }
+    }
+
+    trackedFree(assigned);
+    trackedFree(position);
+    freeLiveness(&live);
+    freeCFG(&cfg);
+    return intervals;
+}
+
+static void spill(RegisterAllocation *alloc, TACList *list, int value)
+{
+    alloc->location[value] = LOCATION_MEMORY;
+    if (value >= list->names.count || !isGlobalSymbol(list, value))
+        alloc->stackSlot[value] = alloc->stackSlotCount++;
+    alloc->spilledCount++;
+}
+
+void allocateRegisters(RegisterAllocation *alloc, TACList *list)
+{
+    int valueCount = tacValueCount(list);
+    alloc->valueCount = valueCount;
+    alloc->location = (int *)allocateOrDie(sizeof(int) * (valueCount + 1));
+    alloc->stackSlot = (int *)allocateOrDie(sizeof(int) * (valueCount + 1));
+    alloc->liveOnEntry = (bool *)allocateOrDie(sizeof(bool) * (valueCount + 1));
+    alloc->stackSlotCount = 0;
+    alloc->savedUsed = 0;
+    alloc->intervalCount = 0;
+    alloc->spilledCount = 0;
+    for (int v = 0; v < valueCount; v++)
+    {
+        alloc->location[v] = LOCATION_NONE;
+        alloc->stackSlot[v] = -1;
+    }
+
+    LiveInterval *intervals = buildIntervals(alloc, list, valueCount);
+
+    // Keep only the values that occur, ordered by start position
+    int count = 0;
+    for (int v = 0; v < valueCount; v++)
+    {
+        if (intervals[v].end >= 0)
+            intervals[count++] = intervals[v];
+    }
+    qsort(intervals, count, sizeof(LiveInterval), compareStart);
+    alloc->intervalCount = count;
+
+    // Active intervals, kept sorted by end position
+    LiveInterval *active[NUM_ALLOCATABLE_REGISTERS];
+    int activeCount = 0;
+    bool registerFree[NUM_ALLOCATABLE_REGISTERS];
+    for (int r = 0; r < NUM_ALLOCATABLE_REGISTERS; r++)
+        registerFree[r] = true;
+
+    for (int k = 0; k < count; k++)
+    {
+        LiveInterval *current = &intervals[k];
+
+        // Expire intervals that ended before this one starts
+        int kept = 0;
+        for (int a = 0; a < activeCount; a++)
+        {
+            if (active[a]->end < current->start)
+                registerFree[alloc->location[active[a]->value]] = true;
+            else
+                active[kept++] = active[a];
+        }
+        activeCount = kept;
+
+        if (current->inMemory)
+        {
+            spill(alloc, list, current->value);
+            continue;
+        }
+
+        // $t registers first; across a call only the $s registers will do
+        int first = current->crossesCall ? FIRST_SAVED_REGISTER : 0;
+        int reg = -1;
+        for (int r = first; r < NUM_ALLOCATABLE_REGISTERS && reg < 0; r++)
+        {
+            if (registerFree[r])
+                reg = r;
+        }
+
+        if (reg < 0)
+        {
+            // No register free: spill whichever of the active intervals and
+            // this one is cheapest, preferring the one that ends last
+            int victim = -1;
+            for (int a = 0; a < activeCount; a++)
+            {
+                if (alloc->location[active[a]->value] < first)
+                    continue;
+                double w = spillWeight(active[a]);
+                double best = victim < 0 ? 0 : spillWeight(active[victim]);
+                if (victim < 0 || w < best || (w == best && active[a]->end > active[victim]->end))
+                    victim = a;
+            }
+
+            double currentWeight = spillWeight(current);
+            double victimWeight = victim < 0 ? 0 : spillWeight(active[victim]);
+            if (victim < 0 || currentWeight < victimWeight ||
+                (currentWeight == victimWeight && current->end >= active[victim]->end))
+            {
+                spill(alloc, list, current->value);
+                continue;
+            }
+
+            reg = alloc->location[active[victim]->value];
+            spill(alloc, list, active[victim]->value);
+            for (int a = victim; a < activeCount - 1; a++)
+                active[a] = active[a + 1];
+            activeCount--;
+        }
+
+        registerFree[reg] = false;
+        alloc->location[current->value] = reg;
+        if (reg >= FIRST_SAVED_REGISTER)
+            alloc->savedUsed |= 1u << reg;
+
+        int a = activeCount++;
+        while (a > 0 && active[a - 1]->end > current->end)
+        {
+            active[a] = active[a - 1];
+            a--;
+        }
+        active[a] = current;
+    }
+
+    TRACE(TRACE_CODEGEN, TRACE_DEBUG, "Register allocation: %d intervals, %d spilled, %d stack slots\n",
+          alloc->intervalCount, alloc->spilledCount, alloc->stackSlotCount);
+    trackedFree(intervals);
+}
+
+void freeRegisterAllocation(RegisterAllocation *alloc)
+{
+    trackedFree(alloc->location);
+    trackedFree(alloc->stackSlot);
+    trackedFree(alloc->liveOnEntry);
+    alloc->location = NULL;
+    alloc->stackSlot = NULL;
+    alloc->liveOnEntry = NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "tac.h"
+#include "mips.h"
+
+// Linear-scan register allocation over the TAC. Each value (program
+// variable or temporary) gets one live interval, the hull of the positions
+// where it is live in list order, and keeps one location for all of it.
+
+#define NUM_ALLOCATABLE_REGISTERS 16 // $t0-$t7, then $s0-$s7
+#define FIRST_SAVED_REGISTER 8
+#define SCRATCH_REGISTER_1 MIPS_T8   // Reserved for spilled and constant operands
+#define SCRATCH_REGISTER_2 MIPS_T9
+
+#define LOCATION_NONE -1   // Value never appears in the code
+#define LOCATION_MEMORY -2 // Globals live in their .data word, temps and locals in a stack slot
+
+typedef struct LiveInterval
+{
+    int value;
+    int start;
+    int end;
+    int uses;          // Uses and definitions, for the spill heuristic
+    bool crossesCall;  // Live across a call: only a saved register survives it
+    bool inMemory;     // Variable a callee or the caller may read: kept in its .data word
+} LiveInterval;
+
+typedef struct RegisterAllocation
+{
+    int valueCount;
+    int *location;       // Value index -> register number or LOCATION_*
+    int *stackSlot;      // Value index -> stack slot of a spilled temp, -1 otherwise
+    bool *liveOnEntry;   // Value index -> read before any assignment
+    int stackSlotCount;
+    unsigned savedUsed;  // Bit r set if $s register r was assigned
+    int intervalCount;
+    int spilledCount;
+} RegisterAllocation;
+
+void allocateRegisters(RegisterAllocation *alloc, TACList *list);
+void freeRegisterAllocation(RegisterAllocation *alloc);
+int registerNumber(int reg); // MIPS register number of an allocatable register
+
+#endif // REGALLOC_H
@@ -2,10 +2,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "tempVars.h"
 #include "symbolTable.h"
 #include "tac.h"
-#define TABLE_SIZE 100
+#include "trace.h"
+
+// Number of scalar parameters in a function's declaration list.
+static int countParameters(ASTNode *paramList)
+{
+    int count = 0;
+    for (ASTNode *param = paramList; param; param = param->varDeclList.varDeclList)
+    {
+        if (param->varDeclList.varDecl && param->varDeclList.varDecl->type == NodeType_VarDecl)
+            count++;
+    }
+    return count;
+}
 
 int semanticAnalysis(ASTNode *node, SymbolTable *symTab)
 {
@@ -14,26 +25,26 @@ int semanticAnalysis(ASTNode *node, SymbolTable *symTab)
     int semanticErrors = 0;
 
     if (node == NULL)
-        return 1; // Early return for a null node
+        return 0; // Empty lists and optional children
 
     switch (node->type)
     {
     case NodeType_Program:
-        printf("Analyzing Program\n");
-        semanticAnalysis(node->program.varDeclList, symTab);
-        semanticAnalysis(node->program.stmtList, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Program\n");
+        semanticErrors += semanticAnalysis(node->program.varDeclList, symTab);
+        semanticErrors += semanticAnalysis(node->program.stmtList, symTab);
         break;
 
     case NodeType_VarDeclList:
-        printf("Analyzing Variable Declaration List\n");
-        semanticAnalysis(node->varDeclList.varDecl, symTab);
-        semanticAnalysis(node->varDeclList.varDeclList, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Variable Declaration List\n");
+        semanticErrors += semanticAnalysis(node->varDeclList.varDecl, symTab);
+        semanticErrors += semanticAnalysis(node->varDeclList.varDeclList, symTab);
         break;
 
     case NodeType_VarDecl:
-        printf("Analyzing Variable Declaration\n");
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Variable Declaration\n");
         symbol = lookupSymbol(symTab, node->varDecl.varName);
-        if (symbol != NULL)
+        if (symbol != NULL && symbol->scopeLevel == symTab->scopeDepth)
         {
             fprintf(stderr, "Semantic error: Variable %s redeclared at line %d\n", node->varDecl.varName, node->lineno);
             semanticErrors++;
@@ -45,50 +56,73 @@ int semanticAnalysis(ASTNode *node, SymbolTable *symTab)
         break;
 
     case NodeType_StmtList:
-        printf("Analyzing Statement List\n");
-        semanticAnalysis(node->stmtList.stmt, symTab);
-        semanticAnalysis(node->stmtList.stmtList, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Statement List\n");
+        semanticErrors += semanticAnalysis(node->stmtList.stmt, symTab);
+        semanticErrors += semanticAnalysis(node->stmtList.stmtList, symTab);
         break;
 
     case NodeType_AssignStmt:
-        printf("Analyzing Assignment Statement\n");
-        semanticAnalysis(node->assignStmt.expr, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Assignment Statement\n");
+        semanticErrors += semanticAnalysis(node->assignStmt.expr, symTab);
         symbol = lookupSymbol(symTab, node->assignStmt.varName);
         if (symbol == NULL)
         {
             fprintf(stderr, "Semantic error: Variable %s used without declaration at line %d\n", node->assignStmt.varName, node->lineno);
             semanticErrors++;
         }
+        else if (symbol->isFunction)
+        {
+            // Functions are labels in the text section, not words of data
+            fprintf(stderr, "Semantic error: Function %s assigned as a variable at line %d\n", node->assignStmt.varName, node->lineno);
+            semanticErrors++;
+        }
+        else if (symbol->isArray)
+        {
+            // Only elements are assigned; the whole array is not a value
+            fprintf(stderr, "Semantic error: Array %s assigned as a variable at line %d\n", node->assignStmt.varName, node->lineno);
+            semanticErrors++;
+        }
         break;
 
     case NodeType_Expr:
-        printf("Analyzing Expression\n");
-        semanticAnalysis(node->expr.left, symTab);
-        semanticAnalysis(node->expr.right, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Expression\n");
+        semanticErrors += semanticAnalysis(node->expr.left, symTab);
+        semanticErrors += semanticAnalysis(node->expr.right, symTab);
         break;
 
     case NodeType_BinOp:
-        printf("Analyzing Binary Operation\n");
-        semanticAnalysis(node->binOp.left, symTab);
-        semanticAnalysis(node->binOp.right, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Binary Operation\n");
+        semanticErrors += semanticAnalysis(node->binOp.left, symTab);
+        semanticErrors += semanticAnalysis(node->binOp.right, symTab);
         break;
 
     case NodeType_SimpleID:
-        printf("Analyzing Simple ID\n");
-        if (lookupSymbol(symTab, node->simpleID.name) == NULL)
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Simple ID\n");
+        symbol = lookupSymbol(symTab, node->simpleID.name);
+        if (symbol == NULL)
         {
             fprintf(stderr, "Semantic error: Variable %s has not been declared at line %d\n", node->simpleID.name, node->lineno);
             semanticErrors++;
         }
+        else if (symbol->isFunction)
+        {
+            fprintf(stderr, "Semantic error: Function %s used as a variable at line %d\n", node->simpleID.name, node->lineno);
+            semanticErrors++;
+        }
+        else if (symbol->isArray)
+        {
+            fprintf(stderr, "Semantic error: Array %s used as a variable at line %d\n", node->simpleID.name, node->lineno);
+            semanticErrors++;
+        }
         break;
 
     case NodeType_SimpleExpr:
-        printf("Analyzing Simple Expression\n");
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Simple Expression\n");
         // Typically, there's no semantic error possible here for just a number.
         break;
 
     case NodeType_FunctionDecl:
-        printf("Analyzing Function Declaration\n");
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Function Declaration\n");
         symbol = lookupSymbol(symTab, node->funcDecl.funcName);
         if (symbol != NULL)
         {
@@ -98,22 +132,28 @@ int semanticAnalysis(ASTNode *node, SymbolTable *symTab)
         else
         {
             addSymbol(symTab, node->funcDecl.funcName, "function");
-            SymbolTable *funcSymTab = createSymbolTable(TABLE_SIZE);
-            semanticAnalysis(node->funcDecl.paramList, funcSymTab);
-            semanticAnalysis(node->funcDecl.funcBody, funcSymTab);
+            symbol = lookupSymbol(symTab, node->funcDecl.funcName);
+            symbol->isFunction = true;
+            symbol->parameters = node->funcDecl.paramList;
+
+            // Parameters live in a scope of their own; the body still sees globals
+            enterScope(symTab);
+            semanticErrors += semanticAnalysis(node->funcDecl.paramList, symTab);
+            semanticErrors += semanticAnalysis(node->funcDecl.funcBody, symTab);
+            exitScope(symTab);
         }
         break;
 
     case NodeType_ParamList:
-        printf("Analyzing Parameter List\n");
-        semanticAnalysis(node->paramList.param, symTab);
-        semanticAnalysis(node->paramList.paramList, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Parameter List\n");
+        semanticErrors += semanticAnalysis(node->paramList.param, symTab);
+        semanticErrors += semanticAnalysis(node->paramList.paramList, symTab);
         break;
 
     case NodeType_Param:
-        printf("Analyzing Parameter\n");
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Parameter\n");
         symbol = lookupSymbol(symTab, node->param.paramName);
-        if (symbol != NULL)
+        if (symbol != NULL && symbol->scopeLevel == symTab->scopeDepth)
         {
             fprintf(stderr, "Semantic error: Parameter %s redeclared at line %d\n", node->param.paramName, node->lineno);
             semanticErrors++;
@@ -125,7 +165,7 @@ int semanticAnalysis(ASTNode *node, SymbolTable *symTab)
         break;
 
     case NodeType_FunctionCall:
-        printf("Analyzing Function Call\n");
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Function Call\n");
         symbol = lookupSymbol(symTab, node->funcCall.funcName);
         if (symbol == NULL || !symbol->isFunction)
         {
@@ -134,42 +174,55 @@ int semanticAnalysis(ASTNode *node, SymbolTable *symTab)
         }
         else
         {
-            ASTNode *arg = node->funcCall.argList;
-            while (arg != NULL)
+            int argCount = 0;
+            for (ASTNode *arg = node->funcCall.argList; arg != NULL; arg = arg->argList.argList)
+            {
+                semanticErrors += semanticAnalysis(arg->argList.arg, symTab);
+                argCount++;
+            }
+            int paramCount = countParameters(symbol->parameters);
+            if (argCount != paramCount)
             {
-                semanticAnalysis(arg->arg.arg, symTab);
-                arg = arg->argList.argList;
+                fprintf(stderr, "Semantic error: Function %s takes %d arguments but is called with %d at line %d\n",
+                        node->funcCall.funcName, paramCount, argCount, node->lineno);
+                semanticErrors++;
             }
         }
         break;
 
     case NodeType_ArgList:
-        printf("Analyzing Argument List\n");
-        semanticAnalysis(node->argList.arg, symTab);
-        semanticAnalysis(node->argList.argList, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Argument List\n");
+        semanticErrors += semanticAnalysis(node->argList.arg, symTab);
+        semanticErrors += semanticAnalysis(node->argList.argList, symTab);
         break;
 
     case NodeType_Arg:
-        printf("Analyzing Argument\n");
-        semanticAnalysis(node->arg.arg, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Argument\n");
+        semanticErrors += semanticAnalysis(node->arg.arg, symTab);
         break;
 
     case NodeType_ArrayDecl:
-        printf("Analyzing Array Declaration\n");
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Array Declaration\n");
         symbol = lookupSymbol(symTab, node->arrayDecl.arrayName);
-        if (symbol != NULL)
+        if (symTab->scopeDepth > 0)
+        {
+            // Arrays live in the data section; parameters are passed by value
+            fprintf(stderr, "Semantic error: Array %s declared as a parameter at line %d\n", node->arrayDecl.arrayName, node->lineno);
+            semanticErrors++;
+        }
+        else if (symbol != NULL && symbol->scopeLevel == symTab->scopeDepth)
         {
             fprintf(stderr, "Semantic error: Array %s redeclared at line %d\n", node->arrayDecl.arrayName, node->lineno);
             semanticErrors++;
         }
         else
         {
-            addSymbol(symTab, node->arrayDecl.arrayName, node->arrayDecl.arrayType);
+            addArraySymbol(symTab, node->arrayDecl.arrayName, node->arrayDecl.arrayType, node->arrayDecl.sizeExpr);
         }
         break;
 
     case NodeType_ArrayAccess:
-        printf("Analyzing Array Access\n");
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Array Access\n");
         symbol = lookupSymbol(symTab, node->arrayAccess.arrayName);
         if (symbol == NULL || !symbol->isArray)
         {
@@ -178,13 +231,41 @@ int semanticAnalysis(ASTNode *node, SymbolTable *symTab)
         }
         else
         {
-            semanticAnalysis(node->arrayAccess.indexExpr, symTab);
+            semanticErrors += semanticAnalysis(node->arrayAccess.indexExpr, symTab);
+        }
+        break;
+
+    case NodeType_ArrayAssignStmt:
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Array Assignment Statement\n");
+        symbol = lookupSymbol(symTab, node->arrayAssignStmt.arrayName);
+        if (symbol == NULL || !symbol->isArray)
+        {
+            fprintf(stderr, "Semantic error: Array %s assigned without declaration at line %d\n", node->arrayAssignStmt.arrayName, node->lineno);
+            semanticErrors++;
         }
+        semanticErrors += semanticAnalysis(node->arrayAssignStmt.indexExpr, symTab);
+        semanticErrors += semanticAnalysis(node->arrayAssignStmt.expr, symTab);
         break;
 
     case NodeType_WriteStmt:
-        printf("Analyzing Write Statement\n");
-        semanticAnalysis(node->writeStmt.expr, symTab);
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Write Statement\n");
+        semanticErrors += semanticAnalysis(node->writeStmt.expr, symTab);
+        break;
+
+    case NodeType_ReturnStmt:
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing Return Statement\n");
+        if (symTab->scopeDepth == 0)
+        {
+            fprintf(stderr, "Semantic error: Return outside a function at line %d\n", node->lineno);
+            semanticErrors++;
+        }
+        semanticErrors += semanticAnalysis(node->returnStmt.expr, symTab);
+        break;
+
+    case NodeType_WhileStmt:
+        TRACE(TRACE_SEMANTIC, TRACE_DEBUG, "Analyzing While Statement\n");
+        semanticErrors += semanticAnalysis(node->whileStmt.condition, symTab);
+        semanticErrors += semanticAnalysis(node->whileStmt.body, symTab);
         break;
 
     default:
@@ -3,7 +3,6 @@
 
 #include "AST.h"
 #include "symbolTable.h"
-#include "tempVars.h"
 
 int semanticAnalysis(ASTNode *node, SymbolTable *symTab);
 
@@ -0,0 +1,114 @@
+#include "source.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SOURCE_TERMINATORS 2
+#define SOURCE_READ_CHUNK (64 * 1024)
+
+// Maps size bytes of fd followed by zeroed memory for the terminators. An
+// anonymous mapping reserves the whole range first, so the terminators are
+// there even when the file ends exactly on a page boundary; the file is then
+// mapped over its start. Both are private and writable because the scanner
+// briefly overwrites the byte after each token.
+static bool mapSource(SourceBuffer *source, int fd, size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = (size + SOURCE_TERMINATORS + page - 1) / page * page;
+
+    char *base = (char *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return false;
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(base, length);
+        return false;
+    }
+    madvise(base, length, MADV_SEQUENTIAL);
+
+    source->data = base;
+    source->size = size;
+    source->mappedSize = length;
+    return true;
+}
+
+// Fallback for pipes, empty files and anything mmap refuses.
+static bool readSource(SourceBuffer *source, int fd)
+{
+    size_t capacity = SOURCE_READ_CHUNK;
+    size_t size = 0;
+    char *data = (char *)trackedMalloc(capacity);
+
+    for (;;)
+    {
+        if (!data)
+        {
+            fprintf(stderr, "readSource: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (capacity - size < SOURCE_TERMINATORS + 1)
+        {
+            capacity *= 2;
+            data = (char *)trackedRealloc(data, capacity);
+            continue;
+        }
+
+        ssize_t n = read(fd, data + size, capacity - size - SOURCE_TERMINATORS);
+        if (n < 0)
+        {
+            trackedFree(data);
+            return false;
+        }
+        if (n == 0)
+            break;
+        size += (size_t)n;
+    }
+
+    memset(data + size, 0, SOURCE_TERMINATORS);
+    source->data = data;
+    source->size = size;
+    source->mappedSize = 0;
+    return true;
+}
+
+// Loads filename into source. Prints the reason and returns false on failure.
+bool loadSource(SourceBuffer *source, const char *filename)
+{
+    source->data = NULL;
+    source->size = 0;
+    source->mappedSize = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename);
+        return false;
+    }
+
+    struct stat info;
+    bool loaded = fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 &&
+                  mapSource(source, fd, (size_t)info.st_size);
+    if (!loaded)
+        loaded = readSource(source, fd);
+    if (!loaded)
+        perror(filename);
+
+    close(fd);
+    return loaded;
+}
+
+void releaseSource(SourceBuffer *source)
+{
+    if (source->mappedSize)
+        munmap(source->data, source->mappedSize);
+    else
+        trackedFree(source->data);
+    source->data = NULL;
+    source->size = 0;
+    source->mappedSize = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// A whole source file in one contiguous buffer, followed by the two NUL
+// bytes flex's yy_scan_buffer expects. Regular files are memory-mapped
+// privately, so the scanner reads the page cache directly and tokens can
+// refer to the text by offset; anything else is read into the heap.
+
+typedef struct SourceBuffer
+{
+    char *data;
+    size_t size;       // Bytes of source, not counting the two terminators
+    size_t mappedSize; // Length of the mapping, 0 when data is on the heap
+} SourceBuffer;
+
+// Text of a token as a range of a SourceBuffer
+typedef struct TokenSlice
+{
+    int offset;
+    int length;
+} TokenSlice;
+
+bool loadSource(SourceBuffer *source, const char *filename);
+void releaseSource(SourceBuffer *source);
+
+#endif // SOURCE_H
@@ -0,0 +1,1221 @@
+#include "ssa.h"
+#include "memtrack.h"
+#include "dataflow.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *allocateOrDie(size_t size)
+{
+    void *ptr = trackedMalloc(size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "SSA: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void *growOrDie(void *ptr, size_t size)
+{
+    ptr = trackedRealloc(ptr, size ? size : 1);
+    if (!ptr)
+    {
+        fprintf(stderr, "SSA: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Dominators //
+
+static int intersect(const int *idom, const int *rpoIndex, int a, int b)
+{
+    while (a != b)
+    {
+        while (rpoIndex[a] > rpoIndex[b])
+            a = idom[a];
+        while (rpoIndex[b] > rpoIndex[a])
+            b = idom[b];
+    }
+    return a;
+}
+
+// Turns (key, value) pairs into CSR form: values of key k end up in
+// values[start[k]..start[k+1]), in pair order.
+static void buildBuckets(int keyCount, const int *keys, const int *pairValues, int pairCount,
+                         int **start, int **values)
+{
+    *start = (int *)allocateOrDie(sizeof(int) * (keyCount + 1));
+    *values = (int *)allocateOrDie(sizeof(int) * pairCount);
+    memset(*start, 0, sizeof(int) * (keyCount + 1));
+    for (int p = 0; p < pairCount; p++)
+        (*start)[keys[p] + 1]++;
+    for (int k = 0; k < keyCount; k++)
+        (*start)[k + 1] += (*start)[k];
+
+    int *fill = (int *)allocateOrDie(sizeof(int) * (keyCount + 1));
+    memcpy(fill, *start, sizeof(int) * (keyCount + 1));
+    for (int p = 0; p < pairCount; p++)
+        (*values)[fill[keys[p]]++] = pairValues[p];
+    trackedFree(fill);
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm: refine each block's
+// immediate dominator in reverse postorder until nothing changes, then read
+// the dominance frontiers off the join points.
+void computeDominators(DominatorTree *dom, CFG *cfg)
+{
+    int n = cfg->blockCount;
+    int *idom = (int *)allocateOrDie(sizeof(int) * n);
+    int *rpoIndex = (int *)allocateOrDie(sizeof(int) * n);
+    for (int k = 0; k < n; k++)
+    {
+        idom[k] = -1;
+        rpoIndex[cfg->order[k]] = k;
+    }
+
+    if (n > 0)
+        idom[0] = 0;
+    bool changed = n > 0;
+    while (changed)
+    {
+        changed = false;
+        for (int k = 1; k < n; k++)
+        {
+            int b = cfg->order[k];
+            int newIdom = -1;
+            for (int p = 0; p < cfg->blocks[b].predCount; p++)
+            {
+                int pred = cfg->blocks[b].preds[p];
+                if (idom[pred] < 0)
+                    continue;
+                newIdom = newIdom < 0 ? pred : intersect(idom, rpoIndex, pred, newIdom);
+            }
+            if (newIdom != idom[b])
+            {
+                idom[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    if (n > 0)
+        idom[0] = -1;
+    dom->idom = idom;
+
+    // Children, and a preorder of the tree
+    int *parents = (int *)allocateOrDie(sizeof(int) * n);
+    int *kids = (int *)allocateOrDie(sizeof(int) * n);
+    int childCount = 0;
+    for (int b = 1; b < n; b++)
+    {
+        if (idom[b] >= 0)
+        {
+            parents[childCount] = idom[b];
+            kids[childCount++] = b;
+        }
+    }
+    buildBuckets(n, parents, kids, childCount, &dom->childStart, &dom->children);
+
+    dom->preorder = (int *)allocateOrDie(sizeof(int) * n);
+    dom->reachableCount = 0;
+    if (n > 0)
+    {
+        int *stack = kids; // No longer needed for the pairs
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            int b = stack[--top];
+            dom->preorder[dom->reachableCount++] = b;
+            for (int c = dom->childStart[b + 1] - 1; c >= dom->childStart[b]; c--)
+                stack[top++] = dom->children[c];
+        }
+    }
+
+    // Frontiers: walk up from each predecessor of a join point to the join
+    // point's immediate dominator
+    int capacity = 16;
+    int frontierCount = 0;
+    int *owners = (int *)allocateOrDie(sizeof(int) * capacity);
+    int *members = (int *)allocateOrDie(sizeof(int) * capacity);
+    int *lastAdded = parents;
+    for (int b = 0; b < n; b++)
+        lastAdded[b] = -1;
+
+    for (int b = 0; b < n; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        if (block->predCount < 2 || (b != 0 && idom[b] < 0))
+            continue;
+        for (int p = 0; p < block->predCount; p++)
+        {
+            int runner = block->preds[p];
+            if (runner != 0 && idom[runner] < 0)
+                continue; // Unreachable predecessor
+            while (runner >= 0 && runner != idom[b] && lastAdded[runner] != b)
+            {
+                if (frontierCount == capacity)
+                {
+                    capacity *= 2;
+                    owners = (int *)growOrDie(owners, sizeof(int) * capacity);
+                    members = (int *)growOrDie(members, sizeof(int) * capacity);
+                }
+                owners[frontierCount] = runner;
+                members[frontierCount++] = b;
+                lastAdded[runner] = b;
+                runner = idom[runner];
+            }
+        }
+    }
+    buildBuckets(n, owners, members, frontierCount, &dom->frontierStart, &dom->frontier);
+
+    trackedFree(owners);
+    trackedFree(members);
+    trackedFree(parents);
+    trackedFree(kids);
+    trackedFree(rpoIndex);
+}
+
+void freeDominatorTree(DominatorTree *dom)
+{
+    trackedFree(dom->idom);
+    trackedFree(dom->childStart);
+    trackedFree(dom->children);
+    trackedFree(dom->preorder);
+    trackedFree(dom->frontierStart);
+    trackedFree(dom->frontier);
+    memset(dom, 0, sizeof(*dom));
+}
+
+// Construction //
+
+// Refills cfg->blockOf after instructions were inserted into blocks.
+static void refreshBlockOf(CFG *cfg)
+{
+    TACList *code = cfg->code;
+    cfg->blockOf = (int *)growOrDie(cfg->blockOf, sizeof(int) * code->count);
+    for (int i = 0; i < code->count; i++)
+        cfg->blockOf[i] = -1;
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+            cfg->blockOf[i] = b;
+    }
+}
+
+static void appendDefinition(int **keys, int **blocks, int *count, int *capacity, int v, int b)
+{
+    if (*count == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *keys = (int *)growOrDie(*keys, sizeof(int) * *capacity);
+        *blocks = (int *)growOrDie(*blocks, sizeof(int) * *capacity);
+    }
+    (*keys)[*count] = v;
+    (*blocks)[(*count)++] = b;
+}
+
+// Places phis for every variable that is assigned somewhere and read in
+// some block before that block assigns it ("semi-pruned" SSA): variables
+// that never live across a block boundary need none. A call counts as an
+// assignment of every global that is assigned anywhere, since renaming
+// takes such a global's value from memory after the call.
+static void placePhis(SSAForm *ssa, int valueCount)
+{
+    CFG *cfg = &ssa->cfg;
+    TACList *code = ssa->code;
+    int n = cfg->blockCount;
+
+    bool *global = (bool *)allocateOrDie(sizeof(bool) * valueCount);
+    int *killedIn = (int *)allocateOrDie(sizeof(int) * valueCount);
+    int *defKeys = NULL;
+    int *defBlocks = NULL;
+    int defCount = 0;
+    int defCapacity = 0;
+    int *callBlocks = (int *)allocateOrDie(sizeof(int) * n);
+    int callCount = 0;
+    bool *callsAdded = (bool *)allocateOrDie(sizeof(bool) * valueCount);
+    for (int v = 0; v < valueCount; v++)
+    {
+        global[v] = false;
+        killedIn[v] = -1;
+        callsAdded[v] = false;
+    }
+
+    for (int b = 0; b < n; b++)
+    {
+        if (!ssa->blockReachable[b])
+            continue;
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            TAC *tac = &code->code[i];
+            Operand *uses[2];
+            int useCount = tacUses(tac, uses);
+            for (int u = 0; u < useCount; u++)
+            {
+                int v = tacValueIndex(code, *uses[u]);
+                if (killedIn[v] != b)
+                    global[v] = true;
+            }
+            if (readsGlobals(tac))
+            {
+                for (int v = 0; v < code->names.count; v++)
+                {
+                    if (killedIn[v] != b && isGlobalSymbol(code, v))
+                        global[v] = true;
+                }
+            }
+
+            Operand *def = tacDefinition(tac);
+            if (def)
+            {
+                int v = tacValueIndex(code, *def);
+                killedIn[v] = b;
+                appendDefinition(&defKeys, &defBlocks, &defCount, &defCapacity, v, b);
+            }
+            if (writesGlobals(tac) && (callCount == 0 || callBlocks[callCount - 1] != b))
+                callBlocks[callCount++] = b;
+        }
+    }
+
+    int assignments = defCount;
+    for (int d = 0; d < assignments && callCount > 0; d++)
+    {
+        int v = defKeys[d];
+        if (v >= code->names.count || !isGlobalSymbol(code, v) || callsAdded[v])
+            continue;
+        callsAdded[v] = true;
+        for (int c = 0; c < callCount; c++)
+            appendDefinition(&defKeys, &defBlocks, &defCount, &defCapacity, v, callBlocks[c]);
+    }
+
+    int *defStart, *defs;
+    buildBuckets(valueCount, defKeys, defBlocks, defCount, &defStart, &defs);
+
+    // Iterated dominance frontier of each global variable's definitions
+    int *hasPhi = (int *)allocateOrDie(sizeof(int) * n);
+    int *inWork = (int *)allocateOrDie(sizeof(int) * n);
+    int *work = (int *)allocateOrDie(sizeof(int) * n);
+    int *phiBlocks = NULL;
+    int *phiVariables = NULL;
+    int phiCount = 0;
+    int phiCapacity = 0;
+    for (int b = 0; b < n; b++)
+        hasPhi[b] = inWork[b] = -1;
+
+    for (int v = 0; v < valueCount; v++)
+    {
+        if (!global[v] || defStart[v] == defStart[v + 1])
+            continue;
+
+        int top = 0;
+        for (int d = defStart[v]; d < defStart[v + 1]; d++)
+        {
+            if (inWork[defs[d]] != v)
+            {
+                inWork[defs[d]] = v;
+                work[top++] = defs[d];
+            }
+        }
+        while (top > 0)
+        {
+            int x = work[--top];
+            for (int f = ssa->dom.frontierStart[x]; f < ssa->dom.frontierStart[x + 1]; f++)
+            {
+                int y = ssa->dom.frontier[f];
+                if (hasPhi[y] == v)
+                    continue;
+                hasPhi[y] = v;
+                if (phiCount == phiCapacity)
+                {
+                    phiCapacity = phiCapacity ? phiCapacity * 2 : 64;
+                    phiBlocks = (int *)growOrDie(phiBlocks, sizeof(int) * phiCapacity);
+                    phiVariables = (int *)growOrDie(phiVariables, sizeof(int) * phiCapacity);
+                }
+                phiBlocks[phiCount] = y;
+                phiVariables[phiCount++] = v;
+                if (inWork[y] != v)
+                {
+                    inWork[y] = v;
+                    work[top++] = y;
+                }
+            }
+        }
+    }
+
+    int *variables;
+    buildBuckets(n, phiBlocks, phiVariables, phiCount, &ssa->phiStart, &variables);
+    ssa->phiCount = phiCount;
+    ssa->phis = (Phi *)allocateOrDie(sizeof(Phi) * phiCount);
+
+    int argCount = 0;
+    for (int b = 0; b < n; b++)
+        argCount += (ssa->phiStart[b + 1] - ssa->phiStart[b]) * cfg->blocks[b].predCount;
+    ssa->phiArgs = (Operand *)allocateOrDie(sizeof(Operand) * argCount);
+
+    Operand *args = ssa->phiArgs;
+    for (int b = 0; b < n; b++)
+    {
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+        {
+            Phi *phi = &ssa->phis[p];
+            phi->variable = variables[p];
+            phi->result = (Operand){OPERAND_NONE, 0};
+            phi->args = args;
+            for (int a = 0; a < cfg->blocks[b].predCount; a++)
+                args[a] = (Operand){OPERAND_NONE, 0};
+            args += cfg->blocks[b].predCount;
+        }
+    }
+
+    trackedFree(variables);
+    trackedFree(phiBlocks);
+    trackedFree(phiVariables);
+    trackedFree(work);
+    trackedFree(inWork);
+    trackedFree(hasPhi);
+    trackedFree(defStart);
+    trackedFree(defs);
+    trackedFree(defKeys);
+    trackedFree(defBlocks);
+    trackedFree(callBlocks);
+    trackedFree(callsAdded);
+    trackedFree(killedIn);
+    trackedFree(global);
+}
+
+typedef struct RenameEntry
+{
+    int variable; // ~variable for an entry of Renamer.stored
+    Operand previous;
+} RenameEntry;
+
+typedef struct Renamer
+{
+    Operand *current; // Variable -> name of its reaching definition
+    Operand *stored;  // Variable -> name of the value last stored to it
+    bool *assigned;   // Variable -> has a definition somewhere
+    RenameEntry *log; // Undo log, unwound when the walk leaves a block
+    int logCount;
+    int logCapacity;
+} Renamer;
+
+static void setName(Renamer *renamer, Operand *names, int variable, Operand name)
+{
+    if (renamer->logCount == renamer->logCapacity)
+    {
+        renamer->logCapacity = renamer->logCapacity ? renamer->logCapacity * 2 : 256;
+        renamer->log = (RenameEntry *)growOrDie(renamer->log, sizeof(RenameEntry) * renamer->logCapacity);
+    }
+    int entry = names == renamer->stored ? ~variable : variable;
+    renamer->log[renamer->logCount++] = (RenameEntry){entry, names[variable]};
+    names[variable] = name;
+}
+
+static void renameBlock(SSAForm *ssa, Renamer *renamer, int b)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    BasicBlock *block = &cfg->blocks[b];
+
+    for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+    {
+        Phi *phi = &ssa->phis[p];
+        phi->result = createTempVar(code);
+        setName(renamer, renamer->current, phi->variable, phi->result);
+    }
+
+    int prev = b > 0 ? cfg->blocks[b - 1].last : TAC_END;
+    for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+    {
+        if (readsGlobals(&code->code[i]))
+        {
+            // The callee, or the caller being returned to, reads globals from memory
+            for (int v = 0; v < code->names.count; v++)
+            {
+                if (!renamer->assigned[v] || sameOperand(renamer->current[v], renamer->stored[v]) ||
+                    !isGlobalSymbol(code, v))
+                    continue;
+                setName(renamer, renamer->stored, v, renamer->current[v]);
+                TAC store = {TAC_ASSIGN, renamer->current[v], {OPERAND_NONE, 0}, {OPERAND_SYMBOL, v}, TAC_END};
+                int index = insertTAC(code, prev, &store);
+                if (i == block->first)
+                    block->first = index;
+                prev = index;
+            }
+        }
+
+        TAC *tac = &code->code[i];
+        Operand *uses[2];
+        int useCount = tacUses(tac, uses);
+        for (int u = 0; u < useCount; u++)
+        {
+            Operand name = renamer->current[tacValueIndex(code, *uses[u])];
+            if (name.kind != OPERAND_NONE)
+                *uses[u] = name;
+        }
+
+        Operand *def = tacDefinition(tac);
+        if (def)
+        {
+            int variable = tacValueIndex(code, *def);
+            *def = createTempVar(code);
+            setName(renamer, renamer->current, variable, *def);
+        }
+        if (writesGlobals(tac))
+        {
+            // and may assign them, so afterwards memory holds their values
+            for (int v = 0; v < code->names.count; v++)
+            {
+                Operand memory = {OPERAND_SYMBOL, v};
+                if (!renamer->assigned[v] || !isGlobalSymbol(code, v))
+                    continue;
+                if (!sameOperand(renamer->current[v], memory))
+                    setName(renamer, renamer->current, v, memory);
+                if (!sameOperand(renamer->stored[v], memory))
+                    setName(renamer, renamer->stored, v, memory);
+            }
+        }
+        prev = i;
+    }
+
+    for (int k = 0; k < block->succCount; k++)
+    {
+        BasicBlock *succ = &cfg->blocks[block->succs[k]];
+        int j = 0;
+        while (succ->preds[j] != b)
+            j++;
+        for (int p = ssa->phiStart[block->succs[k]]; p < ssa->phiStart[block->succs[k] + 1]; p++)
+            ssa->phis[p].args[j] = renamer->current[ssa->phis[p].variable];
+    }
+}
+
+// Walks the dominator tree, renaming on the way down and unwinding the
+// names a block defined on the way back up.
+static void renameVariables(SSAForm *ssa, int valueCount)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+
+    Renamer renamer = {0};
+    renamer.current = (Operand *)allocateOrDie(sizeof(Operand) * valueCount);
+    renamer.stored = (Operand *)allocateOrDie(sizeof(Operand) * valueCount);
+    renamer.assigned = (bool *)allocateOrDie(sizeof(bool) * valueCount);
+    for (int v = 0; v < valueCount; v++)
+    {
+        renamer.current[v] = v < code->names.count ? (Operand){OPERAND_SYMBOL, v} : (Operand){OPERAND_NONE, 0};
+        renamer.stored[v] = renamer.current[v];
+        renamer.assigned[v] = false;
+    }
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+    {
+        Operand *def = tacDefinition(&code->code[i]);
+        if (def)
+            renamer.assigned[tacValueIndex(code, *def)] = true;
+    }
+
+    int *mark = (int *)allocateOrDie(sizeof(int) * n);
+    int *stack = (int *)allocateOrDie(sizeof(int) * 2 * n);
+    int top = 0;
+    if (n > 0)
+        stack[top++] = 0;
+    while (top > 0)
+    {
+        int entry = stack[--top];
+        if (entry < 0)
+        {
+            int b = ~entry;
+            while (renamer.logCount > mark[b])
+            {
+                RenameEntry *undo = &renamer.log[--renamer.logCount];
+                if (undo->variable >= 0)
+                    renamer.current[undo->variable] = undo->previous;
+                else
+                    renamer.stored[~undo->variable] = undo->previous;
+            }
+            continue;
+        }
+
+        mark[entry] = renamer.logCount;
+        renameBlock(ssa, &renamer, entry);
+        stack[top++] = ~entry;
+        for (int c = ssa->dom.childStart[entry + 1] - 1; c >= ssa->dom.childStart[entry]; c--)
+            stack[top++] = ssa->dom.children[c];
+    }
+
+    trackedFree(stack);
+    trackedFree(mark);
+    trackedFree(renamer.log);
+    trackedFree(renamer.assigned);
+    trackedFree(renamer.stored);
+    trackedFree(renamer.current);
+}
+
+void buildSSA(SSAForm *ssa, TACList *list)
+{
+    ssa->code = list;
+    buildCFG(&ssa->cfg, list);
+
+    // Phis at the entry block would have no value for the way in, so give
+    // the entry a block of its own when something jumps back to it
+    if (ssa->cfg.blockCount > 0 && ssa->cfg.blocks[0].predCount > 0)
+    {
+        TAC label = {TAC_LABEL, createLabel(list), {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+        insertTAC(list, TAC_END, &label);
+        freeCFG(&ssa->cfg);
+        buildCFG(&ssa->cfg, list);
+    }
+
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+    computeDominators(&ssa->dom, cfg);
+
+    ssa->blockReachable = (bool *)allocateOrDie(sizeof(bool) * n);
+    ssa->edgeExecutable = (bool *)allocateOrDie(sizeof(bool) * 2 * n);
+    for (int b = 0; b < n; b++)
+    {
+        ssa->blockReachable[b] = b == 0 || ssa->dom.idom[b] >= 0;
+        for (int k = 0; k < 2; k++)
+            ssa->edgeExecutable[2 * b + k] = ssa->blockReachable[b] && k < cfg->blocks[b].succCount;
+    }
+
+    int valueCount = tacValueCount(list);
+    placePhis(ssa, valueCount);
+    renameVariables(ssa, valueCount);
+    refreshBlockOf(cfg);
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "SSA: %d blocks, %d phis\n", n, ssa->phiCount);
+}
+
+// Adds a phi at the head of block b for a value created after renaming,
+// with every argument undefined. Other phis move, so pointers to them and
+// their arguments are invalid afterwards.
+Phi *addPhi(SSAForm *ssa, int b, Operand result)
+{
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+    int argCount = cfg->blocks[b].predCount;
+    for (int c = 0; c < n; c++)
+        argCount += (ssa->phiStart[c + 1] - ssa->phiStart[c]) * cfg->blocks[c].predCount;
+
+    Phi *phis = (Phi *)allocateOrDie(sizeof(Phi) * (ssa->phiCount + 1));
+    Operand *args = (Operand *)allocateOrDie(sizeof(Operand) * argCount);
+    Phi *added = NULL;
+    int count = 0;
+    Operand *nextArgs = args;
+    for (int c = 0; c < n; c++)
+    {
+        int predCount = cfg->blocks[c].predCount;
+        int start = count;
+        for (int p = ssa->phiStart[c]; p < ssa->phiStart[c + 1]; p++)
+        {
+            phis[count] = ssa->phis[p];
+            phis[count].args = nextArgs;
+            memcpy(nextArgs, ssa->phis[p].args, sizeof(Operand) * predCount);
+            nextArgs += predCount;
+            count++;
+        }
+        if (c == b)
+        {
+            added = &phis[count++];
+            added->variable = tacValueIndex(ssa->code, result);
+            added->result = result;
+            added->args = nextArgs;
+            for (int a = 0; a < predCount; a++)
+                nextArgs[a] = (Operand){OPERAND_NONE, 0};
+            nextArgs += predCount;
+        }
+        ssa->phiStart[c] = start;
+    }
+    ssa->phiStart[n] = count;
+
+    trackedFree(ssa->phis);
+    trackedFree(ssa->phiArgs);
+    ssa->phis = phis;
+    ssa->phiArgs = args;
+    ssa->phiCount = count;
+    return added;
+}
+
+// Coalescing //
+
+#define MAX_COALESCE_PAIRS 1024 // Interference checks allowed per merge
+
+typedef struct Coalescer
+{
+    SSAForm *ssa;
+    int *id;              // Value -> dense index among phi operands, -1 otherwise
+    DataflowProblem live; // Liveness of the phi operands, phis included
+    int *defBlock;        // Value -> block of its definition, -1 if none
+    int *defInstruction;  // Value -> defining instruction, -1 for a phi
+    int *treeIn;          // Block -> preorder index in the dominator tree
+    int *treeSize;        // Block -> size of its dominator subtree
+    int *classOf;         // Value -> representative of its congruence class
+    int *nextMember;      // Members of a class, linked from its representative
+    int *classSize;
+} Coalescer;
+
+static bool defDominates(Coalescer *co, int a, int b)
+{
+    int blockA = co->defBlock[a];
+    int blockB = co->defBlock[b];
+    if (blockA != blockB)
+        return co->treeIn[blockA] <= co->treeIn[blockB] && co->treeIn[blockB] < co->treeIn[blockA] + co->treeSize[blockA];
+    if (co->defInstruction[a] < 0)
+        return true;
+    if (co->defInstruction[b] < 0)
+        return false;
+    CFG *cfg = &co->ssa->cfg;
+    for (int i = co->defInstruction[a]; i != TAC_END; i = blockNext(cfg, &cfg->blocks[blockA], i))
+    {
+        if (i == co->defInstruction[b])
+            return true;
+    }
+    return false;
+}
+
+// True if a, whose definition dominates b's, is still live where b is defined.
+static bool liveAtDef(Coalescer *co, int a, int b)
+{
+    SSAForm *ssa = co->ssa;
+    int block = co->defBlock[b];
+    if (co->defInstruction[b] < 0)
+        return bitsetTest(&co->live.in[block], co->id[a]) ||
+               (co->defBlock[a] == block && co->defInstruction[a] < 0); // Phis of one block
+    if (bitsetTest(&co->live.out[block], co->id[a]))
+        return true;
+
+    BasicBlock *bb = &ssa->cfg.blocks[block];
+    for (int i = blockNext(&ssa->cfg, bb, co->defInstruction[b]); i != TAC_END; i = blockNext(&ssa->cfg, bb, i))
+    {
+        Operand *uses[2];
+        int useCount = tacUses(&ssa->code->code[i], uses);
+        for (int u = 0; u < useCount; u++)
+        {
+            if (tacValueIndex(ssa->code, *uses[u]) == a)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Two SSA values can only both be live at some point if one's definition
+// dominates the other's and it is still live there.
+static bool interfere(Coalescer *co, int a, int b)
+{
+    if (defDominates(co, a, b))
+        return liveAtDef(co, a, b);
+    if (defDominates(co, b, a))
+        return liveAtDef(co, b, a);
+    return false;
+}
+
+static bool classesInterfere(Coalescer *co, int x, int y)
+{
+    if (co->classSize[x] * co->classSize[y] > MAX_COALESCE_PAIRS)
+        return true;
+    for (int a = x; a >= 0; a = co->nextMember[a])
+    {
+        for (int b = y; b >= 0; b = co->nextMember[b])
+        {
+            if (interfere(co, a, b))
+                return true;
+        }
+    }
+    return false;
+}
+
+static void mergeClasses(Coalescer *co, int x, int y)
+{
+    if (co->classSize[x] < co->classSize[y])
+    {
+        int t = x;
+        x = y;
+        y = t;
+    }
+    int last = y;
+    for (int m = y; m >= 0; m = co->nextMember[m])
+    {
+        co->classOf[m] = x;
+        last = m;
+    }
+    co->nextMember[last] = co->nextMember[x];
+    co->nextMember[x] = y;
+    co->classSize[x] += co->classSize[y];
+}
+
+// Solves liveness for the values that phis define or read: a phi defines
+// its result at the top of its block and reads each argument at the end of
+// the corresponding predecessor.
+static void computePhiLiveness(Coalescer *co, int universe)
+{
+    SSAForm *ssa = co->ssa;
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    initDataflowProblem(&co->live, cfg, DATAFLOW_BACKWARD, DATAFLOW_UNION, universe);
+
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        if (!ssa->blockReachable[b])
+            continue;
+        BasicBlock *block = &cfg->blocks[b];
+        BitSet *gen = &co->live.gen[b];
+        BitSet *kill = &co->live.kill[b];
+
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+            bitsetSet(kill, co->id[tacValueIndex(code, ssa->phis[p].result)]);
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            TAC *tac = &code->code[i];
+            Operand *uses[2];
+            int useCount = tacUses(tac, uses);
+            for (int u = 0; u < useCount; u++)
+            {
+                int id = co->id[tacValueIndex(code, *uses[u])];
+                if (id >= 0 && !bitsetTest(kill, id))
+                    bitsetSet(gen, id);
+            }
+            Operand *def = tacDefinition(tac);
+            if (def && co->id[tacValueIndex(code, *def)] >= 0)
+                bitsetSet(kill, co->id[tacValueIndex(code, *def)]);
+        }
+        for (int k = 0; k < block->succCount; k++)
+        {
+            BasicBlock *succ = &cfg->blocks[block->succs[k]];
+            int j = 0;
+            while (succ->preds[j] != b)
+                j++;
+            for (int p = ssa->phiStart[block->succs[k]]; p < ssa->phiStart[block->succs[k] + 1]; p++)
+            {
+                Operand arg = ssa->phis[p].args[j];
+                if (arg.kind == OPERAND_TEMP && !bitsetTest(kill, co->id[tacValueIndex(code, arg)]))
+                    bitsetSet(gen, co->id[tacValueIndex(code, arg)]);
+            }
+        }
+    }
+    solveDataflow(&co->live, cfg);
+
+    // Arguments are read on the way out of the predecessor
+    for (int b = 0; b < cfg->blockCount; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        for (int k = 0; k < block->succCount; k++)
+        {
+            BasicBlock *succ = &cfg->blocks[block->succs[k]];
+            int j = 0;
+            while (succ->preds[j] != b)
+                j++;
+            for (int p = ssa->phiStart[block->succs[k]]; p < ssa->phiStart[block->succs[k] + 1]; p++)
+            {
+                Operand arg = ssa->phis[p].args[j];
+                if (arg.kind == OPERAND_TEMP)
+                    bitsetSet(&co->live.out[b], co->id[tacValueIndex(code, arg)]);
+            }
+        }
+    }
+}
+
+// Gives each phi's result and arguments one name wherever their live ranges
+// do not overlap, so that most phis need no copies at all.
+static void coalescePhis(SSAForm *ssa)
+{
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+    int valueCount = tacValueCount(code);
+
+    Coalescer co;
+    co.ssa = ssa;
+    co.id = (int *)allocateOrDie(sizeof(int) * valueCount);
+    co.defBlock = (int *)allocateOrDie(sizeof(int) * valueCount);
+    co.defInstruction = (int *)allocateOrDie(sizeof(int) * valueCount);
+    co.classOf = (int *)allocateOrDie(sizeof(int) * valueCount);
+    co.nextMember = (int *)allocateOrDie(sizeof(int) * valueCount);
+    co.classSize = (int *)allocateOrDie(sizeof(int) * valueCount);
+    co.treeIn = (int *)allocateOrDie(sizeof(int) * n);
+    co.treeSize = (int *)allocateOrDie(sizeof(int) * n);
+    for (int v = 0; v < valueCount; v++)
+    {
+        co.id[v] = -1;
+        co.defBlock[v] = -1;
+        co.classOf[v] = v;
+        co.nextMember[v] = -1;
+        co.classSize[v] = 1;
+    }
+
+    for (int k = 0; k < ssa->dom.reachableCount; k++)
+    {
+        co.treeIn[ssa->dom.preorder[k]] = k;
+        co.treeSize[ssa->dom.preorder[k]] = 1;
+    }
+    for (int k = ssa->dom.reachableCount - 1; k > 0; k--)
+    {
+        int b = ssa->dom.preorder[k];
+        co.treeSize[ssa->dom.idom[b]] += co.treeSize[b];
+    }
+
+    int universe = 0;
+    for (int b = 0; b < n; b++)
+    {
+        if (!ssa->blockReachable[b])
+            continue;
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+        {
+            Phi *phi = &ssa->phis[p];
+            int v = tacValueIndex(code, phi->result);
+            co.defBlock[v] = b;
+            co.defInstruction[v] = -1;
+            if (co.id[v] < 0)
+                co.id[v] = universe++;
+            for (int j = 0; j < cfg->blocks[b].predCount; j++)
+            {
+                if (phi->args[j].kind == OPERAND_TEMP && co.id[tacValueIndex(code, phi->args[j])] < 0)
+                    co.id[tacValueIndex(code, phi->args[j])] = universe++;
+            }
+        }
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            Operand *def = tacDefinition(&code->code[i]);
+            if (def && def->kind == OPERAND_TEMP)
+            {
+                co.defBlock[tacValueIndex(code, *def)] = b;
+                co.defInstruction[tacValueIndex(code, *def)] = i;
+            }
+        }
+    }
+    computePhiLiveness(&co, universe);
+
+    int merged = 0;
+    for (int b = 0; b < n; b++)
+    {
+        if (!ssa->blockReachable[b])
+            continue;
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+        {
+            Phi *phi = &ssa->phis[p];
+            for (int j = 0; j < cfg->blocks[b].predCount; j++)
+            {
+                if (phi->args[j].kind != OPERAND_TEMP || co.defBlock[tacValueIndex(code, phi->args[j])] < 0)
+                    continue;
+                int x = co.classOf[tacValueIndex(code, phi->result)];
+                int y = co.classOf[tacValueIndex(code, phi->args[j])];
+                if (x != y && !classesInterfere(&co, x, y))
+                {
+                    mergeClasses(&co, x, y);
+                    merged++;
+                }
+            }
+        }
+    }
+
+    // Rename every member of a class to its representative
+    int symbols = code->names.count;
+    for (int b = 0; b < n; b++)
+    {
+        if (!ssa->blockReachable[b])
+            continue;
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+        {
+            TAC *tac = &code->code[i];
+            Operand *operands[3] = {&tac->arg1, &tac->arg2, &tac->result};
+            for (int k = 0; k < 3; k++)
+            {
+                if (operands[k]->kind == OPERAND_TEMP)
+                    operands[k]->value = co.classOf[tacValueIndex(code, *operands[k])] - symbols;
+            }
+        }
+        for (int p = ssa->phiStart[b]; p < ssa->phiStart[b + 1]; p++)
+        {
+            Phi *phi = &ssa->phis[p];
+            phi->result.value = co.classOf[tacValueIndex(code, phi->result)] - symbols;
+            for (int j = 0; j < block->predCount; j++)
+            {
+                if (phi->args[j].kind == OPERAND_TEMP)
+                    phi->args[j].value = co.classOf[tacValueIndex(code, phi->args[j])] - symbols;
+            }
+        }
+    }
+
+    TRACE(TRACE_OPTIMIZER, TRACE_DEBUG, "SSA: %d phi operands coalesced\n", merged);
+
+    freeDataflowProblem(&co.live);
+    trackedFree(co.treeSize);
+    trackedFree(co.treeIn);
+    trackedFree(co.classSize);
+    trackedFree(co.nextMember);
+    trackedFree(co.classOf);
+    trackedFree(co.defInstruction);
+    trackedFree(co.defBlock);
+    trackedFree(co.id);
+}
+
+// Destruction //
+
+typedef struct Rewriter
+{
+    TACList *code;
+    int *prev; // Instruction index -> previous live instruction
+    int prevCapacity;
+} Rewriter;
+
+static int insertLinked(Rewriter *rw, int after, const TAC *tac)
+{
+    int index = insertTAC(rw->code, after, tac);
+    if (rw->code->count > rw->prevCapacity)
+    {
+        rw->prevCapacity = rw->code->count * 2;
+        rw->prev = (int *)growOrDie(rw->prev, sizeof(int) * rw->prevCapacity);
+    }
+    rw->prev[index] = after;
+    int next = rw->code->code[index].next;
+    if (next != TAC_END)
+        rw->prev[next] = index;
+    return index;
+}
+
+static int insertCopy(Rewriter *rw, int after, Operand dst, Operand src)
+{
+    TAC copy = {TAC_ASSIGN, src, {OPERAND_NONE, 0}, dst, TAC_END};
+    return insertLinked(rw, after, &copy);
+}
+
+// Emits the parallel assignment dst[i] = src[i] as a sequence of copies
+// after the instruction at after. A copy waits while its destination is
+// still to be read by another; a cycle is broken through a new temporary.
+// Returns the last instruction inserted.
+static int insertParallelCopies(Rewriter *rw, int after, Operand *dst, Operand *src, int count)
+{
+    while (count > 0)
+    {
+        int ready = -1;
+        for (int i = 0; i < count && ready < 0; i++)
+        {
+            ready = i;
+            for (int j = 0; j < count; j++)
+            {
+                if (j != i && sameOperand(src[j], dst[i]))
+                {
+                    ready = -1;
+                    break;
+                }
+            }
+        }
+
+        if (ready < 0)
+        {
+            Operand saved = createTempVar(rw->code);
+            after = insertCopy(rw, after, saved, dst[0]);
+            for (int j = 0; j < count; j++)
+            {
+                if (sameOperand(src[j], dst[0]))
+                    src[j] = saved;
+            }
+            ready = 0;
+        }
+
+        after = insertCopy(rw, after, dst[ready], src[ready]);
+        dst[ready] = dst[count - 1];
+        src[ready] = src[count - 1];
+        count--;
+    }
+    return after;
+}
+
+static int executableSuccs(SSAForm *ssa, int b)
+{
+    return ssa->edgeExecutable[2 * b] + ssa->edgeExecutable[2 * b + 1];
+}
+
+static int executablePreds(SSAForm *ssa, int b)
+{
+    BasicBlock *block = &ssa->cfg.blocks[b];
+    int count = 0;
+    for (int p = 0; p < block->predCount; p++)
+    {
+        BasicBlock *pred = &ssa->cfg.blocks[block->preds[p]];
+        for (int k = 0; k < pred->succCount; k++)
+        {
+            if (pred->succs[k] == b && ssa->edgeExecutable[2 * block->preds[p] + k])
+                count++;
+        }
+    }
+    return count;
+}
+
+// Translates out of SSA form. Phi operands that do not interfere share a
+// name; each remaining phi becomes copies on its incoming edges: at the end
+// of the predecessor when it has no other way out, at the start of the
+// block when it has no other way in, and otherwise in a new block on the
+// edge. Branches with only one executable edge are resolved and unreachable
+// blocks deleted.
+void leaveSSA(SSAForm *ssa)
+{
+    coalescePhis(ssa);
+
+    TACList *code = ssa->code;
+    CFG *cfg = &ssa->cfg;
+    int n = cfg->blockCount;
+    int originalCount = code->count;
+
+    Rewriter rw = {code, NULL, 0};
+    rw.prevCapacity = code->count * 2 + 16;
+    rw.prev = (int *)allocateOrDie(sizeof(int) * rw.prevCapacity);
+    int last = TAC_END;
+    for (int i = code->head; i != TAC_END; i = code->code[i].next)
+    {
+        rw.prev[i] = last;
+        last = i;
+    }
+
+    // Resolve branches first, while block boundaries are still the CFG's
+    char *doomed = (char *)allocateOrDie(originalCount);
+    memset(doomed, 0, originalCount);
+    for (int b = 0; b < n; b++)
+    {
+        BasicBlock *block = &cfg->blocks[b];
+        if (!ssa->blockReachable[b])
+        {
+            for (int i = block->first; i != TAC_END; i = blockNext(cfg, block, i))
+                doomed[i] = 1;
+            continue;
+        }
+
+        TAC *tac = &code->code[block->last];
+        if (tac->op != TAC_IF_FALSE || block->succCount != 2 || executableSuccs(ssa, b) != 1)
+            continue;
+        int live = ssa->edgeExecutable[2 * b] ? 0 : 1;
+        if (isJumpEdge(cfg, b, live))
+        {
+            tac->op = TAC_GOTO;
+            tac->arg1 = tac->arg2;
+            tac->arg2 = (Operand){OPERAND_NONE, 0};
+        }
+        else
+        {
+            doomed[block->last] = 2; // Falls through; unlinked once the copies are in
+        }
+    }
+
+    Operand exitLabel = {OPERAND_NONE, 0};
+    Operand *dst = NULL;
+    Operand *src = NULL;
+    int copyCapacity = 0;
+
+    for (int b = 0; b < n; b++)
+    {
+        int phiCount = ssa->phiStart[b + 1] - ssa->phiStart[b];
+        if (phiCount == 0 || !ssa->blockReachable[b])
+            continue;
+        if (phiCount > copyCapacity)
+        {
+            copyCapacity = phiCount;
+            dst = (Operand *)growOrDie(dst, sizeof(Operand) * copyCapacity);
+            src = (Operand *)growOrDie(src, sizeof(Operand) * copyCapacity);
+        }
+
+        BasicBlock *block = &cfg->blocks[b];
+        bool onePred = executablePreds(ssa, b) == 1;
+        for (int j = 0; j < block->predCount; j++)
+        {
+            int p = block->preds[j];
+            BasicBlock *pred = &cfg->blocks[p];
+            int k = pred->succs[0] == b ? 0 : 1;
+            if (!ssa->edgeExecutable[2 * p + k])
+                continue;
+
+            int count = 0;
+            for (int q = ssa->phiStart[b]; q < ssa->phiStart[b + 1]; q++)
+            {
+                Phi *phi = &ssa->phis[q];
+                if (phi->args[j].kind == OPERAND_NONE || sameOperand(phi->args[j], phi->result))
+                    continue;
+                dst[count] = phi->result;
+                src[count++] = phi->args[j];
+            }
+            if (count == 0)
+                continue;
+
+            TAC *predLast = &code->code[pred->last];
+            if (executableSuccs(ssa, p) == 1)
+            {
+                bool endsInJump = predLast->op == TAC_GOTO || predLast->op == TAC_IF_FALSE;
+                int after = endsInJump ? rw.prev[pred->last] : pred->last;
+                int end = insertParallelCopies(&rw, after, dst, src, count);
+                if (!endsInJump)
+                    pred->last = end;
+            }
+            else if (onePred)
+            {
+                int end = insertParallelCopies(&rw, block->first, dst, src, count); // After the label
+                if (block->last == block->first)
+                    block->last = end;
+            }
+            else if (!isJumpEdge(cfg, p, k))
+            {
+                insertParallelCopies(&rw, pred->last, dst, src, count); // A new block before b
+            }
+            else
+            {
+                // A new block at the end of the code, reached by retargeting the branch
+                if (exitLabel.kind == OPERAND_NONE)
+                {
+                    exitLabel = createLabel(code);
+                    TAC jump = {TAC_GOTO, exitLabel, {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+                    insertLinked(&rw, code->tail, &jump);
+                }
+                Operand edgeLabel = createLabel(code);
+                code->code[pred->last].arg2 = edgeLabel;
+                TAC label = {TAC_LABEL, edgeLabel, {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+                int end = insertParallelCopies(&rw, insertLinked(&rw, code->tail, &label), dst, src, count);
+                TAC jump = {TAC_GOTO, code->code[block->first].arg1, {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+                insertLinked(&rw, end, &jump);
+            }
+        }
+    }
+
+    if (exitLabel.kind != OPERAND_NONE)
+    {
+        TAC label = {TAC_LABEL, exitLabel, {OPERAND_NONE, 0}, {OPERAND_NONE, 0}, TAC_END};
+        insertLinked(&rw, code->tail, &label);
+    }
+
+    int prev = TAC_END;
+    for (int i = code->head; i != TAC_END;)
+    {
+        int next = code->code[i].next;
+        if (i < originalCount && doomed[i])
+            removeTAC(code, prev, i);
+        else
+            prev = i;
+        i = next;
+    }
+
+    trackedFree(dst);
+    trackedFree(src);
+    trackedFree(doomed);
+    trackedFree(rw.prev);
+}
+
+void freeSSA(SSAForm *ssa)
+{
+    freeCFG(&ssa->cfg);
+    freeDominatorTree(&ssa->dom);
+    trackedFree(ssa->phis);
+    trackedFree(ssa->phiStart);
+    trackedFree(ssa->phiArgs);
+    trackedFree(ssa->blockReachable);
+    trackedFree(ssa->edgeExecutable);
+    ssa->phis = NULL;
+    ssa->phiStart = NULL;
+    ssa->phiArgs = NULL;
+    ssa->blockReachable = NULL;
+    ssa->edgeExecutable = NULL;
+    ssa->phiCount = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <stdbool.h>
+#include "cfg.h"
+
+// Dominators and static single assignment form for a TACList.
+//
+// In SSA form every assignment defines a fresh temporary and every use
+// names the one definition that reaches it; where definitions meet, a phi
+// picks the incoming value by predecessor. Phis are kept beside the code
+// rather than in it, so the TAC passes never see them. A program variable
+// that is read before any assignment keeps its symbol operand, which then
+// stands for the value the variable has in memory: its value on entry, or
+// after a call. Calls and returns read every global, so before one the
+// current value of each assigned global is stored back to its symbol unless
+// memory already holds it; a call may also assign any global, so after it
+// each global is read from memory again.
+
+typedef struct DominatorTree
+{
+    int *idom;       // Block -> immediate dominator; -1 for the entry and unreachable blocks
+    int *childStart; // Children of b are children[childStart[b]..childStart[b+1])
+    int *children;
+    int *preorder;   // Reachable blocks, each after its dominator
+    int reachableCount;
+    int *frontierStart; // Dominance frontier of b is frontier[frontierStart[b]..frontierStart[b+1])
+    int *frontier;
+} DominatorTree;
+
+void computeDominators(DominatorTree *dom, CFG *cfg);
+void freeDominatorTree(DominatorTree *dom);
+
+typedef struct Phi
+{
+    int variable;  // Value index of the merged variable in the code before renaming
+    Operand result;
+    Operand *args; // One per predecessor, in the order of the block's preds; OPERAND_NONE if undefined
+} Phi;
+
+typedef struct SSAForm
+{
+    TACList *code;
+    CFG cfg;
+    DominatorTree dom;
+    Phi *phis;
+    int phiCount;
+    int *phiStart;        // Phis of block b are phis[phiStart[b]..phiStart[b+1])
+    Operand *phiArgs;     // Backing storage for the args of all phis
+    bool *blockReachable; // Blocks that may execute; passes may clear entries
+    bool *edgeExecutable; // Edge k of block b is edgeExecutable[2 * b + k]
+} SSAForm;
+
+void buildSSA(SSAForm *ssa, TACList *list);
+Phi *addPhi(SSAForm *ssa, int b, Operand result);
+void leaveSSA(SSAForm *ssa);
+void freeSSA(SSAForm *ssa);
+
+#endif // SSA_H
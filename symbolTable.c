@@ -1,107 +1,228 @@
 #include "symbolTable.h"
+#include "memtrack.h"
+#include "intern.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "trace.h"
+
+// Grow once more than 7 in 10 slots are occupied
+#define MAX_LOAD_NUMERATOR 7
+#define MAX_LOAD_DENOMINATOR 10
+
+static SymbolSlot *allocateSlots(int slotCount)
+{
+    SymbolSlot *slots = (SymbolSlot *)trackedMalloc(sizeof(SymbolSlot) * slotCount);
+    if (!slots)
+        return NULL;
+
+    for (int i = 0; i < slotCount; i++)
+    {
+        slots[i].hash = 0;
+        slots[i].symbol = SLOT_EMPTY;
+    }
+    return slots;
+}
 
 // Function to create a new symbol table
+// size is the number of symbols expected; the table grows past it as needed.
 SymbolTable *createSymbolTable(int size)
 {
-    SymbolTable *newTable = (SymbolTable *)malloc(sizeof(SymbolTable));
+    SymbolTable *newTable = (SymbolTable *)trackedMalloc(sizeof(SymbolTable));
     if (!newTable)
         return 0;
 
-    newTable->size = size;
-    newTable->table = (Symbol **)malloc(sizeof(Symbol *) * size);
+    int slotCount = 16;
+    while (slotCount * MAX_LOAD_NUMERATOR < size * MAX_LOAD_DENOMINATOR)
+        slotCount *= 2;
 
-    if (!newTable->table)
+    newTable->slotCount = slotCount;
+    newTable->slots = allocateSlots(slotCount);
+    newTable->capacity = size > 0 ? size : 16;
+    newTable->symbols = (Symbol *)trackedMalloc(sizeof(Symbol) * newTable->capacity);
+
+    if (!newTable->slots || !newTable->symbols)
     {
-        free(newTable);
+        trackedFree(newTable->slots);
+        trackedFree(newTable->symbols);
+        trackedFree(newTable);
         return 0;
     }
 
-    for (int i = 0; i < size; i++)
+    newTable->count = 0;
+    newTable->slotsUsed = 0;
+    initArena(&newTable->strings, 4096);
+    newTable->scopeMarks = NULL;
+    newTable->scopeDepth = 0;
+    newTable->scopeCapacity = 0;
+    newTable->lookups = 0;
+    newTable->probes = 0;
+    newTable->maxProbe = 0;
+
+    return newTable;
+}
+
+// Returns the slot holding name. If the name is not bound, returns the slot
+// where it would be inserted: the first deleted slot on the probe sequence,
+// or the empty slot that ended it. Records the probe length when counting a
+// lookup.
+static int findSlot(SymbolTable *table, const char *name, unsigned hashval, bool countProbes)
+{
+    int mask = table->slotCount - 1;
+    int slot = hashval & mask;
+    int firstDeleted = -1;
+    int probes = 1;
+
+    while (table->slots[slot].symbol != SLOT_EMPTY)
     {
-        newTable->table[i] = 0;
+        TRACE(TRACE_SYMTAB, TRACE_VERBOSE, "Probing slot %d\n", slot);
+        int symbol = table->slots[slot].symbol;
+        if (symbol == SLOT_DELETED)
+        {
+            if (firstDeleted == -1)
+                firstDeleted = slot;
+        }
+        else if (table->slots[slot].hash == hashval && strcmp(table->symbols[symbol].name, name) == 0)
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+        probes++;
     }
 
-    return newTable;
+    if (countProbes)
+    {
+        table->lookups++;
+        table->probes += probes;
+        if (probes > table->maxProbe)
+            table->maxProbe = probes;
+    }
+
+    if (table->slots[slot].symbol == SLOT_EMPTY && firstDeleted != -1)
+        return firstDeleted;
+    return slot;
 }
 
-// Hash function to map a name to an index
-unsigned int hash(SymbolTable *table, char *name)
+// Reinserts every live slot into a fresh array using its cached hash.
+// Deleted slots are dropped; the array doubles only if live slots need it.
+static void growSlots(SymbolTable *table)
 {
-    unsigned int hashval = 0;
-    for (; *name != '\0'; name++)
-        hashval = *name + (hashval << 5) - hashval;
-    return hashval % table->size;
+    int live = 0;
+    for (int i = 0; i < table->slotCount; i++)
+    {
+        if (table->slots[i].symbol >= 0)
+            live++;
+    }
+
+    int newCount = table->slotCount;
+    if (live * 2 * MAX_LOAD_DENOMINATOR > newCount * MAX_LOAD_NUMERATOR)
+        newCount *= 2;
+
+    SymbolSlot *slots = allocateSlots(newCount);
+    if (!slots)
+    {
+        fprintf(stderr, "Symbol table: Memory allocation failed while resizing\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < table->slotCount; i++)
+    {
+        if (table->slots[i].symbol < 0)
+            continue;
+
+        int slot = table->slots[i].hash & (newCount - 1);
+        while (slots[slot].symbol != SLOT_EMPTY)
+            slot = (slot + 1) & (newCount - 1);
+        slots[slot] = table->slots[i];
+    }
+
+    trackedFree(table->slots);
+    table->slots = slots;
+    table->slotCount = newCount;
+    table->slotsUsed = live;
 }
 
 // Function to add a symbol to the table
+// The symbol belongs to the current scope and shadows any existing binding
+// of the same name until that scope is exited.
 void addSymbol(SymbolTable *table, char *name, char *type)
 {
-    Symbol *newSymbol = (Symbol *)malloc(sizeof(Symbol));
-    if (!newSymbol)
+    if (table == NULL || table->slots == NULL)
+    {
+        fprintf(stderr, "Symbol table or table array not initialized\n");
         return;
-    newSymbol->name = strdup(name);
-    newSymbol->type = strdup(type);
+    }
+
+    if (table->count == table->capacity)
+    {
+        int newCapacity = table->capacity * 2;
+        Symbol *symbols = (Symbol *)trackedRealloc(table->symbols, sizeof(Symbol) * newCapacity);
+        if (!symbols)
+            return;
+        table->symbols = symbols;
+        table->capacity = newCapacity;
+    }
+
+    int index = table->count++;
+    Symbol *newSymbol = &table->symbols[index];
+    newSymbol->name = arenaStrdup(&table->strings, name);
+    newSymbol->type = arenaStrdup(&table->strings, type);
     // Initialize other fields of Symbol
+    newSymbol->scopeLevel = table->scopeDepth;
+    newSymbol->isFunction = false;
+    newSymbol->parameters = NULL;
+    newSymbol->isArray = false;
+    newSymbol->arraySize = 0;
+
+    unsigned hashval = hashString(name);
+    int slot = findSlot(table, name, hashval, false);
+    int previous = table->slots[slot].symbol;
+    newSymbol->shadowed = previous >= 0 ? previous : -1;
+    table->slots[slot].hash = hashval;
+    table->slots[slot].symbol = index;
 
-    if (table == NULL || table->table == NULL)
+    if (previous == SLOT_EMPTY)
     {
-        fprintf(stderr, "Symbol table or table array not initialized\n");
-        // Handle the error, possibly free newSymbol and return
+        table->slotsUsed++;
+        if (table->slotsUsed * MAX_LOAD_DENOMINATOR > table->slotCount * MAX_LOAD_NUMERATOR)
+            growSlots(table);
     }
+}
 
-    unsigned int hashval = hash(table, name);
-    newSymbol->next = table->table[hashval];
-    table->table[hashval] = newSymbol;
+// Adds an array of size elements to the current scope
+void addArraySymbol(SymbolTable *table, char *name, char *type, int size)
+{
+    int count = table->count;
+    addSymbol(table, name, type);
+    if (table->count == count)
+        return; // Not added
+    table->symbols[count].isArray = true;
+    table->symbols[count].arraySize = size;
 }
+
 // Function to look up a name in the table
 Symbol *lookupSymbol(SymbolTable *table, char *name)
 {
-    printf("Looking up %s\n", name);
-    unsigned int hashval = hash(table, name);
-#include <stddef.h> // Include the header file for NULL macro
-
-    // Search the linked list at table->table[hashval]
-    // Check if the entry at hashval is null
+    TRACE(TRACE_SYMTAB, TRACE_DEBUG, "Looking up %s\n", name);
 
-    if (table->table[hashval] == NULL)
+    int slot = findSlot(table, name, hashString(name), true);
+    if (table->slots[slot].symbol < 0)
     {
-        printf("No symbol found at hash value %u\n", hashval);
+        TRACE(TRACE_SYMTAB, TRACE_VERBOSE, "No symbol found for %s\n", name);
         return NULL;
     }
-    else
-    {
-        printf("Symbol found at hash value %u\n", hashval);
-        for (Symbol *sym = table->table[hashval]; sym != 0; sym = sym->next)
-        {
-            printf("Symbol name: %s\n", sym->name);
-            if (strcmp(name, sym->name) == 0)
-                return sym;
-        }
-    }
 
-    return NULL;
+    return &table->symbols[table->slots[slot].symbol];
 }
+
 // Function to free the symbol table
 void freeSymbolTable(SymbolTable *table)
 {
-    for (int i = 0; i < table->size; i++)
-    {
-        Symbol *sym = table->table[i];
-        while (sym != 0)
-        {
-            Symbol *nextSym = sym->next;
-            free(sym->name);
-            free(sym->type);
-            // Free other dynamically allocated fields of Symbol
-            free(sym);
-            sym = nextSym;
-        }
-    }
-    free(table->table);
-    free(table);
+    freeArena(&table->strings);
+    trackedFree(table->scopeMarks);
+    trackedFree(table->symbols);
+    trackedFree(table->slots);
+    trackedFree(table);
 }
 
 // Function to print the symbol table
@@ -109,42 +230,69 @@ void printSymbolTable(SymbolTable *table)
 {
     printf("\n");
     printf("##### SYMBOL TABLE #####\n");
-    for (int i = 0; i < table->size; i++)
+    for (int i = 0; i < table->count; i++)
     {
-        Symbol *sym = table->table[i];
-        while (sym != 0)
-        {
-            printf("Name: %s, Type: %s\n", sym->name, sym->type);
-            // Print other fields of Symbol
-            sym = sym->next;
-        }
+        Symbol *sym = &table->symbols[i];
+        printf("Name: %s, Type: %s\n", sym->name, sym->type);
+        // Print other fields of Symbol
     }
     printf("########################\n");
 }
 
-void enterScope()
+void getSymbolTableStats(SymbolTable *table, SymbolTableStats *stats)
 {
-    if (currentScopeLevel < MAX_SCOPE_LEVEL - 1)
-    {
-        currentScopeLevel++;
-        scopeStack[currentScopeLevel] = createSymbolTable(64); // Assuming a default size for new tables
-    }
-    else
+    stats->count = table->count;
+    stats->slotCount = table->slotCount;
+    stats->loadFactor = (double)table->count / table->slotCount;
+    stats->lookups = table->lookups;
+    stats->averageProbe = table->lookups ? (double)table->probes / table->lookups : 0.0;
+    stats->maxProbe = table->maxProbe;
+}
+
+void printSymbolTableStats(SymbolTable *table)
+{
+    SymbolTableStats stats;
+    getSymbolTableStats(table, &stats);
+    printf("Symbols: %d, slots: %d, load factor: %.2f\n", stats.count, stats.slotCount, stats.loadFactor);
+    printf("Lookups: %lu, average probe length: %.2f, longest probe: %d\n",
+           stats.lookups, stats.averageProbe, stats.maxProbe);
+}
+
+// Opens a nested scope by marking the current end of the undo log.
+void enterScope(SymbolTable *table)
+{
+    if (table->scopeDepth == table->scopeCapacity)
     {
-        fprintf(stderr, "Scope level exceeded maximum allowed.\n");
+        int newCapacity = table->scopeCapacity ? table->scopeCapacity * 2 : 16;
+        int *marks = (int *)trackedRealloc(table->scopeMarks, sizeof(int) * newCapacity);
+        if (!marks)
+        {
+            fprintf(stderr, "enterScope: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        table->scopeMarks = marks;
+        table->scopeCapacity = newCapacity;
     }
+
+    table->scopeMarks[table->scopeDepth++] = table->count;
 }
 
-void exitScope()
+// Closes the innermost scope, undoing every insertion made since the
+// matching enterScope in reverse order.
+void exitScope(SymbolTable *table)
 {
-    if (currentScopeLevel >= 0)
+    if (table->scopeDepth == 0)
     {
-        freeSymbolTable(scopeStack[currentScopeLevel]);
-        scopeStack[currentScopeLevel] = NULL;
-        currentScopeLevel--;
+        fprintf(stderr, "No scope to exit.\n");
+        return;
     }
-    else
+
+    int mark = table->scopeMarks[--table->scopeDepth];
+    while (table->count > mark)
     {
-        fprintf(stderr, "No scope to exit.\n");
+        Symbol *sym = &table->symbols[table->count - 1];
+        int slot = findSlot(table, sym->name, hashString(sym->name), false);
+        table->slots[slot].symbol = sym->shadowed >= 0 ? sym->shadowed : SLOT_DELETED;
+        table->count--;
     }
-}
\ No newline at end of file
+}
@@ -4,42 +4,83 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include "arena.h"
 
 // Symbol structure
 
 typedef struct Symbol
 {
-    char *name;
-    char *type;
+    const char *name;
+    const char *type;
     int scopeLevel;
-    struct Symbol *next;
 
     bool isFunction;
     struct ASTNode *parameters;
 
     bool isArray;
     int arraySize;
+
+    int shadowed; // Index of the outer binding this symbol hides, -1 if none
 } Symbol;
 
+// Open-addressing slot. The cached hash lets probes skip most string
+// compares; symbol is an index into SymbolTable.symbols for the innermost
+// binding of the name, SLOT_EMPTY or SLOT_DELETED.
+typedef struct SymbolSlot
+{
+    unsigned hash;
+    int symbol;
+} SymbolSlot;
+
+#define SLOT_EMPTY -1
+#define SLOT_DELETED -2
+
 // Define the SymbolTable struct
+// A single table serves every scope. Symbol records are packed in insertion
+// order in symbols, which doubles as the undo log: enterScope remembers the
+// current count and exitScope pops every record added since, restoring the
+// binding each one shadowed. Pointers returned by lookupSymbol stay valid
+// until the next addSymbol or exitScope.
 typedef struct SymbolTable
 {
-    int size;
-    struct Symbol **table;
+    SymbolSlot *slots;
+    int slotCount; // Always a power of two
+    int slotsUsed; // Live and deleted slots
+    Symbol *symbols;
+    int count;
+    int capacity;
+    Arena strings; // Names and types of the symbols
+
+    int *scopeMarks; // symbols count at each enterScope
+    int scopeDepth;  // 0 is the global scope
+    int scopeCapacity;
+
+    // Probe statistics
+    unsigned long lookups;
+    unsigned long probes;
+    int maxProbe;
 } SymbolTable;
 
-// Globals
-#define MAX_SCOPE_LEVEL 100
-static SymbolTable *scopeStack[MAX_SCOPE_LEVEL];
-static int currentScopeLevel = -1;
+typedef struct SymbolTableStats
+{
+    int count;
+    int slotCount;
+    double loadFactor;
+    unsigned long lookups;
+    double averageProbe;
+    int maxProbe;
+} SymbolTableStats;
 
 // Function declarations
 void addSymbol(SymbolTable *table, char *name, char *type);
+void addArraySymbol(SymbolTable *table, char *name, char *type, int size);
 Symbol *lookupSymbol(SymbolTable *table, char *name);
 void printSymbolTable(SymbolTable *table);
 SymbolTable *createSymbolTable(int size);
 void freeSymbolTable(SymbolTable *table);
-void enterScope();
-void exitScope();
+void getSymbolTableStats(SymbolTable *table, SymbolTableStats *stats);
+void printSymbolTableStats(SymbolTable *table);
+void enterScope(SymbolTable *table);
+void exitScope(SymbolTable *table);
 
 #endif // SYMBOL_TABL1_H
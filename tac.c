@@ -1,176 +1,572 @@
 #include "tac.h"
+#include "memtrack.h"
+#include "trace.h"
 
-TAC *tacHead = NULL;
-int tempVars[20] = {0};
+const char *tacOpcodeNames[TAC_OPCODE_COUNT] = {
+    [TAC_ASSIGN] = "assign",
+    [TAC_LI] = "li",
+    [TAC_ADD] = "+",
+    [TAC_SUB] = "-",
+    [TAC_MUL] = "*",
+    [TAC_DIV] = "/",
+    [TAC_SLL] = "<<",
+    [TAC_SRA] = ">>",
+    [TAC_SRL] = ">>>",
+    [TAC_LT] = "<",
+    [TAC_LE] = "<=",
+    [TAC_GT] = ">",
+    [TAC_GE] = ">=",
+    [TAC_EQ] = "==",
+    [TAC_NE] = "!=",
+    [TAC_WRITE] = "write",
+    [TAC_CALL] = "call",
+    [TAC_ARRAY_LOAD] = "array_load",
+    [TAC_ARRAY_STORE] = "array_store",
+    [TAC_BOUNDS_CHECK] = "check",
+    [TAC_ADDRESS] = "address",
+    [TAC_POINTER_LOAD] = "pointer_load",
+    [TAC_POINTER_STORE] = "pointer_store",
+    [TAC_LABEL] = "label",
+    [TAC_GOTO] = "goto",
+    [TAC_IF_FALSE] = "ifFalse",
+    [TAC_FUNCTION] = "function",
+    [TAC_PARAM] = "param",
+    [TAC_ARG] = "arg",
+    [TAC_RETURN] = "return",
+};
 
-TAC *generateTACForExpr(ASTNode *expr)
+// Maps an operator token from the AST onto its opcode.
+static TACOpcode opcodeForOperator(const char *operator)
 {
-    if (!expr)
-        return NULL;
+    static const TACOpcode comparisons[] = {TAC_LT, TAC_LE, TAC_GT, TAC_GE, TAC_EQ, TAC_NE};
+    for (size_t k = 0; operator && k < sizeof(comparisons) / sizeof(comparisons[0]); k++)
+    {
+        if (strcmp(operator, tacOpcodeNames[comparisons[k]]) == 0)
+            return comparisons[k];
+    }
+    if (operator && strcmp(operator, "+") == 0)
+        return TAC_ADD;
+    if (operator && strcmp(operator, "-") == 0)
+        return TAC_SUB;
+    if (operator && strcmp(operator, "*") == 0)
+        return TAC_MUL;
+    if (operator && strcmp(operator, "/") == 0)
+        return TAC_DIV;
 
-    TAC *instruction = (TAC *)malloc(sizeof(TAC));
-    if (!instruction)
+    fprintf(stderr, "opcodeForOperator: Unsupported operator %s\n", operator ? operator : "(null)");
+    return TAC_ADD;
+}
+
+// True if the declaration being lowered takes a parameter called name.
+static bool isParameter(const ASTNode *function, const char *name)
+{
+    for (const ASTNode *param = function->funcDecl.paramList; param; param = param->varDeclList.varDeclList)
     {
-        fprintf(stderr, "generateTACForExpr: Memory allocation failed for TAC instruction\n");
-        return NULL;
+        const ASTNode *decl = param->varDeclList.varDecl;
+        if (decl && decl->type == NodeType_VarDecl && strcmp(decl->varDecl.varName, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// The operand for a variable named in the code being lowered. Inside a
+// function its parameters hide the globals of the same name.
+static Operand variableOperand(TACList *list, const char *name)
+{
+    if (list->function && isParameter(list->function, name))
+        return localOperand(list, list->function->funcDecl.funcName, name);
+    return symbolOperand(list, name);
+}
+
+// Lowers a call. Every argument is evaluated before the first is passed, so
+// a call nested in an argument cannot come between a call and its args.
+static void generateCallArguments(TACList *list, ASTNode *argList, TAC *call)
+{
+    int argCount = 0;
+    for (ASTNode *arg = argList; arg; arg = arg->argList.argList)
+        argCount++;
+
+    Operand *args = (Operand *)trackedMalloc(sizeof(Operand) * (argCount ? argCount : 1));
+    if (!args)
+    {
+        fprintf(stderr, "generateTACForExpr: Memory allocation failed for call arguments\n");
+        exit(EXIT_FAILURE);
     }
+    int k = 0;
+    for (ASTNode *arg = argList; arg; arg = arg->argList.argList)
+        args[k++] = createOperand(list, arg->argList.arg);
+    for (k = 0; k < argCount; k++)
+    {
+        TAC pass = {TAC_ARG, args[k], constOperand(k), {OPERAND_NONE, 0}, TAC_END};
+        appendTAC(list, &pass);
+    }
+    trackedFree(args);
+    call->arg2 = constOperand(argCount);
+}
+
+int generateTACForExpr(TACList *list, ASTNode *expr)
+{
+    if (!expr)
+        return TAC_END;
+
+    TAC instruction;
 
     // Initialize fields to ensure clean state
-    instruction->arg1 = instruction->arg2 = instruction->op = instruction->result = NULL;
-    instruction->next = NULL;
+    instruction.arg1 = instruction.arg2 = instruction.result = (Operand){OPERAND_NONE, 0};
+    instruction.next = TAC_END;
 
     switch (expr->type)
     {
     case NodeType_Expr:
-        printf("generateTACForExpr: Generating TAC for Expression\n");
-        instruction->arg1 = createOperand(expr->expr.left);
-        instruction->arg2 = createOperand(expr->expr.right);
-        instruction->op = strdup(expr->expr.operator);
-        instruction->result = createTempVar();
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Expression\n");
+        instruction.arg1 = createOperand(list, expr->expr.left);
+        instruction.arg2 = createOperand(list, expr->expr.right);
+        instruction.op = opcodeForOperator(expr->expr.operator);
+        instruction.result = createTempVar(list);
         break;
 
     case NodeType_SimpleExpr:
-        printf("generateTACForExpr: Generating TAC for Simple Expression\n");
-        char buffer[20]; // Buffer for number to string conversion
-        snprintf(buffer, sizeof(buffer), "%d", expr->simpleExpr.number);
-        instruction->arg1 = strdup(buffer);
-        instruction->op = strdup("li");
-        instruction->result = createTempVar();
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Simple Expression\n");
+        instruction.arg1 = constOperand(expr->simpleExpr.number);
+        instruction.op = TAC_LI;
+        instruction.result = createTempVar(list);
         break;
 
     case NodeType_SimpleID:
-        printf("generateTACForExpr: Generating TAC for Simple ID\n");
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Simple ID\n");
         // For a simple ID, we typically do not generate a TAC unless it's being used in an operation.
-        // However, in the context of your implementation, this could be different.
-        free(instruction); // Avoid memory leak since we're not using this structure.
-        return NULL;
+        return TAC_END;
 
     case NodeType_AssignStmt:
-        printf("generateTACForExpr: Generating TAC for Assignment Statement\n");
-        instruction->arg1 = createOperand(expr->assignStmt.expr); // Right-hand side of assignment
-        instruction->op = strdup("=");
-        instruction->result = strdup(expr->assignStmt.varName);
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Assignment Statement\n");
+        instruction.arg1 = createOperand(list, expr->assignStmt.expr); // Right-hand side of assignment
+        instruction.op = TAC_ASSIGN;
+        instruction.result = variableOperand(list, expr->assignStmt.varName);
         break;
 
     case NodeType_WriteStmt:
-        printf("generateTACForExpr: Generating TAC for Write Statement\n");
-        instruction->arg1 = createOperand(expr->writeStmt.expr); // Expression to write
-        instruction->op = strdup("write");
-        instruction->result = NULL; // No result needed for write operation
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Write Statement\n");
+        instruction.arg1 = createOperand(list, expr->writeStmt.expr); // Expression to write
+        instruction.op = TAC_WRITE;
         break;
 
     case NodeType_BinOp:
-        printf("generateTACForExpr: Generating TAC for Binary Operation\n");
-        instruction->arg1 = createOperand(expr->binOp.left);
-        instruction->arg2 = createOperand(expr->binOp.right);
-        instruction->op = strdup(expr->binOp.operator);
-        instruction->result = createTempVar();
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Binary Operation\n");
+        instruction.arg1 = createOperand(list, expr->binOp.left);
+        instruction.arg2 = createOperand(list, expr->binOp.right);
+        instruction.op = opcodeForOperator(expr->binOp.operator);
+        instruction.result = createTempVar(list);
         break;
 
     case NodeType_FunctionCall:
-        printf("generateTACForExpr: Generating TAC for Function Call\n");
-        instruction->arg1 = strdup(expr->funcCall.funcName);
-        instruction->op = strdup("call");
-        instruction->result = createTempVar(); // TODO Functions might return a value.
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Function Call\n");
+        generateCallArguments(list, expr->funcCall.argList, &instruction);
+        instruction.arg1 = symbolOperand(list, expr->funcCall.funcName);
+        instruction.op = TAC_CALL;
+        instruction.result = createTempVar(list);
+        break;
+
+    case NodeType_ReturnStmt:
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Return Statement\n");
+        instruction.arg1 = createOperand(list, expr->returnStmt.expr);
+        instruction.op = TAC_RETURN;
         break;
 
     case NodeType_ArrayAccess:
-        printf("generateTACForExpr: Generating TAC for Array Access\n");
-        instruction->arg1 = strdup(expr->arrayAccess.arrayName);
-        instruction->arg2 = createOperand(expr->arrayAccess.indexExpr);
-        instruction->op = strdup("array_load");
-        instruction->result = createTempVar();
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Array Access\n");
+        instruction.arg1 = symbolOperand(list, expr->arrayAccess.arrayName);
+        instruction.arg2 = createOperand(list, expr->arrayAccess.indexExpr);
+        instruction.op = TAC_ARRAY_LOAD;
+        instruction.result = createTempVar(list);
+        break;
+
+    case NodeType_ArrayAssignStmt:
+        TRACE(TRACE_TAC, TRACE_DEBUG, "generateTACForExpr: Generating TAC for Array Assignment Statement\n");
+        instruction.arg2 = createOperand(list, expr->arrayAssignStmt.indexExpr); // The index is evaluated first
+        instruction.arg1 = createOperand(list, expr->arrayAssignStmt.expr);
+        instruction.op = TAC_ARRAY_STORE;
+        instruction.result = symbolOperand(list, expr->arrayAssignStmt.arrayName);
         break;
 
         // TODO Add more cases as needed for your specific AST and TAC requirements.
 
     default:
         printf("generateTACForExpr: Unhandled node type in TAC generation: %d\n", expr->type);
-        free(instruction); // Avoid memory leak
-        return NULL;
+        return TAC_END;
     }
 
     // Print the TAC for debugging before appending
-    if (instruction->op != NULL)
-    { // Make sure it's a valid TAC before printing
-        printf("Generated TAC: ");
-        printTAC(instruction); // Function to print single TAC line
-    }
-
-    // Append this instruction to your list of TAC instructions if it's a valid instruction
-    if (instruction->result != NULL || instruction->op != NULL)
+    if (TRACE_ENABLED(TRACE_TAC, TRACE_DEBUG))
     {
-        appendTAC(&tacHead, instruction);
+        traceLog("Generated TAC: ");
+        printTAC(list, &instruction); // Function to print single TAC line
     }
-    else
+
+    return appendTAC(list, &instruction);
+}
+
+// Hands out a fresh temporary. Temporaries are virtual registers with no
+// fixed pool; renumberTemporaries compacts them once the code is final.
+Operand createTempVar(TACList *list)
+{
+    return (Operand){OPERAND_TEMP, list->tempCount++};
+}
+
+Operand createLabel(TACList *list)
+{
+    return (Operand){OPERAND_LABEL, list->labelCount++};
+}
+
+Operand constOperand(int value)
+{
+    return (Operand){OPERAND_CONST, value};
+}
+
+Operand symbolOperand(TACList *list, const char *name)
+{
+    return (Operand){OPERAND_SYMBOL, internString(&list->names, name)};
+}
+
+// The symbol for local name of function, spelled "function.name".
+Operand localOperand(TACList *list, const char *function, const char *name)
+{
+    size_t size = strlen(function) + strlen(name) + 2;
+    char *local = (char *)trackedMalloc(size);
+    if (!local)
     {
-        // If it turned out to be an instruction we don't need to append, clean up.
-        free(instruction);
+        fprintf(stderr, "localOperand: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
     }
-
-    return instruction;
+    snprintf(local, size, "%s.%s", function, name);
+    Operand operand = symbolOperand(list, local);
+    trackedFree(local);
+    return operand;
 }
 
-char *createTempVar()
+bool sameOperand(Operand a, Operand b)
 {
-    static int count = 0;
-    char *tempVar = malloc(10); // Enough space for "t" + number
-    if (!tempVar)
-        return NULL;
-    count = allocateNextAvailableTempVar(tempVars);
-    sprintf(tempVar, "t%d", count++);
-    return tempVar;
+    return a.kind == b.kind && a.value == b.value;
 }
 
-char *createOperand(ASTNode *node)
+// Returns the operand for a node. Leaves are used directly; anything else is
+// lowered first and its result temporary is used.
+Operand createOperand(TACList *list, ASTNode *node)
 {
     if (!node)
-        return strdup(""); // Safety check
-
-    char buffer[64]; // Buffer for creating string representations
+        return (Operand){OPERAND_NONE, 0}; // Safety check
 
     switch (node->type)
     {
     case NodeType_SimpleExpr: // Handle simple numeric expressions
-        snprintf(buffer, sizeof(buffer), "%d", node->simpleExpr.number);
-        return strdup(buffer);
+        return constOperand(node->simpleExpr.number);
     case NodeType_SimpleID: // Handle identifiers
-        return strdup(node->simpleID.name);
+        return variableOperand(list, node->simpleID.name);
+    case NodeType_Expr:
+    case NodeType_BinOp:
+    case NodeType_FunctionCall:
     case NodeType_ArrayAccess:
-    { // Note the opening brace to introduce a new scope
-        char *indexStr = createOperand(node->arrayAccess.indexExpr);
-        snprintf(buffer, sizeof(buffer), "%s[%s]", node->arrayAccess.arrayName, indexStr);
-        free(indexStr); // Cleanup the operand string used for the index
-        return strdup(buffer);
-    } // Close the scope for this case
+    {
+        int index = generateTACForExpr(list, node);
+        if (index == TAC_END)
+            return (Operand){OPERAND_NONE, 0};
+        return list->code[index].result;
+    }
     default:
         fprintf(stderr, "createOperand: Unknown or unsupported node type %d\n", node->type);
-        return strdup("unknown");
+        return (Operand){OPERAND_NONE, 0};
     }
 }
 
-void printTAC(TAC *tac)
+// Produces the text for an operand. Symbols come straight from the string
+// pool; constants and temporaries are formatted into buffer.
+const char *formatOperand(TACList *list, Operand operand, char *buffer, size_t size)
 {
-    if (!tac)
-        return;
+    switch (operand.kind)
+    {
+    case OPERAND_CONST:
+        snprintf(buffer, size, "%d", operand.value);
+        return buffer;
+    case OPERAND_SYMBOL:
+        return internedString(&list->names, operand.value);
+    case OPERAND_TEMP:
+        snprintf(buffer, size, "t%d", operand.value);
+        return buffer;
+    case OPERAND_LABEL:
+        snprintf(buffer, size, "L%d", operand.value);
+        return buffer;
+    default:
+        return "(null)";
+    }
+}
+
+// Writes an operand the way formatOperand spells it.
+static void emitOperand(Emitter *out, TACList *list, Operand operand)
+{
+    switch (operand.kind)
+    {
+    case OPERAND_CONST:
+        emitInt(out, operand.value);
+        break;
+    case OPERAND_SYMBOL:
+        emitString(out, internedString(&list->names, operand.value));
+        break;
+    case OPERAND_TEMP:
+        emitChar(out, 't');
+        emitInt(out, operand.value);
+        break;
+    case OPERAND_LABEL:
+        emitChar(out, 'L');
+        emitInt(out, operand.value);
+        break;
+    default:
+        emitString(out, "(null)");
+        break;
+    }
+}
 
-    // Check if the operation is 'write', which might not have a result
-    if (tac->op && strcmp(tac->op, "write") == 0)
+void emitTAC(Emitter *out, TACList *list, TAC *tac)
+{
+    // Check if the operation is 'write', which has no result
+    if (tac->op == TAC_WRITE)
+    {
+        emitString(out, "write ");
+        emitOperand(out, list, tac->arg1);
+    }
+    else if (tac->op == TAC_LABEL)
     {
-        printf("write %s\n", tac->arg1 ? tac->arg1 : "(null)");
+        emitOperand(out, list, tac->arg1);
+        emitChar(out, ':');
+    }
+    else if (tac->op == TAC_GOTO)
+    {
+        emitString(out, "goto ");
+        emitOperand(out, list, tac->arg1);
+    }
+    else if (tac->op == TAC_IF_FALSE)
+    {
+        emitString(out, "ifFalse ");
+        emitOperand(out, list, tac->arg1);
+        emitString(out, " goto ");
+        emitOperand(out, list, tac->arg2);
+    }
+    else if (tac->op == TAC_FUNCTION)
+    {
+        emitString(out, "function ");
+        emitOperand(out, list, tac->arg1);
+        emitChar(out, ':');
+    }
+    else if (tac->op == TAC_PARAM)
+    {
+        emitOperand(out, list, tac->result);
+        emitString(out, " = param ");
+        emitOperand(out, list, tac->arg1);
+    }
+    else if (tac->op == TAC_ARRAY_STORE)
+    {
+        emitOperand(out, list, tac->result);
+        emitChar(out, '[');
+        emitOperand(out, list, tac->arg2);
+        emitString(out, "] = ");
+        emitOperand(out, list, tac->arg1);
+    }
+    else if (tac->op == TAC_POINTER_STORE)
+    {
+        emitChar(out, '*');
+        emitOperand(out, list, tac->arg2);
+        emitString(out, " = ");
+        emitOperand(out, list, tac->arg1);
+        emitString(out, " in ");
+        emitOperand(out, list, tac->result);
+    }
+    else if (tac->op == TAC_ADDRESS)
+    {
+        emitOperand(out, list, tac->result);
+        emitString(out, " = &");
+        emitOperand(out, list, tac->arg1);
+    }
+    else if (tac->op == TAC_POINTER_LOAD)
+    {
+        emitOperand(out, list, tac->result);
+        emitString(out, " = *");
+        emitOperand(out, list, tac->arg2);
+        emitString(out, " in ");
+        emitOperand(out, list, tac->arg1);
+    }
+    else if (tac->op == TAC_BOUNDS_CHECK)
+    {
+        emitString(out, "check ");
+        emitOperand(out, list, tac->arg1);
+        emitString(out, " < ");
+        emitOperand(out, list, tac->arg2);
+    }
+    else if (tac->op == TAC_ARG || tac->op == TAC_RETURN)
+    {
+        emitString(out, tacOpcodeNames[tac->op]);
+        emitChar(out, ' ');
+        emitOperand(out, list, tac->arg1);
     }
     else
     {
-        // Handle general case with checks for NULL values
-        printf("%s = %s %s %s\n",
-               tac->result ? tac->result : "(null)",
-               tac->arg1 ? tac->arg1 : "(null)",
-               tac->op ? tac->op : "(null)",
-               tac->arg2 ? tac->arg2 : "(null)");
+        emitOperand(out, list, tac->result);
+        emitString(out, " = ");
+        emitOperand(out, list, tac->arg1);
+        emitChar(out, ' ');
+        emitString(out, tacOpcodeNames[tac->op]);
+        emitChar(out, ' ');
+        emitOperand(out, list, tac->arg2);
     }
+    emitChar(out, '\n');
+}
+
+void fprintTAC(FILE *file, TACList *list, TAC *tac)
+{
+    char line[128];
+    Emitter out;
+    initEmitter(&out, file, line, sizeof(line));
+    emitTAC(&out, list, tac);
+    closeEmitter(&out);
 }
 
-void printTACToFile(const char *filename, TAC *tac)
+// Writes the live instructions of list to file, one per line. Returns false
+// if the file could not be written.
+bool writeTACList(FILE *file, TACList *list)
+{
+    Emitter out;
+    initEmitter(&out, file, NULL, 0);
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+        emitTAC(&out, list, &list->code[i]);
+    return closeEmitter(&out);
+}
+
+// Operand queries used by the dataflow analyses //
+
+// Collects pointers to the operands an instruction reads as values. Array and
+// function names, immediates and labels are not value uses.
+int tacUses(TAC *tac, Operand **uses)
+{
+    int count = 0;
+
+    switch (tac->op)
+    {
+    case TAC_ASSIGN:
+    case TAC_WRITE:
+    case TAC_IF_FALSE:
+    case TAC_ARG:
+    case TAC_RETURN:
+    case TAC_BOUNDS_CHECK:
+        uses[count++] = &tac->arg1;
+        break;
+    case TAC_ADD:
+    case TAC_SUB:
+    case TAC_MUL:
+    case TAC_DIV:
+    case TAC_SLL:
+    case TAC_SRA:
+    case TAC_SRL:
+    case TAC_LT:
+    case TAC_LE:
+    case TAC_GT:
+    case TAC_GE:
+    case TAC_EQ:
+    case TAC_NE:
+        uses[count++] = &tac->arg1;
+        uses[count++] = &tac->arg2;
+        break;
+    case TAC_ARRAY_LOAD:
+    case TAC_POINTER_LOAD:
+        uses[count++] = &tac->arg2;
+        break;
+    case TAC_ARRAY_STORE:
+    case TAC_POINTER_STORE:
+        uses[count++] = &tac->arg1;
+        uses[count++] = &tac->arg2;
+        break;
+    default:
+        break;
+    }
+
+    // Constants in use positions are not values either
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (uses[i]->kind == OPERAND_SYMBOL || uses[i]->kind == OPERAND_TEMP)
+            uses[kept++] = uses[i];
+    }
+    return kept;
+}
+
+// Returns the operand an instruction assigns, or NULL if it assigns nothing.
+// A store names its array in result but assigns no value.
+Operand *tacDefinition(TAC *tac)
+{
+    if (tac->op == TAC_ARRAY_STORE || tac->op == TAC_POINTER_STORE)
+        return NULL;
+    if (tac->result.kind == OPERAND_SYMBOL || tac->result.kind == OPERAND_TEMP)
+        return &tac->result;
+    return NULL;
+}
+
+// True for side-effect-free operators that compute result from arg1 and arg2.
+bool isArithmeticOp(TACOpcode op)
+{
+    return op >= TAC_ADD && op <= TAC_NE;
+}
+
+bool isCommutativeOp(TACOpcode op)
+{
+    return op == TAC_ADD || op == TAC_MUL || op == TAC_EQ || op == TAC_NE;
+}
+
+// Comparisons are arithmetic whose result is 0 or 1.
+bool isComparisonOp(TACOpcode op)
+{
+    return op >= TAC_LT && op <= TAC_NE;
+}
+
+// Locals carry their function's name and a dot; anything else a symbol
+// names is global: variables, arrays and functions.
+bool isGlobalSymbol(TACList *list, int id)
+{
+    return strchr(internedString(&list->names, id), '.') == NULL;
+}
+
+// A call and a return hand control to code that may read any global.
+bool readsGlobals(TAC *tac)
+{
+    return tac->op == TAC_CALL || tac->op == TAC_RETURN;
+}
+
+// The callee may also assign any global.
+bool writesGlobals(TAC *tac)
+{
+    return tac->op == TAC_CALL;
+}
+
+// Values are the symbols and temporaries of a list, numbered densely:
+// symbol ids first, then temporaries.
+int tacValueCount(TACList *list)
+{
+    return list->names.count + list->tempCount;
+}
+
+int tacValueIndex(TACList *list, Operand operand)
+{
+    if (operand.kind == OPERAND_SYMBOL)
+        return operand.value;
+    if (operand.kind == OPERAND_TEMP)
+        return list->names.count + operand.value;
+    return -1;
+}
+
+void printTAC(TACList *list, TAC *tac)
+{
+    if (!tac)
+        return;
+
+    fprintTAC(stdout, list, tac);
+}
+
+void printTACToFile(const char *filename, TACList *list)
 {
     FILE *file = fopen(filename, "w");
     if (!file)
@@ -179,79 +575,182 @@ void printTACToFile(const char *filename, TAC *tac)
         return;
     }
 
-    TAC *current = tac;
-    while (current != NULL)
-    {
-        // Handle 'write' operation specifically
-        if (current->op && strcmp(current->op, "write") == 0)
-        {
-            fprintf(file, "write %s\n", current->arg1 ? current->arg1 : "(null)");
-        }
-        else
-        {
-            // Handle general case with checks for NULL values
-            fprintf(file, "%s = %s %s %s\n",
-                    current->result ? current->result : "(null)",
-                    current->arg1 ? current->arg1 : "(null)",
-                    current->op ? current->op : "(null)",
-                    current->arg2 ? current->arg2 : "(null)");
-        }
-        current = current->next;
-    }
+    if (!writeTACList(file, list))
+        fprintf(stderr, "%s: Failed to write TAC\n", filename);
     fclose(file);
-    printf("TAC written to %s\n", filename);
+    TRACE(TRACE_TAC, TRACE_INFO, "TAC written to %s\n", filename);
 }
 
-// Temporary variable allocation and deallocation functions //
+// Instruction buffer management //
 
-void initializeTempVars()
+void initTACList(TACList *list)
 {
-    for (int i = 0; i < 20; i++)
-    {
-        tempVars[i] = 0;
-    }
+    list->code = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    list->head = TAC_END;
+    list->tail = TAC_END;
+    initStringPool(&list->names);
+    list->tempCount = 0;
+    list->labelCount = 0;
+    list->function = NULL;
 }
 
-int allocateNextAvailableTempVar(int tempVars[])
+void freeTACList(TACList *list)
 {
-    // implement the temp var allocation logic
-    // use the tempVars array to keep track of allocated temp vars
+    trackedFree(list->code);
+    freeStringPool(&list->names);
+    list->code = NULL;
+    list->count = list->capacity = 0;
+    list->head = list->tail = TAC_END;
+    list->tempCount = 0;
+    list->labelCount = 0;
+}
 
-    // search for the next available temp var
-    for (int i = 0; i < 20; i++)
+// Copies the instruction into the next free slot, unlinked, and returns its
+// index. May move the buffer.
+static int newSlot(TACList *list, const TAC *instruction)
+{
+    if (list->count == list->capacity)
     {
-        if (tempVars[i] == 0)
+        int newCapacity = list->capacity ? list->capacity * 2 : 256;
+        TAC *code = (TAC *)trackedRealloc(list->code, sizeof(TAC) * newCapacity);
+        if (!code)
         {
-            tempVars[i] = 1;
-            return i;
+            fprintf(stderr, "appendTAC: Memory allocation failed for TAC buffer\n");
+            exit(EXIT_FAILURE);
         }
+        list->code = code;
+        list->capacity = newCapacity;
     }
-    return -1; // No available temp var
+
+    int index = list->count++;
+    list->code[index] = *instruction;
+    list->code[index].next = TAC_END;
+    return index;
 }
 
-void deallocateTempVar(int tempVars[], int index)
+// Copies the instruction into the next free slot and links it at the tail.
+// Returns the index of the new instruction.
+int appendTAC(TACList *list, const TAC *instruction)
 {
-    // implement the temp var deallocation logic
-    // use the tempVars array to keep track of allocated temp vars
-    if (index >= 0 && index < 20)
+    int index = newSlot(list, instruction);
+    if (list->tail == TAC_END)
+        list->head = index;
+    else
+        list->code[list->tail].next = index;
+    list->tail = index;
+
+    return index;
+}
+
+// Links a copy of the instruction in after the live instruction at after, or
+// at the head when after is TAC_END. Returns the index of the new instruction.
+int insertTAC(TACList *list, int after, const TAC *instruction)
+{
+    int index = newSlot(list, instruction);
+    if (after == TAC_END)
+    {
+        list->code[index].next = list->head;
+        list->head = index;
+    }
+    else
     {
-        tempVars[index] = 0;
+        list->code[index].next = list->code[after].next;
+        list->code[after].next = index;
     }
+    if (list->tail == after)
+        list->tail = index;
+    return index;
+}
+
+// Unlinks the instruction at index. prev is the live instruction before it,
+// or TAC_END when index is the head. The slot itself is left in place.
+void removeTAC(TACList *list, int prev, int index)
+{
+    int next = list->code[index].next;
+
+    if (prev == TAC_END)
+        list->head = next;
+    else
+        list->code[prev].next = next;
+
+    if (list->tail == index)
+        list->tail = prev;
 }
 
-void appendTAC(TAC **head, TAC *newInstruction)
+// Number of instructions still linked into the list.
+int tacLength(TACList *list)
 {
-    if (!*head)
+    int length = 0;
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+        length++;
+    return length;
+}
+
+
+// Functions //
+
+// Cuts the list into the program body and one range per TAC_FUNCTION and
+// returns how many ranges there are; the body is always the first, even if
+// it is empty. The ranges stay linked until one is begun.
+int splitTACFunctions(TACList *list, TACFunction **functions)
+{
+    int count = 1;
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
     {
-        *head = newInstruction;
+        if (list->code[i].op == TAC_FUNCTION)
+            count++;
     }
-    else
+    *functions = (TACFunction *)trackedMalloc(sizeof(TACFunction) * count);
+    if (!*functions)
     {
-        TAC *current = *head;
-        while (current->next)
-        {
-            current = current->next;
-        }
-        current->next = newInstruction;
+        fprintf(stderr, "splitTACFunctions: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    TACFunction *current = *functions;
+    *current = (TACFunction){-1, TAC_END, TAC_END};
+    for (int i = list->head; i != TAC_END; i = list->code[i].next)
+    {
+        if (list->code[i].op == TAC_FUNCTION)
+            *++current = (TACFunction){list->code[i].arg1.value, i, i};
+        if (current->head == TAC_END)
+            current->head = i;
+        current->tail = i;
     }
-}
\ No newline at end of file
+    return count;
+}
+
+void beginTACFunction(TACList *list, TACFunction *function)
+{
+    list->head = function->head;
+    list->tail = function->tail;
+    if (list->tail != TAC_END)
+        list->code[list->tail].next = TAC_END;
+}
+
+void endTACFunction(TACList *list, TACFunction *function)
+{
+    function->head = list->head;
+    function->tail = list->tail;
+}
+
+// Links the ranges back into one list, in order, leaving out any whose head
+// is TAC_END.
+void joinTACFunctions(TACList *list, TACFunction *functions, int count)
+{
+    list->head = list->tail = TAC_END;
+    for (int f = 0; f < count; f++)
+    {
+        if (functions[f].head == TAC_END)
+            continue;
+        if (list->tail == TAC_END)
+            list->head = functions[f].head;
+        else
+            list->code[list->tail].next = functions[f].head;
+        list->tail = functions[f].tail;
+    }
+    if (list->tail != TAC_END)
+        list->code[list->tail].next = TAC_END;
+}
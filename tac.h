@@ -1,29 +1,139 @@
 #ifndef TAC_H
 #define TAC_H
 
+#include <stdbool.h>
 #include "AST.h"
 #include "symbolTable.h"
+#include "intern.h"
+#include "emitter.h"
+
+#define TAC_END -1 // Link value marking the end of the instruction list
+
+typedef enum
+{
+    TAC_ASSIGN,       // result = arg1
+    TAC_LI,           // result = immediate arg1
+    TAC_ADD,          // result = arg1 + arg2
+    TAC_SUB,          // result = arg1 - arg2
+    TAC_MUL,          // result = arg1 * arg2
+    TAC_DIV,          // result = arg1 / arg2, truncating
+    TAC_SLL,          // result = arg1 << arg2
+    TAC_SRA,          // result = arg1 >> arg2, arithmetic
+    TAC_SRL,          // result = arg1 >> arg2, logical
+    TAC_LT,           // result = 1 if arg1 < arg2, else 0
+    TAC_LE,           // result = 1 if arg1 <= arg2, else 0
+    TAC_GT,           // result = 1 if arg1 > arg2, else 0
+    TAC_GE,           // result = 1 if arg1 >= arg2, else 0
+    TAC_EQ,           // result = 1 if arg1 == arg2, else 0
+    TAC_NE,           // result = 1 if arg1 != arg2, else 0
+    TAC_WRITE,        // write arg1
+    TAC_CALL,         // result = call arg1 with arg2 arguments
+    TAC_ARRAY_LOAD,   // result = arg1[arg2]
+    TAC_ARRAY_STORE,  // result[arg2] = arg1; defines no value
+    TAC_BOUNDS_CHECK, // trap unless 0 <= arg1 < arg2, arg2 constant
+    TAC_ADDRESS,      // result = address of array arg1
+    TAC_POINTER_LOAD, // result = word at address arg2, inside array arg1
+    TAC_POINTER_STORE, // word at address arg2, inside array result, = arg1
+    TAC_LABEL,        // arg1:
+    TAC_GOTO,         // goto arg1
+    TAC_IF_FALSE,     // if arg1 == 0 goto arg2
+    TAC_FUNCTION,     // arg1: starts the code of function arg1
+    TAC_PARAM,        // result = parameter number arg1
+    TAC_ARG,          // argument number arg2 of the next call is arg1
+    TAC_RETURN,       // return arg1
+    TAC_OPCODE_COUNT
+} TACOpcode;
+
+typedef enum
+{
+    OPERAND_NONE,
+    OPERAND_CONST,  // value is the immediate
+    OPERAND_SYMBOL, // value is an id in TACList.names
+    OPERAND_TEMP,   // value is the temporary number
+    OPERAND_LABEL   // value is the label number
+} OperandKind;
+
+typedef struct Operand
+{
+    OperandKind kind;
+    int value;
+} Operand;
 
 typedef struct TAC
 {
-    char *op;
-    char *arg1;
-    char *arg2;
-    char *result;
-    struct TAC *next;
+    TACOpcode op;
+    Operand arg1;
+    Operand arg2;
+    Operand result;
+    int next; // Index of the next live instruction in TACList.code
 } TAC;
 
-extern TAC *tacHead;
-
-void printTACToFile(const char *filename, TAC *tac);
-void deallocateTempVar(int tempVars[], int index);
-int allocateNextAvailableTempVar(int tempVars[]);
-int allocateNextAvailableTempVar(int tempVars[]);
-void appendTAC(TAC **head, TAC *newInstruction);
-TAC *generateTACForExpr(struct ASTNode *expr);
-char *createOperand(struct ASTNode *node);
-void initializeTempVars();
-void printTAC(TAC *tac);
-char *createTempVar();
+// Contiguous, growable instruction buffer. Instructions are linked by index
+// so passes can unlink them without moving anything; indices stay stable for
+// the lifetime of the list. Symbol operands refer to names interned in the
+// list's string pool, so freeTACList releases the whole IR at once.
+//
+// The program body comes first; each function follows it, starting at its
+// TAC_FUNCTION. The locals of a function are named "function.local" so
+// they cannot clash with globals or with each other.
+typedef struct TACList
+{
+    TAC *code;
+    int count;    // Number of slots used in code
+    int capacity; // Number of slots allocated in code
+    int head;     // Index of the first live instruction
+    int tail;     // Index of the last live instruction
+    StringPool names;
+    int tempCount;  // Temporaries are numbered 0..tempCount-1
+    int labelCount; // Labels are numbered 0..labelCount-1
+    const struct ASTNode *function; // Declaration being lowered, NULL in the program body
+} TACList;
+
+// The instructions of one function, or of the program body, as a range of
+// the list. beginTACFunction detaches the range so the passes see it as the
+// whole list; endTACFunction records where it ended up.
+typedef struct TACFunction
+{
+    int name; // Symbol id, -1 for the program body
+    int head;
+    int tail;
+} TACFunction;
+
+extern const char *tacOpcodeNames[TAC_OPCODE_COUNT];
+
+void initTACList(TACList *list);
+void freeTACList(TACList *list);
+int appendTAC(TACList *list, const TAC *instruction);
+int insertTAC(TACList *list, int after, const TAC *instruction);
+void removeTAC(TACList *list, int prev, int index);
+int tacLength(TACList *list);
+void printTACToFile(const char *filename, TACList *list);
+int generateTACForExpr(TACList *list, struct ASTNode *expr);
+Operand createOperand(TACList *list, struct ASTNode *node);
+Operand constOperand(int value);
+Operand symbolOperand(TACList *list, const char *name);
+Operand localOperand(TACList *list, const char *function, const char *name);
+bool sameOperand(Operand a, Operand b);
+const char *formatOperand(TACList *list, Operand operand, char *buffer, size_t size);
+int tacUses(TAC *tac, Operand **uses);
+Operand *tacDefinition(TAC *tac);
+bool isArithmeticOp(TACOpcode op);
+bool isCommutativeOp(TACOpcode op);
+bool isComparisonOp(TACOpcode op);
+int tacValueCount(TACList *list);
+int tacValueIndex(TACList *list, Operand operand);
+void printTAC(TACList *list, TAC *tac);
+void fprintTAC(FILE *file, TACList *list, TAC *tac);
+void emitTAC(Emitter *out, TACList *list, TAC *tac);
+bool writeTACList(FILE *file, TACList *list);
+Operand createTempVar(TACList *list);
+Operand createLabel(TACList *list);
+bool isGlobalSymbol(TACList *list, int id);
+bool readsGlobals(TAC *tac);
+bool writesGlobals(TAC *tac);
+int splitTACFunctions(TACList *list, TACFunction **functions);
+void beginTACFunction(TACList *list, TACFunction *function);
+void endTACFunction(TACList *list, TACFunction *function);
+void joinTACFunctions(TACList *list, TACFunction *functions, int count);
 
 #endif // TAC_H
\ No newline at end of file
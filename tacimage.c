@@ -0,0 +1,427 @@
+#include "tacimage.h"
+#include "cfg.h"
+#include "memtrack.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TAC_IMAGE_ALIGNMENT 8
+#define TAC_IMAGE_MAIN "main"
+
+// Images store opcodes and operand kinds by number and records by layout.
+// When one of these fails, bump TAC_IMAGE_VERSION and then update the
+// figure here. They cannot see an operand change meaning, as TAC_CALL's
+// arg2 did when it became the argument count; bump the version for that by
+// hand.
+#define IMAGE_NUMBER(name, number) _Static_assert(name == number, #name " renumbered: bump TAC_IMAGE_VERSION")
+IMAGE_NUMBER(TAC_ASSIGN, 0);
+IMAGE_NUMBER(TAC_LI, 1);
+IMAGE_NUMBER(TAC_ADD, 2);
+IMAGE_NUMBER(TAC_SUB, 3);
+IMAGE_NUMBER(TAC_MUL, 4);
+IMAGE_NUMBER(TAC_DIV, 5);
+IMAGE_NUMBER(TAC_SLL, 6);
+IMAGE_NUMBER(TAC_SRA, 7);
+IMAGE_NUMBER(TAC_SRL, 8);
+IMAGE_NUMBER(TAC_LT, 9);
+IMAGE_NUMBER(TAC_LE, 10);
+IMAGE_NUMBER(TAC_GT, 11);
+IMAGE_NUMBER(TAC_GE, 12);
+IMAGE_NUMBER(TAC_EQ, 13);
+IMAGE_NUMBER(TAC_NE, 14);
+IMAGE_NUMBER(TAC_WRITE, 15);
+IMAGE_NUMBER(TAC_CALL, 16);
+IMAGE_NUMBER(TAC_ARRAY_LOAD, 17);
+IMAGE_NUMBER(TAC_ARRAY_STORE, 18);
+IMAGE_NUMBER(TAC_BOUNDS_CHECK, 19);
+IMAGE_NUMBER(TAC_ADDRESS, 20);
+IMAGE_NUMBER(TAC_POINTER_LOAD, 21);
+IMAGE_NUMBER(TAC_POINTER_STORE, 22);
+IMAGE_NUMBER(TAC_LABEL, 23);
+IMAGE_NUMBER(TAC_GOTO, 24);
+IMAGE_NUMBER(TAC_IF_FALSE, 25);
+IMAGE_NUMBER(TAC_FUNCTION, 26);
+IMAGE_NUMBER(TAC_PARAM, 27);
+IMAGE_NUMBER(TAC_ARG, 28);
+IMAGE_NUMBER(TAC_RETURN, 29);
+_Static_assert(TAC_OPCODE_COUNT == 30, "TAC opcodes changed: bump TAC_IMAGE_VERSION");
+IMAGE_NUMBER(OPERAND_NONE, 0);
+IMAGE_NUMBER(OPERAND_CONST, 1);
+IMAGE_NUMBER(OPERAND_SYMBOL, 2);
+IMAGE_NUMBER(OPERAND_TEMP, 3);
+IMAGE_NUMBER(OPERAND_LABEL, 4);
+_Static_assert(sizeof(TACImageHeader) == 104, "TAC image header changed: bump TAC_IMAGE_VERSION");
+_Static_assert(sizeof(TACRecord) == 16, "TAC instruction record changed: bump TAC_IMAGE_VERSION");
+_Static_assert(sizeof(TACSymbolRecord) == 16, "TAC symbol record changed: bump TAC_IMAGE_VERSION");
+_Static_assert(sizeof(TACFunctionRecord) == 24, "TAC function record changed: bump TAC_IMAGE_VERSION");
+
+static void *allocateOrDie(size_t size)
+{
+    void *memory = trackedMalloc(size);
+    if (!memory)
+    {
+        fprintf(stderr, "writeTACImage: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+static uint64_t alignSection(uint64_t offset)
+{
+    return (offset + TAC_IMAGE_ALIGNMENT - 1) / TAC_IMAGE_ALIGNMENT * TAC_IMAGE_ALIGNMENT;
+}
+
+// Pads the output with zeros from offset up to the next section boundary and
+// returns the boundary.
+static uint64_t padSection(Emitter *out, uint64_t offset)
+{
+    static const char zeros[TAC_IMAGE_ALIGNMENT];
+    uint64_t aligned = alignSection(offset);
+    emitBytes(out, zeros, (size_t)(aligned - offset));
+    return aligned;
+}
+
+// Writes list and the global symbols of symTab to filename as one image.
+// Strings keep the ids they have in list->names, so symbol operands are
+// stored as is; names only the symbol table knows are appended after them.
+bool writeTACImage(const char *filename, TACList *list, SymbolTable *symTab)
+{
+    StringPool strings;
+    initStringPool(&strings);
+    for (int id = 0; id < list->names.count; id++)
+        internString(&strings, internedString(&list->names, id));
+    int nameCount = strings.count;
+
+    int symbolCount = symTab->count;
+    TACSymbolRecord *symbols = (TACSymbolRecord *)allocateOrDie(sizeof(TACSymbolRecord) * (symbolCount + 1));
+    for (int i = 0; i < symbolCount; i++)
+    {
+        const Symbol *symbol = &symTab->symbols[i];
+        symbols[i].name = (uint32_t)internString(&strings, symbol->name);
+        symbols[i].type = (uint32_t)internString(&strings, symbol->type);
+        symbols[i].flags = (symbol->isArray ? TAC_SYMBOL_ARRAY : 0) | (symbol->isFunction ? TAC_SYMBOL_FUNCTION : 0);
+        symbols[i].arraySize = symbol->arraySize;
+    }
+
+    // Record order is list order, so a block is named by the position of its
+    // first instruction. The program body is the first function, followed by
+    // one per TAC_FUNCTION, each with the blocks of its own CFG.
+    int instructionCount = tacLength(list);
+    TACRecord *records = (TACRecord *)allocateOrDie(sizeof(TACRecord) * (instructionCount + 1));
+    uint32_t *blocks = (uint32_t *)allocateOrDie(sizeof(uint32_t) * (instructionCount + 1));
+    TACFunction *ranges;
+    int functionCount = splitTACFunctions(list, &ranges);
+    TACFunctionRecord *functions = (TACFunctionRecord *)allocateOrDie(sizeof(TACFunctionRecord) * functionCount);
+    int blockCount = 0;
+    int position = 0;
+    for (int f = 0; f < functionCount; f++)
+    {
+        const char *name = f == 0 ? TAC_IMAGE_MAIN : internedString(&list->names, ranges[f].name);
+        functions[f] = (TACFunctionRecord){(uint32_t)internString(&strings, name), (uint32_t)position, 0,
+                                           (uint32_t)blockCount, 0, 0};
+        beginTACFunction(list, &ranges[f]);
+        CFG cfg;
+        bool haveCFG = list->head != TAC_END;
+        if (haveCFG)
+            buildCFG(&cfg, list);
+        for (int i = list->head; i != TAC_END; i = list->code[i].next, position++)
+        {
+            const TAC *tac = &list->code[i];
+            records[position] = (TACRecord){(uint8_t)tac->op, (uint8_t)tac->arg1.kind, (uint8_t)tac->arg2.kind,
+                                            (uint8_t)tac->result.kind, tac->arg1.value, tac->arg2.value,
+                                            tac->result.value};
+            if (cfg.blocks[cfg.blockOf[i]].first == i)
+                blocks[blockCount++] = (uint32_t)position;
+        }
+        if (haveCFG)
+            freeCFG(&cfg);
+        endTACFunction(list, &ranges[f]);
+        functions[f].instructionCount = (uint32_t)position - functions[f].firstInstruction;
+        functions[f].blockCount = (uint32_t)blockCount - functions[f].firstBlock;
+    }
+    joinTACFunctions(list, ranges, functionCount);
+    trackedFree(ranges);
+
+    uint64_t stringBytes = 0;
+    for (int id = 0; id < strings.count; id++)
+        stringBytes += strlen(internedString(&strings, id)) + 1;
+
+    TACImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TAC_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = TAC_IMAGE_VERSION;
+    header.byteOrder = TAC_IMAGE_BYTE_ORDER;
+    header.instructionCount = (uint32_t)instructionCount;
+    header.stringCount = (uint32_t)strings.count;
+    header.nameCount = (uint32_t)nameCount;
+    header.symbolCount = (uint32_t)symbolCount;
+    header.functionCount = (uint32_t)functionCount;
+    header.blockCount = (uint32_t)blockCount;
+    header.tempCount = (uint32_t)list->tempCount;
+    header.labelCount = (uint32_t)list->labelCount;
+    header.instructionOffset = alignSection(sizeof(header));
+    header.stringOffset = alignSection(header.instructionOffset + sizeof(TACRecord) * (uint64_t)instructionCount);
+    header.stringDataOffset = alignSection(header.stringOffset + sizeof(uint32_t) * ((uint64_t)strings.count + 1));
+    header.symbolOffset = alignSection(header.stringDataOffset + stringBytes);
+    header.functionOffset = alignSection(header.symbolOffset + sizeof(TACSymbolRecord) * (uint64_t)symbolCount);
+    header.blockOffset = alignSection(header.functionOffset + sizeof(TACFunctionRecord) * (uint64_t)functionCount);
+    header.fileSize = header.blockOffset + sizeof(uint32_t) * (uint64_t)blockCount;
+
+    bool written = false;
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        perror(filename);
+    }
+    else
+    {
+        Emitter out;
+        initEmitter(&out, file, NULL, 0);
+        emitBytes(&out, (const char *)&header, sizeof(header));
+        uint64_t offset = padSection(&out, sizeof(header));
+        emitBytes(&out, (const char *)records, sizeof(TACRecord) * instructionCount);
+        offset = padSection(&out, offset + sizeof(TACRecord) * instructionCount);
+
+        uint32_t stringOffset = 0;
+        for (int id = 0; id <= strings.count; id++)
+        {
+            emitBytes(&out, (const char *)&stringOffset, sizeof(stringOffset));
+            if (id < strings.count)
+                stringOffset += (uint32_t)strlen(internedString(&strings, id)) + 1;
+        }
+        offset = padSection(&out, offset + sizeof(uint32_t) * ((uint64_t)strings.count + 1));
+        for (int id = 0; id < strings.count; id++)
+        {
+            const char *str = internedString(&strings, id);
+            emitBytes(&out, str, strlen(str) + 1);
+        }
+        offset = padSection(&out, offset + stringBytes);
+
+        emitBytes(&out, (const char *)symbols, sizeof(TACSymbolRecord) * symbolCount);
+        offset = padSection(&out, offset + sizeof(TACSymbolRecord) * symbolCount);
+        emitBytes(&out, (const char *)functions, sizeof(TACFunctionRecord) * functionCount);
+        padSection(&out, offset + sizeof(TACFunctionRecord) * functionCount);
+        emitBytes(&out, (const char *)blocks, sizeof(uint32_t) * blockCount);
+
+        written = closeEmitter(&out);
+        if (fclose(file) != 0)
+            written = false;
+        if (!written)
+            fprintf(stderr, "%s: Failed to write TAC image\n", filename);
+        else
+            TRACE(TRACE_TAC, TRACE_INFO, "TAC image written to %s\n", filename);
+    }
+
+    trackedFree(functions);
+    trackedFree(blocks);
+    trackedFree(records);
+    trackedFree(symbols);
+    freeStringPool(&strings);
+    return written;
+}
+
+// True if count elements of size bytes starting at offset lie inside the
+// file, on a section boundary.
+static bool sectionFits(const TACImageHeader *header, uint64_t offset, uint64_t count, size_t size)
+{
+    if (offset % TAC_IMAGE_ALIGNMENT != 0 || offset < sizeof(TACImageHeader) || offset > header->fileSize)
+        return false;
+    return count <= (header->fileSize - offset) / size;
+}
+
+// Checks everything a reader indexes without further tests: the section
+// bounds, the string table and the function and block ranges. Operands are
+// checked as loadTACImage copies them.
+static bool validImage(const TACImage *image)
+{
+    const TACImageHeader *header = image->header;
+    if (!sectionFits(header, header->instructionOffset, header->instructionCount, sizeof(TACRecord)) ||
+        !sectionFits(header, header->stringOffset, (uint64_t)header->stringCount + 1, sizeof(uint32_t)) ||
+        !sectionFits(header, header->stringDataOffset, 0, 1) ||
+        !sectionFits(header, header->symbolOffset, header->symbolCount, sizeof(TACSymbolRecord)) ||
+        !sectionFits(header, header->functionOffset, header->functionCount, sizeof(TACFunctionRecord)) ||
+        !sectionFits(header, header->blockOffset, header->blockCount, sizeof(uint32_t)) ||
+        header->nameCount > header->stringCount)
+        return false;
+
+    uint64_t stringBytes = header->fileSize - header->stringDataOffset;
+    const uint32_t *offsets = image->stringOffsets;
+    if (offsets[0] != 0)
+        return false;
+    for (uint32_t id = 0; id < header->stringCount; id++)
+    {
+        if (offsets[id + 1] <= offsets[id] || offsets[id + 1] > stringBytes ||
+            image->stringData[offsets[id + 1] - 1] != '\0')
+            return false;
+    }
+
+    for (uint32_t i = 0; i < header->symbolCount; i++)
+    {
+        if (image->symbols[i].name >= header->stringCount || image->symbols[i].type >= header->stringCount)
+            return false;
+    }
+    for (uint32_t f = 0; f < header->functionCount; f++)
+    {
+        const TACFunctionRecord *function = &image->functions[f];
+        if (function->name >= header->stringCount ||
+            function->firstInstruction > header->instructionCount ||
+            function->instructionCount > header->instructionCount - function->firstInstruction ||
+            function->firstBlock > header->blockCount ||
+            function->blockCount > header->blockCount - function->firstBlock)
+            return false;
+    }
+    for (uint32_t b = 0; b < header->blockCount; b++)
+    {
+        if (image->blocks[b] >= header->instructionCount)
+            return false;
+    }
+    return true;
+}
+
+// Maps filename read-only and points the sections of image into it. Prints
+// the reason and returns false if the file is not an image this build reads.
+bool mapTACImage(TACImage *image, const char *filename)
+{
+    memset(image, 0, sizeof(*image));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (size_t)info.st_size < sizeof(TACImageHeader))
+    {
+        fprintf(stderr, "%s: Not a TAC image\n", filename);
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        perror(filename);
+        return false;
+    }
+    image->mapping = mapping;
+    image->mappedSize = (size_t)info.st_size;
+
+    const TACImageHeader *header = (const TACImageHeader *)mapping;
+    const char *base = (const char *)mapping;
+    image->header = header;
+    if (memcmp(header->magic, TAC_IMAGE_MAGIC, sizeof(header->magic)) != 0)
+    {
+        fprintf(stderr, "%s: Not a TAC image\n", filename);
+        unmapTACImage(image);
+        return false;
+    }
+    if (header->version != TAC_IMAGE_VERSION || header->byteOrder != TAC_IMAGE_BYTE_ORDER)
+    {
+        fprintf(stderr, "%s: TAC image version %u is not readable by this build\n", filename, header->version);
+        unmapTACImage(image);
+        return false;
+    }
+    if (header->fileSize != image->mappedSize)
+    {
+        fprintf(stderr, "%s: Truncated TAC image\n", filename);
+        unmapTACImage(image);
+        return false;
+    }
+
+    image->instructions = (const TACRecord *)(base + header->instructionOffset);
+    image->stringOffsets = (const uint32_t *)(base + header->stringOffset);
+    image->stringData = base + header->stringDataOffset;
+    image->symbols = (const TACSymbolRecord *)(base + header->symbolOffset);
+    image->functions = (const TACFunctionRecord *)(base + header->functionOffset);
+    image->blocks = (const uint32_t *)(base + header->blockOffset);
+    if (!validImage(image))
+    {
+        fprintf(stderr, "%s: Corrupt TAC image\n", filename);
+        unmapTACImage(image);
+        return false;
+    }
+    return true;
+}
+
+void unmapTACImage(TACImage *image)
+{
+    if (image->mapping)
+        munmap(image->mapping, image->mappedSize);
+    memset(image, 0, sizeof(*image));
+}
+
+const char *tacImageString(const TACImage *image, uint32_t id)
+{
+    return image->stringData + image->stringOffsets[id];
+}
+
+static bool validOperand(const TACImageHeader *header, uint8_t kind, int32_t value)
+{
+    switch (kind)
+    {
+    case OPERAND_NONE:
+    case OPERAND_CONST:
+        return true;
+    case OPERAND_SYMBOL:
+        return value >= 0 && (uint32_t)value < header->nameCount;
+    case OPERAND_TEMP:
+        return value >= 0 && (uint32_t)value < header->tempCount;
+    case OPERAND_LABEL:
+        return value >= 0 && (uint32_t)value < header->labelCount;
+    default:
+        return false;
+    }
+}
+
+// Rebuilds the TAC of a mapped image into an empty list and its symbols into
+// symTab. The strings are copied, so the image can be unmapped afterwards.
+bool loadTACImage(const TACImage *image, TACList *list, SymbolTable *symTab)
+{
+    const TACImageHeader *header = image->header;
+    for (uint32_t id = 0; id < header->nameCount; id++)
+    {
+        if (internString(&list->names, tacImageString(image, id)) != (int)id)
+            return false; // A repeated name would renumber the operands
+    }
+    list->tempCount = (int)header->tempCount;
+    list->labelCount = (int)header->labelCount;
+
+    for (uint32_t i = 0; i < header->instructionCount; i++)
+    {
+        const TACRecord *record = &image->instructions[i];
+        if (record->op >= TAC_OPCODE_COUNT || !validOperand(header, record->arg1Kind, record->arg1) ||
+            !validOperand(header, record->arg2Kind, record->arg2) ||
+            !validOperand(header, record->resultKind, record->result))
+            return false;
+
+        TAC tac;
+        tac.op = (TACOpcode)record->op;
+        tac.arg1 = (Operand){(OperandKind)record->arg1Kind, record->arg1};
+        tac.arg2 = (Operand){(OperandKind)record->arg2Kind, record->arg2};
+        tac.result = (Operand){(OperandKind)record->resultKind, record->result};
+        appendTAC(list, &tac);
+    }
+
+    for (uint32_t i = 0; i < header->symbolCount; i++)
+    {
+        const TACSymbolRecord *record = &image->symbols[i];
+        addSymbol(symTab, (char *)tacImageString(image, record->name), (char *)tacImageString(image, record->type));
+        Symbol *symbol = &symTab->symbols[symTab->count - 1];
+        symbol->isArray = (record->flags & TAC_SYMBOL_ARRAY) != 0;
+        symbol->isFunction = (record->flags & TAC_SYMBOL_FUNCTION) != 0;
+        symbol->arraySize = record->arraySize;
+    }
+    return true;
+}
+
+bool isTACImageFilename(const char *filename)
+{
+    size_t length = strlen(filename);
+    return length > 4 && strcmp(filename + length - 4, ".tac") == 0;
+}
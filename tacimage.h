@@ -0,0 +1,99 @@
+#ifndef TAC_IMAGE_H
+#define TAC_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "tac.h"
+#include "symbolTable.h"
+
+// Binary TAC files. An image holds the instructions in list order as
+// fixed-size records, a string table, the global symbols, and the
+// functions and basic blocks as offsets into the instructions. Every
+// section starts on an 8-byte boundary at an offset given in the header,
+// so a reader maps the file and uses the records where they lie. Only
+// images written by a build with the same byte order and version load.
+//
+//   header | instructions | string offsets | string bytes | symbols | functions | blocks
+
+#define TAC_IMAGE_MAGIC "CMMTAC\r\n" // The CR LF catches text-mode transfers
+#define TAC_IMAGE_VERSION 4
+#define TAC_IMAGE_BYTE_ORDER 0x01020304u
+
+typedef struct TACImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;        // TAC_IMAGE_BYTE_ORDER as the writer stored it
+    uint32_t instructionCount;
+    uint32_t stringCount;
+    uint32_t nameCount;        // Strings 0..nameCount-1 are the TAC's symbol operands, in id order
+    uint32_t symbolCount;
+    uint32_t functionCount;
+    uint32_t blockCount;
+    uint32_t tempCount;
+    uint32_t labelCount;
+    uint64_t instructionOffset;
+    uint64_t stringOffset;     // stringCount + 1 uint32 offsets into the string bytes
+    uint64_t stringDataOffset; // NUL-terminated strings
+    uint64_t symbolOffset;
+    uint64_t functionOffset;
+    uint64_t blockOffset;
+    uint64_t fileSize;
+} TACImageHeader;
+
+typedef struct TACRecord
+{
+    uint8_t op;
+    uint8_t arg1Kind;
+    uint8_t arg2Kind;
+    uint8_t resultKind;
+    int32_t arg1;
+    int32_t arg2;
+    int32_t result;
+} TACRecord;
+
+#define TAC_SYMBOL_ARRAY 1u
+#define TAC_SYMBOL_FUNCTION 2u
+
+typedef struct TACSymbolRecord
+{
+    uint32_t name; // String id
+    uint32_t type; // String id
+    uint32_t flags;
+    int32_t arraySize;
+} TACSymbolRecord;
+
+typedef struct TACFunctionRecord
+{
+    uint32_t name; // String id
+    uint32_t firstInstruction;
+    uint32_t instructionCount;
+    uint32_t firstBlock;
+    uint32_t blockCount;
+    uint32_t reserved;
+} TACFunctionRecord;
+
+// A mapped image. The section pointers point into the mapping and are valid
+// until unmapTACImage.
+typedef struct TACImage
+{
+    void *mapping;
+    size_t mappedSize;
+    const TACImageHeader *header;
+    const TACRecord *instructions;
+    const uint32_t *stringOffsets;
+    const char *stringData;
+    const TACSymbolRecord *symbols;
+    const TACFunctionRecord *functions;
+    const uint32_t *blocks; // Index of the first instruction of each block
+} TACImage;
+
+bool writeTACImage(const char *filename, TACList *list, SymbolTable *symTab);
+bool mapTACImage(TACImage *image, const char *filename);
+void unmapTACImage(TACImage *image);
+const char *tacImageString(const TACImage *image, uint32_t id);
+bool loadTACImage(const TACImage *image, TACList *list, SymbolTable *symTab);
+bool isTACImageFilename(const char *filename);
+
+#endif // TAC_IMAGE_H
@@ -1,3 +0,0 @@
-#include "tempVars.h"
-
-int tempVars[20] = {0};
\ No newline at end of file
@@ -1,7 +0,0 @@
-// tempVars.h
-#ifndef TEMPVARS_H
-#define TEMPVARS_H
-
-extern int tempVars[20];
-
-#endif // TEMPVARS_H
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "trace.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NO_TRACE
+int traceLevels[TRACE_CATEGORY_COUNT];
+
+static const char *categoryNames[TRACE_CATEGORY_COUNT] = {
+    [TRACE_DRIVER] = "driver",
+    [TRACE_LEXER] = "lexer",
+    [TRACE_PARSER] = "parser",
+    [TRACE_AST] = "ast",
+    [TRACE_SEMANTIC] = "semantic",
+    [TRACE_SYMTAB] = "symtab",
+    [TRACE_TAC] = "tac",
+    [TRACE_OPTIMIZER] = "optimizer",
+    [TRACE_CODEGEN] = "codegen",
+};
+#endif
+
+// Parses a comma separated list of category[=level] entries. "all" selects
+// every category; a category without a level is traced at TRACE_DEBUG.
+void initTrace(const char *spec)
+{
+#ifdef NO_TRACE
+    if (spec && *spec)
+        fprintf(stderr, "Tracing is not available in this build\n");
+#else
+    for (int i = 0; i < TRACE_CATEGORY_COUNT; i++)
+        traceLevels[i] = TRACE_OFF;
+
+    while (spec && *spec)
+    {
+        size_t len = strcspn(spec, ",");
+        size_t nameLen = strcspn(spec, "=,");
+        int level = TRACE_DEBUG;
+        if (nameLen < len)
+            level = atoi(spec + nameLen + 1);
+
+        int matched = 0;
+        for (int i = 0; i < TRACE_CATEGORY_COUNT; i++)
+        {
+            if ((nameLen == 3 && strncmp(spec, "all", 3) == 0) ||
+                (strlen(categoryNames[i]) == nameLen && strncmp(spec, categoryNames[i], nameLen) == 0))
+            {
+                traceLevels[i] = level;
+                matched = 1;
+            }
+        }
+        if (!matched)
+            fprintf(stderr, "Unknown trace category: %.*s\n", (int)nameLen, spec);
+
+        spec += len;
+        if (*spec == ',')
+            spec++;
+    }
+#endif
+}
+
+void traceLog(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stdout, format, args);
+    va_end(args);
+}
@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Per-phase debug tracing. Levels are chosen at runtime through the CMM_TRACE
+// environment variable, e.g. CMM_TRACE="parser=2,symtab=3" or CMM_TRACE=all.
+// Building with -DNO_TRACE removes every trace call, including the argument
+// evaluation, so a production build does no formatting or I/O for tracing.
+
+typedef enum
+{
+    TRACE_DRIVER,    // Phase banners and summaries from main
+    TRACE_LEXER,     // Every token
+    TRACE_PARSER,    // Every reduction and node creation
+    TRACE_AST,       // AST dump after parsing
+    TRACE_SEMANTIC,  // Every node visited by semanticAnalysis
+    TRACE_SYMTAB,    // Symbol table dump and lookups
+    TRACE_TAC,       // TAC generation
+    TRACE_OPTIMIZER, // Optimization passes
+    TRACE_CODEGEN,   // MIPS generation
+    TRACE_CATEGORY_COUNT
+} TraceCategory;
+
+typedef enum
+{
+    TRACE_OFF = 0,
+    TRACE_INFO = 1,   // One line per phase or pass
+    TRACE_DEBUG = 2,  // One line per node, token or instruction
+    TRACE_VERBOSE = 3 // Inner loops such as hash probes
+} TraceLevel;
+
+#ifdef NO_TRACE
+
+#define TRACE_ENABLED(category, level) 0
+#define TRACE(category, level, ...) ((void)0)
+
+#else
+
+extern int traceLevels[TRACE_CATEGORY_COUNT];
+
+#define TRACE_ENABLED(category, level) (traceLevels[category] >= (level))
+#define TRACE(category, level, ...)          \
+    do                                       \
+    {                                        \
+        if (TRACE_ENABLED(category, level))  \
+            traceLog(__VA_ARGS__);           \
+    } while (0)
+
+#endif
+
+void initTrace(const char *spec);
+void traceLog(const char *format, ...);
+
+#endif // TRACE_H